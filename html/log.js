@@ -1,6 +1,29 @@
-const evtSource = new EventSource("/logging");
-evtSource.onmessage = function(event) {
+function append(text) {
     const log = document.getElementById("log");
-    log.textContent += event.data + "\n";
+    log.textContent += text;
     log.scrollTop = log.scrollHeight;
 }
+
+function useEventSource() {
+    const evtSource = new EventSource("/logging");
+    evtSource.onmessage = function(event) {
+        append(event.data + "\n");
+    }
+}
+
+// Prefer the binary WebSocket, batches arrive as raw console bytes
+if ("WebSocket" in window) {
+    const ws = new WebSocket("ws://" + location.host + "/logging.ws");
+    const decoder = new TextDecoder();
+    let opened = false;
+    ws.binaryType = "arraybuffer";
+    ws.onopen = function() { opened = true; }
+    ws.onmessage = function(event) {
+        append(decoder.decode(event.data, {stream: true}));
+    }
+    ws.onclose = function() {
+        if (!opened) useEventSource();
+    }
+} else {
+    useEventSource();
+}
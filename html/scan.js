@@ -6,6 +6,7 @@ function _(el) {
 
 function init() {
     initAat();
+    initStats();
 
     // sends XMLHttpRequest, so do it last
     initOptions();
@@ -31,6 +32,7 @@ function initOptions() {
       if (this.readyState == 4 && this.status == 200) {
         const data = JSON.parse(this.responseText);
         updateConfig(data);
+        if (_('linkstats')) getStats();
         setTimeout(get_networks, 2000);
       }
     };
@@ -57,10 +59,69 @@ function updateConfig(data) {
         _('tx_tab').style.display = 'none';
     }
     if(config['product_name']) _('product_name').textContent = config['product_name'];
+    if (config.espnow && _('espnow')) {
+        _('espnow_channel').value = config.espnow.channel;
+        _('espnow_rate').value = config.espnow.rate;
+        _('espnow_lr').checked = config.espnow.lr;
+    }
 
     updateAatConfig(config);
 }
 
+function initStats() {
+    if (!_('linkstats'))
+        return;
+    _('linkrefresh').addEventListener('click', (e) => { e.preventDefault(); getStats(); });
+    _('memrefresh').addEventListener('click', (e) => { e.preventDefault(); getStats(); });
+}
+
+function getStats() {
+    fetch('/stats')
+        .then(response => response.json())
+        .then(data => {
+            showLinkStats(data);
+            showMemoryStats(data);
+        });
+}
+
+function showLinkStats(data) {
+    const rows = _('linkstats').getElementsByTagName('tbody')[0];
+    rows.innerHTML = '';
+    (data.link || []).forEach(peer => {
+        const sent = peer.sent_ok + peer.sent_failed;
+        const cells = [
+            peer.mac,
+            sent,
+            sent ? (100 * peer.sent_failed / sent).toFixed(1) + '%' : '-',
+            peer.received,
+            peer.rssi ? peer.rssi + ' (' + peer.rssi_avg + ') dBm' : '-',
+            peer.received > 2 ? (peer.jitter_us / 1000).toFixed(1) + ' ms' : '-',
+            (peer.last_seen_ms / 1000).toFixed(1) + ' s ago'
+        ];
+        const row = rows.insertRow();
+        cells.forEach(text => { row.insertCell().textContent = text; });
+    });
+}
+
+function showMemoryStats(data) {
+    const rows = _('memstats').getElementsByTagName('tbody')[0];
+    rows.innerHTML = '';
+    const memory = data.memory;
+    if (!memory)
+        return;
+    const add = (cells) => {
+        const row = rows.insertRow();
+        cells.forEach(text => { row.insertCell().textContent = text; });
+    };
+    const now = memory.history.length ? memory.history[0] : {};
+    add(['Free heap', now.free, memory.min_free, '-']);
+    add(['Largest block', now.largest_block, memory.min_largest_block, '-']);
+    for (const [name, free] of Object.entries(memory.stack_free))
+        add(['Stack ' + name, '-', free + ' free', '-']);
+    for (const [name, queue] of Object.entries(memory.occupancy))
+        add([name, '-', queue.peak + ' (' + (100 * queue.peak / queue.capacity).toFixed(0) + '%)', queue.capacity]);
+}
+
 function updateAatConfig(config)
 {
     if (!config.hasOwnProperty('aat'))
@@ -90,6 +151,9 @@ function get_networks() {
             var data = JSON.parse(this.responseText);
             _('loader').style.display = 'none';
             autocomplete(_('network'), data);
+        } else if (this.readyState == 4 && this.status == 204) {
+            // scan still running, ask again shortly
+            setTimeout(get_networks, 2000);
         }
     };
     xmlhttp.open("POST", json_url, true);
@@ -422,6 +486,10 @@ _('sethome').addEventListener('submit', callback("Set Home Network", "An error o
 _('connect').addEventListener('click', callback("Connect to Home Network", "An error occurred connecting to the Home network", "/connect", null));
 _('access').addEventListener('click', callback("Access Point", "An error occurred starting the Access Point", "/access", null));
 _('forget').addEventListener('click', callback("Forget Home Network", "An error occurred forgetting the home network", "/forget", null));
+if (_('espnow')) _('espnow').addEventListener('submit', callback("ESP-NOW Link", "An error occurred saving the ESP-NOW settings", "/espnow", function() {
+    return new FormData(_('espnow'));
+}));
+
 if (_('setrtc')) _('setrtc').addEventListener('submit', callback("Set RTC Time", "An error occured setting the RTC time", "/setrtc", function() {
     return new FormData(_('setrtc'));
 }));
@@ -0,0 +1,32 @@
+#pragma once
+
+// ESP-NOW link settings shared by the backpacks and the network simulator,
+// so the simulator runs with what the firmware does
+
+#define ESPNOW_MAX_FRAME_SIZE       250
+// Frames received over ESP-NOW waiting for loop(), must be a power of two
+#ifndef ESPNOW_RX_RING_SIZE
+#define ESPNOW_RX_RING_SIZE         2048
+#endif
+
+// Functions whose latest value the TX backpack replays to a VRX backpack when it (re)joins
+#if !defined(MSP_CACHE_FUNCTIONS)
+#define MSP_CACHE_FUNCTIONS MSP_SET_VTX_CONFIG, MSP_ELRS_BACKPACK_SET_HEAD_TRACKING
+#endif
+#define MSP_CACHE_MAX_ENTRIES       8
+#define MSP_CACHE_POOL_SIZE         256
+
+// Functions that are acknowledged by the VRX and resent until they are
+#if !defined(MSP_LINK_RELIABLE_FUNCTIONS)
+#define MSP_LINK_RELIABLE_FUNCTIONS MSP_SET_VTX_CONFIG, MSP_ELRS_BACKPACK_SET_HEAD_TRACKING, \
+  MSP_ELRS_BACKPACK_SET_RECORDING_STATE, MSP_ELRS_SET_VRX_BACKPACK_WIFI_MODE, \
+  MSP_ELRS_BACKPACK_SET_CHANNEL_INDEX, MSP_ELRS_BACKPACK_SET_FREQUENCY
+#endif
+
+// Initial state sync of a VRX backpack with the TX backpack, retried with backoff while sends fail
+#define VRX_SYNC_WINDOW_MS          5000  // stop asking if the TX backpack has not answered by then
+#define VRX_SYNC_RETRY_MIN_MS       20
+#define VRX_SYNC_RETRY_MAX_MS       1000
+#define VRX_SYNC_REPLY_TIMEOUT_MS   250   // delivered but unanswered, e.g. an old TX backpack with nothing cached
+// After a bind, time for any response to be sent back before the VRX backpack reboots
+#define VRX_BIND_REBOOT_MS          200
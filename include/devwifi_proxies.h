@@ -6,7 +6,12 @@
 #include <ArduinoJson.h>
 #include <ESPAsyncWebServer.h>
 
+// The aat and vbat objects WebAatAppendConfig() adds to /config, and their
+// two members of the config object
+#define WEB_AAT_CONFIG_JSON_SIZE (JSON_OBJECT_SIZE(2) + JSON_OBJECT_SIZE(9) + JSON_OBJECT_SIZE(4))
+
 void WebAatAppendConfig(ArduinoJson::JsonDocument &json);
 void WebAatInit(AsyncWebServer &server);
+void WebAatLoop(uint32_t now);
 
 #endif /* defined(AAT_BACKPACK) */
@@ -0,0 +1,123 @@
+#pragma once
+
+#include <Arduino.h>
+#include "options.h"
+
+#if defined(PLATFORM_ESP8266)
+  #include <ESP8266WiFi.h>
+#elif defined(PLATFORM_ESP32)
+  #include <esp_wifi.h>
+#endif
+
+// Settings binding is done with, and what a backpack runs until told otherwise
+#define ESPNOW_DEFAULT_CHANNEL  1
+#define ESPNOW_MAX_CHANNEL      13
+
+// MSP_ELRS_BIND payload: the group address, then the sender's channel, rate and LR mode
+#define ESPNOW_BIND_PHY_OFFSET  6
+#define ESPNOW_BIND_PHY_SIZE    3
+
+// PHY rate ESP-NOW frames are sent at. The 802.11b rates are all the ESP8266
+// SDK can not fix, it picks one of them itself when left at the default
+typedef enum : uint8_t {
+    ESPNOW_RATE_DEFAULT,    // whatever the SDK uses, 1Mbps
+    ESPNOW_RATE_1M,
+    ESPNOW_RATE_2M,
+    ESPNOW_RATE_5M5,
+    ESPNOW_RATE_11M,
+    ESPNOW_RATE_6M,
+    ESPNOW_RATE_9M,
+    ESPNOW_RATE_12M,
+    ESPNOW_RATE_18M,
+    ESPNOW_RATE_24M,
+    ESPNOW_RATE_36M,
+    ESPNOW_RATE_48M,
+    ESPNOW_RATE_54M,
+    ESPNOW_RATE_COUNT
+} espnowRate_e;
+
+/**
+ * @brief: Put the STA interface on channel, and set the rate and protocol ESP-NOW sends with
+ *
+ * Call once WiFi is in STA mode. LR mode only on ESP32: an LR interface can
+ * not talk to a non-LR one, so every backpack in the group has to match.
+ */
+inline void espnowPhyApply(uint8_t channel, uint8_t rate, bool lr)
+{
+#if defined(PLATFORM_ESP8266)
+    static const uint8_t fixedRates[ESPNOW_RATE_COUNT] = {
+        0, 0, 0, 0, 0, PHY_RATE_6, PHY_RATE_9, PHY_RATE_12, PHY_RATE_18, PHY_RATE_24, PHY_RATE_36, PHY_RATE_48, PHY_RATE_54
+    };
+    wifi_set_channel(channel);
+    uint8_t fixed = rate < ESPNOW_RATE_COUNT ? fixedRates[rate] : 0;
+    if (fixed)
+    {
+        wifi_set_user_fixed_rate(FIXED_RATE_MASK_STA, fixed);
+    }
+    else
+    {
+        wifi_set_user_fixed_rate(FIXED_RATE_MASK_NONE, 0);
+    }
+    (void)lr;
+#elif defined(PLATFORM_ESP32)
+    static const wifi_phy_rate_t phyRates[ESPNOW_RATE_COUNT] = {
+        WIFI_PHY_RATE_1M_L, WIFI_PHY_RATE_1M_L, WIFI_PHY_RATE_2M_L, WIFI_PHY_RATE_5M_L, WIFI_PHY_RATE_11M_L,
+        WIFI_PHY_RATE_6M, WIFI_PHY_RATE_9M, WIFI_PHY_RATE_12M, WIFI_PHY_RATE_18M,
+        WIFI_PHY_RATE_24M, WIFI_PHY_RATE_36M, WIFI_PHY_RATE_48M, WIFI_PHY_RATE_54M
+    };
+    if (lr)
+    {
+        esp_wifi_set_protocol(WIFI_IF_STA, WIFI_PROTOCOL_LR);
+    }
+    else
+    {
+        esp_wifi_set_protocol(WIFI_IF_STA, WIFI_PROTOCOL_11B | WIFI_PROTOCOL_11G | WIFI_PROTOCOL_11N);
+        esp_wifi_config_espnow_rate(WIFI_IF_STA, phyRates[rate < ESPNOW_RATE_COUNT ? rate : ESPNOW_RATE_DEFAULT]);
+    }
+    esp_wifi_set_channel(channel, WIFI_SECOND_CHAN_NONE);
+#endif
+}
+
+// What binding is done with, so backpacks with different settings can still find each other
+inline void espnowPhyApplyDefault()
+{
+    espnowPhyApply(ESPNOW_DEFAULT_CHANNEL, ESPNOW_RATE_DEFAULT, false);
+}
+
+inline void espnowPhyApplyOptions()
+{
+    espnowPhyApply(firmwareOptions.espnow_channel, firmwareOptions.espnow_rate, firmwareOptions.espnow_lr);
+}
+
+inline void espnowPhyToBind(uint8_t *phy)
+{
+    phy[0] = firmwareOptions.espnow_channel;
+    phy[1] = firmwareOptions.espnow_rate;
+    phy[2] = firmwareOptions.espnow_lr;
+}
+
+/***
+ * @brief: Take on the settings a bind packet carries, so both ends agree after binding
+ * @return: true if they changed and have to be saved with saveOptions(), older senders do not send them
+ */
+inline bool espnowPhyFromBind(const uint8_t *payload, uint16_t size)
+{
+    if (size < ESPNOW_BIND_PHY_OFFSET + ESPNOW_BIND_PHY_SIZE)
+    {
+        return false;
+    }
+    const uint8_t *phy = &payload[ESPNOW_BIND_PHY_OFFSET];
+    if (phy[0] < 1 || phy[0] > ESPNOW_MAX_CHANNEL || phy[1] >= ESPNOW_RATE_COUNT)
+    {
+        return false;
+    }
+    if (phy[0] == firmwareOptions.espnow_channel && phy[1] == firmwareOptions.espnow_rate &&
+        (bool)phy[2] == firmwareOptions.espnow_lr)
+    {
+        return false;
+    }
+    firmwareOptions.espnow_channel = phy[0];
+    firmwareOptions.espnow_rate = phy[1];
+    firmwareOptions.espnow_lr = phy[2];
+    return true;
+}
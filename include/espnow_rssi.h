@@ -0,0 +1,45 @@
+#pragma once
+
+#include <Arduino.h>
+#include "stats.h"
+
+#if defined(PLATFORM_ESP32)
+  #include <esp_wifi.h>
+#endif
+
+#if defined(PLATFORM_ESP32)
+// ESP-NOW frames are vendor specific action frames from Espressif
+static void ICACHE_RAM_ATTR espnowRssiPromiscuous(void *buf, wifi_promiscuous_pkt_type_t type)
+{
+    if (type != WIFI_PKT_MGMT)
+    {
+        return;
+    }
+    const wifi_promiscuous_pkt_t *pkt = (const wifi_promiscuous_pkt_t *)buf;
+    const uint8_t *frame = pkt->payload;
+    if (pkt->rx_ctrl.sig_len < 28 || frame[0] != 0xD0 || frame[24] != 127 ||
+        frame[25] != 0x18 || frame[26] != 0xFE || frame[27] != 0x34)
+    {
+        return;
+    }
+    // addr2, the sender
+    linkStatsRssi(&frame[10], pkt->rx_ctrl.rssi);
+}
+#endif
+
+/**
+ * @brief: Have the RSSI of every ESP-NOW frame received recorded in the link stats
+ *
+ * The ESP-NOW receive callback does not carry it, so on ESP32 it is taken from
+ * the control info promiscuous mode hands over just before. The ESP8266 can not
+ * receive normally while promiscuous, its peers report an RSSI of 0.
+ */
+inline void espnowRssiBegin()
+{
+#if defined(PLATFORM_ESP32)
+    wifi_promiscuous_filter_t filter = { .filter_mask = WIFI_PROMIS_FILTER_MASK_MGMT };
+    esp_wifi_set_promiscuous_filter(&filter);
+    esp_wifi_set_promiscuous_rx_cb(espnowRssiPromiscuous);
+    esp_wifi_set_promiscuous(true);
+#endif
+}
@@ -1,5 +1,10 @@
 #pragma once
 
+#include "elrs_eeprom.h"
+
+// Longest target_name, magic and NUL included, the upload matcher is sized for it
+#define TARGET_NAME_MAX_SIZE 96
+
 extern const unsigned char target_name[];
 extern const uint8_t target_name_size;
 extern const char PROGMEM compile_options[];
@@ -10,8 +15,13 @@ typedef struct {
     char    home_wifi_ssid[33];
     char    home_wifi_password[65];
     char    product_name[65];
+    uint8_t espnow_channel;     // WiFi channel ESP-NOW runs on, 1-13
+    uint8_t espnow_rate;        // espnowRate_e, the PHY rate frames are sent at
+    bool    espnow_lr;          // ESP32 long range mode, both ends have to be ESP32
 } firmware_options_t;
 
 extern firmware_options_t firmwareOptions;
 
-extern bool options_init();
\ No newline at end of file
+extern bool options_init(ELRS_EEPROM *eeprom);
+// Write firmwareOptions to options.json, they are used from the next boot
+extern void saveOptions();
\ No newline at end of file
@@ -2,7 +2,12 @@
 
 #include <Arduino.h>
 
-const uint16_t frequencyTable[48] = {
+#define CHANNEL_BAND_COUNT  6
+#define CHANNELS_PER_BAND   8
+#define CHANNEL_COUNT       (CHANNEL_BAND_COUNT * CHANNELS_PER_BAND)
+
+// Channel index is band * 8 + channel, both zero based, as sent by ELRS
+constexpr uint16_t frequencyTable[CHANNEL_COUNT] = {
     5865, 5845, 5825, 5805, 5785, 5765, 5745, 5725, // A
     5733, 5752, 5771, 5790, 5809, 5828, 5847, 5866, // B
     5705, 5685, 5665, 5645, 5885, 5905, 5925, 5945, // E
@@ -11,6 +16,36 @@ const uint16_t frequencyTable[48] = {
     5333, 5373, 5413, 5453, 5493, 5533, 5573, 5613  // L
 };
 
-uint16_t GetFrequency(uint8_t index);
-uint8_t GetBand(uint8_t index);
-uint8_t GetChannel(uint8_t index);
\ No newline at end of file
+// ELRS bands A, B, E, F, R, L as numbered by ImmersionRC (Rapidfire) and GHST (Orqa):
+// 0x01 ImmersionRC/FatShark, 0x02 RaceBand, 0x03 Boscam E, 0x04 Boscam B,
+// 0x05 Boscam A, 0x06 LowRace, 0x07 Band X
+constexpr uint8_t imrcBandTable[CHANNEL_BAND_COUNT] = { 0x05, 0x04, 0x03, 0x01, 0x02, 0x06 };
+
+constexpr uint16_t GetFrequency(uint8_t index)
+{
+    return index < CHANNEL_COUNT ? frequencyTable[index] : 0;
+}
+
+// One based ELRS band and channel
+constexpr uint8_t GetBand(uint8_t index)
+{
+    return index / CHANNELS_PER_BAND + 1;
+}
+
+constexpr uint8_t GetChannel(uint8_t index)
+{
+    return (index % CHANNELS_PER_BAND) + 1;
+}
+
+constexpr uint8_t GetImrcBand(uint8_t index)
+{
+    return index < CHANNEL_COUNT ? imrcBandTable[index / CHANNELS_PER_BAND] : 0x01;
+}
+
+// GHST packs the IMRC band in the high nibble and the one based channel in the low
+constexpr uint8_t GetGhstChannel(uint8_t index)
+{
+    return (GetImrcBand(index) << 4) | GetChannel(index);
+}
+
+static_assert(GetGhstChannel(0) == 0x51 && GetGhstChannel(47) == 0x68, "GHST channel mapping");
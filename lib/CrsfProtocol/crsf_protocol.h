@@ -25,7 +25,7 @@ typedef struct crsf_sensor_gps_s {
     int32_t lat;        // degrees * 1e7
     int32_t lon;        // degrees * 1e7
     uint16_t speed;     // big-endian km/h * 10
-    uint16_t heading;   // big-endian degrees * 10
+    uint16_t heading;   // big-endian degrees * 100
     uint16_t altitude;  // big endian meters + 1000
     uint8_t satcnt;     // number of satellites
 } crsf_sensor_gps_t;
@@ -3,19 +3,111 @@
 #include "device.h"
 #include "common.h"
 #include "helpers.h"
+#include "recorder.h"
+#include "profiler.h"
 
-static bool eventFired = false;
+#if defined(PLATFORM_ESP32)
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#elif defined(PLATFORM_ESP8266)
+#include <coredecls.h>
+#endif
+
+#define MAX_DEVICES 16
+
+static volatile uint16_t pendingEvents = 0;
 static device_t **uiDevices;
 static uint8_t deviceCount;
-static unsigned long deviceTimeout[16] = {0};
+static unsigned long deviceTimeout[MAX_DEVICES] = {0};
 
 static connectionState_e lastConnectionState = starting;
 
+// Min-heap of device indexes ordered by deviceTimeout, devices with a
+// DURATION_NEVER timeout are not in the heap
+static uint8_t heap[MAX_DEVICES];
+static uint8_t heapSize = 0;
+
+static volatile bool wakeupPending = false;
+#if defined(PLATFORM_ESP32)
+static TaskHandle_t loopTask = NULL;
+#endif
+
+// Deadlines are compared by difference so they behave across the millis() wrap
+static bool before(unsigned long a, unsigned long b)
+{
+    return (long)(a - b) < 0;
+}
+
+static void heapSwap(uint8_t a, uint8_t b)
+{
+    uint8_t t = heap[a];
+    heap[a] = heap[b];
+    heap[b] = t;
+}
+
+static void heapDown(uint8_t pos)
+{
+    for (;;)
+    {
+        uint8_t smallest = pos;
+        uint8_t left = 2 * pos + 1;
+        uint8_t right = left + 1;
+        if (left < heapSize && before(deviceTimeout[heap[left]], deviceTimeout[heap[smallest]]))
+            smallest = left;
+        if (right < heapSize && before(deviceTimeout[heap[right]], deviceTimeout[heap[smallest]]))
+            smallest = right;
+        if (smallest == pos)
+            return;
+        heapSwap(pos, smallest);
+        pos = smallest;
+    }
+}
+
+static void heapPush(uint8_t device)
+{
+    uint8_t pos = heapSize++;
+    heap[pos] = device;
+    while (pos > 0)
+    {
+        uint8_t parent = (pos - 1) / 2;
+        if (!before(deviceTimeout[heap[pos]], deviceTimeout[heap[parent]]))
+            break;
+        heapSwap(pos, parent);
+        pos = parent;
+    }
+}
+
+static void heapPop()
+{
+    heap[0] = heap[--heapSize];
+    heapDown(0);
+}
+
+static void heapRebuild()
+{
+    heapSize = 0;
+    for (uint8_t i = 0 ; i < deviceCount ; i++)
+    {
+        if (deviceTimeout[i] != 0xFFFFFFFF && uiDevices[i]->timeout)
+        {
+            heapPush(i);
+        }
+    }
+}
+
+static void setTimeout(uint8_t device, unsigned long now, int delay)
+{
+    deviceTimeout[device] = delay == DURATION_NEVER ? 0xFFFFFFFF : now + delay;
+}
+
 void devicesInit(device_t **devices, uint8_t count)
 {
     uiDevices = devices;
-    deviceCount = count;
-    for(size_t i=0 ; i<count ; i++) {
+    deviceCount = min(count, (uint8_t)MAX_DEVICES);
+#if defined(PLATFORM_ESP32)
+    loopTask = xTaskGetCurrentTaskHandle();
+#endif
+    for(size_t i=0 ; i<deviceCount ; i++) {
         if (uiDevices[i]->initialize) {
             (uiDevices[i]->initialize)();
         }
@@ -30,39 +122,105 @@ void devicesStart()
         deviceTimeout[i] = 0xFFFFFFFF;
         if (uiDevices[i]->start)
         {
-            int delay = (uiDevices[i]->start)();
-            deviceTimeout[i] = delay == DURATION_NEVER ? 0xFFFFFFFF : now + delay;
+            setTimeout(i, now, (uiDevices[i]->start)());
         }
     }
+    heapRebuild();
 }
 
-void devicesTriggerEvent()
+void devicesTriggerEvent(uint16_t events)
 {
-    eventFired = true;
+    pendingEvents |= events;
+    devicesWakeup();
 }
 
 void devicesUpdate(unsigned long now)
 {
-    bool handleEvents = eventFired;
-    eventFired = false;
-    for(size_t i=0 ; i<deviceCount ; i++)
+    uint16_t events = pendingEvents;
+    pendingEvents = 0;
+    if (lastConnectionState != connectionState)
     {
-        if ((handleEvents || lastConnectionState != connectionState) && uiDevices[i]->event)
+        events |= EVENT_CONNECTION_STATE;
+        traceEvent(TRACE_CONNECTION_STATE, connectionState, lastConnectionState);
+    }
+    lastConnectionState = connectionState;
+    if (events)
+    {
+        bool rescheduled = false;
+        for(size_t i=0 ; i<deviceCount ; i++)
         {
-            int delay = (uiDevices[i]->event)();
-            if (delay != DURATION_IGNORE)
+            uint16_t subscribed = uiDevices[i]->events ? uiDevices[i]->events : EVENT_ALL;
+            if ((events & subscribed) && uiDevices[i]->event)
             {
-                deviceTimeout[i] = delay == DURATION_NEVER ? 0xFFFFFFFF : now + delay;
+                PROFILE_SCOPE_ARG("device_event", i);
+                int delay = (uiDevices[i]->event)();
+                if (delay != DURATION_IGNORE)
+                {
+                    setTimeout(i, now, delay);
+                    rescheduled = true;
+                }
             }
         }
+        if (rescheduled)
+        {
+            heapRebuild();
+        }
     }
-    lastConnectionState = connectionState;
-    for(size_t i=0 ; i<deviceCount ; i++)
+
+    // Only the devices that are due are visited
+    while (heapSize > 0 && before(deviceTimeout[heap[0]], now))
     {
-        if (now > deviceTimeout[i] && uiDevices[i]->timeout)
+        uint8_t device = heap[0];
+        heapPop();
+        PROFILE_SCOPE_ARG("device_timeout", device);
+        setTimeout(device, now, (uiDevices[device]->timeout)());
+        if (deviceTimeout[device] != 0xFFFFFFFF)
         {
-            int delay = (uiDevices[i]->timeout)();
-            deviceTimeout[i] = delay == DURATION_NEVER ? 0xFFFFFFFF : now + delay;
+            heapPush(device);
         }
     }
 }
+
+unsigned long devicesNextTimeout(unsigned long now)
+{
+    if (pendingEvents || lastConnectionState != connectionState)
+        return 0;
+    if (heapSize == 0)
+        return 0xFFFFFFFF;
+    // A device is due once now has passed its deadline
+    unsigned long deadline = deviceTimeout[heap[0]] + 1;
+    return before(now, deadline) ? deadline - now : 0;
+}
+
+void devicesIdle(unsigned long now, unsigned long maxWait)
+{
+    profilerLoopEnd();
+    unsigned long wait = min(devicesNextTimeout(now), maxWait);
+    if (wait == 0 || wakeupPending)
+    {
+        wakeupPending = false;
+        profilerLoopStart();
+        return;
+    }
+#if defined(PLATFORM_ESP32)
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(wait));
+#elif defined(PLATFORM_ESP8266)
+    // esp_delay() returns early once devicesWakeup() schedules us
+    esp_delay(wait, []() { return !wakeupPending; });
+#else
+    delay(wait);
+#endif
+    wakeupPending = false;
+    profilerLoopStart();
+}
+
+void devicesWakeup()
+{
+    wakeupPending = true;
+#if defined(PLATFORM_ESP32)
+    if (loopTask)
+        xTaskNotifyGive(loopTask);
+#elif defined(PLATFORM_ESP8266)
+    esp_schedule();
+#endif
+}
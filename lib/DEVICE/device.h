@@ -8,6 +8,17 @@
 #define DURATION_NEVER -1       // timeout() will not be called, only event()
 #define DURATION_IMMEDIATELY 0  // timeout() will be called each loop
 
+// Longest devicesIdle() sleep at the end of loop(), bounds how long polled UARTs go unread
+#ifndef LOOP_IDLE_MAX_MS
+#define LOOP_IDLE_MAX_MS 1
+#endif
+
+// Event topics, a device's event() is only called for the topics it subscribes to
+#define EVENT_LED_BLIP          (1 << 0)    // packet activity
+#define EVENT_CONNECTION_STATE  (1 << 1)    // connectionState changed, raised by devicesUpdate()
+#define EVENT_WIFI_REQUEST      (1 << 2)    // WiFi was asked to start
+#define EVENT_ALL               0xFFFF
+
 typedef struct {
     // Called at the beginning of setup() so the device can configure IO pins etc
     void (*initialize)();
@@ -17,9 +28,17 @@ typedef struct {
     int (*event)();
     // The duration has passed so take appropriate action and return a new duration, this function should never return DURATION_IGNORE
     int (*timeout)();
+    // EVENT_* topics event() is called for, 0 subscribes to all of them
+    uint16_t events;
 } device_t;
 
 void devicesInit(device_t **devices, uint8_t count);
 void devicesStart();
 void devicesUpdate(unsigned long now);
-void devicesTriggerEvent();
\ No newline at end of file
+void devicesTriggerEvent(uint16_t events = EVENT_ALL);
+// Number of ms until the next device timeout() is due, 0xFFFFFFFF if none is scheduled
+unsigned long devicesNextTimeout(unsigned long now);
+// Sleep until the next device timeout is due, devicesWakeup() is called or maxWait ms have passed
+void devicesIdle(unsigned long now, unsigned long maxWait);
+// Wake the loop from devicesIdle(), safe to call from radio and UART callbacks
+void devicesWakeup();
@@ -10,14 +10,21 @@
             #warning "!! Using default EEPROM address (0x51) !!"
         #endif
 
+        // A 24C02 does 400kHz from 2.5V, the 100kHz default made config load visible in boot time
+        #if !defined(TARGET_EEPROM_I2C_CLOCK)
+            #define TARGET_EEPROM_I2C_CLOCK extEEPROM::twiClock400kHz
+        #endif
+        // 8 byte pages, one write cycle per page rather than per byte
+        #define TARGET_EEPROM_PAGE_SIZE 8
+
         #include <Wire.h>
         #include <extEEPROM.h>
-        extEEPROM EEPROM(kbits_2, 1, 1, TARGET_EEPROM_ADDR);
+        extEEPROM EEPROM(kbits_2, 1, TARGET_EEPROM_PAGE_SIZE, TARGET_EEPROM_ADDR);
     #else
         #define STM32_USE_FLASH 1
         #include <stm32_eeprom.h>
     #endif
-#else
+#elif defined(PLATFORM_ESP32)
     #include <EEPROM.h>
 #endif
 
@@ -33,9 +40,15 @@ ELRS_EEPROM::Begin()
         Wire.setSCL(GPIO_PIN_SCL);
         Wire.begin();
         /* Initialize EEPROM */
-        EEPROM.begin(extEEPROM::twiClock100kHz, &Wire);
+        EEPROM.begin(TARGET_EEPROM_I2C_CLOCK, &Wire);
     #endif // STM32_USE_FLASH
-#else /* !PLATFORM_STM32 */
+#elif defined(PLATFORM_ESP8266)
+    if (!m_journal.Load(m_image, sizeof(m_image)))
+    {
+        DBGLN("EEPROM journal not found, using legacy contents");
+    }
+    memset(m_dirty, 0, sizeof(m_dirty));
+#else
     EEPROM.begin(RESERVED_EEPROM_SIZE);
 #endif /* PLATFORM_STM32 */
 }
@@ -51,6 +64,8 @@ ELRS_EEPROM::ReadByte(const uint32_t address)
     }
 #if STM32_USE_FLASH
     return eeprom_buffered_read_byte(address);
+#elif defined(PLATFORM_ESP8266)
+    return m_image[address];
 #else
     return EEPROM.read(address);
 #endif
@@ -67,15 +82,124 @@ ELRS_EEPROM::WriteByte(const uint32_t address, const uint8_t value)
     }
 #if STM32_USE_FLASH
     eeprom_buffered_write_byte(address, value);
+#elif defined(PLATFORM_ESP8266)
+    if (m_image[address] != value)
+    {
+        m_image[address] = value;
+        m_dirty[address / 8] |= 1 << (address % 8);
+    }
 #else
     EEPROM.write(address, value);
 #endif
 }
 
+bool
+ELRS_EEPROM::ReadBlock(const uint32_t address, uint8_t *data, const size_t len)
+{
+    if (address + len > RESERVED_EEPROM_SIZE)
+    {
+        // block is out of bounds
+        ERRLN("EEPROM block is out of bounds");
+        return false;
+    }
+#if STM32_USE_FLASH
+    for (size_t i = 0; i < len; i++)
+    {
+        data[i] = eeprom_buffered_read_byte(address + i);
+    }
+#elif defined(PLATFORM_ESP8266)
+    memcpy(data, &m_image[address], len);
+#elif defined(PLATFORM_ESP32)
+    memcpy(data, EEPROM.getDataPtr() + address, len);
+#else
+    // Sequential read, the address is only sent once
+    if (EEPROM.read(address, data, len) != 0)
+    {
+        ERRLN("EEPROM read failed");
+        return false;
+    }
+#endif
+    return true;
+}
+
+bool
+ELRS_EEPROM::WriteBlock(const uint32_t address, const uint8_t *data, const size_t len)
+{
+    if (address + len > RESERVED_EEPROM_SIZE)
+    {
+        // block is out of bounds
+        ERRLN("EEPROM block is out of bounds");
+        return false;
+    }
+#if STM32_USE_FLASH
+    for (size_t i = 0; i < len; i++)
+    {
+        eeprom_buffered_write_byte(address + i, data[i]);
+    }
+#elif defined(PLATFORM_ESP8266)
+    // Only the bytes that change are journalled
+    for (size_t i = 0; i < len; i++)
+    {
+        uint32_t a = address + i;
+        if (m_image[a] != data[i])
+        {
+            m_image[a] = data[i];
+            m_dirty[a / 8] |= 1 << (a % 8);
+        }
+    }
+#elif defined(PLATFORM_ESP32)
+    EEPROM.writeBytes(address, data, len);
+#else
+    // Split into page writes by the library, each one write cycle
+    if (EEPROM.write(address, (uint8_t *)data, len) != 0)
+    {
+        ERRLN("EEPROM write failed");
+        return false;
+    }
+#endif
+    return true;
+}
+
 void
 ELRS_EEPROM::Commit()
 {
-#if defined(PLATFORM_ESP32) || defined(PLATFORM_ESP8266)
+    // Repeated commits, e.g. from a web slider, only reach flash once per window
+    if (m_written && millis() - m_lastWrite < EEPROM_COMMIT_WINDOW_MS)
+    {
+        m_pending = true;
+        return;
+    }
+    write();
+}
+
+void
+ELRS_EEPROM::Update(unsigned long now)
+{
+    if (m_pending && now - m_lastWrite >= EEPROM_COMMIT_WINDOW_MS)
+    {
+        write();
+    }
+}
+
+void
+ELRS_EEPROM::Flush()
+{
+    if (m_pending)
+    {
+        write();
+    }
+}
+
+void
+ELRS_EEPROM::write()
+{
+    m_pending = false;
+    m_written = true;
+    m_lastWrite = millis();
+#if defined(PLATFORM_ESP8266)
+    m_journal.Append(m_image, m_dirty, sizeof(m_image));
+    memset(m_dirty, 0, sizeof(m_dirty));
+#elif defined(PLATFORM_ESP32)
     if (!EEPROM.commit())
     {
       ERRLN("EEPROM commit failed");
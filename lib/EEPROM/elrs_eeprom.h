@@ -5,27 +5,52 @@
 
 #define RESERVED_EEPROM_SIZE 1024
 
+// Commits closer together than this are coalesced into one flash write
+#if !defined(EEPROM_COMMIT_WINDOW_MS)
+#define EEPROM_COMMIT_WINDOW_MS 1000
+#endif
+
+#if defined(PLATFORM_ESP8266)
+#include "flash_journal.h"
+#endif
+
 class ELRS_EEPROM
 {
 public:
     void Begin();
     uint8_t ReadByte(const uint32_t address);
     void WriteByte(const uint32_t address, const uint8_t value);
+    // len bytes at once, false (and nothing copied) if they do not all fit in the EEPROM
+    bool ReadBlock(const uint32_t address, uint8_t *data, const size_t len);
+    bool WriteBlock(const uint32_t address, const uint8_t *data, const size_t len);
     void Commit();
+    // Write a coalesced commit once its window has passed, call from loop()
+    void Update(unsigned long now);
+    // Write any coalesced commit now, e.g. before rebooting
+    void Flush();
 
     // The extEEPROM lib that we use for STM doesn't have the get and put templates
     // These templates need to be reimplemented here
     template <typename T> void Get(uint32_t addr, T &value)
     {
-        uint8_t* p = (uint8_t*)(void*)&value;
-        size_t   i = sizeof(value);
-        while(i--)  *p++ = ReadByte(addr++);
+        ReadBlock(addr, (uint8_t*)(void*)&value, sizeof(value));
     };
 
     template <typename T> const void Put(uint32_t addr, const T &value)
     {
-        const uint8_t* p = (const uint8_t*)(const void*)&value;
-        size_t         i = sizeof(value);
-        while(i--)  WriteByte(addr++, *p++);
+        WriteBlock(addr, (const uint8_t*)(const void*)&value, sizeof(value));
     };
+
+private:
+    bool            m_pending = false;
+    unsigned long   m_lastWrite = 0;
+    bool            m_written = false;
+
+    void write();
+
+#if defined(PLATFORM_ESP8266)
+    FlashJournal    m_journal;
+    uint8_t         m_image[RESERVED_EEPROM_SIZE];
+    uint8_t         m_dirty[RESERVED_EEPROM_SIZE / 8];
+#endif
 };
@@ -0,0 +1,180 @@
+#include "flash_journal.h"
+#include "logging.h"
+
+#if defined(PLATFORM_ESP8266)
+
+#include <spi_flash.h>
+
+extern "C" uint32_t _EEPROM_start;
+
+#define JOURNAL_MAGIC   0x314A4C45  // "ELJ1", cannot collide with a config version word
+#define JOURNAL_HEADER  4
+// Runs separated by fewer unchanged bytes than a record header are merged
+#define JOURNAL_MERGE_GAP 4
+
+// Each record is a header word followed by the data padded to a whole word
+typedef struct {
+    uint16_t offset;
+    uint8_t len;
+    uint8_t crc;
+} journalRecord_t;
+
+static uint8_t
+crc8(uint8_t crc, const uint8_t *data, size_t len)
+{
+    while (len--)
+    {
+        crc ^= *data++;
+        for (uint8_t i = 0; i < 8; i++)
+            crc = (crc & 0x80) ? (crc << 1) ^ 0xD5 : crc << 1;
+    }
+    return crc;
+}
+
+static uint8_t
+recordCrc(uint16_t offset, const uint8_t *data, uint8_t len)
+{
+    uint8_t head[3] = { (uint8_t)offset, (uint8_t)(offset >> 8), len };
+    return crc8(crc8(0, head, sizeof(head)), data, len);
+}
+
+FlashJournal::FlashJournal()
+    : m_base((uint32_t)&_EEPROM_start - 0x40200000), m_end(SPI_FLASH_SEC_SIZE)
+{
+}
+
+bool
+FlashJournal::Load(uint8_t *image, size_t size)
+{
+    uint32_t magic;
+    ESP.flashRead(m_base, &magic, sizeof(magic));
+    if (magic != JOURNAL_MAGIC)
+    {
+        // Either erased or written by the EEPROM class, whose image starts the sector
+        ESP.flashRead(m_base, (uint32_t *)image, size);
+        m_end = SPI_FLASH_SEC_SIZE;
+        return false;
+    }
+
+    memset(image, 0xFF, size);
+    uint32_t pos = JOURNAL_HEADER;
+    uint32_t data[256 / sizeof(uint32_t)];
+    while (pos + sizeof(journalRecord_t) <= SPI_FLASH_SEC_SIZE)
+    {
+        journalRecord_t record;
+        ESP.flashRead(m_base + pos, (uint32_t *)&record, sizeof(record));
+        if (record.offset == 0xFFFF && record.len == 0xFF && record.crc == 0xFF)
+        {
+            // Erased, end of the journal
+            m_end = pos;
+            return true;
+        }
+        uint32_t padded = (record.len + 3) & ~3;
+        if (pos + sizeof(record) + padded > SPI_FLASH_SEC_SIZE || record.offset + record.len > size)
+        {
+            break;
+        }
+        ESP.flashRead(m_base + pos + sizeof(record), data, padded);
+        if (recordCrc(record.offset, (uint8_t *)data, record.len) != record.crc)
+        {
+            break;
+        }
+        memcpy(&image[record.offset], data, record.len);
+        pos += sizeof(record) + padded;
+    }
+
+    // A torn or corrupt record, keep everything before it and start a fresh journal
+    // on the next append so nothing is ever written after the bad record
+    ERRLN("EEPROM journal damaged, discarding the tail");
+    m_end = SPI_FLASH_SEC_SIZE;
+    return true;
+}
+
+bool
+FlashJournal::writeRecord(uint16_t offset, const uint8_t *data, uint8_t len)
+{
+    uint32_t padded = (len + 3) & ~3;
+    if (m_end + sizeof(journalRecord_t) + padded > SPI_FLASH_SEC_SIZE)
+    {
+        return false;
+    }
+    uint32_t buffer[(sizeof(journalRecord_t) + 256) / sizeof(uint32_t)];
+    journalRecord_t *record = (journalRecord_t *)buffer;
+    record->offset = offset;
+    record->len = len;
+    record->crc = recordCrc(offset, data, len);
+    memset((uint8_t *)buffer + sizeof(journalRecord_t), 0xFF, padded);
+    memcpy((uint8_t *)buffer + sizeof(journalRecord_t), data, len);
+    if (!ESP.flashWrite(m_base + m_end, buffer, sizeof(journalRecord_t) + padded))
+    {
+        ERRLN("EEPROM journal write failed");
+    }
+    m_end += sizeof(journalRecord_t) + padded;
+    return true;
+}
+
+void
+FlashJournal::Append(const uint8_t *image, const uint8_t *dirty, size_t size)
+{
+    size_t pos = 0;
+    while (pos < size)
+    {
+        if (!(dirty[pos / 8] & (1 << (pos % 8))))
+        {
+            pos++;
+            continue;
+        }
+        // Extend the run while there are changed bytes near enough to be worth merging
+        size_t end = pos + 1;
+        size_t last = pos;
+        while (end < size && end - pos < 255 && end - last <= JOURNAL_MERGE_GAP)
+        {
+            if (dirty[end / 8] & (1 << (end % 8)))
+                last = end;
+            end++;
+        }
+        if (!writeRecord(pos, &image[pos], last + 1 - pos))
+        {
+            Compact(image, size);
+            return;
+        }
+        pos = last + 1;
+    }
+}
+
+void
+FlashJournal::Compact(const uint8_t *image, size_t size)
+{
+    DBGLN("EEPROM journal compacting");
+    ESP.flashEraseSector(m_base / SPI_FLASH_SEC_SIZE);
+    uint32_t magic = JOURNAL_MAGIC;
+    ESP.flashWrite(m_base, &magic, sizeof(magic));
+    m_end = JOURNAL_HEADER;
+
+    // Loading starts from an all 0xFF image, so only bytes that differ from it are written
+    size_t pos = 0;
+    while (pos < size)
+    {
+        if (image[pos] == 0xFF)
+        {
+            pos++;
+            continue;
+        }
+        size_t end = pos + 1;
+        size_t last = pos;
+        while (end < size && end - pos < 255 && end - last <= JOURNAL_MERGE_GAP)
+        {
+            if (image[end] != 0xFF)
+                last = end;
+            end++;
+        }
+        if (!writeRecord(pos, &image[pos], last + 1 - pos))
+        {
+            ERRLN("EEPROM image does not fit the journal");
+            return;
+        }
+        pos = last + 1;
+    }
+}
+
+#endif
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <Arduino.h>
+
+#if defined(PLATFORM_ESP8266)
+
+/**
+ * @brief: Append-only journal of EEPROM changes kept in the EEPROM flash sector
+ *
+ * The Arduino EEPROM class erases and rewrites the whole sector on every
+ * commit. Instead each commit appends only the byte runs that changed, as
+ * CRC protected records in the erased part of the sector, and the sector is
+ * only erased when it is full and the current image is compacted back into it.
+ */
+class FlashJournal
+{
+public:
+    FlashJournal();
+    // Rebuild image from the journal, returns false if the sector does not hold a journal
+    bool Load(uint8_t *image, size_t size);
+    // Append the runs of image flagged in the dirty bitmap, compacting if they do not fit
+    void Append(const uint8_t *image, const uint8_t *dirty, size_t size);
+    // Erase the sector and write image as the only contents
+    void Compact(const uint8_t *image, size_t size);
+
+private:
+    uint32_t m_base;    // flash address of the sector
+    uint32_t m_end;     // offset of the first free word in the sector
+
+    bool writeRecord(uint16_t offset, const uint8_t *data, uint8_t len);
+};
+
+#endif
@@ -0,0 +1,127 @@
+#pragma once
+
+#include <Arduino.h>
+
+/**
+ * @brief: Fixed size byte FIFO holding variable length records
+ *
+ * Records are stored as a one byte length followed by the record bytes, so the
+ * buffer only holds as much as has actually been pushed. Push and pop are
+ * guarded so that a producer in a radio callback and a consumer in loop() can
+ * share a FIFO.
+ */
+template <uint32_t FIFO_SIZE>
+class FIFO
+{
+private:
+    uint32_t head = 0;
+    uint32_t tail = 0;
+    uint32_t numBytes = 0;
+    uint32_t numRecords = 0;
+    uint8_t buffer[FIFO_SIZE];
+#if defined(PLATFORM_ESP32)
+    portMUX_TYPE mux = portMUX_INITIALIZER_UNLOCKED;
+#endif
+
+    void lock()
+    {
+#if defined(PLATFORM_ESP32)
+        portENTER_CRITICAL(&mux);
+#else
+        noInterrupts();
+#endif
+    }
+
+    void unlock()
+    {
+#if defined(PLATFORM_ESP32)
+        portEXIT_CRITICAL(&mux);
+#else
+        interrupts();
+#endif
+    }
+
+    void write(const uint8_t *data, uint32_t len)
+    {
+        uint32_t first = min(len, FIFO_SIZE - tail);
+        memcpy(&buffer[tail], data, first);
+        memcpy(&buffer[0], data + first, len - first);
+        tail = (tail + len) % FIFO_SIZE;
+    }
+
+    void read(uint32_t from, uint8_t *data, uint32_t len)
+    {
+        uint32_t first = min(len, FIFO_SIZE - from);
+        memcpy(data, &buffer[from], first);
+        memcpy(data + first, &buffer[0], len - first);
+    }
+
+public:
+    // Append a record, returns false (and stores nothing) if it does not fit
+    bool push(const uint8_t *data, uint8_t len)
+    {
+        lock();
+        if (numBytes + len + 1 > FIFO_SIZE)
+        {
+            unlock();
+            return false;
+        }
+        write(&len, 1);
+        write(data, len);
+        numBytes += len + 1;
+        numRecords++;
+        unlock();
+        return true;
+    }
+
+    // Copy the oldest record into data without removing it, returns its length or 0 if empty
+    uint8_t peek(uint8_t *data, uint8_t maxLen)
+    {
+        lock();
+        if (numRecords == 0)
+        {
+            unlock();
+            return 0;
+        }
+        uint8_t len = buffer[head];
+        read((head + 1) % FIFO_SIZE, data, min(len, maxLen));
+        unlock();
+        return len;
+    }
+
+    // Remove the oldest record
+    void drop()
+    {
+        lock();
+        if (numRecords != 0)
+        {
+            uint8_t len = buffer[head];
+            head = (head + len + 1) % FIFO_SIZE;
+            numBytes -= len + 1;
+            numRecords--;
+        }
+        unlock();
+    }
+
+    // Copy out and remove the oldest record, returns its length or 0 if empty
+    uint8_t pop(uint8_t *data, uint8_t maxLen)
+    {
+        uint8_t len = peek(data, maxLen);
+        if (len)
+        {
+            drop();
+        }
+        return len;
+    }
+
+    void flush()
+    {
+        lock();
+        head = tail = numBytes = numRecords = 0;
+        unlock();
+    }
+
+    uint32_t size() { return numRecords; }
+    uint32_t bytes() { return numBytes; }
+    uint32_t free() { return FIFO_SIZE - numBytes; }
+};
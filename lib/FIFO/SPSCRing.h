@@ -0,0 +1,120 @@
+#pragma once
+
+#include <Arduino.h>
+#include <atomic>
+
+/**
+ * @brief: Lock-free byte ring of variable length records, one producer and one consumer
+ *
+ * For handing raw frames from a radio callback to loop() without the critical
+ * sections FIFO takes, so the WiFi task is never held up by the consumer. Only
+ * the producer moves the tail and only the consumer moves the head; aligned
+ * 32 bit loads and stores are atomic on every supported part and the fences
+ * order the record bytes against them. Records are a two byte length, then the
+ * bytes, and may wrap around the end of the buffer.
+ */
+template <uint32_t RING_SIZE>
+class SPSCRing
+{
+    static_assert((RING_SIZE & (RING_SIZE - 1)) == 0, "SPSCRing size must be a power of two");
+
+public:
+    static const uint8_t RECORD_HEADER_SIZE = 2;
+
+    // Producer: append prefix then body as one record, false (and nothing stored) if it does not fit
+    bool push(const uint8_t *prefix, uint16_t prefixLen, const uint8_t *body, uint16_t bodyLen)
+    {
+        uint32_t tail = m_tail;
+        uint32_t head = m_head;
+        std::atomic_thread_fence(std::memory_order_acquire);
+        uint16_t len = prefixLen + bodyLen;
+        if ((uint32_t)RECORD_HEADER_SIZE + len > RING_SIZE - (tail - head))
+        {
+            m_dropped++;
+            return false;
+        }
+        uint8_t header[RECORD_HEADER_SIZE] = { (uint8_t)(len & 0xFF), (uint8_t)(len >> 8) };
+        tail = write(tail, header, RECORD_HEADER_SIZE);
+        tail = write(tail, prefix, prefixLen);
+        tail = write(tail, body, bodyLen);
+        // The bytes have to be in place before the consumer can see them
+        std::atomic_thread_fence(std::memory_order_release);
+        m_tail = tail;
+        return true;
+    }
+
+    bool push(const uint8_t *data, uint16_t len)
+    {
+        return push(data, len, nullptr, 0);
+    }
+
+    /***
+     * @brief: Consumer: take the oldest record
+     * @return: its length, 0 if the ring is empty. A record longer than maxLen is dropped.
+     */
+    uint16_t pop(uint8_t *data, uint16_t maxLen)
+    {
+        while (true)
+        {
+            uint32_t head = m_head;
+            uint32_t tail = m_tail;
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (head == tail)
+            {
+                return 0;
+            }
+            uint8_t header[RECORD_HEADER_SIZE];
+            read(head, header, RECORD_HEADER_SIZE);
+            uint16_t len = header[0] | (header[1] << 8);
+            bool fits = len <= maxLen;
+            if (fits)
+            {
+                read(head + RECORD_HEADER_SIZE, data, len);
+            }
+            // Done with the bytes before the producer may reuse them
+            std::atomic_thread_fence(std::memory_order_release);
+            m_head = head + RECORD_HEADER_SIZE + len;
+            if (fits)
+            {
+                return len;
+            }
+            m_tooLong++;
+        }
+    }
+
+    bool empty() const { return m_head == m_tail; }
+    // Bytes in use, record headers included
+    uint32_t used() const { return m_tail - m_head; }
+    // Records the producer could not fit, and ones the consumer had no room for
+    uint32_t dropped() const { return m_dropped; }
+    uint32_t tooLong() const { return m_tooLong; }
+
+private:
+    uint8_t m_buffer[RING_SIZE];
+    // Free running, the index into the buffer is taken modulo RING_SIZE
+    volatile uint32_t m_head = 0;
+    volatile uint32_t m_tail = 0;
+    uint32_t m_dropped = 0;
+    uint32_t m_tooLong = 0;
+
+    uint32_t write(uint32_t at, const uint8_t *data, uint16_t len)
+    {
+        if (len == 0)
+        {
+            return at;
+        }
+        uint32_t index = at % RING_SIZE;
+        uint32_t first = min((uint32_t)len, RING_SIZE - index);
+        memcpy(&m_buffer[index], data, first);
+        memcpy(&m_buffer[0], data + first, len - first);
+        return at + len;
+    }
+
+    void read(uint32_t at, uint8_t *data, uint16_t len) const
+    {
+        uint32_t index = at % RING_SIZE;
+        uint32_t first = min((uint32_t)len, RING_SIZE - index);
+        memcpy(data, &m_buffer[index], first);
+        memcpy(data + first, &m_buffer[0], len - first);
+    }
+};
@@ -86,12 +86,13 @@ void turnOffLED()
 void blinkLED()
 {
   blipLED = true;
-  devicesTriggerEvent();
+  devicesTriggerEvent(EVENT_LED_BLIP);
 }
 
 device_t LED_device = {
     .initialize = initialize,
     .start = event,
     .event = event,
-    .timeout = timeout
+    .timeout = timeout,
+    .events = EVENT_LED_BLIP | EVENT_CONNECTION_STATE
 };
@@ -1,5 +1,8 @@
 #include "msp.h"
 
+#include <algorithm>
+
+#include "crc.h"
 #include "logging.h"
 
 /* ==========================================
@@ -16,23 +19,76 @@ Offset: Usage:         In CRC:  Comment:
 n+8     checksum                uint8, (n= payload size), crc8_dvb_s2 checksum
 ========================================== */
 
-// CRC helper function. External to MSP class
-// TODO: Move all our CRC functions to a CRC lib
+#define MSP_CRC_POLY 0xD5
+
+// Table driven DVB-S2 CRC, shared by every MSP instance
+static GENERIC_CRC8 mspCrc(MSP_CRC_POLY);
+
 uint8_t crc8_dvb_s2(uint8_t crc, unsigned char a)
 {
-    crc ^= a;
-    for (int ii = 0; ii < 8; ++ii) {
-        if (crc & 0x80) {
-            crc = (crc << 1) ^ 0xD5;
-        } else {
-            crc = crc << 1;
-        }
+    return mspCrc.calc(crc ^ a);
+}
+
+MSP::MSP() : m_inputState(MSP_IDLE), m_packetTime(0), m_streaming(false)
+{
+}
+
+uint8_t
+MSP::crc(uint8_t crc, const uint8_t* data, size_t len)
+{
+    // calc() takes at most 255 bytes at a time
+    while (len > 0) {
+        uint8_t count = std::min(len, (size_t)255);
+        crc = mspCrc.calc(data, count, crc);
+        data += count;
+        len -= count;
     }
     return crc;
 }
 
-MSP::MSP() : m_inputState(MSP_IDLE)
+void
+MSP::processHeader()
 {
+    // Copy header values into packet
+    mspHeaderV2_t* header = (mspHeaderV2_t*)&m_inputBuffer[0];
+    m_packet.payloadSize = header->payloadSize;
+    m_packet.function = header->function;
+    m_packet.flags = header->flags;
+    // reset the offset iterator for re-use in payload below
+    m_offset = 0;
+    m_streaming = false;
+    if (m_packet.payloadSize > MSP_PORT_INBUF_SIZE && m_onChunk && m_packet.payloadSize <= MSP_STREAM_MAX_PAYLOAD)
+    {
+        // payload[] is reused as the buffer for each chunk
+        m_streaming = true;
+        m_inputState = MSP_PAYLOAD_V2_STREAM;
+    }
+    else if (m_packet.payloadSize > MSP_PORT_INBUF_SIZE)
+    {
+        DBGLN("MSP payload too large - Got %u", m_packet.payloadSize);
+        m_inputState = MSP_IDLE;
+    }
+    else if (m_packet.payloadSize == 0)
+        m_inputState = MSP_CHECKSUM_V2_NATIVE;
+    else
+        m_inputState = MSP_PAYLOAD_V2_NATIVE;
+}
+
+/***
+ * @brief: Hand the chunk buffer to the handler once it is full or the payload is complete
+ */
+void
+MSP::streamChunk()
+{
+    uint16_t len = m_offset % MSP_PORT_INBUF_SIZE;
+    if (len != 0 && m_offset != m_packet.payloadSize)
+        return;
+    if (len == 0)
+        len = MSP_PORT_INBUF_SIZE;
+
+    m_onChunk(MSP_CHUNK_DATA, &m_packet, m_offset - len, m_packet.payload, len);
+    if (m_offset == m_packet.payloadSize)
+        m_inputState = MSP_CHECKSUM_V2_NATIVE;
 }
 
 bool
@@ -90,17 +146,7 @@ MSP::processReceivedByte(uint8_t c)
 
             // If we've received the correct amount of bytes for a full header
             if (m_offset == sizeof(mspHeaderV2_t)) {
-                // Copy header values into packet
-                mspHeaderV2_t* header = (mspHeaderV2_t*)&m_inputBuffer[0];
-                m_packet.payloadSize = header->payloadSize;
-                m_packet.function = header->function;
-                m_packet.flags = header->flags;
-                // reset the offset iterator for re-use in payload below
-                m_offset = 0;
-                if (m_packet.payloadSize == 0)
-                    m_inputState = MSP_CHECKSUM_V2_NATIVE;
-                else
-                    m_inputState = MSP_PAYLOAD_V2_NATIVE;
+                processHeader();
             }
             break;
 
@@ -116,10 +162,27 @@ MSP::processReceivedByte(uint8_t c)
             }
             break;
 
+        case MSP_PAYLOAD_V2_STREAM:
+            m_packet.payload[m_offset++ % MSP_PORT_INBUF_SIZE] = c;
+            m_crc = crc8_dvb_s2(m_crc, c);
+            streamChunk();
+            break;
+
         case MSP_CHECKSUM_V2_NATIVE:
+            if (m_streaming) {
+                // The payload has already gone to the chunk handler, only the outcome is left
+                m_streaming = false;
+                m_inputState = MSP_IDLE;
+                if (m_crc != c) {
+                    DBGLN("CRC failure on streamed MSP packet - Got %d expected %d", c, m_crc);
+                }
+                m_onChunk(m_crc == c ? MSP_CHUNK_END : MSP_CHUNK_ABORT, &m_packet, m_packet.payloadSize, nullptr, 0);
+                break;
+            }
             // Assert that the checksums match
             if (m_crc == c) {
                 m_inputState = MSP_COMMAND_RECEIVED;
+                m_packetTime = micros();
             }
             else {
                 DBGLN("CRC failure on MSP packet - Got %d expected %d", c, m_crc);
@@ -141,6 +204,81 @@ MSP::processReceivedByte(uint8_t c)
     return false;
 }
 
+uint8_t
+MSP::processReceivedBytes(const uint8_t *data, size_t len, const mspPacketCallback_t &onPacket)
+{
+    uint8_t packetCount = 0;
+    const uint8_t *end = data + len;
+
+    while (data < end) {
+        switch (m_inputState) {
+
+            case MSP_IDLE: {
+                // Skip anything up to the next framing char in one go
+                const uint8_t *start = (const uint8_t *)memchr(data, '$', end - data);
+                if (start == nullptr) {
+                    return packetCount;
+                }
+                data = start + 1;
+                m_inputState = MSP_HEADER_START;
+                break;
+            }
+
+            case MSP_HEADER_V2_NATIVE: {
+                // Copy as much of the header as is available
+                size_t count = std::min((size_t)(sizeof(mspHeaderV2_t) - m_offset), (size_t)(end - data));
+                memcpy(&m_inputBuffer[m_offset], data, count);
+                m_crc = mspCrc.calc(data, count, m_crc);
+                m_offset += count;
+                data += count;
+
+                if (m_offset == sizeof(mspHeaderV2_t)) {
+                    processHeader();
+                }
+                break;
+            }
+
+            case MSP_PAYLOAD_V2_NATIVE: {
+                // Copy as much of the payload as is available
+                size_t count = std::min((size_t)(m_packet.payloadSize - m_offset), (size_t)(end - data));
+                memcpy(&m_packet.payload[m_offset], data, count);
+                m_crc = mspCrc.calc(data, count, m_crc);
+                m_offset += count;
+                data += count;
+
+                if (m_offset == m_packet.payloadSize) {
+                    m_inputState = MSP_CHECKSUM_V2_NATIVE;
+                }
+                break;
+            }
+
+            case MSP_PAYLOAD_V2_STREAM: {
+                // Copy up to the end of the chunk buffer
+                uint16_t used = m_offset % MSP_PORT_INBUF_SIZE;
+                size_t count = std::min((size_t)(MSP_PORT_INBUF_SIZE - used), (size_t)(m_packet.payloadSize - m_offset));
+                count = std::min(count, (size_t)(end - data));
+                memcpy(&m_packet.payload[used], data, count);
+                m_crc = mspCrc.calc(data, count, m_crc);
+                m_offset += count;
+                data += count;
+                streamChunk();
+                break;
+            }
+
+            default:
+                // Single byte states (framing, packet type, checksum) share the byte-wise path
+                if (processReceivedByte(*data++)) {
+                    ++packetCount;
+                    onPacket(&m_packet);
+                    markPacketReceived();
+                }
+                break;
+        }
+    }
+
+    return packetCount;
+}
+
 mspPacket_t*
 MSP::getReceivedPacket()
 {
@@ -153,65 +291,33 @@ MSP::markPacketReceived()
     // Set input state to idle, ready to receive the next packet
     // The current packet data will be discarded internally
     m_inputState = MSP_IDLE;
+    if (m_streaming) {
+        // The chunk handler already has part of it
+        m_streaming = false;
+        m_onChunk(MSP_CHUNK_ABORT, &m_packet, m_offset, nullptr, 0);
+    }
 }
 
 bool
 MSP::sendPacket(mspPacket_t* packet, Stream* port)
 {
-    // Sanity check the packet before sending
-    if (packet->type != MSP_PACKET_COMMAND && packet->type != MSP_PACKET_RESPONSE) {
-        // Unsupported packet type (note: ignoring '!' until we know what it is)
-        return false;
-    }
+    uint8_t frame[MSP_FRAME_MAX_SIZE];
+    uint8_t frameSize = convertToByteArray(packet, frame);
 
-    if (packet->type == MSP_PACKET_RESPONSE && packet->payloadSize == 0) {
-        // Response packet with no payload
+    if (frameSize == 0) {
+        // packet could not be serialized, bail out
         return false;
     }
-    
-    // Write out the framing chars
-    port->write('$');
-    port->write('X');
-
-    // Write out the packet type
-    if (packet->type == MSP_PACKET_COMMAND) {
-        port->write('<');
-    }
-    else if (packet->type == MSP_PACKET_RESPONSE) {
-        port->write('>');
-    }
 
-    // Subsequent bytes are contained in the crc
-    uint8_t crc = 0;
-
-    // Pack header struct into buffer
-    uint8_t headerBuffer[5];
-    mspHeaderV2_t* header = (mspHeaderV2_t*)&headerBuffer[0];
-    header->flags = packet->flags;
-    header->function = packet->function;
-    header->payloadSize = packet->payloadSize;
-
-    // Write out the header buffer, adding each byte to the crc
-    for (uint8_t i = 0; i < sizeof(mspHeaderV2_t); ++i) {
-        port->write(headerBuffer[i]);
-        crc = crc8_dvb_s2(crc, headerBuffer[i]);
-    }
-
-    // Write out the payload, adding each byte to the crc
-    for (uint16_t i = 0; i < packet->payloadSize; ++i) {
-        port->write(packet->payload[i]);
-        crc = crc8_dvb_s2(crc, packet->payload[i]);
-    }
-
-    // Write out the crc
-    port->write(crc);
+    // Hand the whole frame to the port in one go
+    port->write(frame, frameSize);
 
     return true;
 }
+
 uint8_t
 MSP::convertToByteArray(mspPacket_t* packet, uint8_t* byteArray)
 {
-    uint8_t bufferPos = 0;
     // Sanity check the packet before converting
     if (packet->type != MSP_PACKET_COMMAND && packet->type != MSP_PACKET_RESPONSE) {
         // Unsupported packet type (note: ignoring '!' until we know what it is)
@@ -222,74 +328,39 @@ MSP::convertToByteArray(mspPacket_t* packet, uint8_t* byteArray)
         // Response packet with no payload
         return 0;
     }
-    
-    // Write out the framing chars
-    byteArray[bufferPos++] = '$';
-    byteArray[bufferPos++] = 'X';
-
-    // Write out the packet type
-    if (packet->type == MSP_PACKET_COMMAND) {
-        byteArray[bufferPos++] = '<';
-    }
-    else if (packet->type == MSP_PACKET_RESPONSE) {
-        byteArray[bufferPos++] = '>';
+
+    if (packet->payloadSize > MSP_PORT_INBUF_SIZE || packet->writeError) {
+        // Payload does not fit in a frame, or bytes were dropped adding to it
+        return 0;
     }
 
-    // Subsequent bytes are contained in the crc
-    uint8_t crc = 0;
+    // Write out the framing chars and the packet type
+    byteArray[0] = '$';
+    byteArray[1] = 'X';
+    byteArray[2] = packet->type == MSP_PACKET_COMMAND ? '<' : '>';
 
     // Pack header struct into buffer
-    uint8_t headerBuffer[5];
-    mspHeaderV2_t* header = (mspHeaderV2_t*)&headerBuffer[0];
+    mspHeaderV2_t* header = (mspHeaderV2_t*)&byteArray[MSP_FRAME_PREAMBLE_SIZE];
     header->flags = packet->flags;
     header->function = packet->function;
     header->payloadSize = packet->payloadSize;
 
-    // Write out the header buffer, adding each byte to the crc
-    for (uint8_t i = 0; i < sizeof(mspHeaderV2_t); ++i) {
-        byteArray[bufferPos++] = headerBuffer[i];
-        crc = crc8_dvb_s2(crc, headerBuffer[i]);
-    }
-
-    // Write out the payload, adding each byte to the crc
-    for (uint16_t i = 0; i < packet->payloadSize; ++i) {
-        byteArray[bufferPos++] = packet->payload[i];
-        crc = crc8_dvb_s2(crc, packet->payload[i]);
-    }
+    // Followed by the payload
+    uint8_t* payload = &byteArray[MSP_FRAME_PREAMBLE_SIZE + sizeof(mspHeaderV2_t)];
+    memcpy(payload, packet->payload, packet->payloadSize);
 
-    // Write out the crc
-    byteArray[bufferPos++] = crc;
+    // The header and payload are contained in the crc
+    uint8_t crcSize = sizeof(mspHeaderV2_t) + packet->payloadSize;
+    payload[packet->payloadSize] = mspCrc.calc((uint8_t*)header, crcSize, 0);
 
-    return bufferPos;
+    return MSP_FRAME_PREAMBLE_SIZE + crcSize + 1;
 }
 
 uint8_t
 MSP::getTotalPacketSize(mspPacket_t* packet)
 {
-    uint8_t totalSize = 0;
-    
-    // framing chars
-    totalSize += sizeof('$');
-    totalSize += sizeof('X');
-
-    // packet type
-    if (packet->type == MSP_PACKET_COMMAND) {
-        totalSize += sizeof('<');
-    }
-    else if (packet->type == MSP_PACKET_RESPONSE) {
-        totalSize += sizeof('>');
-    }
-
-    // header
-    totalSize += sizeof(mspHeaderV2_t);
-
-    // payload
-    totalSize += packet->payloadSize;
-
-    // crc
-    totalSize++;
-
-    return totalSize;
+    // framing chars, packet type, header, payload and crc
+    return MSP_FRAME_PREAMBLE_SIZE + sizeof(mspHeaderV2_t) + packet->payloadSize + 1;
 }
 
 bool
@@ -314,3 +385,18 @@ MSP::awaitPacket(mspPacket_t* packet, Stream* port, uint32_t timeoutMillis)
     DBGLN("MSP::awaitPacket Exceeded timeout while waiting for packet");
     return false;
 }
+
+uint8_t
+MSP::convertHeaderToByteArray(const mspPacket_t* packet, uint8_t* byteArray)
+{
+    byteArray[0] = '$';
+    byteArray[1] = 'X';
+    byteArray[2] = packet->type == MSP_PACKET_COMMAND ? '<' : '>';
+
+    mspHeaderV2_t* header = (mspHeaderV2_t*)&byteArray[MSP_FRAME_PREAMBLE_SIZE];
+    header->flags = packet->flags;
+    header->function = packet->function;
+    header->payloadSize = packet->payloadSize;
+
+    return MSP_FRAME_PREAMBLE_SIZE + sizeof(mspHeaderV2_t);
+}
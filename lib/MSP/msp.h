@@ -1,12 +1,17 @@
 #pragma once
 
 #include <Arduino.h>
+#include <functional>
 
-// TODO: MSP_PORT_INBUF_SIZE should be changed to
-// dynamically allocate array length based on the payload size
-// Hardcoding payload size to 64 bytes for now, to allow enough space
-// for custom OSD text.
+// Largest payload held in an mspPacket_t. Bigger payloads, up to
+// MSP_STREAM_MAX_PAYLOAD, can only be received in chunks, see MSP::setChunkHandler()
 #define MSP_PORT_INBUF_SIZE 64
+#define MSP_STREAM_MAX_PAYLOAD 1024
+
+// '$', 'X' and the packet type
+#define MSP_FRAME_PREAMBLE_SIZE 3
+// Largest complete frame: preamble, header, payload and crc
+#define MSP_FRAME_MAX_SIZE (MSP_FRAME_PREAMBLE_SIZE + 5 + MSP_PORT_INBUF_SIZE + 1)
 
 #define CHECK_PACKET_PARSING() \
   if (packet->readError) {\
@@ -20,6 +25,7 @@ typedef enum {
 
     MSP_HEADER_V2_NATIVE,
     MSP_PAYLOAD_V2_NATIVE,
+    MSP_PAYLOAD_V2_STREAM,
     MSP_CHECKSUM_V2_NATIVE,
 
     MSP_COMMAND_RECEIVED
@@ -37,6 +43,8 @@ typedef struct __attribute__((packed)) {
     uint16_t payloadSize;
 } mspHeaderV2_t;
 
+static_assert(MSP_FRAME_MAX_SIZE == MSP_FRAME_PREAMBLE_SIZE + sizeof(mspHeaderV2_t) + MSP_PORT_INBUF_SIZE + 1, "MSP frame size mismatch");
+
 typedef struct {
     mspPacketType_e type;
     uint8_t         flags;
@@ -45,6 +53,7 @@ typedef struct {
     uint8_t         payload[MSP_PORT_INBUF_SIZE];
     uint16_t        payloadReadIterator;
     bool            readError;
+    bool            writeError;
 
     void reset()
     {
@@ -54,10 +63,16 @@ typedef struct {
         payloadSize = 0;
         payloadReadIterator = 0;
         readError = false;
+        writeError = false;
     }
 
     void addByte(uint8_t b)
     {
+        if (payloadSize >= MSP_PORT_INBUF_SIZE) {
+            // A packet that lost bytes is never sent
+            writeError = true;
+            return;
+        }
         payload[payloadSize++] = b;
     }
 
@@ -81,8 +96,36 @@ typedef struct {
 
         return payload[payloadReadIterator++];
     }
+
+    // Fletcher-16 of the function and payload, used to tell whether two ends hold
+    // the same state without sending it. Never 0, which is left to mean no state
+    uint16_t digest() const
+    {
+        uint16_t a = function & 0xFF;
+        uint16_t b = a;
+        a = (a + (function >> 8)) % 255;
+        b = (b + a) % 255;
+        for (uint16_t i = 0; i < payloadSize; i++)
+        {
+            a = (a + payload[i]) % 255;
+            b = (b + a) % 255;
+        }
+        uint16_t sum = (b << 8) | a;
+        return sum ? sum : 1;
+    }
 } mspPacket_t;
 
+typedef std::function<void(mspPacket_t *packet)> mspPacketCallback_t;
+
+typedef enum {
+    MSP_CHUNK_DATA,     // the next len bytes of the payload, starting at offset
+    MSP_CHUNK_END,      // the whole payload arrived and the crc matched
+    MSP_CHUNK_ABORT     // crc failure, anything taken from the chunks has to be dropped
+} mspChunkEvent_e;
+
+// packet has the type, flags, function and full payloadSize, but not the payload
+typedef std::function<void(mspChunkEvent_e event, const mspPacket_t *packet, uint16_t offset, const uint8_t *data, uint16_t len)> mspChunkCallback_t;
+
 /////////////////////////////////////////////////
 
 class MSP
@@ -90,17 +133,34 @@ class MSP
 public:
     MSP();
     bool            processReceivedByte(uint8_t c);
+    // Decode a whole buffer, calling onPacket for every complete packet. Returns the number of packets found
+    uint8_t         processReceivedBytes(const uint8_t *data, size_t len, const mspPacketCallback_t &onPacket);
     mspPacket_t*    getReceivedPacket();
+    // micros() when the last received packet was completed
+    uint32_t        getReceivedTime() { return m_packetTime; }
     void            markPacketReceived();
     bool            sendPacket(mspPacket_t* packet, Stream* port);
     uint8_t         convertToByteArray(mspPacket_t* packet, uint8_t* byteArray);
     uint8_t         getTotalPacketSize(mspPacket_t* packet);
     bool            awaitPacket(mspPacket_t* packet, Stream* port, uint32_t timeoutMillis);
+    // Framing and header of a packet whose payload is sent separately, e.g. a streamed one. Returns the size
+    uint8_t         convertHeaderToByteArray(const mspPacket_t* packet, uint8_t* byteArray);
+    static uint8_t  crc(uint8_t crc, const uint8_t* data, size_t len);
+
+    // Deliver payloads too big for mspPacket_t in chunks of up to MSP_PORT_INBUF_SIZE
+    // bytes as they arrive, rather than dropping them
+    void            setChunkHandler(const mspChunkCallback_t &onChunk) { m_onChunk = onChunk; }
 
 private:
+    void        processHeader();
+    void        streamChunk();
+
     mspState_e  m_inputState;
     uint16_t    m_offset;
     uint8_t     m_inputBuffer[MSP_PORT_INBUF_SIZE];
     mspPacket_t m_packet;
     uint8_t     m_crc;
+    uint32_t    m_packetTime;
+    bool        m_streaming;
+    mspChunkCallback_t m_onChunk;
 };
@@ -0,0 +1,144 @@
+#pragma once
+
+#include "msp.h"
+
+/**
+ * @brief: Last value cache of MSP packets keyed by function
+ *
+ * Only functions in the list given at construction are cached. Payloads are
+ * packed into a shared pool at their real size, and each entry keeps the
+ * digest of its packet so a peer reporting the digests it holds can be sent
+ * just the entries that differ.
+ */
+template <uint8_t MAX_ENTRIES, uint16_t POOL_BYTES>
+class MSPCache
+{
+private:
+    typedef struct {
+        uint16_t function;
+        uint8_t type;
+        uint8_t flags;
+        uint16_t digest;
+        uint16_t offset;
+        uint8_t size;
+    } entry_t;
+
+    const uint16_t *cacheable;
+    uint8_t cacheableCount;
+    entry_t entries[MAX_ENTRIES];
+    uint8_t numEntries = 0;
+    uint16_t poolUsed = 0;
+    uint8_t pool[POOL_BYTES];
+
+    int8_t find(uint16_t function) const
+    {
+        for (uint8_t i = 0; i < numEntries; i++)
+        {
+            if (entries[i].function == function)
+                return i;
+        }
+        return -1;
+    }
+
+    // Remove an entry and close the gap its payload left in the pool
+    void remove(uint8_t idx)
+    {
+        uint16_t offset = entries[idx].offset;
+        uint8_t size = entries[idx].size;
+        memmove(&pool[offset], &pool[offset + size], poolUsed - offset - size);
+        poolUsed -= size;
+        for (uint8_t i = 0; i < numEntries; i++)
+        {
+            if (entries[i].offset > offset)
+                entries[i].offset -= size;
+        }
+        entries[idx] = entries[--numEntries];
+    }
+
+public:
+    MSPCache(const uint16_t *functions, uint8_t count) : cacheable(functions), cacheableCount(count) {}
+
+    bool isCacheable(uint16_t function) const
+    {
+        for (uint8_t i = 0; i < cacheableCount; i++)
+        {
+            if (cacheable[i] == function)
+                return true;
+        }
+        return false;
+    }
+
+    // Store the packet if its function is cacheable, replacing any older value.
+    // If the new value does not fit, the old one is dropped rather than left stale
+    bool update(const mspPacket_t *packet)
+    {
+        if (!isCacheable(packet->function) || packet->payloadSize > MSP_PORT_INBUF_SIZE)
+        {
+            return false;
+        }
+        int8_t idx = find(packet->function);
+        if (idx >= 0 && entries[idx].size != packet->payloadSize)
+        {
+            remove(idx);
+            idx = -1;
+        }
+        if (idx < 0)
+        {
+            if (numEntries == MAX_ENTRIES || poolUsed + packet->payloadSize > POOL_BYTES)
+            {
+                return false;
+            }
+            idx = numEntries++;
+            entries[idx].function = packet->function;
+            entries[idx].offset = poolUsed;
+            entries[idx].size = packet->payloadSize;
+            poolUsed += packet->payloadSize;
+        }
+        entries[idx].type = packet->type;
+        entries[idx].flags = packet->flags;
+        entries[idx].digest = packet->digest();
+        memcpy(&pool[entries[idx].offset], packet->payload, packet->payloadSize);
+        return true;
+    }
+
+    bool get(uint16_t function, mspPacket_t *packet) const
+    {
+        int8_t idx = find(function);
+        if (idx < 0)
+        {
+            return false;
+        }
+        const entry_t *e = &entries[idx];
+        packet->reset();
+        packet->type = (mspPacketType_e)e->type;
+        packet->flags = e->flags;
+        packet->function = e->function;
+        packet->payloadSize = e->size;
+        memcpy(packet->payload, &pool[e->offset], e->size);
+        return true;
+    }
+
+    // Send every entry for which wanted(function, digest) returns true
+    template <typename FILTER, typename SEND>
+    void replay(FILTER wanted, SEND send) const
+    {
+        mspPacket_t packet;
+        for (uint8_t i = 0; i < numEntries; i++)
+        {
+            if (wanted(entries[i].function, entries[i].digest) && get(entries[i].function, &packet))
+            {
+                send(&packet);
+            }
+        }
+    }
+
+    uint8_t size() const { return numEntries; }
+    uint16_t function(uint8_t idx) const { return entries[idx].function; }
+    uint16_t digest(uint8_t idx) const { return entries[idx].digest; }
+
+    void clear()
+    {
+        numEntries = 0;
+        poolUsed = 0;
+    }
+};
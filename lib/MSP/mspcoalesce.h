@@ -0,0 +1,73 @@
+#pragma once
+
+#include <Arduino.h>
+#include <functional>
+#include "msplink.h"
+
+// frame has MSP_LINK_HEADER_SIZE bytes free at the front for MSPLinkSender::stamp(),
+// startUs is when the oldest MSP frame in it was added
+typedef std::function<void(uint8_t *frame, uint8_t len, mspLinkClass_e linkClass, uint32_t startUs)> mspCoalesceSend_t;
+
+/**
+ * @brief: Gathers small MSP frames sent back to back into a single link frame
+ *
+ * A frame is as reliable as the most important packet in it: any reliable
+ * packet makes the whole frame reliable, and mixing best effort and latest
+ * packets leaves it best effort so the best effort ones are not dropped as
+ * stale. The owner decides when a frame is sent, on a timeout with due() or
+ * straight away for latency sensitive packets.
+ */
+class MSPCoalescer
+{
+public:
+    // Append one MSP frame of len bytes, sending what is already held first if it does not fit
+    void add(const uint8_t *data, uint8_t len, mspLinkClass_e linkClass, uint32_t nowUs, const mspCoalesceSend_t &send)
+    {
+        if (MSP_LINK_HEADER_SIZE + m_size + len > MSP_LINK_FRAME_SIZE)
+        {
+            flush(send);
+        }
+
+        if (m_size == 0)
+        {
+            m_startUs = nowUs;
+            m_class = linkClass;
+        }
+        else if (linkClass == MSP_LINK_RELIABLE || m_class == MSP_LINK_RELIABLE)
+        {
+            m_class = MSP_LINK_RELIABLE;
+        }
+        else if (linkClass != m_class)
+        {
+            m_class = MSP_LINK_BEST_EFFORT;
+        }
+        memcpy(&m_buffer[MSP_LINK_HEADER_SIZE + m_size], data, len);
+        m_size += len;
+    }
+
+    void flush(const mspCoalesceSend_t &send)
+    {
+        if (m_size == 0)
+        {
+            return;
+        }
+        uint8_t frameSize = MSP_LINK_HEADER_SIZE + m_size;
+        m_size = 0;
+        send(m_buffer, frameSize, m_class, m_startUs);
+    }
+
+    // Something has waited timeoutUs or longer
+    bool due(uint32_t nowUs, uint32_t timeoutUs) const
+    {
+        return m_size != 0 && nowUs - m_startUs >= timeoutUs;
+    }
+
+    bool empty() const { return m_size == 0; }
+
+private:
+    // The link header, then m_size bytes of MSP frames
+    uint8_t m_buffer[MSP_LINK_FRAME_SIZE];
+    uint8_t m_size = 0;
+    mspLinkClass_e m_class = MSP_LINK_BEST_EFFORT;
+    uint32_t m_startUs = 0;
+};
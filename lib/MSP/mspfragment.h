@@ -0,0 +1,135 @@
+#pragma once
+
+#include <Arduino.h>
+#include <functional>
+
+// An MSP frame too long for one ESP-NOW frame is sent as a run of fragments,
+// each [MSP_FRAGMENT_MAGIC, id, index, count] followed by the next slice of the
+// frame. Plain MSP frames always start with '$', so the two can share a link.
+#define MSP_FRAGMENT_MAGIC          '#'
+#define MSP_FRAGMENT_HEADER_SIZE    4
+#define MSP_FRAGMENT_FRAME_SIZE     250
+#define MSP_FRAGMENT_BODY_SIZE      (MSP_FRAGMENT_FRAME_SIZE - MSP_FRAGMENT_HEADER_SIZE)
+
+typedef std::function<void(const uint8_t *data, uint8_t len)> mspFragmentSend_t;
+
+/**
+ * @brief: Splits one MSP frame into fragments as its bytes are written
+ *
+ * The frame does not have to be held in memory, each fragment goes to send as
+ * soon as it is full, so a streamed payload can be passed through as it arrives.
+ */
+class MSPFragmenter
+{
+public:
+    // Start a frame of frameSize bytes, framing and crc included
+    void begin(uint16_t frameSize)
+    {
+        m_buffer[0] = MSP_FRAGMENT_MAGIC;
+        m_buffer[1] = ++m_id;
+        m_buffer[2] = 0;
+        m_buffer[3] = (frameSize + MSP_FRAGMENT_BODY_SIZE - 1) / MSP_FRAGMENT_BODY_SIZE;
+        m_remaining = frameSize;
+        m_size = MSP_FRAGMENT_HEADER_SIZE;
+    }
+
+    void write(const uint8_t *data, uint16_t len, const mspFragmentSend_t &send)
+    {
+        while (len > 0 && m_remaining > 0)
+        {
+            uint16_t count = min((uint16_t)(MSP_FRAGMENT_FRAME_SIZE - m_size), min(len, m_remaining));
+            memcpy(&m_buffer[m_size], data, count);
+            m_size += count;
+            m_remaining -= count;
+            data += count;
+            len -= count;
+
+            if (m_size == MSP_FRAGMENT_FRAME_SIZE || m_remaining == 0)
+            {
+                send(m_buffer, m_size);
+                m_buffer[2]++;
+                m_size = MSP_FRAGMENT_HEADER_SIZE;
+            }
+        }
+    }
+
+    // Drop the rest of the frame, the receiver throws away what it already has
+    // when the next frame starts
+    void abort() { m_remaining = 0; }
+
+    bool active() const { return m_remaining != 0; }
+
+private:
+    uint8_t m_buffer[MSP_FRAGMENT_FRAME_SIZE];
+    uint8_t m_size = 0;
+    uint16_t m_remaining = 0;
+    uint8_t m_id = 0;
+};
+
+/**
+ * @brief: Checks fragments arrive complete and in order
+ *
+ * There is no reassembly buffer, the body of each fragment is fed straight to
+ * the MSP parser, which streams the payload out in chunks. A lost or reordered
+ * fragment cannot be recovered, the rest of that frame is dropped and the
+ * parser has to be reset so the partial frame is discarded.
+ */
+class MSPDefragmenter
+{
+public:
+    static bool isFragment(const uint8_t *data, uint8_t len)
+    {
+        return len > MSP_FRAGMENT_HEADER_SIZE && data[0] == MSP_FRAGMENT_MAGIC;
+    }
+
+    /***
+     * @brief: Check the next fragment received
+     * @param body: set to the part of data to pass to the parser
+     * @param bodyLen: its length
+     * @param restart: set if the parser holds part of a frame that will never complete
+     * @return: true if the body should be parsed, false if the fragment is dropped
+     */
+    bool accept(const uint8_t *data, uint8_t len, const uint8_t **body, uint8_t *bodyLen, bool *restart)
+    {
+        uint8_t id = data[1];
+        uint8_t index = data[2];
+        uint8_t count = data[3];
+
+        *restart = false;
+        if (index == 0)
+        {
+            // A new frame, the last one was cut short if it was still expected to continue
+            *restart = m_next != 0;
+            m_id = id;
+            m_count = count;
+        }
+        else if (id != m_id || index != m_next)
+        {
+            // A gap, drop the rest of this frame
+            *restart = m_next != 0;
+            m_next = 0;
+            return false;
+        }
+
+        m_next = (index + 1 < m_count) ? index + 1 : 0;
+        *body = &data[MSP_FRAGMENT_HEADER_SIZE];
+        *bodyLen = len - MSP_FRAGMENT_HEADER_SIZE;
+        return true;
+    }
+
+    /***
+     * @brief: Forget the frame in progress, for when a plain frame arrives instead
+     * @return: true if the parser holds part of a frame and has to be reset
+     */
+    bool interrupt()
+    {
+        bool wasActive = m_next != 0;
+        m_next = 0;
+        return wasActive;
+    }
+
+private:
+    uint8_t m_id = 0;
+    uint8_t m_count = 0;
+    uint8_t m_next = 0;
+};
@@ -0,0 +1,405 @@
+#pragma once
+
+#include <Arduino.h>
+#include <functional>
+
+// ESP-NOW frames of MSP packets can start with a link header:
+//   [MSP_LINK_MAGIC, flags, session, seq]
+// flags holds the delivery class and which kind of backpack sent the frame,
+// each kind has a sequence of its own. An ACK frame is the header followed by
+// a bitmap of the MSP_LINK_ACK_BITS sequence numbers before seq that were also
+// received, and the id of the receiver sending it. Every VRX of a group shares
+// the group MAC, the id is how the sender tells their ACKs apart. Nothing in the
+// header is ever '$', so a receiver that does not know about it finds the MSP
+// frame behind it by the framing char as before.
+#define MSP_LINK_MAGIC          '%'
+#define MSP_LINK_HEADER_SIZE    4
+#define MSP_LINK_ACK_SIZE       (MSP_LINK_HEADER_SIZE + 2)
+// ACKs from backpacks that do not send a receiver id
+#define MSP_LINK_ACK_SIZE_NO_ID (MSP_LINK_HEADER_SIZE + 1)
+#define MSP_LINK_ACK_BITS       8
+#define MSP_LINK_FRAME_SIZE     250
+
+#define MSP_LINK_CLASS_MASK     0x03
+#define MSP_LINK_SOURCE_SHIFT   2
+#define MSP_LINK_SOURCES        4
+
+// Reliable frames not yet acknowledged, and how they are retried
+#define MSP_LINK_WINDOW         4
+#define MSP_LINK_RETRY_MS       30
+#define MSP_LINK_MAX_RETRIES    3
+
+// Receivers a sender keeps track of, and how long one is expected to ACK after it was last heard
+#define MSP_LINK_RECEIVERS      8
+#define MSP_LINK_RECEIVER_TIMEOUT_MS 10000
+
+// Sequence numbers a receiver remembers, anything older is taken as a new session
+#define MSP_LINK_HISTORY        32
+
+typedef enum {
+    MSP_LINK_BEST_EFFORT,   // sent once, duplicates dropped
+    MSP_LINK_RELIABLE,      // acknowledged, resent until it is
+    MSP_LINK_LATEST,        // sent once, dropped if a newer frame already arrived
+    MSP_LINK_ACK
+} mspLinkClass_e;
+
+typedef enum {
+    MSP_LINK_SOURCE_TX,
+    MSP_LINK_SOURCE_TIMER
+} mspLinkSource_e;
+
+typedef std::function<void(const uint8_t *data, uint8_t len)> mspLinkSend_t;
+
+/**
+ * @brief: Numbers outgoing frames and resends reliable ones until they are acknowledged
+ *
+ * Frames are built with MSP_LINK_HEADER_SIZE bytes free at the front for
+ * stamp(). Only loop() may call into it; acknowledgements arriving in the
+ * radio callback are handed over with postAck() and applied by update().
+ *
+ * Reliable frames go to a group, so one ACK is not enough. Every receiver
+ * that has ACKed anything in the last MSP_LINK_RECEIVER_TIMEOUT_MS is
+ * expected to ACK each frame, which is resent until all of them have or the
+ * retries run out. A receiver that misses a frame that way is forgotten until
+ * it next ACKs, and gaveUp() tells the caller to send its state again.
+ */
+class MSPLinkSender
+{
+public:
+    void begin(mspLinkSource_e source, uint8_t session)
+    {
+        m_source = source;
+        // Never '$', see above
+        m_session = session == '$' ? session + 1 : session;
+        m_seq = 0;
+    }
+
+    /***
+     * @brief: Fill in the header of frame, and keep a copy to resend if it is reliable
+     * @return: the sequence number it was given
+     */
+    uint8_t stamp(uint8_t *frame, uint8_t len, mspLinkClass_e linkClass, uint32_t now)
+    {
+        if (++m_seq == '$')
+        {
+            ++m_seq;
+        }
+        frame[0] = MSP_LINK_MAGIC;
+        frame[1] = linkClass | (m_source << MSP_LINK_SOURCE_SHIFT);
+        frame[2] = m_session;
+        frame[3] = m_seq;
+
+        if (linkClass == MSP_LINK_RELIABLE)
+        {
+            Pending *slot = freeSlot();
+            if (slot == nullptr)
+            {
+                // Sent anyway, but nothing will resend it
+                m_windowFull++;
+            }
+            else
+            {
+                memcpy(slot->frame, frame, len);
+                slot->len = len;
+                slot->seq = m_seq;
+                slot->sentAt = now;
+                slot->retries = 0;
+                slot->acked = 0;
+                slot->used = true;
+            }
+        }
+        return m_seq;
+    }
+
+    // From the receive callback, frame is an ACK frame
+    void postAck(const uint8_t *frame, uint8_t len)
+    {
+        if (frame[2] != m_session)
+        {
+            return;
+        }
+        uint8_t next = (m_ackHead + 1) % ACK_QUEUE_SIZE;
+        if (next == m_ackTail)
+        {
+            // Full, the resend will be acknowledged again
+            return;
+        }
+        m_acks[m_ackHead][0] = frame[3];
+        m_acks[m_ackHead][1] = frame[4];
+        m_acks[m_ackHead][2] = len >= MSP_LINK_ACK_SIZE ? frame[5] : 0;
+        m_ackHead = next;
+    }
+
+    // Release acknowledged frames and resend the ones whose time is up
+    void update(uint32_t now, const mspLinkSend_t &send)
+    {
+        while (m_ackTail != m_ackHead)
+        {
+            acknowledge(m_acks[m_ackTail][0], m_acks[m_ackTail][1], receiverSlot(m_acks[m_ackTail][2], now));
+            m_ackTail = (m_ackTail + 1) % ACK_QUEUE_SIZE;
+        }
+
+        // Everyone that should ACK. One that is not known yet cannot be waited for, but
+        // it ACKs what it does get, and is waited for from then on
+        uint8_t expected = 0;
+        for (uint8_t r = 0; r < MSP_LINK_RECEIVERS; r++)
+        {
+            if (m_receivers[r].used && now - m_receivers[r].lastAck < MSP_LINK_RECEIVER_TIMEOUT_MS)
+                expected |= 1 << r;
+        }
+
+        for (uint8_t i = 0; i < MSP_LINK_WINDOW; i++)
+        {
+            Pending &p = m_window[i];
+            if (p.used && p.acked != 0 && (p.acked & expected) == expected)
+            {
+                p.used = false;
+            }
+            if (!p.used || now - p.sentAt < MSP_LINK_RETRY_MS)
+            {
+                continue;
+            }
+            if (p.retries == MSP_LINK_MAX_RETRIES)
+            {
+                m_lost++;
+                p.used = false;
+                uint8_t missed = expected & ~p.acked;
+                for (uint8_t r = 0; r < MSP_LINK_RECEIVERS; r++)
+                {
+                    if (missed & (1 << r))
+                        m_receivers[r].used = false;
+                }
+                m_gaveUp |= missed != 0;
+                continue;
+            }
+            p.retries++;
+            p.sentAt = now;
+            m_resent++;
+            send(p.frame, p.len);
+        }
+    }
+
+    bool pending() const
+    {
+        for (uint8_t i = 0; i < MSP_LINK_WINDOW; i++)
+        {
+            if (m_window[i].used)
+                return true;
+        }
+        return false;
+    }
+
+    // True once after a receiver that was ACKing did not get a frame, its state has to be sent again
+    bool gaveUp()
+    {
+        bool gaveUp = m_gaveUp;
+        m_gaveUp = false;
+        return gaveUp;
+    }
+
+    uint32_t resent() const { return m_resent; }
+    uint32_t lost() const { return m_lost; }
+    uint32_t windowFull() const { return m_windowFull; }
+
+private:
+    static const uint8_t ACK_QUEUE_SIZE = 8;
+
+    struct Pending
+    {
+        uint8_t frame[MSP_LINK_FRAME_SIZE];
+        uint8_t len;
+        uint8_t seq;
+        uint8_t retries;
+        uint8_t acked;      // bit n: m_receivers[n] has ACKed it
+        bool used;
+        uint32_t sentAt;
+    };
+
+    struct Receiver
+    {
+        uint8_t id;
+        bool used;
+        uint32_t lastAck;
+    };
+
+    Pending m_window[MSP_LINK_WINDOW] = {};
+    uint8_t m_source = MSP_LINK_SOURCE_TX;
+    uint8_t m_session = 0;
+    uint8_t m_seq = 0;
+
+    Receiver m_receivers[MSP_LINK_RECEIVERS] = {};
+    bool m_gaveUp = false;
+
+    volatile uint8_t m_acks[ACK_QUEUE_SIZE][3];
+    volatile uint8_t m_ackHead = 0;
+    volatile uint8_t m_ackTail = 0;
+
+    uint32_t m_resent = 0;
+    uint32_t m_lost = 0;
+    uint32_t m_windowFull = 0;
+
+    Pending *freeSlot()
+    {
+        for (uint8_t i = 0; i < MSP_LINK_WINDOW; i++)
+        {
+            if (!m_window[i].used)
+                return &m_window[i];
+        }
+        return nullptr;
+    }
+
+    // The slot of receiver id, taking over a free one or the one heard from longest ago if it is new
+    uint8_t receiverSlot(uint8_t id, uint32_t now)
+    {
+        for (uint8_t r = 0; r < MSP_LINK_RECEIVERS; r++)
+        {
+            if (m_receivers[r].used && m_receivers[r].id == id)
+            {
+                m_receivers[r].lastAck = now;
+                return r;
+            }
+        }
+        uint8_t slot = 0;
+        for (uint8_t r = 0; r < MSP_LINK_RECEIVERS; r++)
+        {
+            if (!m_receivers[r].used)
+            {
+                slot = r;
+                break;
+            }
+            if (now - m_receivers[r].lastAck > now - m_receivers[slot].lastAck)
+                slot = r;
+        }
+        // A new receiver has ACKed nothing sent before it was known
+        for (uint8_t i = 0; i < MSP_LINK_WINDOW; i++)
+            m_window[i].acked &= ~(1 << slot);
+        m_receivers[slot].id = id;
+        m_receivers[slot].used = true;
+        m_receivers[slot].lastAck = now;
+        return slot;
+    }
+
+    void acknowledge(uint8_t seq, uint8_t bitmap, uint8_t slot)
+    {
+        for (uint8_t i = 0; i < MSP_LINK_WINDOW; i++)
+        {
+            Pending &p = m_window[i];
+            if (!p.used)
+                continue;
+            uint8_t behind = seq - p.seq;
+            if (behind == 0 || (behind <= MSP_LINK_ACK_BITS && (bitmap & (1 << (behind - 1)))))
+            {
+                p.acked |= 1 << slot;
+            }
+        }
+    }
+};
+
+/**
+ * @brief: Drops duplicate and stale frames, and builds the ACKs for reliable ones
+ */
+class MSPLinkReceiver
+{
+public:
+    static bool isLinkFrame(const uint8_t *data, uint8_t len)
+    {
+        return len >= MSP_LINK_HEADER_SIZE && data[0] == MSP_LINK_MAGIC;
+    }
+
+    static bool isAck(const uint8_t *data, uint8_t len)
+    {
+        return len >= MSP_LINK_ACK_SIZE_NO_ID && (data[1] & MSP_LINK_CLASS_MASK) == MSP_LINK_ACK;
+    }
+
+    // The id sent with every ACK, it only has to differ from the other receivers of the group
+    void begin(uint8_t id) { m_id = id; }
+
+    /***
+     * @brief: Check a received link frame
+     * @param ack: filled with the ACK to send back when ackLen is set non zero
+     * @return: true if the MSP behind the header (MSP_LINK_HEADER_SIZE on) should be parsed
+     */
+    bool accept(const uint8_t *data, uint8_t len, uint8_t *ack, uint8_t *ackLen)
+    {
+        *ackLen = 0;
+        if (len < MSP_LINK_HEADER_SIZE)
+        {
+            return false;
+        }
+        uint8_t linkClass = data[1] & MSP_LINK_CLASS_MASK;
+        uint8_t source = (data[1] >> MSP_LINK_SOURCE_SHIFT) % MSP_LINK_SOURCES;
+        uint8_t session = data[2];
+        uint8_t seq = data[3];
+        History &h = m_history[source];
+
+        if (linkClass == MSP_LINK_ACK)
+        {
+            return false;
+        }
+
+        bool fresh;
+        int8_t ahead = seq - h.highest;
+        bool stale = ahead < 0 && -ahead >= MSP_LINK_HISTORY;
+        if (!h.valid || session != h.session || stale)
+        {
+            // A new session, or so far behind it has to be one
+            h.valid = true;
+            h.session = session;
+            h.highest = seq;
+            h.seen = 1;
+            h.reliable = linkClass == MSP_LINK_RELIABLE;
+            fresh = true;
+        }
+        else if (ahead > 0)
+        {
+            h.seen = ahead >= MSP_LINK_HISTORY ? 0 : h.seen << ahead;
+            h.reliable = ahead >= MSP_LINK_HISTORY ? 0 : h.reliable << ahead;
+            h.highest = seq;
+            h.seen |= 1;
+            if (linkClass == MSP_LINK_RELIABLE)
+                h.reliable |= 1;
+            fresh = true;
+        }
+        else
+        {
+            uint32_t bit = 1UL << -ahead;
+            fresh = !(h.seen & bit) && linkClass != MSP_LINK_LATEST;
+            h.seen |= bit;
+            if (linkClass == MSP_LINK_RELIABLE)
+                h.reliable |= bit;
+            if (!fresh)
+                m_dropped++;
+        }
+
+        if (linkClass == MSP_LINK_RELIABLE)
+        {
+            // Acknowledged even when a duplicate, the last ACK may have been lost
+            ack[0] = MSP_LINK_MAGIC;
+            ack[1] = MSP_LINK_ACK | (source << MSP_LINK_SOURCE_SHIFT);
+            ack[2] = session;
+            ack[3] = seq;
+            // The reliable frames before seq, none once they are out of the history
+            uint8_t behind = h.highest - seq;
+            ack[4] = behind + 1 >= MSP_LINK_HISTORY ? 0 : (h.reliable >> (behind + 1)) & 0xFF;
+            ack[5] = m_id;
+            *ackLen = MSP_LINK_ACK_SIZE;
+        }
+        return fresh;
+    }
+
+    uint32_t dropped() const { return m_dropped; }
+
+private:
+    struct History
+    {
+        bool valid;
+        uint8_t session;
+        uint8_t highest;
+        uint32_t seen;      // bit n: highest - n arrived
+        uint32_t reliable;  // bit n: highest - n arrived and was reliable
+    };
+
+    History m_history[MSP_LINK_SOURCES] = {};
+    uint8_t m_id = 0;
+    uint32_t m_dropped = 0;
+};
@@ -0,0 +1,77 @@
+#pragma once
+
+#include "msp.h"
+
+/**
+ * @brief: Single slot, latest value wins, store for an MSP packet
+ *
+ * Used for streams such as head-tracking PTR where a sample that has been
+ * superseded is worthless. Posting overwrites any sample that has not been
+ * taken yet, and each sample carries the micros() time it was posted so the
+ * consumer can tell how long it waited.
+ */
+class MSPMailbox
+{
+private:
+    mspPacket_t packet;
+    uint32_t postedAt = 0;
+    uint32_t lastLatency = 0;
+    uint32_t overwritten = 0;
+    volatile bool full = false;
+#if defined(PLATFORM_ESP32)
+    portMUX_TYPE mux = portMUX_INITIALIZER_UNLOCKED;
+#endif
+
+    void lock()
+    {
+#if defined(PLATFORM_ESP32)
+        portENTER_CRITICAL(&mux);
+#else
+        noInterrupts();
+#endif
+    }
+
+    void unlock()
+    {
+#if defined(PLATFORM_ESP32)
+        portEXIT_CRITICAL(&mux);
+#else
+        interrupts();
+#endif
+    }
+
+public:
+    void post(const mspPacket_t *sample, uint32_t now)
+    {
+        lock();
+        if (full)
+        {
+            overwritten++;
+        }
+        packet = *sample;
+        postedAt = now;
+        full = true;
+        unlock();
+    }
+
+    // Copy out the pending sample, returns false if there is none
+    bool take(mspPacket_t *sample, uint32_t now)
+    {
+        if (!full)
+        {
+            return false;
+        }
+        lock();
+        *sample = packet;
+        lastLatency = now - postedAt;
+        full = false;
+        unlock();
+        return true;
+    }
+
+    bool pending() { return full; }
+    // Time the last taken sample spent in the mailbox, in microseconds
+    uint32_t latency() { return lastLatency; }
+    // Number of samples replaced before they were taken
+    uint32_t dropped() { return overwritten; }
+};
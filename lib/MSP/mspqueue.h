@@ -0,0 +1,73 @@
+#pragma once
+
+#include "msp.h"
+#include "FIFO.h"
+
+/**
+ * @brief: Queue of MSP packets stored at their real size
+ *
+ * Each packet is packed as its type, header and payloadSize bytes of payload,
+ * so a queue of short timer packets takes a fraction of the RAM a queue of
+ * full mspPacket_t copies would.
+ */
+template <uint32_t QUEUE_BYTES>
+class MSPQueue
+{
+private:
+    static const uint8_t RECORD_HEADER_SIZE = 1 + sizeof(mspHeaderV2_t);
+    FIFO<QUEUE_BYTES> fifo;
+
+    static void unpack(const uint8_t *record, mspPacket_t *packet)
+    {
+        packet->reset();
+        packet->type = (mspPacketType_e)record[0];
+        const mspHeaderV2_t *header = (const mspHeaderV2_t *)&record[1];
+        packet->flags = header->flags;
+        packet->function = header->function;
+        packet->payloadSize = header->payloadSize;
+        memcpy(packet->payload, &record[RECORD_HEADER_SIZE], packet->payloadSize);
+    }
+
+public:
+    bool push(const mspPacket_t *packet)
+    {
+        if (packet->payloadSize > MSP_PORT_INBUF_SIZE)
+        {
+            return false;
+        }
+        uint8_t record[RECORD_HEADER_SIZE + MSP_PORT_INBUF_SIZE];
+        record[0] = packet->type;
+        mspHeaderV2_t *header = (mspHeaderV2_t *)&record[1];
+        header->flags = packet->flags;
+        header->function = packet->function;
+        header->payloadSize = packet->payloadSize;
+        memcpy(&record[RECORD_HEADER_SIZE], packet->payload, packet->payloadSize);
+        return fifo.push(record, RECORD_HEADER_SIZE + packet->payloadSize);
+    }
+
+    bool peek(mspPacket_t *packet)
+    {
+        uint8_t record[RECORD_HEADER_SIZE + MSP_PORT_INBUF_SIZE];
+        if (fifo.peek(record, sizeof(record)) == 0)
+        {
+            return false;
+        }
+        unpack(record, packet);
+        return true;
+    }
+
+    bool pop(mspPacket_t *packet)
+    {
+        if (!peek(packet))
+        {
+            return false;
+        }
+        fifo.drop();
+        return true;
+    }
+
+    void drop() { fifo.drop(); }
+    void flush() { fifo.flush(); }
+    uint32_t size() { return fifo.size(); }
+    uint32_t bytes() { return fifo.bytes(); }
+};
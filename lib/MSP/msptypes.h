@@ -13,7 +13,7 @@
 #define MSP_ELRS_TLM_RATE                       0x08
 #define MSP_ELRS_BIND                           0x09
 #define MSP_ELRS_MODEL_ID                       0x0A
-#define MSP_ELRS_REQU_VTX_PKT                   0x0B
+#define MSP_ELRS_REQU_VTX_PKT                   0x0B  // payload is 0 then (function, digest) pairs the VRX holds, the reply carries the TX's
 #define MSP_ELRS_SET_TX_BACKPACK_WIFI_MODE      0x0C
 #define MSP_ELRS_SET_VRX_BACKPACK_WIFI_MODE     0x0D
 #define MSP_ELRS_SET_RX_WIFI_MODE               0x0E
@@ -52,3 +52,7 @@
 #define MSP_ELRS_BACKPACK_GET_VERSION           0x0381  // get the bacpack firmware version
 #define MSP_ELRS_BACKPACK_GET_STATUS            0x0382  // get the status of the backpack
 #define MSP_ELRS_BACKPACK_SET_PTR               0x0383  // forwarded back to TX backpack
+#define MSP_ELRS_BACKPACK_GET_LATENCY           0x0384  // get a per-hop latency histogram, payload is the probe index
+#define MSP_ELRS_BACKPACK_GET_BOOT_TIMING       0x0385  // get the micros() each boot phase was reached
+#define MSP_ELRS_BACKPACK_GET_LINK_STATS        0x0386  // get ESP-NOW link quality for a peer, payload is the peer index
+#define MSP_ELRS_BACKPACK_GET_MEMORY            0x0387  // get heap, stack and queue high-water marks, payload is the report
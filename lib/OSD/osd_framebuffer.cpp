@@ -0,0 +1,145 @@
+#include "osd_framebuffer.h"
+#include "msptypes.h"
+
+#define OSD_BLANK                   ' '
+// MSP v2 framing plus the write-string header, the cost of starting a new run
+#define OSD_FB_FRAME_OVERHEAD       13
+#define OSD_FB_MAX_RUN              (MSP_PORT_INBUF_SIZE - 4)
+
+OsdFramebuffer::OsdFramebuffer() :
+    _sentValid(false), _writesSent(0), _cellsSent(0)
+{
+    memset(_chars, OSD_BLANK, sizeof(_chars));
+    memset(_attrs, 0, sizeof(_attrs));
+}
+
+void OsdFramebuffer::apply(mspPacket_t *packet, const mspPacketCallback_t &send)
+{
+    if (packet->payloadSize == 0)
+        return;
+
+    switch (packet->payload[0])
+    {
+    case OSD_CMD_CLEAR:
+        memset(_chars, OSD_BLANK, sizeof(_chars));
+        memset(_attrs, 0, sizeof(_attrs));
+        break;
+
+    case OSD_CMD_WRITE_STRING:
+        if (packet->payloadSize < 4)
+            break;
+        if (packet->payload[1] >= OSD_FB_ROWS || packet->payload[2] >= OSD_FB_COLS)
+        {
+            // Off the canvas, the goggles may still know what to do with it
+            send(packet);
+            break;
+        }
+        write(packet->payload[1], packet->payload[2], packet->payload[3], &packet->payload[4], packet->payloadSize - 4);
+        break;
+
+    case OSD_CMD_DRAW:
+        sendChanges(send);
+        send(packet);
+        break;
+
+    case OSD_CMD_RELEASE:
+        _sentValid = false;
+        send(packet);
+        break;
+
+    default:
+        send(packet);
+        break;
+    }
+}
+
+void OsdFramebuffer::write(uint8_t row, uint8_t col, uint8_t attr, const uint8_t *text, uint8_t len)
+{
+    len = min(len, (uint8_t)(OSD_FB_COLS - col));
+    memcpy(&_chars[row][col], text, len);
+    memset(&_attrs[row][col], attr, len);
+}
+
+/***
+ * @brief: Whether clearing the goggles and writing every non-blank cell costs
+ *         less than rewriting the changed cells, e.g. after a screen change
+ */
+bool OsdFramebuffer::clearIsCheaper() const
+{
+    uint16_t changedCells = 0;
+    uint16_t filledCells = 0;
+    for (uint8_t row = 0; row < OSD_FB_ROWS; row++)
+    {
+        for (uint8_t col = 0; col < OSD_FB_COLS; col++)
+        {
+            changedCells += changed(row, col);
+            filledCells += _chars[row][col] != OSD_BLANK || _attrs[row][col] != 0;
+        }
+    }
+    return filledCells + OSD_FB_FRAME_OVERHEAD < changedCells;
+}
+
+void OsdFramebuffer::sendCommand(uint8_t command, const mspPacketCallback_t &send)
+{
+    mspPacket_t packet;
+    packet.reset();
+    packet.makeCommand();
+    packet.function = MSP_ELRS_SET_OSD;
+    packet.addByte(command);
+    send(&packet);
+}
+
+void OsdFramebuffer::sendChanges(const mspPacketCallback_t &send)
+{
+    if (!_sentValid || clearIsCheaper())
+    {
+        sendCommand(OSD_CMD_CLEAR, send);
+        memset(_sentChars, OSD_BLANK, sizeof(_sentChars));
+        memset(_sentAttrs, 0, sizeof(_sentAttrs));
+        _sentValid = true;
+    }
+
+    mspPacket_t packet;
+    for (uint8_t row = 0; row < OSD_FB_ROWS; row++)
+    {
+        uint8_t col = 0;
+        while (col < OSD_FB_COLS)
+        {
+            if (!changed(row, col))
+            {
+                col++;
+                continue;
+            }
+
+            // Extend the run over later changes with the same attribute, resending
+            // short stretches of unchanged cells between them
+            uint8_t start = col;
+            uint8_t end = col + 1;
+            uint8_t attr = _attrs[row][col];
+            for (uint8_t c = end; c < OSD_FB_COLS && c - start < OSD_FB_MAX_RUN && _attrs[row][c] == attr; c++)
+            {
+                if (changed(row, c))
+                    end = c + 1;
+                else if (c - end >= OSD_FB_MERGE_GAP)
+                    break;
+            }
+
+            packet.reset();
+            packet.makeCommand();
+            packet.function = MSP_ELRS_SET_OSD;
+            packet.addByte(OSD_CMD_WRITE_STRING);
+            packet.addByte(row);
+            packet.addByte(start);
+            packet.addByte(attr);
+            for (uint8_t c = start; c < end; c++)
+                packet.addByte(_chars[row][c]);
+            send(&packet);
+
+            memcpy(&_sentChars[row][start], &_chars[row][start], end - start);
+            memset(&_sentAttrs[row][start], attr, end - start);
+            _writesSent++;
+            _cellsSent += end - start;
+            col = end;
+        }
+    }
+}
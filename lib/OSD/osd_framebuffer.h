@@ -0,0 +1,60 @@
+#pragma once
+
+#include <Arduino.h>
+#include "msp.h"
+
+// MSP DisplayPort sub-commands carried in MSP_ELRS_SET_OSD
+#define OSD_CMD_HEARTBEAT       0
+#define OSD_CMD_RELEASE         1
+#define OSD_CMD_CLEAR           2
+#define OSD_CMD_WRITE_STRING    3
+#define OSD_CMD_DRAW            4
+#define OSD_CMD_OPTIONS         5
+
+// Largest HD canvas, writes outside it are passed straight through
+#define OSD_FB_ROWS             18
+#define OSD_FB_COLS             50
+// Unchanged cells worth resending to join two runs rather than start another frame
+#define OSD_FB_MERGE_GAP        12
+
+/**
+ * @brief: Character cell copy of the goggle OSD, forwarding only what changed
+ *
+ * Clear and write-string sub-commands are applied to a local screen instead of
+ * being forwarded. On draw, the screen is compared with what the goggles were
+ * last sent, and only the changed runs of each row go out, followed by the
+ * draw. A flight controller that redraws a static screen every frame then costs
+ * a single draw, rather than a clear and a write per element.
+ */
+class OsdFramebuffer
+{
+public:
+    OsdFramebuffer();
+
+    // Apply an MSP_ELRS_SET_OSD packet, calling send for each packet to forward
+    void apply(mspPacket_t *packet, const mspPacketCallback_t &send);
+    // The goggles' screen is unknown, e.g. after they restart. The next draw starts with a clear
+    void invalidate() { _sentValid = false; }
+
+    // Write-string sub-commands forwarded, and the cells they carried
+    uint32_t writesSent() const { return _writesSent; }
+    uint32_t cellsSent() const { return _cellsSent; }
+
+private:
+    uint8_t _chars[OSD_FB_ROWS][OSD_FB_COLS];
+    uint8_t _attrs[OSD_FB_ROWS][OSD_FB_COLS];
+    uint8_t _sentChars[OSD_FB_ROWS][OSD_FB_COLS];
+    uint8_t _sentAttrs[OSD_FB_ROWS][OSD_FB_COLS];
+    bool _sentValid;
+    uint32_t _writesSent;
+    uint32_t _cellsSent;
+
+    bool changed(uint8_t row, uint8_t col) const
+    {
+        return _chars[row][col] != _sentChars[row][col] || _attrs[row][col] != _sentAttrs[row][col];
+    }
+    void write(uint8_t row, uint8_t col, uint8_t attr, const uint8_t *text, uint8_t len);
+    bool clearIsCheaper() const;
+    void sendCommand(uint8_t command, const mspPacketCallback_t &send);
+    void sendChanges(const mspPacketCallback_t &send);
+};
@@ -0,0 +1,128 @@
+#include "profiler.h"
+
+#if defined(LOOP_PROFILER)
+
+#include "logging.h"
+
+static profilerSlot_t slots[PROFILER_SLOTS];
+static uint8_t slotCount = 0;
+static uint32_t loopStart = 0;
+#if defined(PROFILER_DUMP_INTERVAL_MS)
+static uint32_t lastDump = 0;
+#endif
+
+uint8_t profilerSlot(const char *name, uint16_t arg)
+{
+    for (uint8_t i = 0 ; i < slotCount ; i++)
+    {
+        // Names are literals each used in one place, so compared by pointer
+        if (slots[i].name == name && slots[i].arg == arg)
+        {
+            return i;
+        }
+    }
+    if (slotCount == PROFILER_SLOTS)
+    {
+        return PROFILER_NO_SLOT;
+    }
+    profilerSlot_t *s = &slots[slotCount];
+    memset(s, 0, sizeof(*s));
+    s->name = name;
+    s->arg = arg;
+    return slotCount++;
+}
+
+void profilerRecord(uint8_t slot, uint32_t cycles)
+{
+    if (slot >= slotCount)
+    {
+        return;
+    }
+    profilerSlot_t *s = &slots[slot];
+
+    uint8_t bucket = 0;
+    uint32_t v = cycles >> PROFILER_BUCKET_SHIFT;
+    while (v && bucket < PROFILER_BUCKET_COUNT - 1)
+    {
+        v >>= 1;
+        bucket++;
+    }
+    s->buckets[bucket]++;
+
+    if (cycles > s->max)
+    {
+        s->max = cycles;
+        s->maxAtMs = millis();
+    }
+    s->total += cycles;
+    s->count++;
+}
+
+const profilerSlot_t *profilerGet(uint8_t slot)
+{
+    return slot < slotCount ? &slots[slot] : nullptr;
+}
+
+uint8_t profilerCount()
+{
+    return slotCount;
+}
+
+void profilerReset()
+{
+    // The slots stay allocated, the static slot numbers in PROFILE_SCOPE refer to them
+    for (uint8_t i = 0 ; i < slotCount ; i++)
+    {
+        profilerSlot_t *s = &slots[i];
+        s->count = 0;
+        s->total = 0;
+        s->max = 0;
+        s->maxAtMs = 0;
+        memset(s->buckets, 0, sizeof(s->buckets));
+    }
+}
+
+void profilerDump(Print &out)
+{
+    uint32_t mhz = ESP.getCpuFreqMHz();
+    out.printf("# %uMHz, buckets from %u cycles doubling\n", mhz, 1U << PROFILER_BUCKET_SHIFT);
+    out.println("# name arg count avg_us max_us max_at_ms buckets...");
+    for (uint8_t i = 0 ; i < slotCount ; i++)
+    {
+        const profilerSlot_t *s = &slots[i];
+        uint32_t avg = s->count ? (uint32_t)(s->total / s->count) : 0;
+        out.printf("%s %u %u %u %u %u", s->name, s->arg, s->count, avg / mhz, s->max / mhz, s->maxAtMs);
+        for (uint8_t b = 0 ; b < PROFILER_BUCKET_COUNT ; b++)
+        {
+            out.printf(" %u", s->buckets[b]);
+        }
+        out.println();
+    }
+}
+
+void profilerLoopEnd()
+{
+    static const uint8_t slot = profilerSlot("loop", 0);
+    if (loopStart != 0)
+    {
+        profilerRecord(slot, ESP.getCycleCount() - loopStart);
+    }
+}
+
+void profilerLoopStart()
+{
+    loopStart = ESP.getCycleCount();
+}
+
+void profilerUpdate(uint32_t now)
+{
+#if defined(PROFILER_DUMP_INTERVAL_MS)
+    if (now - lastDump >= PROFILER_DUMP_INTERVAL_MS)
+    {
+        lastDump = now;
+        profilerDump(LOGGING_UART);
+    }
+#endif
+}
+
+#endif
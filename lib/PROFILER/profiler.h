@@ -0,0 +1,80 @@
+#pragma once
+
+#include <Arduino.h>
+
+/**
+ * Optional loop-time profiler, built in with -DLOOP_PROFILER
+ *
+ * Each profiled section is a slot named by a string literal and a number,
+ * e.g. the device index or the MSP function, with a log2 histogram of the CPU
+ * cycles it took and the worst case seen. The "loop" slot is a whole busy pass,
+ * from devicesIdle() returning until it is entered again. Without the define
+ * the macros expand to nothing and none of it is compiled in.
+ */
+
+#define PROFILER_SLOTS          64
+// Bucket 0 holds passes below 256 cycles, bucket n holds [2^(n+7), 2^(n+8))
+// cycles and the last bucket everything from ~2^27 (~0.5s at 240MHz) up
+#define PROFILER_BUCKET_COUNT   20
+#define PROFILER_BUCKET_SHIFT   8
+#define PROFILER_NO_SLOT        0xFF
+
+typedef struct {
+    const char *name;
+    uint16_t arg;
+    uint32_t count;
+    uint64_t total;
+    uint32_t max;
+    uint32_t maxAtMs;       // millis() when the worst case happened
+    uint32_t buckets[PROFILER_BUCKET_COUNT];
+} profilerSlot_t;
+
+#if defined(LOOP_PROFILER)
+
+// The slot for name and arg, allocated on first use. PROFILER_NO_SLOT once all are taken
+uint8_t profilerSlot(const char *name, uint16_t arg);
+void profilerRecord(uint8_t slot, uint32_t cycles);
+const profilerSlot_t *profilerGet(uint8_t slot);
+uint8_t profilerCount();
+void profilerReset();
+// One line per slot: name, arg, count, average, worst and the histogram, times in us
+void profilerDump(Print &out);
+// The busy part of a loop() pass ends, and a new one starts, around devicesIdle()
+void profilerLoopEnd();
+void profilerLoopStart();
+// Dump to LOGGING_UART every PROFILER_DUMP_INTERVAL_MS, if that is defined
+void profilerUpdate(uint32_t now);
+
+class ProfileScope
+{
+public:
+    ProfileScope(uint8_t slot) : m_slot(slot), m_start(ESP.getCycleCount()) {}
+    ~ProfileScope() { profilerRecord(m_slot, ESP.getCycleCount() - m_start); }
+
+private:
+    uint8_t m_slot;
+    uint32_t m_start;
+};
+
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+// Time the rest of the enclosing block
+#define PROFILE_SCOPE(name) \
+    static const uint8_t PROFILE_CONCAT(_profileSlot, __LINE__) = profilerSlot(name, 0); \
+    ProfileScope PROFILE_CONCAT(_profile, __LINE__)(PROFILE_CONCAT(_profileSlot, __LINE__))
+// As PROFILE_SCOPE, with a slot per value of arg
+#define PROFILE_SCOPE_ARG(name, arg) \
+    ProfileScope PROFILE_CONCAT(_profile, __LINE__)(profilerSlot(name, arg))
+// Time a single statement
+#define PROFILE_CALL(name, ...) do { PROFILE_SCOPE(name); __VA_ARGS__; } while (0)
+
+#else
+
+#define PROFILE_SCOPE(name)
+#define PROFILE_SCOPE_ARG(name, arg)
+#define PROFILE_CALL(name, ...) do { __VA_ARGS__; } while (0)
+inline void profilerLoopEnd() {}
+inline void profilerLoopStart() {}
+inline void profilerUpdate(uint32_t now) {}
+
+#endif
@@ -0,0 +1,90 @@
+#include <Arduino.h>
+
+#include "recorder.h"
+
+#ifndef TRACE_RECORDER_SIZE
+#if defined(PLATFORM_ESP32)
+#define TRACE_RECORDER_SIZE 1024
+#else
+#define TRACE_RECORDER_SIZE 256
+#endif
+#endif
+
+#define TRACE_MAGIC     0x54524C45  // "ELRT"
+#define TRACE_VERSION   1
+
+typedef struct __attribute__((packed)) {
+    uint32_t magic;
+    uint8_t version;
+    uint8_t recordSize;
+    uint16_t count;
+    uint32_t micros;    // time of the download, to relate records to now
+} traceHeader_t;
+
+static traceRecord_t records[TRACE_RECORDER_SIZE];
+static uint16_t head = 0;
+static uint16_t count = 0;
+#if defined(PLATFORM_ESP32)
+static portMUX_TYPE mux = portMUX_INITIALIZER_UNLOCKED;
+#endif
+
+// Snapshot of the header taken when a download starts
+static traceHeader_t downloadHeader;
+static uint16_t downloadFirst;
+
+void ICACHE_RAM_ATTR traceEvent(traceEvent_e type, uint8_t arg, uint16_t a, uint32_t b)
+{
+    uint32_t now = micros();
+#if defined(PLATFORM_ESP32)
+    portENTER_CRITICAL(&mux);
+#else
+    noInterrupts();
+#endif
+    traceRecord_t *r = &records[head];
+    head = (head + 1) % TRACE_RECORDER_SIZE;
+    if (count < TRACE_RECORDER_SIZE)
+        count++;
+#if defined(PLATFORM_ESP32)
+    portEXIT_CRITICAL(&mux);
+#else
+    interrupts();
+#endif
+    r->micros = now;
+    r->type = type;
+    r->arg = arg;
+    r->a = a;
+    r->b = b;
+}
+
+size_t traceDownloadSize()
+{
+    downloadHeader.magic = TRACE_MAGIC;
+    downloadHeader.version = TRACE_VERSION;
+    downloadHeader.recordSize = sizeof(traceRecord_t);
+    downloadHeader.count = count;
+    downloadHeader.micros = micros();
+    downloadFirst = (head + TRACE_RECORDER_SIZE - count) % TRACE_RECORDER_SIZE;
+    return sizeof(traceHeader_t) + count * sizeof(traceRecord_t);
+}
+
+size_t traceDownloadRead(uint8_t *buffer, size_t len, size_t index)
+{
+    size_t total = sizeof(traceHeader_t) + downloadHeader.count * sizeof(traceRecord_t);
+    size_t copied = 0;
+    while (copied < len && index < total)
+    {
+        if (index < sizeof(traceHeader_t))
+        {
+            buffer[copied++] = ((uint8_t *)&downloadHeader)[index++];
+            continue;
+        }
+        size_t offset = index - sizeof(traceHeader_t);
+        size_t record = (downloadFirst + offset / sizeof(traceRecord_t)) % TRACE_RECORDER_SIZE;
+        size_t within = offset % sizeof(traceRecord_t);
+        size_t n = min(len - copied, sizeof(traceRecord_t) - within);
+        memcpy(&buffer[copied], ((uint8_t *)&records[record]) + within, n);
+        copied += n;
+        index += n;
+    }
+    return copied;
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * In-RAM flight recorder, a fixed size circular buffer of compact binary events
+ * stamped with micros(). Downloaded from /recorder.bin and decoded by
+ * python/recorder_decode.py
+ */
+
+typedef enum : uint8_t {
+    TRACE_MSP_IN,           // a = function, b = payload size, arg = source
+    TRACE_MSP_OUT,          // a = function, b = payload size, arg = destination
+    TRACE_ESPNOW_STATUS,    // arg = esp_now send status (0 = success)
+    TRACE_CONNECTION_STATE, // arg = new connectionState, a = previous connectionState
+    TRACE_GPS_FIX,          // arg = satellites, a = azimuth, b = distance in m
+    TRACE_SERVO_TARGET,     // a = azimuth servo us, b = elevation servo us
+} traceEvent_e;
+
+// Where an MSP packet came from or went to
+#define TRACE_PORT_UART     0
+#define TRACE_PORT_ESPNOW   1
+
+typedef struct __attribute__((packed)) {
+    uint32_t micros;
+    uint8_t type;
+    uint8_t arg;
+    uint16_t a;
+    uint32_t b;
+} traceRecord_t;
+
+void traceEvent(traceEvent_e type, uint8_t arg, uint16_t a = 0, uint32_t b = 0);
+
+// Size in bytes of the download, a header followed by the records oldest first
+size_t traceDownloadSize();
+// Copy up to len bytes of the download starting at index, returns the number of bytes copied
+size_t traceDownloadRead(uint8_t *buffer, size_t len, size_t index);
@@ -0,0 +1,181 @@
+#include "spi_engine.h"
+
+SpiEngine::SpiEngine(uint8_t mosi, uint8_t clk, uint8_t cs, int8_t cs2, uint32_t bitFreq) :
+    _mosi(mosi), _clk(clk), _cs(cs), _cs2(cs2), _halfPeriodUs(500000 / bitFreq),
+    _idleMosi(LOW), _releasePins(false), _head(0), _count(0),
+    _step(STEP_IDLE), _bit(0), _stepStartUs(0), _stepWaitUs(0)
+{
+}
+
+bool SpiEngine::push(const Op &op)
+{
+    if (_count == SPI_ENGINE_QUEUE_SIZE)
+        return false;
+    _queue[(_head + _count) % SPI_ENGINE_QUEUE_SIZE] = op;
+    ++_count;
+    return true;
+}
+
+bool SpiEngine::queueWrite(uint64_t data, uint8_t bits, bool msbFirst, uint32_t csSetupUs, uint32_t csHoldUs)
+{
+    Op op = { OP_WRITE, (uint8_t)min(bits, (uint8_t)64), msbFirst, data, csSetupUs, csHoldUs };
+    return push(op);
+}
+
+bool SpiEngine::queueClockLevel(uint8_t level, uint32_t waitUs)
+{
+    Op op = { OP_CLOCK_LEVEL, 0, false, level, 0, waitUs };
+    return push(op);
+}
+
+bool SpiEngine::queueDelay(uint32_t waitUs)
+{
+    Op op = { OP_DELAY, 0, false, 0, 0, waitUs };
+    return push(op);
+}
+
+void SpiEngine::cancelPending()
+{
+    // Keep the op in progress, it has to finish to leave CS high
+    _count = (_step == STEP_IDLE) ? 0 : min(_count, (uint8_t)1);
+}
+
+void SpiEngine::setCs(uint8_t level)
+{
+    digitalWrite(_cs, level);
+    if (_cs2 >= 0)
+        digitalWrite(_cs2, level);
+}
+
+void SpiEngine::drivePins()
+{
+    pinMode(_mosi, OUTPUT);
+    pinMode(_clk, OUTPUT);
+    pinMode(_cs, OUTPUT);
+    if (_cs2 >= 0)
+        pinMode(_cs2, OUTPUT);
+}
+
+void SpiEngine::floatPins()
+{
+    pinMode(_mosi, INPUT);
+    pinMode(_clk, INPUT);
+    pinMode(_cs, INPUT);
+    if (_cs2 >= 0)
+        pinMode(_cs2, INPUT);
+}
+
+void SpiEngine::wait(uint32_t us)
+{
+    _stepStartUs = micros();
+    _stepWaitUs = us;
+}
+
+/***
+ * @brief: Run the current step if its wait is over
+ * @return: true if a step ran, false if still waiting or idle
+ */
+bool SpiEngine::step()
+{
+    if (_step != STEP_IDLE && micros() - _stepStartUs < _stepWaitUs)
+        return false;
+
+    Op &op = _queue[_head];
+    switch (_step)
+    {
+    case STEP_IDLE:
+        if (_count == 0)
+            return false;
+        if (op.type != OP_WRITE)
+        {
+            if (op.type == OP_CLOCK_LEVEL)
+            {
+                pinMode(_clk, OUTPUT);
+                digitalWrite(_clk, (uint8_t)op.data);
+            }
+            _step = STEP_HOLD;
+            wait(op.csHoldUs);
+            break;
+        }
+        if (_releasePins)
+            drivePins();
+        digitalWrite(_mosi, _idleMosi);
+        digitalWrite(_clk, LOW);
+        setCs(HIGH);
+        _step = STEP_CS_LOW;
+        wait(_halfPeriodUs * 2);
+        break;
+
+    case STEP_CS_LOW:
+        setCs(LOW);
+        _bit = 0;
+        _step = STEP_BIT_LOW;
+        wait(op.csSetupUs);
+        break;
+
+    case STEP_BIT_LOW:
+        if (_bit == op.bits)
+        {
+            digitalWrite(_clk, LOW);
+            _step = STEP_CS_HIGH;
+            wait(_halfPeriodUs * 2);
+            break;
+        }
+        digitalWrite(_clk, LOW);
+        digitalWrite(_mosi, (op.data >> (op.msbFirst ? op.bits - 1 - _bit : _bit)) & 1);
+        _step = STEP_BIT_HIGH;
+        wait(_halfPeriodUs);
+        break;
+
+    case STEP_BIT_HIGH:
+        digitalWrite(_clk, HIGH);
+        ++_bit;
+        _step = STEP_BIT_LOW;
+        wait(_halfPeriodUs);
+        break;
+
+    case STEP_CS_HIGH:
+        digitalWrite(_mosi, _idleMosi);
+        setCs(HIGH);
+        _step = STEP_HOLD;
+        wait(op.csHoldUs);
+        break;
+
+    case STEP_HOLD:
+        if (op.type == OP_WRITE && _releasePins)
+            floatPins();
+        _head = (_head + 1) % SPI_ENGINE_QUEUE_SIZE;
+        --_count;
+        _step = STEP_IDLE;
+        break;
+    }
+    return true;
+}
+
+void SpiEngine::update()
+{
+    while (true)
+    {
+        if (step())
+            continue;
+        if (_step == STEP_IDLE)
+            return;
+        // Spin through short waits, leave long ones to the next loop()
+        uint32_t elapsed = micros() - _stepStartUs;
+        if (elapsed < _stepWaitUs)
+        {
+            if (_stepWaitUs - elapsed > SPI_ENGINE_SPIN_US)
+                return;
+            delayMicroseconds(_stepWaitUs - elapsed);
+        }
+    }
+}
+
+void SpiEngine::flush()
+{
+    while (busy())
+    {
+        update();
+        yield();
+    }
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <Arduino.h>
+
+#define SPI_ENGINE_QUEUE_SIZE 8
+
+/**
+ * @brief: Queue of bit-banged SPI writes clocked out from loop()
+ *
+ * Callers queue frames and return immediately; update() walks each frame as a
+ * state machine with a deadline per step, so chip select hold times of tens of
+ * milliseconds cost the loop nothing. Steps due within SPI_ENGINE_SPIN_US are
+ * waited out inline, so a fast clock still goes out as one burst rather than
+ * one bit per loop() pass. Bits are clocked SPI mode 0: data is set with the
+ * clock low and sampled on the rising edge.
+ */
+class SpiEngine
+{
+public:
+    SpiEngine(uint8_t mosi, uint8_t clk, uint8_t cs, int8_t cs2, uint32_t bitFreq);
+
+    // Queue a frame of up to 64 bits, returns false if the queue is full
+    //   csSetupUs: CS low to the first clock edge
+    //   csHoldUs: after CS goes high, before anything else is sent
+    bool queueWrite(uint64_t data, uint8_t bits, bool msbFirst, uint32_t csSetupUs, uint32_t csHoldUs);
+    // Queue setting the clock line to level for waitUs, for devices that use it as a mode strobe
+    bool queueClockLevel(uint8_t level, uint32_t waitUs);
+    // Queue a gap between frames
+    bool queueDelay(uint32_t waitUs);
+    // Drop everything queued that has not started, the frame in progress is finished
+    void cancelPending();
+
+    // Advance the frame in progress, call from loop()
+    void update();
+    // Block until everything queued has been sent
+    void flush();
+    bool busy() const { return _count != 0; }
+
+    // Level MOSI is left at between frames
+    void setIdleMosi(uint8_t level) { _idleMosi = level; }
+    // Float the pins between frames, and drive them only while sending
+    void setReleasePins(bool release) { _releasePins = release; }
+
+private:
+    enum OpType { OP_WRITE, OP_CLOCK_LEVEL, OP_DELAY };
+    enum Step { STEP_IDLE, STEP_CS_LOW, STEP_BIT_LOW, STEP_BIT_HIGH, STEP_CS_HIGH, STEP_HOLD };
+
+    struct Op
+    {
+        OpType type;
+        uint8_t bits;
+        bool msbFirst;
+        uint64_t data;
+        uint32_t csSetupUs;
+        uint32_t csHoldUs;
+    };
+
+    static const uint32_t SPI_ENGINE_SPIN_US = 100;
+
+    const uint8_t _mosi;
+    const uint8_t _clk;
+    const uint8_t _cs;
+    const int8_t _cs2;
+    const uint32_t _halfPeriodUs;
+    uint8_t _idleMosi;
+    bool _releasePins;
+
+    Op _queue[SPI_ENGINE_QUEUE_SIZE];
+    uint8_t _head;
+    uint8_t _count;
+
+    Step _step;
+    uint8_t _bit;
+    uint32_t _stepStartUs;
+    uint32_t _stepWaitUs;
+
+    bool push(const Op &op);
+    void setCs(uint8_t level);
+    void drivePins();
+    void floatPins();
+    void wait(uint32_t us);
+    bool step();
+};
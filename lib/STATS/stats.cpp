@@ -0,0 +1,554 @@
+#include <Arduino.h>
+
+#include "stats.h"
+#include "SPSCRing.h"
+
+static latencyHistogram_t histograms[LATENCY_PROBE_COUNT];
+
+static const char *probeNames[LATENCY_PROBE_COUNT] = {
+    "msp_to_espnow",
+    "espnow_send",
+    "espnow_to_vrx",
+    "ptr",
+};
+
+static uint32_t bootTimes[BOOT_PHASE_COUNT];
+
+static const char *bootNames[BOOT_PHASE_COUNT] = {
+    "setup",
+    "eeprom",
+    "options",
+    "wifi",
+    "espnow",
+    "first_packet",
+};
+
+void ICACHE_RAM_ATTR latencyRecord(latencyProbe_e probe, uint32_t us)
+{
+    if (probe >= LATENCY_PROBE_COUNT)
+    {
+        return;
+    }
+    latencyHistogram_t *h = &histograms[probe];
+
+    uint8_t bucket = 0;
+    uint32_t v = us >> LATENCY_BUCKET_SHIFT;
+    while (v && bucket < LATENCY_BUCKET_COUNT - 1)
+    {
+        v >>= 1;
+        bucket++;
+    }
+    h->buckets[bucket]++;
+
+    if (h->count == 0 || us < h->min)
+        h->min = us;
+    if (us > h->max)
+        h->max = us;
+    h->total += us;
+    h->count++;
+}
+
+const latencyHistogram_t *latencyGet(latencyProbe_e probe)
+{
+    return &histograms[probe];
+}
+
+const char *latencyName(latencyProbe_e probe)
+{
+    return probeNames[probe];
+}
+
+uint32_t latencyBucketStart(uint8_t bucket)
+{
+    return bucket == 0 ? 0 : 1UL << (bucket + LATENCY_BUCKET_SHIFT - 1);
+}
+
+void latencyReset()
+{
+    memset(histograms, 0, sizeof(histograms));
+}
+
+static uint8_t put32(uint8_t *buffer, uint32_t value)
+{
+    buffer[0] = value;
+    buffer[1] = value >> 8;
+    buffer[2] = value >> 16;
+    buffer[3] = value >> 24;
+    return 4;
+}
+
+uint8_t latencySerialize(latencyProbe_e probe, uint8_t *buffer)
+{
+    // probe, count, min, max, then each bucket as a saturated uint16
+    const latencyHistogram_t *h = &histograms[probe];
+    uint8_t pos = 0;
+    buffer[pos++] = probe;
+    pos += put32(&buffer[pos], h->count);
+    pos += put32(&buffer[pos], h->min);
+    pos += put32(&buffer[pos], h->max);
+    for (uint8_t i = 0 ; i < LATENCY_BUCKET_COUNT ; i++)
+    {
+        uint16_t count = h->buckets[i] > 0xFFFF ? 0xFFFF : h->buckets[i];
+        buffer[pos++] = count;
+        buffer[pos++] = count >> 8;
+    }
+    return pos;
+}
+
+void bootMark(bootPhase_e phase)
+{
+    if (bootTimes[phase] == 0)
+    {
+        // micros() is never 0 by the time setup() runs
+        bootTimes[phase] = micros();
+    }
+}
+
+uint32_t bootGet(bootPhase_e phase)
+{
+    return bootTimes[phase];
+}
+
+const char *bootName(bootPhase_e phase)
+{
+    return bootNames[phase];
+}
+
+uint8_t bootSerialize(uint8_t *buffer)
+{
+    // phase count, then micros() for each phase
+    uint8_t pos = 0;
+    buffer[pos++] = BOOT_PHASE_COUNT;
+    for (uint8_t i = 0 ; i < BOOT_PHASE_COUNT ; i++)
+    {
+        pos += put32(&buffer[pos], bootTimes[i]);
+    }
+    return pos;
+}
+
+static powerMode_e powerMode = POWER_MODE_FULL;
+static uint32_t powerModeSince = 0;
+static uint32_t powerModeMs[POWER_MODE_COUNT];
+static uint32_t powerModeCount[POWER_MODE_COUNT] = { 1, 0 };
+
+static const uint16_t powerModeMa[POWER_MODE_COUNT] = {
+    POWER_FULL_MA,
+    POWER_SAVE_MA,
+};
+
+static const char *powerModeNames[POWER_MODE_COUNT] = {
+    "full",
+    "save",
+};
+
+void powerModeEnter(powerMode_e mode)
+{
+    if (mode == powerMode)
+    {
+        return;
+    }
+    uint32_t now = millis();
+    powerModeMs[powerMode] += now - powerModeSince;
+    powerModeSince = now;
+    powerMode = mode;
+    powerModeCount[mode]++;
+}
+
+powerMode_e powerModeGet()
+{
+    return powerMode;
+}
+
+uint32_t powerModeTime(powerMode_e mode)
+{
+    uint32_t ms = powerModeMs[mode];
+    if (mode == powerMode)
+    {
+        ms += millis() - powerModeSince;
+    }
+    return ms;
+}
+
+uint32_t powerModeEntries(powerMode_e mode)
+{
+    return powerModeCount[mode];
+}
+
+uint16_t powerModeCurrent(powerMode_e mode)
+{
+    return powerModeMa[mode];
+}
+
+const char *powerModeName(powerMode_e mode)
+{
+    return powerModeNames[mode];
+}
+
+static linkPeerStats_t linkPeers[LINK_STATS_PEERS];
+
+static linkPeerStats_t *linkStatsPeer(const uint8_t *mac)
+{
+    linkPeerStats_t *oldest = nullptr;
+    for (uint8_t i = 0 ; i < LINK_STATS_PEERS ; i++)
+    {
+        linkPeerStats_t *p = &linkPeers[i];
+        if (p->used && memcmp(p->mac, mac, 6) == 0)
+        {
+            return p;
+        }
+        if (oldest == nullptr || !p->used || (oldest->used && p->lastSeenMs < oldest->lastSeenMs))
+        {
+            oldest = p;
+        }
+    }
+    memset(oldest, 0, sizeof(*oldest));
+    memcpy(oldest->mac, mac, 6);
+    oldest->used = true;
+    return oldest;
+}
+
+typedef enum {
+    LINK_EVENT_SENT_OK,
+    LINK_EVENT_SENT_FAILED,
+    LINK_EVENT_RECEIVED,
+} linkEventType_e;
+
+typedef struct {
+    uint8_t mac[6];
+    uint8_t type;
+    int8_t rssi;        // 0 if none was seen for the frame
+    uint32_t us;
+    uint32_t ms;
+} linkEvent_t;
+
+// The callbacks run in the WiFi task, only the ring is shared with loop()
+static SPSCRing<LINK_STATS_EVENT_RING_SIZE> linkEvents;
+
+static void ICACHE_RAM_ATTR linkStatsQueue(const uint8_t *mac, linkEventType_e type, int8_t rssi)
+{
+    linkEvent_t event;
+    memcpy(event.mac, mac, 6);
+    event.type = type;
+    event.rssi = rssi;
+    event.us = micros();
+    event.ms = millis();
+    linkEvents.push((const uint8_t *)&event, sizeof(event));
+}
+
+void ICACHE_RAM_ATTR linkStatsSent(const uint8_t *mac, bool delivered)
+{
+    linkStatsQueue(mac, delivered ? LINK_EVENT_SENT_OK : LINK_EVENT_SENT_FAILED, 0);
+}
+
+// The RSSI of the frame the receive callback is about to be given. Frames
+// for other devices show up too, so nothing is recorded until it is
+static uint8_t rssiMac[6];
+static int8_t rssiPending = 0;
+
+void ICACHE_RAM_ATTR linkStatsReceived(const uint8_t *mac)
+{
+    int8_t rssi = rssiPending != 0 && memcmp(rssiMac, mac, 6) == 0 ? rssiPending : 0;
+    rssiPending = 0;
+    linkStatsQueue(mac, LINK_EVENT_RECEIVED, rssi);
+}
+
+void ICACHE_RAM_ATTR linkStatsRssi(const uint8_t *mac, int8_t rssi)
+{
+    memcpy(rssiMac, mac, 6);
+    rssiPending = rssi;
+}
+
+static void linkStatsApply(const linkEvent_t &event)
+{
+    linkPeerStats_t *p = linkStatsPeer(event.mac);
+    p->lastSeenMs = event.ms;
+    if (event.type == LINK_EVENT_SENT_OK)
+    {
+        p->sentOk++;
+        return;
+    }
+    if (event.type == LINK_EVENT_SENT_FAILED)
+    {
+        p->sentFailed++;
+        return;
+    }
+
+    if (p->received != 0)
+    {
+        uint32_t interval = event.us - p->lastRxUs;
+        if (p->received > 1)
+        {
+            // Like the RTP jitter estimate, with the change in spacing for the transit time difference
+            uint32_t change = interval > p->intervalUs ? interval - p->intervalUs : p->intervalUs - interval;
+            p->jitterUs += ((int32_t)change - (int32_t)p->jitterUs) / 16;
+        }
+        p->intervalUs = interval;
+    }
+    p->lastRxUs = event.us;
+    p->received++;
+
+    if (event.rssi != 0)
+    {
+        p->rssiAvg = p->rssi == 0 ? event.rssi * 16 : p->rssiAvg + (event.rssi * 16 - p->rssiAvg) / 16;
+        p->rssi = event.rssi;
+    }
+}
+
+void linkStatsUpdate()
+{
+    linkEvent_t event;
+    while (linkEvents.pop((uint8_t *)&event, sizeof(event)) == sizeof(event))
+    {
+        linkStatsApply(event);
+    }
+}
+
+const linkPeerStats_t *linkStatsGet(uint8_t index)
+{
+    for (uint8_t i = 0 ; i < LINK_STATS_PEERS ; i++)
+    {
+        if (linkPeers[i].used && index-- == 0)
+        {
+            return &linkPeers[i];
+        }
+    }
+    return nullptr;
+}
+
+uint8_t linkStatsCount()
+{
+    uint8_t count = 0;
+    for (uint8_t i = 0 ; i < LINK_STATS_PEERS ; i++)
+    {
+        count += linkPeers[i].used;
+    }
+    return count;
+}
+
+void linkStatsReset()
+{
+    memset(linkPeers, 0, sizeof(linkPeers));
+}
+
+uint8_t linkStatsSerialize(uint8_t index, uint8_t *buffer)
+{
+    // index, peer count, then if there is such a peer: mac, sent ok, sent failed,
+    // received, rssi, average rssi, interval, jitter and ms since last seen
+    uint8_t pos = 0;
+    buffer[pos++] = index;
+    buffer[pos++] = linkStatsCount();
+    const linkPeerStats_t *p = linkStatsGet(index);
+    if (p == nullptr)
+    {
+        return pos;
+    }
+    memcpy(&buffer[pos], p->mac, 6);
+    pos += 6;
+    pos += put32(&buffer[pos], p->sentOk);
+    pos += put32(&buffer[pos], p->sentFailed);
+    pos += put32(&buffer[pos], p->received);
+    buffer[pos++] = p->rssi;
+    buffer[pos++] = p->rssiAvg / 16;
+    pos += put32(&buffer[pos], p->intervalUs);
+    pos += put32(&buffer[pos], p->jitterUs);
+    pos += put32(&buffer[pos], millis() - p->lastSeenMs);
+    return pos;
+}
+
+static memorySample_t memorySamples[MEMORY_HISTORY_SAMPLES];
+static uint8_t memorySampleCount = 0;
+static uint8_t memorySampleNext = 0;
+static uint32_t memoryLastSample = 0;
+static uint32_t memoryMinFreeHeap = UINT32_MAX;
+static uint32_t memoryMinLargest = UINT32_MAX;
+
+#if defined(PLATFORM_ESP32)
+// The Arduino loop, the async web server, lwIP and the WiFi driver
+static const char *memoryStackNames[MEMORY_STACK_COUNT] = {
+    "loopTask",
+    "async_tcp",
+    "tiT",
+    "wifi",
+};
+#else
+// Everything but the SDK runs on the one continuation stack
+static const char *memoryStackNames[MEMORY_STACK_COUNT] = {
+    "cont",
+};
+#endif
+static uint32_t memoryStackFree[MEMORY_STACK_COUNT];
+static bool memoryStackFound[MEMORY_STACK_COUNT];
+
+static occupancy_t occupancy[OCCUPANCY_PROBE_COUNT];
+
+static const char *occupancyNames[OCCUPANCY_PROBE_COUNT] = {
+    "espnow_rx",
+    "uart_ingest",
+    "timer_tx",
+    "timer_rx",
+    "uart_tx",
+    "web_config_json",
+    "web_stats_json",
+    "options_json",
+};
+
+static void memorySampleStacks()
+{
+#if defined(PLATFORM_ESP32)
+    for (uint8_t i = 0 ; i < MEMORY_STACK_COUNT ; i++)
+    {
+        TaskHandle_t task = xTaskGetHandle(memoryStackNames[i]);
+        if (task != nullptr)
+        {
+            // ESP-IDF counts the high-water mark in bytes, not words
+            memoryStackFree[i] = uxTaskGetStackHighWaterMark(task);
+            memoryStackFound[i] = true;
+        }
+    }
+#else
+    memoryStackFree[0] = ESP.getFreeContStack();
+    memoryStackFound[0] = true;
+#endif
+}
+
+void memoryUpdate(uint32_t now)
+{
+    if (memorySampleCount != 0 && now - memoryLastSample < MEMORY_SAMPLE_INTERVAL_MS)
+    {
+        return;
+    }
+    memoryLastSample = now;
+
+    memorySample_t *s = &memorySamples[memorySampleNext];
+    s->timeMs = now;
+    s->freeHeap = ESP.getFreeHeap();
+#if defined(PLATFORM_ESP32)
+    s->largestBlock = ESP.getMaxAllocHeap();
+    // Kept by the allocator, so it includes the dips between samples
+    memoryMinFreeHeap = ESP.getMinFreeHeap();
+#else
+    s->largestBlock = ESP.getMaxFreeBlockSize();
+    memoryMinFreeHeap = min(memoryMinFreeHeap, s->freeHeap);
+#endif
+    memoryMinLargest = min(memoryMinLargest, s->largestBlock);
+    memorySampleNext = (memorySampleNext + 1) % MEMORY_HISTORY_SAMPLES;
+    if (memorySampleCount < MEMORY_HISTORY_SAMPLES)
+    {
+        memorySampleCount++;
+    }
+
+    memorySampleStacks();
+}
+
+const memorySample_t *memoryHistory(uint8_t index)
+{
+    if (index >= memorySampleCount)
+    {
+        return nullptr;
+    }
+    return &memorySamples[(memorySampleNext + MEMORY_HISTORY_SAMPLES - 1 - index) % MEMORY_HISTORY_SAMPLES];
+}
+
+uint32_t memoryMinFree()
+{
+    return memoryMinFreeHeap;
+}
+
+uint32_t memoryMinLargestBlock()
+{
+    return memoryMinLargest;
+}
+
+bool memoryStack(uint8_t index, const char **name, uint32_t *freeBytes)
+{
+    for (uint8_t i = 0 ; i < MEMORY_STACK_COUNT ; i++)
+    {
+        if (memoryStackFound[i] && index-- == 0)
+        {
+            *name = memoryStackNames[i];
+            *freeBytes = memoryStackFree[i];
+            return true;
+        }
+    }
+    return false;
+}
+
+uint8_t memoryStackCount()
+{
+    uint8_t count = 0;
+    for (uint8_t i = 0 ; i < MEMORY_STACK_COUNT ; i++)
+    {
+        count += memoryStackFound[i];
+    }
+    return count;
+}
+
+void ICACHE_RAM_ATTR occupancyRecord(occupancyProbe_e probe, uint32_t used, uint32_t capacity)
+{
+    occupancy_t *o = &occupancy[probe];
+    o->capacity = capacity;
+    if (used > o->peak)
+    {
+        o->peak = used;
+    }
+}
+
+void ICACHE_RAM_ATTR occupancyOverflow(occupancyProbe_e probe)
+{
+    occupancy[probe].overflows++;
+}
+
+const occupancy_t *occupancyGet(occupancyProbe_e probe)
+{
+    return &occupancy[probe];
+}
+
+const char *occupancyName(occupancyProbe_e probe)
+{
+    return occupancyNames[probe];
+}
+
+uint8_t memorySerialize(uint8_t report, uint8_t *buffer)
+{
+    uint8_t pos = 0;
+    buffer[pos++] = report;
+    if (report == MEMORY_REPORT_HEAP)
+    {
+        // free heap, lowest free heap, largest block, lowest largest block, then
+        // the stack count and for each stack found its index in memoryStackNames
+        // and its free bytes at its deepest
+        const memorySample_t *s = memoryHistory(0);
+        pos += put32(&buffer[pos], s ? s->freeHeap : 0);
+        pos += put32(&buffer[pos], memoryMinFreeHeap);
+        pos += put32(&buffer[pos], s ? s->largestBlock : 0);
+        pos += put32(&buffer[pos], memoryMinLargest);
+        buffer[pos++] = memoryStackCount();
+        for (uint8_t i = 0 ; i < MEMORY_STACK_COUNT ; i++)
+        {
+            if (memoryStackFound[i])
+            {
+                buffer[pos++] = i;
+                pos += put32(&buffer[pos], memoryStackFree[i]);
+            }
+        }
+    }
+    else if (report == MEMORY_REPORT_OCCUPANCY)
+    {
+        // probe count, then the peak, capacity and overflows of each as a
+        // saturated uint16, 0 for those this build does not have
+        buffer[pos++] = OCCUPANCY_PROBE_COUNT;
+        for (uint8_t i = 0 ; i < OCCUPANCY_PROBE_COUNT ; i++)
+        {
+            uint16_t peak = occupancy[i].peak > 0xFFFF ? 0xFFFF : occupancy[i].peak;
+            uint16_t capacity = occupancy[i].capacity > 0xFFFF ? 0xFFFF : occupancy[i].capacity;
+            uint16_t overflows = occupancy[i].overflows > 0xFFFF ? 0xFFFF : occupancy[i].overflows;
+            buffer[pos++] = peak;
+            buffer[pos++] = peak >> 8;
+            buffer[pos++] = capacity;
+            buffer[pos++] = capacity >> 8;
+            buffer[pos++] = overflows;
+            buffer[pos++] = overflows >> 8;
+        }
+    }
+    return pos;
+}
@@ -0,0 +1,175 @@
+#pragma once
+
+#include <stdint.h>
+
+// Bucket 0 holds samples below 32us, bucket n holds [2^(n+4), 2^(n+5)) us
+// and the last bucket holds everything from ~0.5s up
+#define LATENCY_BUCKET_COUNT    16
+#define LATENCY_BUCKET_SHIFT    5
+
+typedef enum {
+    LATENCY_MSP_TO_ESPNOW,  // MSP frame complete until esp_now_send issued
+    LATENCY_ESPNOW_SEND,    // esp_now_send issued until the send callback fired
+    LATENCY_ESPNOW_TO_VRX,  // OnDataRecv until the VRX module applied the change
+    LATENCY_PTR,            // head-tracking sample waiting in the PTR mailbox
+    LATENCY_PROBE_COUNT
+} latencyProbe_e;
+
+typedef struct {
+    uint32_t count;
+    uint32_t min;
+    uint32_t max;
+    uint64_t total;
+    uint32_t buckets[LATENCY_BUCKET_COUNT];
+} latencyHistogram_t;
+
+// Add a sample in microseconds. Cheap enough for the radio callbacks,
+// concurrent updates of the same probe may occasionally lose a sample
+void latencyRecord(latencyProbe_e probe, uint32_t us);
+const latencyHistogram_t *latencyGet(latencyProbe_e probe);
+const char *latencyName(latencyProbe_e probe);
+// Lower edge of a bucket in microseconds
+uint32_t latencyBucketStart(uint8_t bucket);
+void latencyReset();
+
+// Pack a probe for an MSP_ELRS_BACKPACK_GET_LATENCY response, returns the length used
+uint8_t latencySerialize(latencyProbe_e probe, uint8_t *buffer);
+
+typedef enum {
+    BOOT_SETUP,         // setup() entered
+    BOOT_EEPROM,        // EEPROM loaded
+    BOOT_OPTIONS,       // firmware options resolved
+    BOOT_WIFI,          // STA interface up with the bound MAC
+    BOOT_ESPNOW,        // ESP-NOW initialised and peers registered
+    BOOT_FIRST_PACKET,  // first MSP packet processed
+    BOOT_PHASE_COUNT
+} bootPhase_e;
+
+// Record micros() the first time a boot phase is reached, later calls are ignored
+void bootMark(bootPhase_e phase);
+// micros() when the phase was reached, 0 if it has not been
+uint32_t bootGet(bootPhase_e phase);
+const char *bootName(bootPhase_e phase);
+
+// Pack the phases for an MSP_ELRS_BACKPACK_GET_BOOT_TIMING response, returns the length used
+uint8_t bootSerialize(uint8_t *buffer);
+
+typedef enum {
+    POWER_MODE_FULL,    // radio always listening, loop() polling
+    POWER_MODE_SAVE,    // radio asleep between wake windows, loop() blocking
+    POWER_MODE_COUNT
+} powerMode_e;
+
+// Current drawn in each mode in mA, set per chip in targets/common.ini.
+// 0 leaves the average out of /stats
+#ifndef POWER_FULL_MA
+#define POWER_FULL_MA   0
+#endif
+#ifndef POWER_SAVE_MA
+#define POWER_SAVE_MA   0
+#endif
+
+// Switch the mode time is counted against, a no-op if it is already the current one
+void powerModeEnter(powerMode_e mode);
+powerMode_e powerModeGet();
+// Milliseconds spent in a mode, including the current stay
+uint32_t powerModeTime(powerMode_e mode);
+uint32_t powerModeEntries(powerMode_e mode);
+uint16_t powerModeCurrent(powerMode_e mode);
+const char *powerModeName(powerMode_e mode);
+
+// ESP-NOW peers link quality is kept for, the least recently seen is replaced
+#define LINK_STATS_PEERS        8
+// Bytes of radio events waiting for linkStatsUpdate(), about 28 events
+#ifndef LINK_STATS_EVENT_RING_SIZE
+#define LINK_STATS_EVENT_RING_SIZE  512
+#endif
+
+typedef struct {
+    uint8_t mac[6];
+    bool used;
+    uint32_t sentOk;        // send callback reported delivered
+    uint32_t sentFailed;    // send callback reported no MAC ACK
+    uint32_t received;
+    int8_t rssi;            // dBm of the last frame, 0 if the platform can not tell
+    int16_t rssiAvg;        // dBm * 16, averaged over the last ~16 frames
+    uint32_t intervalUs;    // last time between two frames
+    uint32_t jitterUs;      // average change between successive intervals
+    uint32_t lastSeenMs;    // millis() of the last frame received or sent to
+    uint32_t lastRxUs;
+} linkPeerStats_t;
+
+// Called from the radio callbacks, mac is the peer. They only queue the event,
+// the peer table is kept by linkStatsUpdate(). linkStatsRssi() is for the
+// promiscuous callback, the RSSI is kept if the next frame received is from mac
+void linkStatsSent(const uint8_t *mac, bool delivered);
+void linkStatsReceived(const uint8_t *mac);
+void linkStatsRssi(const uint8_t *mac, int8_t rssi);
+// Apply the queued radio events to the peer table, call from loop()
+void linkStatsUpdate();
+// The index-th peer in use, nullptr past the last
+const linkPeerStats_t *linkStatsGet(uint8_t index);
+uint8_t linkStatsCount();
+void linkStatsReset();
+
+// Pack a peer for an MSP_ELRS_BACKPACK_GET_LINK_STATS response, returns the length used
+uint8_t linkStatsSerialize(uint8_t index, uint8_t *buffer);
+
+// Free heap is sampled from loop() this often, and the last few samples kept
+#define MEMORY_SAMPLE_INTERVAL_MS   10000
+#define MEMORY_HISTORY_SAMPLES      16
+// Tasks whose stack high-water mark is tracked
+#if defined(PLATFORM_ESP32)
+#define MEMORY_STACK_COUNT          4
+#else
+#define MEMORY_STACK_COUNT          1
+#endif
+
+typedef struct {
+    uint32_t timeMs;
+    uint32_t freeHeap;
+    uint32_t largestBlock;  // largest single allocation that would succeed
+} memorySample_t;
+
+typedef enum {
+    OCCUPANCY_ESPNOW_RX,        // bytes in the ESP-NOW receive ring
+    OCCUPANCY_UART_INGEST,      // bytes in the TX backpack UART ingest queue
+    OCCUPANCY_TIMER_TX,         // bytes in the Timer ESP-NOW send queue
+    OCCUPANCY_TIMER_RX,         // bytes in the Timer ESP-NOW receive queue
+    OCCUPANCY_UART_TX,          // bytes in the Timer UART transmit ring
+    OCCUPANCY_WEB_CONFIG_JSON,  // bytes used of the /config JSON document
+    OCCUPANCY_WEB_STATS_JSON,   // bytes used of the /stats JSON document
+    OCCUPANCY_OPTIONS_JSON,     // bytes used of the firmware options JSON documents
+    OCCUPANCY_PROBE_COUNT
+} occupancyProbe_e;
+
+typedef struct {
+    uint32_t capacity;
+    uint32_t peak;
+    uint32_t overflows;     // writes dropped because it was full
+} occupancy_t;
+
+// Take a heap and stack sample if one is due, call from loop()
+void memoryUpdate(uint32_t now);
+// The index-th most recent sample, nullptr past the oldest
+const memorySample_t *memoryHistory(uint8_t index);
+uint32_t memoryMinFree();
+uint32_t memoryMinLargestBlock();
+// Name and free bytes at the deepest point of the index-th task's stack, false past the last
+bool memoryStack(uint8_t index, const char **name, uint32_t *freeBytes);
+uint8_t memoryStackCount();
+
+// Note how full a queue, ring or buffer is. Cheap enough for the radio callbacks
+void occupancyRecord(occupancyProbe_e probe, uint32_t used, uint32_t capacity);
+// Count a write that was dropped because it did not fit
+void occupancyOverflow(occupancyProbe_e probe);
+const occupancy_t *occupancyGet(occupancyProbe_e probe);
+const char *occupancyName(occupancyProbe_e probe);
+
+typedef enum {
+    MEMORY_REPORT_HEAP,         // heap and stacks
+    MEMORY_REPORT_OCCUPANCY,    // queue and buffer peaks
+} memoryReport_e;
+
+// Pack a report for an MSP_ELRS_BACKPACK_GET_MEMORY response, returns the length used
+uint8_t memorySerialize(uint8_t report, uint8_t *buffer);
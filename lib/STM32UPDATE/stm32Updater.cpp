@@ -1,12 +1,13 @@
 #include "stm32Updater.h"
 #include "logging.h"
+#include "helpers.h"
 
 //adapted from https://github.com/mengguang/esp8266_stm32_isp
 
-#define BLOCK_SIZE 128
+#define BLOCK_SIZE STM32_BLOCK_SIZE
 
 uint8_t memory_buffer[BLOCK_SIZE];
-uint8_t file_buffer[BLOCK_SIZE];
+static uint8_t bootloader_version = 0;
 
 void reset_stm32_to_isp_mode()
 {
@@ -37,9 +38,9 @@ void reset_stm32_to_app_mode()
 	//pinMode(RESET_PIN, INPUT);
 }
 
-void stm32flasher_hardware_init()
+void stm32flasher_hardware_init(uint32_t baud)
 {
-	Serial.begin(115200, SERIAL_8E1);
+	Serial.begin(baud, SERIAL_8E1);
 	Serial.setTimeout(5000);
 }
 
@@ -47,12 +48,12 @@ uint8_t init_chip();
 uint8_t cmd_generic(uint8_t command);
 uint8_t cmd_get();
 
-uint8_t isp_serial_write(uint8_t *buffer, uint8_t length)
+uint16_t isp_serial_write(uint8_t *buffer, uint16_t length)
 {
 	return Serial.write(buffer, length);
 }
 
-uint8_t isp_serial_read(uint8_t *buffer, uint8_t length)
+uint16_t isp_serial_read(uint8_t *buffer, uint16_t length)
 {
 	uint8_t timeout = 100;
 	// wait until date is available
@@ -204,7 +205,7 @@ void encode_address(uint32_t address, uint8_t *result)
 	result[4] = crc;
 }
 
-uint8_t cmd_read_memory(uint32_t address, uint8_t length)
+uint8_t cmd_read_memory(uint32_t address, uint16_t length)
 {
 	if (cmd_generic(0x11) == 1)
 	{
@@ -225,17 +226,20 @@ uint8_t cmd_read_memory(uint32_t address, uint8_t length)
 		{
 			return 0;
 		}
-		uint8_t nreaded = 0;
+		uint16_t nreaded = 0;
 		while (nreaded < length)
 		{
-			nreaded += isp_serial_read(memory_buffer + nreaded, length - nreaded);
+			uint16_t nread = isp_serial_read(memory_buffer + nreaded, length - nreaded);
+			if (nread == 0)
+				return 0;
+			nreaded += nread;
 		}
 		return 1;
 	}
 	return 0;
 }
 
-uint8_t cmd_write_memory(uint32_t address, uint8_t length)
+uint8_t cmd_write_memory(uint32_t address, uint16_t length)
 {
 	if (cmd_generic(0x31) == 1)
 	{
@@ -263,6 +267,22 @@ uint8_t cmd_write_memory(uint32_t address, uint8_t length)
 	return 0;
 }
 
+// Erase pages [first, first + pages) with the page list form of Erase (0x43)
+static uint8_t cmd_erase_page_list(uint8_t first, uint8_t pages)
+{
+	uint8_t checksum = 0, page;
+	DBGLN("erasing pages: %u...%u", first, (first + pages));
+	// Send to DFU
+	Serial.write((uint8_t)(pages-1));
+	checksum ^= (pages-1);
+	for (page = first; page < (first + pages); page++) {
+		Serial.write(page);
+		checksum ^= page;
+	}
+	Serial.write(checksum);
+	return wait_for_ack("erase_pages");
+}
+
 // if bootversion < 0x30
 // pg 7 of https://www.st.com/resource/en/application_note/cd00264342-usart-protocol-used-in-the-stm32-bootloader-stmicroelectronics.pdf
 static uint8_t cmd_erase_all_memory(uint32_t const start_addr, uint32_t filesize)
@@ -279,21 +299,11 @@ static uint8_t cmd_erase_all_memory(uint32_t const start_addr, uint32_t filesize
 		return wait_for_ack("mass_erase");
 #else
 		// Erase only defined pages
-		uint8_t checksum = 0, page;
 		uint8_t pages = (FLASH_SIZE / FLASH_PAGE_SIZE);
 		if (filesize)
 			pages = (filesize + (FLASH_PAGE_SIZE - 1)) / FLASH_PAGE_SIZE;
 		uint8_t page_offset = ((start_addr - FLASH_START) / FLASH_PAGE_SIZE);
-		DBGLN("erasing pages: %u...%u", page_offset, (page_offset + pages));
-		// Send to DFU
-		Serial.write((uint8_t)(pages-1));
-		checksum ^= (pages-1);
-		for (page = page_offset; page < (page_offset + pages); page++) {
-			Serial.write(page);
-			checksum ^= page;
-		}
-		Serial.write(checksum);
-		return wait_for_ack("erase_pages");
+		return cmd_erase_page_list(page_offset, pages);
 #endif
 	}
 	return 0;
@@ -337,6 +347,101 @@ uint8_t cmd_go(uint32_t address)
 	return 0;
 }
 
+static const __FlashStringHelper *stm32_isp_prepare()
+{
+	// The bootloader measures the baud rate from the first 0x7F after reset,
+	// so try the fast rate first and reset again at the default if it is not locked on
+	static const uint32_t bauds[] = {STM32_ISP_BAUD, STM32_ISP_DEFAULT_BAUD};
+	bootloader_version = 0;
+	for (uint8_t i = 0; i < ARRAY_SIZE(bauds) && bootloader_version == 0; i++)
+	{
+		if (i > 0 && bauds[i] == bauds[i - 1])
+			continue;
+		DBGLN("ISP baud: %u", bauds[i]);
+		stm32flasher_hardware_init(bauds[i]);
+		reset_stm32_to_isp_mode();
+		isp_serial_flush();
+		if (init_chip() == 1)
+			bootloader_version = cmd_get();
+	}
+	if (bootloader_version == 0) {
+		return F("[ERROR] init chip failed.");
+	}
+
+	if (cmd_getID() != 1) {
+		return F("[ERROR] Wrong ID. No R9M found!");
+	}
+	return NULL;
+}
+
+const __FlashStringHelper *stm32_stream_begin()
+{
+	return stm32_isp_prepare();
+}
+
+static const __FlashStringHelper *stm32_write_block(uint32_t address, const uint8_t *data, uint16_t length)
+{
+	// Write memory takes whole words, pad a short last block with erased flash
+	uint16_t padded = (length + 3) & ~3;
+	memcpy(memory_buffer, data, length);
+	memset(memory_buffer + length, 0xFF, padded - length);
+	if (cmd_write_memory(address, padded) != 1)
+		return F("[ERROR] file write failed.");
+	// Read the block straight back rather than in a second pass over the image
+	if (cmd_read_memory(address, length) != 1)
+	{
+		DBGLN("[ERROR] read memory failed: %x", address);
+		return F("[ERROR] read memory failed");
+	}
+	if (memcmp(data, memory_buffer, length) != 0)
+		return F("[ERROR] verify failed.");
+	return NULL;
+}
+
+const __FlashStringHelper *stm32_write_page(uint32_t address, const uint8_t *data, uint16_t length, bool *skipped)
+{
+	if (address < FLASH_START)
+		address += FLASH_START;
+	*skipped = false;
+	if (length == 0 || length > FLASH_PAGE_SIZE || address + length > FLASH_START + FLASH_SIZE)
+		return F("[ERROR] file is too big!");
+	if ((address - FLASH_START) % FLASH_PAGE_SIZE != 0)
+		return F("[ERROR] unaligned page");
+
+	// Most of the image is usually unchanged between releases, reading a page
+	// back is cheaper than erasing and rewriting it
+	bool same = true;
+	for (uint16_t offset = 0; offset < length && same; offset += BLOCK_SIZE)
+	{
+		uint16_t len = min((uint16_t)BLOCK_SIZE, (uint16_t)(length - offset));
+		if (cmd_read_memory(address + offset, len) != 1)
+			return F("[ERROR] read memory failed");
+		same = memcmp(data + offset, memory_buffer, len) == 0;
+	}
+	if (same)
+	{
+		*skipped = true;
+		return NULL;
+	}
+
+	if (cmd_erase(address, FLASH_PAGE_SIZE, bootloader_version) != 1)
+		return F("[ERROR] erase Failed!");
+	for (uint16_t offset = 0; offset < length; offset += BLOCK_SIZE)
+	{
+		uint16_t len = min((uint16_t)BLOCK_SIZE, (uint16_t)(length - offset));
+		const __FlashStringHelper *errmsg = stm32_write_block(address + offset, data + offset, len);
+		if (errmsg != NULL)
+			return errmsg;
+	}
+	return NULL;
+}
+
+void stm32_stream_end()
+{
+	DBGLN("start application.");
+	cmd_go(FLASH_START);
+}
+
 const __FlashStringHelper *esp8266_spiffs_write_file(const char *filename, uint32_t begin_addr)
 {
 	if (!SPIFFS.exists(filename))
@@ -356,95 +461,40 @@ const __FlashStringHelper *esp8266_spiffs_write_file(const char *filename, uint3
     String message = "Using flash base: 0x";
     message += String(begin_addr, 16);
 
-	stm32flasher_hardware_init();
-	reset_stm32_to_isp_mode();
-	isp_serial_flush();
-
-	if (init_chip() != 1) {
-		fp.close();
-		return F("[ERROR] init chip failed.");
-	}
-
-	uint8_t bootloader_ver = cmd_get();
-	if (bootloader_ver == 0) {
-		fp.close();
-		return F("[ERROR] Invalid bootloader");
-	}
-
-	if (cmd_getID() != 1) {
+	uint8_t *page = (uint8_t *)malloc(FLASH_PAGE_SIZE);
+	if (page == NULL) {
 		fp.close();
-		return F("[ERROR] Wrong ID. No R9M found!");
+		return F("[ERROR] out of memory");
 	}
 
-	if (cmd_erase(begin_addr, filesize, bootloader_ver) != 1)
-	{
-		fp.close();
-		return F("[ERROR] erase Failed!");
-	}
-	DBGLN("erase Success!");
+	const __FlashStringHelper *errmsg = stm32_isp_prepare();
 
 	DBGLN("begin to write file.");
-	uint32_t junks = (filesize + (BLOCK_SIZE - 1)) / BLOCK_SIZE;
-	uint32_t junk = 0;
-	uint8_t proc;
-	while (fp.position() < filesize)
-	{
-		uint8_t nread = BLOCK_SIZE;
-		if ((filesize - fp.position()) < BLOCK_SIZE)
-		{
-			nread = filesize - fp.position();
-		}
-		nread = fp.readBytes((char *)memory_buffer, nread);
-
-		//DBGLN("write bytes: %d, file position: %d", nread, fp.position());
-		proc = (++junk * 100) / junks;
-		if ((junk % 40) == 0 || junk >= junks)
-			DBGLN("Write %u%%", proc);
-
-		uint8_t result = cmd_write_memory(begin_addr + fp.position() - nread, nread);
-		if (result != 1)
-		{
-			fp.close();
-			return F("[ERROR] file write failed.");
-		}
-	}
-	DBGLN("file write succeeded.");
-	DBGLN("begin to verify file.");
-	fp.seek(0, SeekSet);
-	junk = 0;
-	while (fp.position() < filesize)
+	uint32_t pages = (filesize + (FLASH_PAGE_SIZE - 1)) / FLASH_PAGE_SIZE;
+	uint32_t done = 0;
+	uint32_t skipped = 0;
+	while (errmsg == NULL && fp.position() < filesize)
 	{
-		uint8_t nread = BLOCK_SIZE;
-		if ((filesize - fp.position()) < BLOCK_SIZE)
+		uint16_t nread = FLASH_PAGE_SIZE;
+		if ((filesize - fp.position()) < FLASH_PAGE_SIZE)
 		{
 			nread = filesize - fp.position();
 		}
-		nread = fp.readBytes((char *)file_buffer, nread);
+		uint32_t address = begin_addr + fp.position();
+		nread = fp.readBytes((char *)page, nread);
 
-		//DBGLN("read bytes: %d, file position: %d", nread, fp.position());
-		proc = (++junk * 100) / junks;
-		if ((junk % 40) == 0 || junk >= junks)
-			DBGLN("Verify %u%%", proc);
-
-		uint8_t result = cmd_read_memory(begin_addr + fp.position() - nread, nread);
-		if (result != 1)
-		{
-			fp.close();
-			DBGLN("[ERROR] read memory failed: %d", fp.position());
-			return F("[ERROR] read memory failed");
-		}
-		result = memcmp(file_buffer, memory_buffer, nread);
-		if (result != 0)
-		{
-			fp.close();
-			return F("[ERROR] verify failed.");
-		}
+		bool same;
+		errmsg = stm32_write_page(address, page, nread, &same);
+		skipped += same;
+		DBGLN("Write %u%%", (++done * 100) / pages);
 	}
-
+	free(page);
 	fp.close();
-	DBGLN("verify file succeeded.");
-	DBGLN("start application.");
+	if (errmsg != NULL)
+		return errmsg;
+
+	DBGLN("write and verify succeeded, %u of %u pages unchanged.", skipped, pages);
 	//reset_stm32_to_app_mode();
-	cmd_go(FLASH_START);
+	stm32_stream_end();
 	return NULL;
 }
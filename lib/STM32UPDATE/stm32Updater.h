@@ -15,14 +15,29 @@
 #define FLASH_PAGE_SIZE 0x400
 #define FLASH_OFFSET 0x4000
 #define BEGIN_ADDRESS (FLASH_START + FLASH_OFFSET)
+// Largest block the bootloader write and read memory commands accept
+#define STM32_BLOCK_SIZE 256
+
+#define STM32_ISP_DEFAULT_BAUD 115200
+// The bootloader auto-bauds, the fast rate is tried first and falls back to the default
+#ifndef STM32_ISP_BAUD
+#define STM32_ISP_BAUD 230400
+#endif
 
 
 void reset_stm32_to_isp_mode();
 
 void reset_stm32_to_app_mode();
 
-void stm32flasher_hardware_init();
+void stm32flasher_hardware_init(uint32_t baud = STM32_ISP_DEFAULT_BAUD);
 
 void debug_log();
 
 const __FlashStringHelper *esp8266_spiffs_write_file(const char *filename, uint32_t const begin_addr);
+
+// Streaming flash: reset into the bootloader, then hand over the image one
+// FLASH_PAGE_SIZE page at a time. Pages that already hold the same bytes are
+// skipped, others are erased, written and verified.
+const __FlashStringHelper *stm32_stream_begin();
+const __FlashStringHelper *stm32_write_page(uint32_t address, const uint8_t *data, uint16_t length, bool *skipped);
+void stm32_stream_end();
@@ -16,6 +16,27 @@ void STMUpdateClass::setFilename(const String& filename)
 bool STMUpdateClass::begin(size_t size)
 {
     _error = UPDATE_ERROR_OK;
+    _errmsg = NULL;
+    streamFree();
+
+    if (filename.endsWith(".bin"))
+    {
+        // Raw image, write it to the STM32 as it arrives instead of staging it
+        // Stream buffer followed by the page being written
+        _buffer = (uint8_t *)malloc(STM_STREAM_BUFFER_SIZE + FLASH_PAGE_SIZE);
+        if (_buffer == NULL)
+        {
+            _error = UPDATE_ERROR_SPACE;
+            return false;
+        }
+        _streaming = true;
+        _streamStarted = false;
+        _tail = 0;
+        _buffered = 0;
+        _address = BEGIN_ADDRESS;
+        _pagesSkipped = 0;
+        return true;
+    }
 
     /* Remove old file */
     if (SPIFFS.exists(spiffs_firmware_filename))
@@ -49,11 +70,120 @@ bool STMUpdateClass::begin(size_t size)
 
 size_t STMUpdateClass::write(uint8_t *data, size_t len)
 {
-    return fsUploadFile.write(data, len);
+    // Also covers the rest of an upload after abort() freed the stream
+    if (hasError())
+        return 0;
+    if (!_streaming)
+        return fsUploadFile.write(data, len);
+
+    // Called from the TCP callback, so only buffer here and leave the UART to handle()
+    if (_buffered + len > STM_STREAM_BUFFER_SIZE)
+    {
+        _error = UPDATE_ERROR_SPACE;
+        return 0;
+    }
+    size_t head = (_tail + _buffered) % STM_STREAM_BUFFER_SIZE;
+    size_t first = min(len, (size_t)STM_STREAM_BUFFER_SIZE - head);
+    memcpy(&_buffer[head], data, first);
+    memcpy(&_buffer[0], data + first, len - first);
+    _buffered += len;
+    return len;
+}
+
+void STMUpdateClass::writePage(size_t len)
+{
+    // The TCP callback can run while the bootloader is being waited on, so
+    // take the page out of the buffer before talking to the STM32
+    uint8_t *page = &_buffer[STM_STREAM_BUFFER_SIZE];
+    size_t first = min(len, (size_t)STM_STREAM_BUFFER_SIZE - _tail);
+    memcpy(page, &_buffer[_tail], first);
+    memcpy(page + first, &_buffer[0], len - first);
+    _tail = (_tail + len) % STM_STREAM_BUFFER_SIZE;
+    _buffered -= len;
+
+    bool skipped;
+    _errmsg = stm32_write_page(_address, page, len, &skipped);
+    if (_errmsg != NULL)
+        _error = UPDATE_ERROR_NO_DATA;
+    _address += len;
+    _pagesSkipped += skipped;
+}
+
+void STMUpdateClass::handle()
+{
+    if (!_streaming || hasError() || _buffered == 0)
+        return;
+
+    if (!_streamStarted)
+    {
+        _streamStarted = true;
+        _errmsg = stm32_stream_begin();
+        if (_errmsg != NULL)
+        {
+            _error = UPDATE_ERROR_NO_DATA;
+            return;
+        }
+    }
+
+    for (int i = 0; i < STM_STREAM_PAGES_PER_HANDLE && !hasError() && _buffered >= FLASH_PAGE_SIZE; i++)
+        writePage(FLASH_PAGE_SIZE);
+}
+
+void STMUpdateClass::streamFree()
+{
+    free(_buffer);
+    _buffer = NULL;
+    _streaming = false;
+    _buffered = 0;
+}
+
+void STMUpdateClass::abort()
+{
+    if (!_streaming)
+        return;
+    if (!hasError())
+    {
+        _errmsg = F("Upload aborted");
+        _error = UPDATE_ERROR_NO_DATA;
+    }
+    // Once the bootloader has been entered the STM32 may be partly erased,
+    // don't leave it sitting in ISP mode with the serial port taken
+    if (_streamStarted)
+        reset_stm32_to_app_mode();
+    streamFree();
+    Serial.begin(460800);
 }
 
 bool STMUpdateClass::end(bool evenIfRemaining)
 {
+    if (_streaming)
+    {
+        // The upload is complete, write out what is left including the short last page
+        while (!hasError() && _buffered >= FLASH_PAGE_SIZE)
+            handle();
+        if (!hasError() && _buffered > 0)
+        {
+            handle();
+            if (!hasError())
+                writePage(_buffered);
+        }
+        if (!hasError() && !_streamStarted)
+        {
+            _errmsg = F("No data received");
+            _error = UPDATE_ERROR_NO_DATA;
+        }
+        if (hasError())
+        {
+            abort();
+            return false;
+        }
+        DBGLN("%u pages unchanged", _pagesSkipped);
+        stm32_stream_end();
+        streamFree();
+        Serial.begin(460800);
+        return true;
+    }
+
     fsUploadFile.close(); // Close the file again
 
     _error = flashSTM32(BEGIN_ADDRESS);
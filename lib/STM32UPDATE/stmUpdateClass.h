@@ -3,6 +3,19 @@
 #include <Updater.h>
 #include <FS.h>
 
+// Raw .bin images are not staged in SPIFFS, they are written to the STM32 as
+// they arrive. The buffer absorbs a TCP window while the UART catches up.
+#ifndef STM_STREAM_BUFFER_SIZE
+#define STM_STREAM_BUFFER_SIZE 8192
+#endif
+// Stop acking received data once this much is waiting to be written, leaving
+// room in the buffer for whatever the sender already has in flight
+#ifndef STM_STREAM_PAUSE_LEVEL
+#define STM_STREAM_PAUSE_LEVEL 2048
+#endif
+// Upper bound on pages written per handle() so the web server keeps running
+#define STM_STREAM_PAGES_PER_HANDLE 2
+
 class STMUpdateClass
 {
 public:
@@ -13,15 +26,33 @@ public:
     bool begin(size_t size);
     size_t write(uint8_t *data, size_t len);
     bool end(bool evenIfRemaining = false);
+    // Give up on a streaming upload: reset the STM32 out of the bootloader
+    // and hand the serial port back. Must be called from loop() context
+    void abort();
+    // Write buffered blocks to the STM32, must be called from loop() context
+    void handle();
+    // True while the stream buffer is too full to accept another TCP window
+    bool needsPause() { return _streaming && _buffered >= STM_STREAM_PAUSE_LEVEL; }
+    bool isStreaming() { return _streaming; }
     void printError(Print &out);
     bool hasError() { return _error != UPDATE_ERROR_OK; }
 
 private:
     int8_t flashSTM32(uint32_t flash_addr);
+    void writePage(size_t len);
+    void streamFree();
     String filename;
     File fsUploadFile;
     uint8_t _error = UPDATE_ERROR_OK;
     const __FlashStringHelper *_errmsg = NULL;
+
+    bool _streaming = false;
+    bool _streamStarted = false;
+    uint8_t *_buffer = NULL;
+    volatile size_t _tail = 0;
+    volatile size_t _buffered = 0;
+    uint32_t _address = 0;
+    uint16_t _pagesSkipped = 0;
 };
 
 extern STMUpdateClass STMUpdate;
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <stdint.h>
+
+/**
+ * @brief: Finds a byte pattern in a stream fed a byte at a time
+ *
+ * Uses a precomputed prefix table (Knuth-Morris-Pratt), so a mismatch falls
+ * back to the longest prefix that is still matched instead of starting over,
+ * and the state carries across however the stream is split into chunks.
+ */
+template <uint8_t MAX_PATTERN>
+class StreamMatcher
+{
+public:
+    void begin(const uint8_t *pattern, uint8_t len)
+    {
+        _pattern = pattern;
+        _len = len < MAX_PATTERN ? len : MAX_PATTERN;
+        _matched = 0;
+        // _fail[i] is the length of the longest proper prefix of pattern[0..i] that is also its suffix
+        _fail[0] = 0;
+        uint8_t k = 0;
+        for (uint8_t i = 1; i < _len; i++)
+        {
+            while (k > 0 && _pattern[i] != _pattern[k])
+                k = _fail[k - 1];
+            if (_pattern[i] == _pattern[k])
+                k++;
+            _fail[i] = k;
+        }
+    }
+
+    void reset() { _matched = 0; }
+
+    // Returns true when c completes the pattern
+    bool feed(uint8_t c)
+    {
+        while (_matched > 0 && c != _pattern[_matched])
+            _matched = _fail[_matched - 1];
+        if (c == _pattern[_matched])
+            _matched++;
+        if (_matched == _len)
+        {
+            _matched = _fail[_len - 1];
+            return true;
+        }
+        return false;
+    }
+
+private:
+    const uint8_t *_pattern;
+    uint8_t _len;
+    uint8_t _matched;
+    uint8_t _fail[MAX_PATTERN];
+};
@@ -0,0 +1,197 @@
+#if defined(PLATFORM_ESP32)
+#include "UpdateInflater.h"
+
+#include <Update.h>
+#include "logging.h"
+
+#define GZ_HEADER_SIZE 10
+#define GZ_FLAG_HCRC 0x02
+#define GZ_FLAG_EXTRA 0x04
+#define GZ_FLAG_NAME 0x08
+#define GZ_FLAG_COMMENT 0x10
+#define GZ_FLAG_RESERVED 0xE0
+
+bool UpdateInflater::begin()
+{
+    end();
+    _decomp = (tinfl_decompressor *)malloc(sizeof(tinfl_decompressor));
+    _window = (uint8_t *)malloc(TINFL_LZ_DICT_SIZE);
+    if (_decomp == nullptr || _window == nullptr)
+    {
+        end();
+        _state = GZ_ERROR;
+        return false;
+    }
+    tinfl_init(_decomp);
+    _windowOfs = 0;
+    _state = GZ_HEADER;
+    _count = 0;
+    _trailerCount = 0;
+    _outTotal = 0;
+    return true;
+}
+
+void UpdateInflater::end()
+{
+    free(_decomp);
+    free(_window);
+    _decomp = nullptr;
+    _window = nullptr;
+}
+
+bool UpdateInflater::finished()
+{
+    if (_state != GZ_DONE || _trailerCount != sizeof(_trailer))
+        return false;
+    uint32_t isize = _trailer[4] | (_trailer[5] << 8) | (_trailer[6] << 16) | ((uint32_t)_trailer[7] << 24);
+    return isize == _outTotal;
+}
+
+void UpdateInflater::nextField()
+{
+    // Optional header fields follow in this order when their flag is set
+    _count = 0;
+    if (_flags & GZ_FLAG_EXTRA)
+    {
+        _flags &= ~GZ_FLAG_EXTRA;
+        _skip = 0;
+        _state = GZ_EXTRA_LEN;
+    }
+    else if (_flags & GZ_FLAG_NAME)
+    {
+        _flags &= ~GZ_FLAG_NAME;
+        _state = GZ_NAME;
+    }
+    else if (_flags & GZ_FLAG_COMMENT)
+    {
+        _flags &= ~GZ_FLAG_COMMENT;
+        _state = GZ_COMMENT;
+    }
+    else if (_flags & GZ_FLAG_HCRC)
+    {
+        _flags &= ~GZ_FLAG_HCRC;
+        _state = GZ_HCRC;
+    }
+    else
+    {
+        _state = GZ_DATA;
+    }
+}
+
+void UpdateInflater::headerByte(uint8_t c)
+{
+    switch (_state)
+    {
+    case GZ_HEADER:
+        // ID1 ID2 CM FLG MTIME(4) XFL OS
+        if ((_count == 0 && c != 0x1F) || (_count == 1 && c != 0x8B) || (_count == 2 && c != 8) ||
+            (_count == 3 && (c & GZ_FLAG_RESERVED)))
+        {
+            _state = GZ_ERROR;
+            return;
+        }
+        if (_count == 3)
+            _flags = c;
+        if (++_count == GZ_HEADER_SIZE)
+            nextField();
+        break;
+    case GZ_EXTRA_LEN:
+        _skip |= c << (8 * _count);
+        if (++_count == 2)
+        {
+            if (_skip == 0)
+                nextField();
+            else
+                _state = GZ_EXTRA;
+        }
+        break;
+    case GZ_EXTRA:
+        if (--_skip == 0)
+            nextField();
+        break;
+    case GZ_NAME:
+    case GZ_COMMENT:
+        if (c == 0)
+            nextField();
+        break;
+    case GZ_HCRC:
+        if (++_count == 2)
+            nextField();
+        break;
+    default:
+        break;
+    }
+}
+
+void UpdateInflater::flushWindow(size_t len)
+{
+    if (len == 0)
+        return;
+    if (Update.write(&_window[_windowOfs], len) != len)
+    {
+        _state = GZ_ERROR;
+        return;
+    }
+    _windowOfs = (_windowOfs + len) & (TINFL_LZ_DICT_SIZE - 1);
+    _outTotal += len;
+}
+
+size_t UpdateInflater::inflate(const uint8_t *data, size_t len)
+{
+    size_t consumed = 0;
+    tinfl_status status;
+    do
+    {
+        size_t inBytes = len - consumed;
+        size_t outBytes = TINFL_LZ_DICT_SIZE - _windowOfs;
+        status = tinfl_decompress(_decomp, data + consumed, &inBytes, _window, &_window[_windowOfs], &outBytes, TINFL_FLAG_HAS_MORE_INPUT);
+        consumed += inBytes;
+        flushWindow(outBytes);
+        if (status < TINFL_STATUS_DONE || _state == GZ_ERROR)
+        {
+            DBGLN("Inflate failed: %d", status);
+            _state = GZ_ERROR;
+            return consumed;
+        }
+    } while (status == TINFL_STATUS_HAS_MORE_OUTPUT || (status == TINFL_STATUS_NEEDS_MORE_INPUT && consumed < len));
+
+    if (status == TINFL_STATUS_DONE)
+    {
+        // Read ahead past the end of the stream, these are trailer bytes
+        _trailerCount = _decomp->m_num_bits >> 3;
+        _state = GZ_DONE;
+    }
+    return consumed;
+}
+
+size_t UpdateInflater::write(const uint8_t *data, size_t len)
+{
+    size_t pos = 0;
+    while (pos < len && _state != GZ_ERROR && _state != GZ_DONE)
+    {
+        if (_state == GZ_DATA)
+        {
+            pos += inflate(data + pos, len - pos);
+        }
+        else
+        {
+            headerByte(data[pos++]);
+        }
+    }
+
+    if (_state == GZ_DONE)
+        _trailerCount += len - pos;
+
+    // Keep the last 8 bytes seen for the trailer
+    if (len >= sizeof(_trailer))
+    {
+        memcpy(_trailer, data + len - sizeof(_trailer), sizeof(_trailer));
+    }
+    else
+    {
+        memmove(_trailer, &_trailer[len], sizeof(_trailer) - len);
+        memcpy(&_trailer[sizeof(_trailer) - len], data, len);
+    }
+    return hasError() ? 0 : len;
+}
+#endif
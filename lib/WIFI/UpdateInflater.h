@@ -0,0 +1,66 @@
+#pragma once
+
+#if defined(PLATFORM_ESP32)
+#include <Arduino.h>
+#include <rom/miniz.h>
+
+/**
+ * @brief: Inflates a gzip firmware image into Update as it is uploaded
+ *
+ * The ESP32 Update class only takes raw images, so the gzip header is
+ * skipped here and the deflate stream is decoded with the ROM copy of tinfl
+ * into a 32KB window that is written out to Update as it fills. The trailer
+ * length is checked at the end, Update.end() checks the image itself.
+ *
+ * The ROM tinfl is miniz 1.x, which can report up to 4 bytes past the end of
+ * the deflate stream as consumed and keeps them in its bit buffer. So the
+ * trailer is taken from the last 8 bytes of the upload, and the bytes after
+ * the deflate stream are counted from its end less the whole bytes still in
+ * the bit buffer.
+ */
+class UpdateInflater
+{
+public:
+    // Allocate the decompressor, false if there is not enough heap
+    bool begin();
+    // Decode an upload chunk, returns len or 0 on error
+    size_t write(const uint8_t *data, size_t len);
+    // True once the whole stream including the trailer has been decoded
+    bool finished();
+    void end();
+    bool hasError() { return _state == GZ_ERROR; }
+    // Mark a stream that ended early as failed
+    void fail() { _state = GZ_ERROR; }
+
+private:
+    enum gzState_e {
+        GZ_HEADER,
+        GZ_EXTRA_LEN,
+        GZ_EXTRA,
+        GZ_NAME,
+        GZ_COMMENT,
+        GZ_HCRC,
+        GZ_DATA,
+        GZ_DONE,    // deflate stream complete, the rest is the trailer
+        GZ_ERROR
+    };
+
+    void nextField();
+    void headerByte(uint8_t c);
+    size_t inflate(const uint8_t *data, size_t len);
+    void flushWindow(size_t len);
+
+    tinfl_decompressor *_decomp = nullptr;
+    uint8_t *_window = nullptr;
+    size_t _windowOfs = 0;
+    gzState_e _state = GZ_HEADER;
+    uint8_t _flags = 0;
+    uint16_t _count = 0;
+    uint16_t _skip = 0;
+    // Last bytes written, CRC32 and ISIZE once the upload is complete
+    uint8_t _trailer[8];
+    // Bytes written after the end of the deflate stream
+    uint32_t _trailerCount;
+    uint32_t _outTotal = 0;
+};
+#endif
@@ -3,6 +3,9 @@
 #ifdef STM32_TX_BACKPACK
 #include "stmUpdateClass.h"
 #endif
+#if PLATFORM_ESP32
+#include "UpdateInflater.h"
+#endif
 
 class UpdateWrapper {
 public:
@@ -16,6 +19,10 @@ public:
     bool begin() {
 #endif
       _running = true;
+#if PLATFORM_ESP32
+        _gzip = false;
+        _firstWrite = true;
+#endif
 #ifdef STM32_TX_BACKPACK
         if (_stmMode)
             return STMUpdate.begin(0); // we don't know the size!
@@ -31,6 +38,15 @@ public:
 #ifdef STM32_TX_BACKPACK
         if (_stmMode)
             return STMUpdate.write(data, len);
+#endif
+#if PLATFORM_ESP32
+        // Update only takes raw images, inflate gzip ones on the way through
+        if (_firstWrite) {
+            _firstWrite = false;
+            _gzip = len >= 2 && data[0] == 0x1F && data[1] == 0x8B && _inflater.begin();
+        }
+        if (_gzip)
+            return _inflater.write(data, len);
 #endif
         return Update.write(data, len);
     }
@@ -40,14 +56,57 @@ public:
 #ifdef STM32_TX_BACKPACK
         if (_stmMode)
             return STMUpdate.end(evenIfRemaining);
+#endif
+#if PLATFORM_ESP32
+        if (_gzip) {
+            bool finished = _inflater.finished();
+            _inflater.end();
+            if (!finished) {
+                _inflater.fail();
+                Update.abort();
+                return false;
+            }
+        }
 #endif
         return Update.end(evenIfRemaining);
     }
 
+    // Service work that cannot run in the upload callback, call from loop()
+    void handle() {
+#ifdef STM32_TX_BACKPACK
+        if (_stmMode)
+            STMUpdate.handle();
+#endif
+    }
+
+    // True when the upload should stop acking data until handle() catches up
+    bool needsPause() {
+#ifdef STM32_TX_BACKPACK
+        if (_stmMode)
+            return STMUpdate.needsPause();
+#endif
+        return false;
+    }
+
+    // True while the STM32 bootloader owns the serial port
+    bool ownsSerial() {
+#ifdef STM32_TX_BACKPACK
+        if (_stmMode)
+            return _running && STMUpdate.isStreaming();
+#endif
+        return false;
+    }
+
     void printError(Print &out) {
 #ifdef STM32_TX_BACKPACK
         if (_stmMode)
             return STMUpdate.printError(out);
+#endif
+#if PLATFORM_ESP32
+        if (_gzip && _inflater.hasError()) {
+            out.println(F("ERROR: Decompression failed"));
+            return;
+        }
 #endif
         return Update.printError(out);
     }
@@ -56,6 +115,10 @@ public:
 #ifdef STM32_TX_BACKPACK
         if (_stmMode)
             return STMUpdate.hasError();
+#endif
+#if PLATFORM_ESP32
+        if (_gzip && _inflater.hasError())
+            return true;
 #endif
         return Update.hasError();
     }
@@ -70,13 +133,27 @@ public:
         return _running;
     }
 
-#ifdef PLATFORM_ESP32
+    // Drop an upload that will not be completed, call from loop()
     void abort() {
-        if (!_stmMode) Update.abort();
-    }
+        _running = false;
+#ifdef STM32_TX_BACKPACK
+        if (_stmMode) {
+            STMUpdate.abort();
+            return;
+        }
 #endif
+#ifdef PLATFORM_ESP32
+        Update.abort();
+        if (_gzip) _inflater.end();
+#endif
+    }
 
 private:
     bool _stmMode = false;
     bool _running = false;
+#if PLATFORM_ESP32
+    UpdateInflater _inflater;
+    bool _gzip = false;
+    bool _firstWrite = false;
+#endif
 };
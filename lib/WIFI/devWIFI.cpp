@@ -16,7 +16,6 @@
 #endif
 #include <DNSServer.h>
 
-#include <set>
 #include <StreamString.h>
 
 #include <ESPAsyncWebServer.h>
@@ -25,14 +24,19 @@
 #include "common.h"
 #include "logging.h"
 #include "options.h"
+#include "espnow_phy.h"
 #include "helpers.h"
 
 #include "UpdateWrapper.h"
+#include "StreamMatcher.h"
 #include "time.h"
 
 #include "WebContent.h"
 
 #include "config.h"
+#include "stats.h"
+#include "recorder.h"
+#include "profiler.h"
 #if defined(TARGET_VRX_BACKPACK)
 extern VrxBackpackConfig config;
 extern bool sendRTCChangesToVrx;
@@ -79,18 +83,41 @@ static DNSServer dnsServer;
 static AsyncWebServer server(80);
 static bool servicesStarted = false;
 
+// Longest target name read back from an uploaded image
+#define TARGET_FOUND_MAX 50
+// Every image carries 0xBEEFCAFE then its NUL terminated target name
+static const uint8_t target_magic[] = {0xBE, 0xEF, 0xCA, 0xFE};
+
 static bool target_seen = false;
-static uint8_t target_pos = 0;
-static String target_found;
+static StreamMatcher<TARGET_NAME_MAX_SIZE> target_matcher;
+static StreamMatcher<sizeof(target_magic)> magic_matcher;
+static char target_found[TARGET_FOUND_MAX + 1];
+static uint8_t target_found_len = 0;
+static bool target_capturing = false;
 static bool target_complete = false;
 static bool force_update = false;
 static bool do_flash = false;
 static uint32_t totalSize;
 static UpdateWrapper updater = UpdateWrapper();
+// Upload connection whose received data is not being acked until the updater catches up
+static AsyncClient *paused_client = nullptr;
+// Set from the TCP callbacks when an upload ends without the final chunk,
+// the updater is then aborted from loop()
+static bool upload_final = false;
+static volatile bool abort_upload = false;
+
+// Serial console lines are forwarded in batches rather than one event per line
+#define LOG_BATCH_MS 100
+// Drop batches once the EventSource clients have this many messages queued
+#define LOG_QUEUE_LIMIT 8
 
 static AsyncEventSource logging("/logging");
-static char logBuffer[256];
+static AsyncWebSocket loggingWS("/logging.ws");
+static char logBuffer[512];
 static int logPos = 0;
+static int logLineEnd = 0;
+static unsigned long logBatchStart = 0;
+static uint32_t logDropped = 0;
 
 /** Is this an IP? */
 static boolean isIp(String str)
@@ -136,22 +163,45 @@ static struct {
   const char *contentType;
   const uint8_t* content;
   const size_t size;
+  const char *etag;
 } files[] = {
-  {"/mui.css", "text/css", (uint8_t *)MUI_CSS, sizeof(MUI_CSS)},
-  {"/elrs.css", "text/css", (uint8_t *)ELRS_CSS, sizeof(ELRS_CSS)},
-  {"/mui.js", "text/javascript", (uint8_t *)MUI_JS, sizeof(MUI_JS)},
-  {"/scan.js", "text/javascript", (uint8_t *)SCAN_JS, sizeof(SCAN_JS)},
-  {"/logo.svg", "image/svg+xml", (uint8_t *)LOGO_SVG, sizeof(LOGO_SVG)},
-  {"/log.js", "text/javascript", (uint8_t *)LOG_JS, sizeof(LOG_JS)},
-  {"/log.html", "text/html", (uint8_t *)LOG_HTML, sizeof(LOG_HTML)},
+  {"/mui.css", "text/css", (uint8_t *)MUI_CSS, sizeof(MUI_CSS), MUI_CSS_ETAG},
+  {"/elrs.css", "text/css", (uint8_t *)ELRS_CSS, sizeof(ELRS_CSS), ELRS_CSS_ETAG},
+  {"/mui.js", "text/javascript", (uint8_t *)MUI_JS, sizeof(MUI_JS), MUI_JS_ETAG},
+  {"/scan.js", "text/javascript", (uint8_t *)SCAN_JS, sizeof(SCAN_JS), SCAN_JS_ETAG},
+  {"/logo.svg", "image/svg+xml", (uint8_t *)LOGO_SVG, sizeof(LOGO_SVG), LOGO_SVG_ETAG},
+  {"/log.js", "text/javascript", (uint8_t *)LOG_JS, sizeof(LOG_JS), LOG_JS_ETAG},
+  {"/log.html", "text/html", (uint8_t *)LOG_HTML, sizeof(LOG_HTML), LOG_HTML_ETAG},
 };
 
+// Answer 304 if the browser already holds this version of the content
+static bool NotModified(AsyncWebServerRequest *request, const char *etag)
+{
+  if (!request->hasHeader("If-None-Match") || !request->header("If-None-Match").equals(etag)) {
+    return false;
+  }
+  AsyncWebServerResponse *response = request->beginResponse(304);
+  response->addHeader("ETag", etag);
+  request->send(response);
+  return true;
+}
+
 static void WebUpdateSendContent(AsyncWebServerRequest *request)
 {
   for (size_t i=0 ; i<ARRAY_SIZE(files) ; i++) {
     if (request->url().equals(files[i].url)) {
+      if (NotModified(request, files[i].etag)) {
+        return;
+      }
       AsyncWebServerResponse *response = request->beginResponse_P(200, files[i].contentType, files[i].content, files[i].size);
       response->addHeader("Content-Encoding", "gzip");
+      response->addHeader("ETag", files[i].etag);
+      // The pages reference assets with their content hash (?v=), those URLs never change content
+      if (request->hasArg("v")) {
+        response->addHeader("Cache-Control", "public, max-age=31536000, immutable");
+      } else {
+        response->addHeader("Cache-Control", "no-cache");
+      }
       request->send(response);
       return;
     }
@@ -166,25 +216,41 @@ static void WebUpdateHandleRoot(AsyncWebServerRequest *request)
     return;
   }
   force_update = request->hasArg("force");
+  // Revalidate every time, but a phone repeating the portal probes only gets a 304
+  if (NotModified(request, INDEX_HTML_ETAG)) {
+    return;
+  }
   AsyncWebServerResponse *response = request->beginResponse_P(200, "text/html", (uint8_t*)INDEX_HTML, sizeof(INDEX_HTML));
-  response->addHeader("Cache-Control", "no-cache, no-store, must-revalidate");
-  response->addHeader("Pragma", "no-cache");
-  response->addHeader("Expires", "-1");
+  response->addHeader("Cache-Control", "no-cache");
+  response->addHeader("ETag", INDEX_HTML_ETAG);
   response->addHeader("Content-Encoding", "gzip");
   request->send(response);
 }
 
-static void GetConfiguration(AsyncWebServerRequest *request)
-{
-#if defined(PLATFORM_ESP32)
-  DynamicJsonDocument json(32768);
+// root (config, stm32), config (ssid, mode, product_name, version, espnow),
+// espnow and the copies of ssid, mode and product_name
+#define CONFIG_JSON_BASE_SIZE (JSON_OBJECT_SIZE(2) + JSON_OBJECT_SIZE(5) + JSON_OBJECT_SIZE(3) + sizeof(station_ssid) + sizeof(firmwareOptions.product_name) + 8)
+#if defined(AAT_BACKPACK)
+#define CONFIG_JSON_SIZE (CONFIG_JSON_BASE_SIZE + WEB_AAT_CONFIG_JSON_SIZE)
 #else
-  DynamicJsonDocument json(2048);
+#define CONFIG_JSON_SIZE CONFIG_JSON_BASE_SIZE
 #endif
 
+static void GetConfiguration(AsyncWebServerRequest *request)
+{
+  // Sized at compile time and kept out of the heap, the document is small
+  // but a large transient allocation can fail once the heap is fragmented
+  static StaticJsonDocument<CONFIG_JSON_SIZE> json;
+  json.clear();
+
   json["config"]["ssid"] = station_ssid;
   json["config"]["mode"] = wifiMode == WIFI_STA ? "STA" : "AP";
   json["config"]["product_name"] = firmwareOptions.product_name;
+  json["config"]["version"] = VERSION;
+  JsonObject espnow = json["config"].createNestedObject("espnow");
+  espnow["channel"] = firmwareOptions.espnow_channel;
+  espnow["rate"] = firmwareOptions.espnow_rate;
+  espnow["lr"] = firmwareOptions.espnow_lr;
 
 #if defined(STM32_TX_BACKPACK)
   json["stm32"] = "yes";
@@ -192,30 +258,262 @@ static void GetConfiguration(AsyncWebServerRequest *request)
 #if defined(AAT_BACKPACK)
   WebAatAppendConfig(json);
 #endif
+  if (json.overflowed()) {
+    DBGLN("/config document overflowed");
+  }
+  occupancyRecord(OCCUPANCY_WEB_CONFIG_JSON, json.memoryUsage(), json.capacity());
 
   AsyncResponseStream *response = request->beginResponseStream("application/json");
   serializeJson(json, *response);
   request->send(response);
 }
 
-static void WebUpdateSendNetworks(AsyncWebServerRequest *request)
+static void GetStats(AsyncWebServerRequest *request)
 {
-  int numNetworks = WiFi.scanComplete();
-  if (numNetworks >= 0) {
-    DBGLN("Found %d networks", numNetworks);
-    std::set<String> vs;
-    String s="[";
-    for(int i=0 ; i<numNetworks ; i++) {
-      String w = WiFi.SSID(i);
-      DBGLN("found %s", w.c_str());
-      if (vs.find(w)==vs.end() && w.length()>0) {
-        if (!vs.empty()) s += ",";
-        s += "\"" + w + "\"";
-        vs.insert(w);
+  DynamicJsonDocument json(6144);
+
+  JsonObject latency = json.createNestedObject("latency");
+  for (uint8_t p = 0 ; p < LATENCY_PROBE_COUNT ; p++)
+  {
+    const latencyHistogram_t *h = latencyGet((latencyProbe_e)p);
+    JsonObject probe = latency.createNestedObject(latencyName((latencyProbe_e)p));
+    probe["count"] = h->count;
+    probe["min"] = h->min;
+    probe["max"] = h->max;
+    probe["avg"] = h->count ? (uint32_t)(h->total / h->count) : 0;
+    JsonArray buckets = probe.createNestedArray("buckets");
+    for (uint8_t i = 0 ; i < LATENCY_BUCKET_COUNT ; i++)
+    {
+      buckets.add(h->buckets[i]);
+    }
+  }
+  JsonArray edges = json.createNestedArray("bucket_us");
+  for (uint8_t i = 0 ; i < LATENCY_BUCKET_COUNT ; i++)
+  {
+    edges.add(latencyBucketStart(i));
+  }
+
+  JsonObject boot = json.createNestedObject("boot_us");
+  for (uint8_t p = 0 ; p < BOOT_PHASE_COUNT ; p++)
+  {
+    boot[bootName((bootPhase_e)p)] = bootGet((bootPhase_e)p);
+  }
+
+  JsonArray link = json.createNestedArray("link");
+  for (uint8_t i = 0 ; i < linkStatsCount() ; i++)
+  {
+    const linkPeerStats_t *p = linkStatsGet(i);
+    if (p == nullptr)
+    {
+      break;
+    }
+    char mac[18];
+    snprintf(mac, sizeof(mac), "%02X:%02X:%02X:%02X:%02X:%02X", p->mac[0], p->mac[1], p->mac[2], p->mac[3], p->mac[4], p->mac[5]);
+    JsonObject peer = link.createNestedObject();
+    peer["mac"] = mac;
+    peer["sent_ok"] = p->sentOk;
+    peer["sent_failed"] = p->sentFailed;
+    peer["received"] = p->received;
+    peer["rssi"] = p->rssi;
+    peer["rssi_avg"] = p->rssiAvg / 16;
+    peer["interval_us"] = p->intervalUs;
+    peer["jitter_us"] = p->jitterUs;
+    peer["last_seen_ms"] = millis() - p->lastSeenMs;
+  }
+
+  // Time in each power mode, and with the bench currents the average drawn
+  JsonObject power = json.createNestedObject("power");
+  power["mode"] = powerModeName(powerModeGet());
+  uint64_t charge = 0;
+  uint32_t total = 0;
+  bool measured = true;
+  for (uint8_t m = 0 ; m < POWER_MODE_COUNT ; m++)
+  {
+    JsonObject mode = power.createNestedObject(powerModeName((powerMode_e)m));
+    uint32_t ms = powerModeTime((powerMode_e)m);
+    uint16_t ma = powerModeCurrent((powerMode_e)m);
+    mode["ms"] = ms;
+    mode["entries"] = powerModeEntries((powerMode_e)m);
+    mode["ma"] = ma;
+    charge += (uint64_t)ms * ma;
+    total += ms;
+    measured &= ma != 0;
+  }
+  if (measured && total != 0)
+  {
+    power["avg_ma"] = (uint32_t)(charge / total);
+  }
+
+  // Heap over time, stack and queue high-water marks
+  JsonObject memory = json.createNestedObject("memory");
+  memory["min_free"] = memoryMinFree();
+  memory["min_largest_block"] = memoryMinLargestBlock();
+  JsonArray history = memory.createNestedArray("history");
+  for (uint8_t i = 0 ; i < MEMORY_HISTORY_SAMPLES ; i++)
+  {
+    const memorySample_t *s = memoryHistory(i);
+    if (s == nullptr)
+    {
+      break;
+    }
+    JsonObject sample = history.createNestedObject();
+    sample["age_ms"] = millis() - s->timeMs;
+    sample["free"] = s->freeHeap;
+    sample["largest_block"] = s->largestBlock;
+  }
+  JsonObject stacks = memory.createNestedObject("stack_free");
+  for (uint8_t i = 0 ; i < memoryStackCount() ; i++)
+  {
+    const char *name;
+    uint32_t freeBytes;
+    if (memoryStack(i, &name, &freeBytes))
+    {
+      stacks[name] = freeBytes;
+    }
+  }
+  // Recorded just before, this document only shows the previous request's use
+  occupancyRecord(OCCUPANCY_WEB_STATS_JSON, json.memoryUsage(), json.capacity());
+  JsonObject queues = memory.createNestedObject("occupancy");
+  for (uint8_t p = 0 ; p < OCCUPANCY_PROBE_COUNT ; p++)
+  {
+    const occupancy_t *o = occupancyGet((occupancyProbe_e)p);
+    if (o->capacity == 0)
+    {
+      continue;
+    }
+    JsonObject queue = queues.createNestedObject(occupancyName((occupancyProbe_e)p));
+    queue["peak"] = o->peak;
+    queue["capacity"] = o->capacity;
+    queue["overflows"] = o->overflows;
+  }
+
+  AsyncResponseStream *response = request->beginResponseStream("application/json");
+  serializeJson(json, *response);
+  request->send(response);
+}
+
+#if defined(LOOP_PROFILER)
+// The profiler histograms as text, /profile?reset clears them after
+static void GetProfile(AsyncWebServerRequest *request)
+{
+  AsyncResponseStream *response = request->beginResponseStream("text/plain");
+  profilerDump(*response);
+  request->send(response);
+  if (request->hasArg("reset"))
+  {
+    profilerReset();
+  }
+}
+#endif
+
+static void GetRecorder(AsyncWebServerRequest *request)
+{
+  AsyncWebServerResponse *response = request->beginResponse("application/octet-stream", traceDownloadSize(),
+    [](uint8_t *buffer, size_t maxLen, size_t index) -> size_t {
+      return traceDownloadRead(buffer, maxLen, index);
+    });
+  response->addHeader("Content-Disposition", "attachment; filename=\"recorder.bin\"");
+  request->send(response);
+}
+
+// Scan results are kept serialized as a JSON array of SSIDs, strongest first.
+// Two buffers are alternated so a response still being sent is not rewritten.
+#define SCAN_CACHE_SIZE 768
+#define SCAN_MAX_NETWORKS 32
+#define SCAN_REFRESH_MS 30000
+
+static char scanCache[2][SCAN_CACHE_SIZE];
+static uint16_t scanCacheLen = 0;
+static uint8_t scanCacheIdx = 0;
+static unsigned long scanTime = 0;
+static bool scanWanted = false;
+
+static bool ScanCacheAppend(char *out, uint16_t &len, const char *text, uint16_t n)
+{
+  if (len + n >= SCAN_CACHE_SIZE - 1) {
+    return false;
+  }
+  memcpy(&out[len], text, n);
+  len += n;
+  return true;
+}
+
+static void ScanCacheBuild(int numNetworks)
+{
+  uint8_t order[SCAN_MAX_NETWORKS];
+  uint8_t count = 0;
+  for (int i = 0 ; i < numNetworks && count < SCAN_MAX_NETWORKS ; i++) {
+    // Insertion sort by RSSI, the lists are short
+    uint8_t pos = count++;
+    while (pos > 0 && WiFi.RSSI(order[pos - 1]) < WiFi.RSSI(i)) {
+      order[pos] = order[pos - 1];
+      pos--;
+    }
+    order[pos] = i;
+  }
+
+  char *out = scanCache[scanCacheIdx ^ 1];
+  uint16_t len = 0;
+  uint8_t listed = 0;
+  out[len++] = '[';
+  for (uint8_t k = 0 ; k < count ; k++) {
+    String ssid = WiFi.SSID(order[k]);
+    bool dup = ssid.length() == 0;
+    // Other APs of the same network are weaker, so only the first one is listed
+    for (uint8_t j = 0 ; j < k && !dup ; j++) {
+      dup = ssid.equals(WiFi.SSID(order[j]));
+    }
+    if (dup) {
+      continue;
+    }
+    uint16_t start = len;
+    bool ok = ScanCacheAppend(out, len, listed ? ",\"" : "\"", listed ? 2 : 1);
+    for (size_t c = 0 ; c < ssid.length() && ok ; c++) {
+      char ch = ssid[c];
+      if (ch == '"' || ch == '\\') {
+        ok = ScanCacheAppend(out, len, "\\", 1);
+      }
+      if ((uint8_t)ch >= 0x20) {
+        ok = ok && ScanCacheAppend(out, len, &ch, 1);
       }
     }
-    s+="]";
-    request->send(200, "application/json", s);
+    ok = ok && ScanCacheAppend(out, len, "\"", 1);
+    if (!ok) {
+      len = start;
+      break;
+    }
+    listed++;
+  }
+  out[len++] = ']';
+  out[len] = 0;
+  scanCacheLen = len;
+  scanCacheIdx ^= 1;
+  DBGLN("Found %d networks, %u listed", numNetworks, listed);
+}
+
+static void ScanCacheUpdate(unsigned long now)
+{
+  int numNetworks = WiFi.scanComplete();
+  if (numNetworks >= 0) {
+    ScanCacheBuild(numNetworks);
+    WiFi.scanDelete();
+    scanTime = now;
+  }
+  // Scanning hops channels and disturbs connected clients, so only refresh
+  // when the page is asking for the list, and never during an upload
+  else if (numNetworks == WIFI_SCAN_FAILED && scanWanted && !updater.isRunning()) {
+    WiFi.scanNetworks(true);
+  }
+  scanWanted = false;
+}
+
+static void WebUpdateSendNetworks(AsyncWebServerRequest *request)
+{
+  if (scanCacheLen == 0 || millis() - scanTime > SCAN_REFRESH_MS) {
+    scanWanted = true;
+  }
+  if (scanCacheLen != 0) {
+    request->send(request->beginResponse_P(200, "application/json", (const uint8_t *)scanCache[scanCacheIdx], scanCacheLen));
   } else {
     request->send(204, "application/json", "[]");
   }
@@ -283,6 +581,23 @@ static void WebUpdateForget(AsyncWebServerRequest *request)
   }
 }
 
+static void WebUpdateSetEspnow(AsyncWebServerRequest *request)
+{
+  long channel = request->arg("channel").toInt();
+  long rate = request->arg("rate").toInt();
+  if (channel < 1 || channel > ESPNOW_MAX_CHANNEL || rate < 0 || rate >= ESPNOW_RATE_COUNT)
+  {
+    request->send(400, "text/plain", "Invalid ESP-NOW settings");
+    return;
+  }
+  firmwareOptions.espnow_channel = channel;
+  firmwareOptions.espnow_rate = rate;
+  firmwareOptions.espnow_lr = request->hasArg("lr");
+  saveOptions();
+  DBGLN("ESP-NOW channel %u rate %u lr %u", firmwareOptions.espnow_channel, firmwareOptions.espnow_rate, firmwareOptions.espnow_lr);
+  request->send(200, "text/plain", "Saved, used from the next boot. Bind again so the other backpacks take the same settings.");
+}
+
 static void WebUpdateHandleNotFound(AsyncWebServerRequest *request)
 {
   if (captivePortal(request))
@@ -309,7 +624,50 @@ static void WebUpdateHandleNotFound(AsyncWebServerRequest *request)
   request->send(response);
 }
 
+static void LogSend(char *text, int len) {
+  if (loggingWS.count() != 0) {
+    loggingWS.binaryAll((uint8_t *)text, len);
+  }
+  if (logging.count() != 0) {
+    // EventSource splits the data into lines itself, and the page adds the final newline
+    int end = text[len - 1] == '\n' ? len - 1 : len;
+    char c = text[end];
+    text[end] = 0;
+    logging.send(text);
+    text[end] = c;
+  }
+}
+
+// Forward the first len bytes of logBuffer and keep the rest for the next batch
+static void LogFlush(int len) {
+  bool congested = (logging.count() != 0 && logging.avgPacketsWaiting() > LOG_QUEUE_LIMIT) ||
+    (loggingWS.count() != 0 && !loggingWS.availableForWriteAll());
+  if (congested) {
+    logDropped += len;
+  } else {
+    if (logDropped != 0) {
+      char note[40];
+      int noteLen = snprintf(note, sizeof(note), "[%u log bytes dropped]\n", logDropped);
+      LogSend(note, noteLen);
+      logDropped = 0;
+    }
+    LogSend(logBuffer, len);
+  }
+  logPos -= len;
+  memmove(logBuffer, &logBuffer[len], logPos);
+  logLineEnd = 0;
+  logBatchStart = millis();
+}
+
+static void ResumeUpload() {
+  if (paused_client) {
+    paused_client->ack(SIZE_MAX);
+    paused_client = nullptr;
+  }
+}
+
 static void WebUploadResponseHandler(AsyncWebServerRequest *request) {
+  ResumeUpload();
   if (updater.hasError()) {
     StreamString p = StreamString();
     updater.printError(p);
@@ -329,8 +687,10 @@ static void WebUploadResponseHandler(AsyncWebServerRequest *request) {
       do_flash = true;
     } else {
       String message = String(R"({"status": "mismatch", "msg": "<b>Current target:</b> )") + (const char *)&target_name[4] + ".<br>";
-      if (target_found.length() != 0) {
-        message += "<b>Uploaded image:</b> " + target_found + ".<br/>";
+      if (target_found_len != 0) {
+        message += "<b>Uploaded image:</b> ";
+        message += target_found;
+        message += ".<br/>";
       }
       message += "<br/>Flashing the wrong firmware may lock or damage your device.\"}";
       request->send(200, "application/json", message);
@@ -342,10 +702,21 @@ static void WebUploadDataHandler(AsyncWebServerRequest *request, const String& f
   if (index == 0) {
     DBGLN("Update: %s, %s", filename.c_str(), request->arg("type").c_str());
     target_seen = false;
-    target_found.clear();
+    target_matcher.begin(target_name, target_name_size);
+    magic_matcher.begin(target_magic, sizeof(target_magic));
+    target_found[0] = 0;
+    target_found_len = 0;
+    target_capturing = false;
     target_complete = false;
-    target_pos = 0;
     totalSize = 0;
+    paused_client = nullptr;
+    upload_final = false;
+    abort_upload = false;
+    request->onDisconnect([]() {
+      paused_client = nullptr;
+      if (!upload_final)
+        abort_upload = true;
+    });
     #ifdef STM32_TX_BACKPACK
       if (request->arg("type").equals("tx"))
       {
@@ -379,31 +750,39 @@ static void WebUploadDataHandler(AsyncWebServerRequest *request, const String& f
       if (force_update || (totalSize == 0 && *data == 0x1F)) // forced or gzipped image, we can't check
         target_seen = true;
       if (!target_seen) {
-        for (size_t i=0 ; i<len ;i++) {
-          if (!target_complete && (target_pos >= 4 || target_found.length() > 0)) {
-            if (target_pos == 4) {
-              target_found.clear();
-            }
-            if (data[i] == 0 || target_found.length() > 50) {
+        for (size_t i=0 ; i<len && !target_seen ;i++) {
+          uint8_t c = data[i];
+          // Keep the name of the first image target found, to report a mismatch
+          if (target_capturing) {
+            if (c == 0 || target_found_len >= TARGET_FOUND_MAX) {
+              target_capturing = false;
               target_complete = true;
             }
             else {
-              target_found += (char)data[i];
+              target_found[target_found_len++] = c;
+              target_found[target_found_len] = 0;
             }
           }
-          if (data[i] == target_name[target_pos]) {
-            ++target_pos;
-            if (target_pos >= target_name_size) {
-              target_seen = true;
-            }
+          if (!target_complete && magic_matcher.feed(c)) {
+            target_capturing = true;
+            target_found_len = 0;
+            target_found[0] = 0;
           }
-          else {
-            target_pos = 0; // Startover
+          if (target_matcher.feed(c)) {
+            target_seen = true;
           }
         }
       }
       totalSize += len;
     }
+    // Hold back the TCP acks so the sender waits for the STM32 UART
+    if (updater.needsPause()) {
+      request->client()->ackLater();
+      paused_client = request->client();
+    }
+  }
+  if (final) {
+    upload_final = true;
   }
 }
 
@@ -565,11 +944,17 @@ static void startServices()
   server.on("/scan.js", WebUpdateSendContent);
   server.on("/logo.svg", WebUpdateSendContent);
   server.on("/config", HTTP_GET, GetConfiguration);
+  server.on("/stats", HTTP_GET, GetStats);
+  server.on("/recorder.bin", HTTP_GET, GetRecorder);
+#if defined(LOOP_PROFILER)
+  server.on("/profile", HTTP_GET, GetProfile);
+#endif
   server.on("/networks.json", WebUpdateSendNetworks);
   server.on("/sethome", WebUpdateSetHome);
   server.on("/forget", WebUpdateForget);
   server.on("/connect", WebUpdateConnect);
   server.on("/access", WebUpdateAccessPoint);
+  server.on("/espnow", HTTP_POST, WebUpdateSetEspnow);
 
   server.on("/generate_204", WebUpdateHandleRoot); // handle Andriod phones doing shit to detect if there is 'real' internet and possibly dropping conn.
   server.on("/gen_204", WebUpdateHandleRoot);
@@ -590,6 +975,7 @@ static void startServices()
   server.on("/log.js", WebUpdateSendContent);
   server.on("/log.html", WebUpdateSendContent);
   server.addHandler(&logging);
+  server.addHandler(&loggingWS);
 
   server.onNotFound(WebUpdateHandleNotFound);
 
@@ -666,15 +1052,40 @@ static void HandleWebUpdate()
 
   if (servicesStarted)
   {
-    while (Serial.available()) {
+    ScanCacheUpdate(now);
+#if defined(AAT_BACKPACK)
+    WebAatLoop(now);
+#endif
+    updater.handle();
+    if (!updater.needsPause())
+      ResumeUpload();
+    // A failed STM32 write or a dropped client would otherwise leave the
+    // bootloader holding the serial port until reboot
+    bool dropped = abort_upload;
+    abort_upload = false;
+    if ((dropped || (updater.ownsSerial() && updater.hasError())) && updater.isRunning()) {
+      DBGLN("Upload aborted");
+      updater.abort();
+    }
+
+    while (!updater.ownsSerial() && Serial.available()) {
       int val = Serial.read();
+      if (logPos == 0) {
+        logBatchStart = millis();
+      }
       logBuffer[logPos++] = val;
-      logBuffer[logPos] = 0;
-      if (val == '\n' || logPos == sizeof(logBuffer)-1) {
-        logging.send(logBuffer);
-        logPos = 0;
+      if (val == '\n') {
+        logLineEnd = logPos;
       }
+      // Leave room for the terminator LogSend() adds
+      if (logPos == sizeof(logBuffer) - 1) {
+        LogFlush(logLineEnd != 0 ? logLineEnd : logPos);
+      }
+    }
+    if (logLineEnd != 0 && millis() - logBatchStart >= LOG_BATCH_MS) {
+      LogFlush(logLineEnd);
     }
+    loggingWS.cleanupClients();
 
     dnsServer.processNextRequest();
     #if defined(PLATFORM_ESP8266)
@@ -727,7 +1138,8 @@ device_t WIFI_device = {
   .initialize = wifiOff,
   .start = start,
   .event = event,
-  .timeout = timeout
+  .timeout = timeout,
+  .events = EVENT_CONNECTION_STATE | EVENT_WIFI_REQUEST
 };
 
 #endif
@@ -102,6 +102,16 @@ VrxBackpackConfig::Load()
     // Populate the struct from eeprom
     m_eeprom->Get(0, m_config);
 
+    // Version 4 only added the sync state at the end, the rest of a version 3 config is kept
+    if (m_config.version == (uint32_t)(3 | VRX_BACKPACK_CONFIG_MAGIC))
+    {
+        DBGLN("Upgrading EEPROM from version 3");
+        memset(&m_config.sync, 0, sizeof(m_config.sync));
+        m_config.version = VRX_BACKPACK_CONFIG_VERSION | VRX_BACKPACK_CONFIG_MAGIC;
+        m_modified = true;
+        Commit();
+    }
+
     // Check if version number matches
     if (m_config.version != (uint32_t)(VRX_BACKPACK_CONFIG_VERSION | VRX_BACKPACK_CONFIG_MAGIC))
     {
@@ -198,6 +208,27 @@ VrxBackpackConfig::SetStartWiFiOnBoot(bool startWifi)
     m_modified = true;
 }
 
+void
+VrxBackpackConfig::SetSyncChannel(uint8_t index, uint16_t frequency, uint16_t digest)
+{
+    if (m_config.sync.channelIndex == index && m_config.sync.frequency == frequency && m_config.sync.vtxDigest == digest)
+        return;
+    m_config.sync.channelIndex = index;
+    m_config.sync.frequency = frequency;
+    m_config.sync.vtxDigest = digest;
+    m_modified = true;
+}
+
+void
+VrxBackpackConfig::SetSyncHeadTracking(bool enabled, uint16_t digest)
+{
+    if (m_config.sync.headTracking == enabled && m_config.sync.htDigest == digest)
+        return;
+    m_config.sync.headTracking = enabled;
+    m_config.sync.htDigest = digest;
+    m_modified = true;
+}
+
 #if defined(AAT_BACKPACK)
 
 void
@@ -242,6 +273,12 @@ VrxBackpackConfig::SetAatServoMode(uint8_t val)
     CONFIG_MOD_CHECK(m_config.aat.servoMode, val);
 }
 
+void
+VrxBackpackConfig::SetAatProject(uint8_t val)
+{
+    CONFIG_MOD_CHECK(m_config.aat.project, val);
+}
+
 /**
  * @brief: Validate that the endpoints have a valid range, i.e. low/high not the same
 */
@@ -8,7 +8,7 @@
 #define TIMER_BACKPACK_CONFIG_MAGIC (0b11 << 30)
 
 #define TX_BACKPACK_CONFIG_VERSION      3
-#define VRX_BACKPACK_CONFIG_VERSION     3
+#define VRX_BACKPACK_CONFIG_VERSION     4
 #define TIMER_BACKPACK_CONFIG_VERSION   3
 
 #if defined(TARGET_TX_BACKPACK)
@@ -67,7 +67,7 @@ typedef struct {
         uint8_t     satelliteHomeMin;   // minimum number of satellites to establish home
         uint8_t     servoSmooth;    // 0-9 for min smoothing to most smoothing
         uint8_t     centerDir;      // Direction servo points at center position 0=N 2=E 4=S 6=W (can hold 45 degrees but only 90 is supported)
-        uint8_t     project;        // FUTURE: 0=none, 1=projectAzim, 2=projectElev, 3=projectBoth
+        uint8_t     project;        // 0=none, 1=projectAzim, 2=projectElev, 3=projectBoth
         uint8_t     units;          // FUTURE: 0=meters, anything else=also meters :-D
         uint8_t     servoMode;      // 0=2:1, 1=clip180, FUTURE: 180+flip servo
                                     // Also maybe invertAzim / invertElev servo bit or just swap low/high
@@ -82,6 +82,16 @@ typedef struct {
         int16_t offset;
     } vbat;
 #endif
+
+    // Added in version 4, what was last applied to the receiver. Restored at boot
+    // so the sync request's digests are right and the TX only resends what changed
+    struct __attribute__((packed)) tagSyncState {
+        uint8_t     channelIndex;
+        uint16_t    frequency;      // MHz, tuned to instead of channelIndex when set
+        bool        headTracking;
+        uint16_t    vtxDigest;      // 0 when nothing was applied
+        uint16_t    htDigest;
+    } sync;
 } vrx_backpack_config_t;
 
 class VrxBackpackConfig
@@ -97,11 +107,18 @@ public:
     char    *GetSSID() { return m_config.ssid; }
     char    *GetPassword() { return m_config.password; }
     uint8_t *GetGroupAddress() { return m_config.address; }
+    uint8_t  GetSyncChannelIndex() const { return m_config.sync.channelIndex; }
+    uint16_t GetSyncFrequency() const { return m_config.sync.frequency; }
+    uint16_t GetSyncVTXDigest() const { return m_config.sync.vtxDigest; }
+    bool     GetSyncHeadTracking() const { return m_config.sync.headTracking; }
+    uint16_t GetSyncHTDigest() const { return m_config.sync.htDigest; }
 
     // Setters
     void SetStorageProvider(ELRS_EEPROM *eeprom);
     void SetDefaults();
     void SetBootCount(uint8_t count);
+    void SetSyncChannel(uint8_t index, uint16_t frequency, uint16_t digest);
+    void SetSyncHeadTracking(bool enabled, uint16_t digest);
     void SetStartWiFiOnBoot(bool startWifi);
     void SetSSID(const char *ssid);
     void SetPassword(const char *ssid);
@@ -114,6 +131,7 @@ public:
     uint8_t GetAatServoMode() const { return m_config.aat.servoMode; }
     void SetAatServoMode(uint8_t val);
     uint8_t GetAatProject() const { return m_config.aat.project; }
+    void SetAatProject(uint8_t val);
     uint8_t GetAatCenterDir() const { return m_config.aat.centerDir; }
     void SetAatCenterDir(uint8_t val);
     uint16_t GetAatServoLow(uint8_t idx) const { return m_config.aat.servoEndpoints[idx].low; }
@@ -42,4 +42,124 @@ void debugPrintf(const char* fmt, ...)
     c = GETCHAR;
   }
   va_end(vlist);
-}
\ No newline at end of file
+}
+
+#if defined(LOG_DEFERRED)
+#include "FIFO.h"
+
+#ifndef LOG_DEFERRED_SIZE
+#define LOG_DEFERRED_SIZE 2048
+#endif
+// Longest single queued message; the format pointer, flags and its arguments
+#define LOG_RECORD_SIZE 96
+// Strings are copied at log time as they may not outlive the call
+#define LOG_STRING_MAX  32
+
+typedef struct __attribute__((packed)) {
+  const char *fmt;
+  uint8_t newline;
+} logRecordHeader_t;
+
+static FIFO<LOG_DEFERRED_SIZE> logFifo;
+static volatile uint32_t logDropped = 0;
+
+void debugPrintfDeferred(bool newline, const char* fmt, ...)
+{
+  uint8_t record[LOG_RECORD_SIZE];
+  logRecordHeader_t *header = (logRecordHeader_t *)record;
+  header->fmt = fmt;
+  header->newline = newline;
+  uint8_t pos = sizeof(logRecordHeader_t);
+
+  va_list  vlist;
+  va_start(vlist,fmt);
+
+  // Only the arguments are captured, formatting happens in debugFlush()
+  char c = GETCHAR;
+  while(c) {
+    if (c == '%') {
+      fmt++;
+      c = GETCHAR;
+      if (c == 's') {
+        if (pos + 1 >= LOG_RECORD_SIZE)
+          break;
+        const char *str = va_arg(vlist,const char *);
+        uint8_t len = min(strlen(str), (size_t)min(LOG_STRING_MAX, LOG_RECORD_SIZE - pos - 1));
+        record[pos++] = len;
+        memcpy(&record[pos], str, len);
+        pos += len;
+      } else if (c == 'd' || c == 'u' || c == 'x' || c == 'c') {
+        if (pos + sizeof(uint32_t) > LOG_RECORD_SIZE)
+          break;
+        uint32_t value = va_arg(vlist,uint32_t);
+        memcpy(&record[pos], &value, sizeof(value));
+        pos += sizeof(value);
+      } else if (c == 0) {
+        break;
+      }
+    }
+    fmt++;
+    c = GETCHAR;
+  }
+  va_end(vlist);
+
+  if (!logFifo.push(record, pos))
+  {
+    logDropped++;
+  }
+}
+
+void debugFlush()
+{
+  uint8_t record[LOG_RECORD_SIZE];
+  uint8_t len;
+
+  if (logDropped)
+  {
+    LOGGING_UART.print("[log dropped ");
+    LOGGING_UART.print(logDropped, DEC);
+    LOGGING_UART.println("]");
+    logDropped = 0;
+  }
+
+  while ((len = logFifo.pop(record, sizeof(record))) != 0)
+  {
+    logRecordHeader_t *header = (logRecordHeader_t *)record;
+    const char *fmt = header->fmt;
+    uint8_t pos = sizeof(logRecordHeader_t);
+
+    char c = GETCHAR;
+    while(c) {
+      if (c == '%') {
+        fmt++;
+        c = GETCHAR;
+        if (c == 's' && pos < len) {
+          uint8_t strLen = record[pos++];
+          LOGGING_UART.write(&record[pos], strLen);
+          pos += strLen;
+        } else if ((c == 'd' || c == 'u' || c == 'x' || c == 'c') && pos + sizeof(uint32_t) <= len) {
+          uint32_t value;
+          memcpy(&value, &record[pos], sizeof(value));
+          pos += sizeof(value);
+          if (c == 'd')
+            LOGGING_UART.print((int32_t)value, DEC);
+          else if (c == 'u')
+            LOGGING_UART.print(value, DEC);
+          else if (c == 'x')
+            LOGGING_UART.print(value, HEX);
+          else
+            LOGGING_UART.write((uint8_t)value);
+        } else if (c == 0) {
+          break;
+        }
+      } else {
+        LOGGING_UART.write(c);
+      }
+      fmt++;
+      c = GETCHAR;
+    }
+    if (header->newline)
+      LOGGING_UART.println();
+  }
+}
+#endif
@@ -9,7 +9,11 @@
  * DBGLN / DBGVLN - Same as DBG except also includes newline
  * DBGW / DBGVW - Write a single byte to logging (Serial.write(x))
  * 
+ * DBGFLUSH - Print anything queued by LOG_DEFERRED, call from loop()
+ *
  * Set LOGGING_UART define to Serial instance to use if not Serial
+ * Define LOG_DEFERRED to queue the format and arguments in RAM and only format
+ * and print them from DBGFLUSH, keeping logging out of the timing of callbacks
  **/
 
 #ifndef LOGGING_UART
@@ -19,6 +23,8 @@
 // #define LOG_USE_PROGMEM
 
 extern void debugPrintf(const char* fmt, ...);
+extern void debugPrintfDeferred(bool newline, const char* fmt, ...);
+extern void debugFlush();
 
 #define INFOLN(msg, ...) { \
   debugPrintf(msg, ##__VA_ARGS__); \
@@ -26,7 +32,19 @@ extern void debugPrintf(const char* fmt, ...);
 }
 #define ERRLN(msg) LOGGING_UART.println("ERROR: " msg)
 
-#if defined(DEBUG_LOG) || defined(DEBUG_LOG_VERBOSE)
+#if (defined(DEBUG_LOG) || defined(DEBUG_LOG_VERBOSE)) && defined(LOG_DEFERRED)
+  #define DBGFLUSH()  debugFlush()
+  #define DBGCR       debugPrintfDeferred(true, "")
+  #define DBGW(c)     debugPrintfDeferred(false, "%c", c)
+  #ifndef LOG_USE_PROGMEM
+    #define DBG(msg, ...)   debugPrintfDeferred(false, msg, ##__VA_ARGS__)
+    #define DBGLN(msg, ...) { debugPrintfDeferred(true, msg, ##__VA_ARGS__); }
+  #else
+    #define DBG(msg, ...)   debugPrintfDeferred(false, PSTR(msg), ##__VA_ARGS__)
+    #define DBGLN(msg, ...) { debugPrintfDeferred(true, PSTR(msg), ##__VA_ARGS__); }
+  #endif
+#elif defined(DEBUG_LOG) || defined(DEBUG_LOG_VERBOSE)
+  #define DBGFLUSH()
   #define DBGCR   LOGGING_UART.println()
   #define DBGW(c) LOGGING_UART.write(c)
   #ifndef LOG_USE_PROGMEM
@@ -42,7 +60,9 @@ extern void debugPrintf(const char* fmt, ...);
       LOGGING_UART.println(); \
     }
   #endif
+#endif
 
+#if defined(DEBUG_LOG) || defined(DEBUG_LOG_VERBOSE)
   // Verbose logging is for spammy stuff
   #if defined(DEBUG_LOG_VERBOSE)
     #define DBGVCR DBGCR
@@ -56,6 +76,7 @@ extern void debugPrintf(const char* fmt, ...);
     #define DBGVLN(...)
   #endif
 #else
+  #define DBGFLUSH()
   #define DBGCR
   #define DBGW(c)
   #define DBG(...)
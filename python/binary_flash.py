@@ -12,6 +12,7 @@ from random import randint
 from os.path import dirname
 
 import UnifiedConfiguration
+import fleet_flash
 import serials_find
 import upload_via_esp8266_backpack
 
@@ -54,18 +55,26 @@ def upload_wifi(args, mcuType, upload_addr):
         upload_addr = [args.port]
     try:
         if mcuType == MCUType.ESP8266:
-            upload_via_esp8266_backpack.do_upload('firmware.bin.gz', upload_addr, False, {})
+            upload_via_esp8266_backpack.do_upload('firmware.bin.gz', None, upload_addr, False, {})
         else:
-            upload_via_esp8266_backpack.do_upload(args.file.name, upload_addr, False, {})
+            upload_via_esp8266_backpack.do_upload(args.file.name, None, upload_addr, False, {})
     except:
         return ElrsUploadResult.ErrorGeneral
     return ElrsUploadResult.Success
 
+def esp8266_uart_args(port, baud, filename):
+    return ['--chip', 'esp8266', '--port', port, '--baud', str(baud), '--after', 'soft_reset', 'write_flash', '0x0000', filename]
+
+def esp32_uart_args(platform, port, baud, filename):
+    dir = os.path.dirname(filename)
+    start_addr = '0x0000' if platform.startswith('esp32-c') else '0x1000'
+    return ['--chip', platform.replace('-', ''), '--port', port, '--baud', str(baud), '--after', 'hard_reset', 'write_flash', '-z', '--flash_mode', 'dio', '--flash_freq', '40m', '--flash_size', 'detect', start_addr, os.path.join(dir, 'bootloader.bin'), '0x8000', os.path.join(dir, 'partitions.bin'), '0xe000', os.path.join(dir, 'boot_app0.bin'), '0x10000', filename]
+
 def upload_esp8266_uart(args):
     if args.port == None:
         args.port = serials_find.get_serial_port()
     try:
-        esptool.main(['--chip', 'esp8266', '--port', args.port, '--baud', str(args.baud), '--after', 'soft_reset', 'write_flash', '0x0000', args.file.name])
+        esptool.main(esp8266_uart_args(args.port, args.baud, args.file.name))
     except:
         return ElrsUploadResult.ErrorGeneral
     return ElrsUploadResult.Success
@@ -92,9 +101,7 @@ def upload_esp32_uart(args):
     if args.port == None:
         args.port = serials_find.get_serial_port()
     try:
-        dir = os.path.dirname(args.file.name)
-        start_addr = '0x0000' if args.platform.startswith('esp32-c') else '0x1000'
-        esptool.main(['--chip', args.platform.replace('-', ''), '--port', args.port, '--baud', str(args.baud), '--after', 'hard_reset', 'write_flash', '-z', '--flash_mode', 'dio', '--flash_freq', '40m', '--flash_size', 'detect', start_addr, os.path.join(dir, 'bootloader.bin'), '0x8000', os.path.join(dir, 'partitions.bin'), '0xe000', os.path.join(dir, 'boot_app0.bin'), '0x10000', args.file.name])
+        esptool.main(esp32_uart_args(args.platform, args.port, args.baud, args.file.name))
     except:
         return ElrsUploadResult.ErrorGeneral
     return ElrsUploadResult.Success
@@ -230,6 +237,13 @@ def main():
     parser.add_argument("--baud", type=int, default=0, help="Baud rate for serial communication")
     parser.add_argument("--force", action='store_true', default=False, help="Force upload even if target does not match")
     parser.add_argument("--confirm", action='store_true', default=False, help="Confirm upload if a mismatched target was previously uploaded")
+    # Fleet flashing
+    parser.add_argument("--fleet", action='store_true', default=False, help="Flash every backpack found on serial ports and the network, in parallel")
+    parser.add_argument("--version", dest='fw_version', type=str, help="With --fleet, skip devices already running this version")
+    parser.add_argument("--jobs", type=int, default=4, help="With --fleet, number of devices flashed at the same time")
+    parser.add_argument("--mdns-wait", type=int, default=3, help="With --fleet, seconds to look for backpacks on the network")
+    parser.add_argument("--no-serial", action='store_true', default=False, help="With --fleet, do not flash over serial ports")
+    parser.add_argument("--no-wifi", action='store_true', default=False, help="With --fleet, do not flash over WiFi")
     # Firmware file to patch/configure
     parser.add_argument("file", nargs="?", type=argparse.FileType("r+b"))
 
@@ -244,7 +258,8 @@ def main():
 
     with open('hardware/targets.json') as f:
         targets = json.load(f)
-    mcu = MCUType.ESP8266 if targets[vendor][hardware][target]['platform'] == "esp8285" else MCUType.ESP32
+    args.platform = targets[vendor][hardware][target]['platform']
+    mcu = MCUType.ESP8266 if args.platform == "esp8285" else MCUType.ESP32
 
     if args.file is None:
         srcdir = targets[vendor][hardware][target]['firmware']
@@ -272,6 +287,10 @@ def main():
     else:
         devicetype = DeviceType.VRX
 
+    if args.fleet:
+        args.file.close()
+        sys.exit(ElrsUploadResult.Success if fleet_flash.flash_fleet(devicetype, mcu, args, args.file.name) else ElrsUploadResult.ErrorGeneral)
+
     ret = upload(devicetype, mcu, args)
     sys.exit(ret)
 
@@ -44,5 +44,5 @@ try:
 except FileNotFoundError:
     None
 env.AddPostAction("$BUILD_DIR/${PROGNAME}.bin", UnifiedConfiguration.appendConfiguration)
-if platform in ['espressif8266'] and "_WIFI" in target_name:
+if platform in ['espressif8266', 'espressif32'] and "_WIFI" in target_name:
     env.AddPostAction("$BUILD_DIR/${PROGNAME}.bin", esp_compress.compressFirmware)
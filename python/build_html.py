@@ -9,11 +9,15 @@ import fnmatch
 import elrs_helpers
 
 import gzip
+import hashlib
 from minify import (html_minifier, rcssmin, rjsmin)
 
 def get_version(env):
     return '%s (%s)' % (env.get('GIT_VERSION'), env.get('GIT_SHA'))
 
+def get_platform(env):
+    return re.sub("_via_.*", "", env['PIOENV'])
+
 def build_version(out, env):
     out.write('const char *VERSION = "%s";\n\n' % get_version(env))
 
@@ -26,32 +30,74 @@ def compress(data):
         f.write(data)
     return buf.getvalue()
 
-def build_html(mainfile, var, out, env):
-    with open('html/%s' % mainfile, 'r') as file:
-        data = file.read()
+# Bump when the minify/compress steps change, so older cache entries are not used
+CACHE_FORMAT = 1
+
+def cache_dir(env):
+    # Under the build dir rather than the env's own, every environment shares it
+    return os.path.join(env['PROJECT_BUILD_DIR'], 'html_cache')
+
+def process(mainfile, data, env, assets):
     if mainfile.endswith('.html'):
-        data = html_minifier.html_minify(data).replace('@VERSION@', get_version(env)).replace('@PLATFORM@', re.sub("_via_.*", "", env['PIOENV']))
+        data = html_minifier.html_minify(data).replace('@VERSION@', get_version(env)).replace('@PLATFORM@', get_platform(env))
+        # Reference assets by content hash so the browser can cache them for good
+        for name, etag in assets.items():
+            data = re.sub(r'((?:href|src)=["\']?)%s(?=["\'\s>])' % re.escape(name), r'\g<1>%s?v=%s' % (name, etag), data)
     if mainfile.endswith('.css'):
         data = rcssmin.cssmin(data)
     if mainfile.endswith('.js'):
         data = rjsmin.jsmin(data)
+    return compress(data.encode('utf-8'))
+
+def cached_process(mainfile, data, env, assets):
+    """Return the compressed asset, from the cache when the source and what is substituted into it are unchanged"""
+    key = hashlib.sha1()
+    key.update(('%d\0%s\0' % (CACHE_FORMAT, mainfile)).encode('utf-8'))
+    key.update(data.encode('utf-8'))
+    # Only pages get substitutions, scripts and styles are the same for every environment
+    if mainfile.endswith('.html'):
+        key.update(('\0%s\0%s' % (get_version(env), get_platform(env))).encode('utf-8'))
+        for name, etag in sorted(assets.items()):
+            key.update(('\0%s=%s' % (name, etag)).encode('utf-8'))
+    path = os.path.join(cache_dir(env), key.hexdigest() + '.gz')
+    if os.path.exists(path):
+        with open(path, 'rb') as f:
+            return f.read()
+    content = process(mainfile, data, env, assets)
+    # Environments may build in parallel, write the entry under another name then move it in place
+    os.makedirs(cache_dir(env), exist_ok=True)
+    fd, tmp = tempfile.mkstemp(dir=cache_dir(env))
+    with os.fdopen(fd, 'wb') as f:
+        f.write(content)
+    os.replace(tmp, path)
+    return content
+
+def build_html(mainfile, var, out, env, assets={}):
+    with open('html/%s' % mainfile, 'r') as file:
+        data = file.read()
+    content = cached_process(mainfile, data, env, assets)
+    etag = hashlib.sha1(content).hexdigest()[:16]
     out.write('static const char PROGMEM %s[] = {\n' % var)
-    out.write(','.join("0x{:02x}".format(c) for c in compress(data.encode('utf-8'))))
-    out.write('\n};\n\n')
+    out.write(','.join("0x{:02x}".format(c) for c in content))
+    out.write('\n};\n')
+    out.write('static const char %s_ETAG[] = "\\"%s\\"";\n\n' % (var, etag))
+    return etag
 
 def build_common(env, mainfile):
     fd, path = tempfile.mkstemp()
     try:
         with os.fdopen(fd, 'w') as out:
             build_version(out, env)
-            build_html(mainfile, "INDEX_HTML", out, env)
-            build_html("scan.js", "SCAN_JS", out, env)
-            build_html("mui.js", "MUI_JS", out, env)
-            build_html("elrs.css", "ELRS_CSS", out, env)
-            build_html("mui.css", "MUI_CSS", out, env)
-            build_html("logo.svg", "LOGO_SVG", out, env)
-            build_html("log.html", "LOG_HTML", out, env)
-            build_html("log.js", "LOG_JS", out, env)
+            # Assets first, the pages that reference them embed their hashes
+            assets = {}
+            assets["scan.js"] = build_html("scan.js", "SCAN_JS", out, env)
+            assets["mui.js"] = build_html("mui.js", "MUI_JS", out, env)
+            assets["elrs.css"] = build_html("elrs.css", "ELRS_CSS", out, env)
+            assets["mui.css"] = build_html("mui.css", "MUI_CSS", out, env)
+            assets["logo.svg"] = build_html("logo.svg", "LOGO_SVG", out, env)
+            assets["log.js"] = build_html("log.js", "LOG_JS", out, env)
+            build_html("log.html", "LOG_HTML", out, env, assets)
+            build_html(mainfile, "INDEX_HTML", out, env, assets)
     finally:
         if not os.path.exists("include/WebContent.h") or not filecmp.cmp(path, "include/WebContent.h"):
             shutil.copyfile(path, "include/WebContent.h")
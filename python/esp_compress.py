@@ -44,7 +44,7 @@ def binary_compress(target_file, source_file):
 
 
 def compressFirmware(source, target, env):
-    """ Compress ESP8266 firmware using gzip for 'compressed OTA upload' """
+    """ Compress ESP8266/ESP32 firmware using gzip for 'compressed OTA upload' """
     if FIRMWARE_PACKING_ENABLED:
         build_dir = env.subst("$BUILD_DIR")
         image_name = env.subst("$PROGNAME")
@@ -0,0 +1,306 @@
+#!/usr/bin/python
+
+# Flash every backpack that can be found, over serial and WiFi at once.
+#
+# Serial ports are taken from serials_find, backpacks on the network from the
+# "_http._tcp" services startMDNS() advertises with vendor=elrs. Only devices
+# reporting the target the image was built for are flashed, unless --force is
+# given, and those already on the version being flashed are skipped. Each device is flashed
+# from a worker thread of its own, the esptool and curl runs are subprocesses
+# so their output can be kept per device rather than interleaved.
+
+import gzip
+import json
+import os
+import re
+import shutil
+import socket
+import subprocess
+import sys
+import threading
+import time
+import urllib.request
+from concurrent.futures import ThreadPoolExecutor
+from os.path import dirname
+
+import bootloader
+import serials_find
+import upload_via_esp8266_backpack
+
+ESPTOOL = os.path.join(dirname(__file__), 'external', 'esptool', 'esptool.py')
+
+MSP_ELRS_GET_BACKPACK_VERSION = 0x10
+MSP_PORT_INBUF_SIZE = 64
+MDNS_SERVICE = '_http._tcp.local.'
+# The marker the firmware puts in front of its target name, see options.cpp
+TARGET_MAGIC = b'\xBE\xEF\xCA\xFE'
+
+
+class Device:
+    def __init__(self, kind, address, name, version=None, devtype=None, target=None):
+        self.kind = kind            # 'serial' or 'wifi'
+        self.address = address      # port, or host for HTTP
+        self.name = name
+        self.version = version
+        self.devtype = devtype
+        self.target = target
+        self.target_cut = False     # only the start of the target name fitted in the reply
+        self.state = 'queued'
+        self.progress = None
+        self.error = None
+
+    def __str__(self):
+        return '%s %s' % (self.kind, self.name)
+
+
+class Report:
+    """ One status line per device, redrawn as they change """
+    def __init__(self, devices):
+        self.devices = devices
+        self.lock = threading.Lock()
+
+    def update(self, device, state=None, progress=None, error=None):
+        with self.lock:
+            if state is not None:
+                device.state = state
+            device.progress = progress
+            if error is not None:
+                device.error = error
+            line = '  %-28s %-10s' % (device, device.state)
+            if device.progress is not None:
+                line += ' %3d%%' % device.progress
+            if device.error:
+                line += '  %s' % device.error
+            print(line, flush=True)
+
+    def summary(self):
+        done = [d for d in self.devices if d.state == 'done']
+        skipped = [d for d in self.devices if d.state == 'skipped']
+        failed = [d for d in self.devices if d.state == 'failed']
+        print()
+        print('Flashed %d, skipped %d, failed %d' % (len(done), len(skipped), len(failed)))
+        for d in failed:
+            print('  FAILED %s: %s' % (d, d.error))
+        return len(failed) == 0
+
+
+def msp_v2_request(function):
+    frame = [0, function & 0xFF, function >> 8, 0, 0]
+    return bytes([ord('$'), ord('X'), ord('<')] + frame + [bootloader.calc_crc8(frame)])
+
+def serial_version(port, timeout=1.0):
+    """
+    Ask a TX or Timer backpack for its version with MSP_ELRS_GET_BACKPACK_VERSION
+    :returns: (version, target, cut), target None from firmware that does not send it and cut
+              if it did not fit in the reply, or None if nothing answers
+    """
+    import serial
+    try:
+        with serial.Serial(port, 460800, timeout=0.1) as s:
+            s.reset_input_buffer()
+            s.write(msp_v2_request(MSP_ELRS_GET_BACKPACK_VERSION))
+            data = b''
+            end = time.time() + timeout
+            while time.time() < end:
+                data += s.read(64)
+                start = data.find(b'$X>')
+                if start >= 0 and len(data) >= start + 8:
+                    size = data[start + 6] | (data[start + 7] << 8)
+                    if len(data) >= start + 9 + size:
+                        # The version, then the target after a NUL
+                        fields = data[start + 8:start + 8 + size].decode('ascii', 'replace').split('\0')
+                        target = fields[1] if len(fields) > 1 and fields[1] else None
+                        return fields[0], target, size == MSP_PORT_INBUF_SIZE
+    except Exception:
+        pass
+    return None
+
+def firmware_target(firmware):
+    """ The target name built into a firmware image, None if it has none """
+    with open(firmware, 'rb') as f:
+        data = f.read()
+    start = data.find(TARGET_MAGIC)
+    if start < 0:
+        return None
+    start += len(TARGET_MAGIC)
+    return data[start:data.index(b'\0', start)].decode('ascii', 'replace')
+
+def target_matches(device, wanted):
+    """ True if device reported the target wanted, or the start of it when the name did not fit """
+    if device.target is None or wanted is None:
+        return False
+    if device.target_cut:
+        return wanted.upper().startswith(device.target.upper())
+    return device.target.upper() == wanted.upper()
+
+def http_version(host, timeout=3):
+    """ The version a backpack in WiFi mode reports in /config """
+    try:
+        with urllib.request.urlopen('http://%s/config' % host, timeout=timeout) as r:
+            return json.load(r).get('config', {}).get('version')
+    except Exception:
+        return None
+
+def discover_serial():
+    """ Ports with a backpack answering MSP_ELRS_GET_BACKPACK_VERSION, asked in parallel """
+    ports = serials_find.serial_ports()
+    if not ports:
+        return []
+    with ThreadPoolExecutor(max_workers=len(ports)) as pool:
+        answers = list(pool.map(serial_version, ports))
+    devices = []
+    for port, answer in zip(ports, answers):
+        device = Device('serial', port, port)
+        if answer is None:
+            device.state = 'silent'
+        else:
+            device.version, device.target, device.target_cut = answer
+        devices.append(device)
+    return devices
+
+def discover_mdns(wait):
+    """ Backpacks advertised over mDNS, empty if the zeroconf module is not installed """
+    try:
+        from zeroconf import ServiceBrowser, Zeroconf
+    except ImportError:
+        print('  ** zeroconf is not installed (pip install zeroconf), not looking for WiFi backpacks **')
+        return []
+
+    found = {}
+    zc = Zeroconf()
+
+    class Listener:
+        def add_service(self, zc, type, name):
+            info = zc.get_service_info(type, name)
+            if info is None:
+                return
+            props = {k.decode(): (v.decode() if v else '') for k, v in info.properties.items()}
+            if props.get('vendor') != 'elrs' or not info.addresses:
+                return
+            host = socket.inet_ntoa(info.addresses[0])
+            found[host] = Device('wifi', host, '%s (%s)' % (info.server.rstrip('.'), host),
+                                 props.get('version'), props.get('type'), props.get('target'))
+
+        def update_service(self, zc, type, name):
+            self.add_service(zc, type, name)
+
+        def remove_service(self, zc, type, name):
+            pass
+
+    ServiceBrowser(zc, MDNS_SERVICE, Listener())
+    time.sleep(wait)
+    zc.close()
+    return list(found.values())
+
+def run_tracked(cmd, device, report, pattern):
+    """ Run cmd, reporting the percentages pattern picks out of its output """
+    proc = subprocess.Popen(cmd, stdout=subprocess.PIPE, stderr=subprocess.STDOUT)
+    last = None
+    tail = []
+    buf = b''
+    while True:
+        chunk = proc.stdout.read(64)
+        if not chunk:
+            break
+        buf += chunk
+        lines = re.split(rb'[\r\n]', buf)
+        buf = lines.pop()
+        for line in lines:
+            text = line.decode('utf-8', 'replace').strip()
+            if not text:
+                continue
+            tail = (tail + [text])[-3:]
+            m = re.search(pattern, text)
+            if m:
+                percent = int(float(m.group(1)))
+                if percent != last and (last is None or percent - last >= 10 or percent == 100):
+                    last = percent
+                    report.update(device, 'flashing', percent)
+    if proc.wait() != 0:
+        raise Exception(tail[-1] if tail else 'exit code %d' % proc.returncode)
+    return tail
+
+def flash_serial(device, report, mcu, args, firmware):
+    # binary_flash is usually __main__, compare the MCUType by value
+    import binary_flash
+    baud = args.baud if args.baud else 460800
+    if str(mcu) == 'esp8266':
+        esp_args = binary_flash.esp8266_uart_args(device.address, baud, firmware)
+    else:
+        esp_args = binary_flash.esp32_uart_args(args.platform, device.address, baud, firmware)
+    run_tracked([sys.executable, ESPTOOL] + esp_args, device, report, r'\((\d+) ?%\)')
+
+def flash_wifi(device, report, mcu, args, firmware):
+    if str(mcu) == 'esp8266':
+        firmware = firmware + '.gz'
+    cmd = upload_via_esp8266_backpack.upload_command(firmware) + ['--progress-bar', '--fail',
+        upload_via_esp8266_backpack.upload_url(device.address, False)]
+    tail = run_tracked(cmd, device, report, r'(\d+(?:\.\d+)?)%')
+    # The backpack answers a rejected image with a JSON status
+    if tail and '"status": "mismatch"' in tail[-1].replace("'", '"'):
+        raise Exception('target mismatch, use --force to flash anyway')
+
+def flash_one(device, report, mcu, args, firmware):
+    try:
+        if args.fw_version:
+            report.update(device, 'checking')
+            if device.version is None and device.kind == 'wifi':
+                device.version = http_version(device.address)
+            if device.version == args.fw_version:
+                report.update(device, 'skipped', error='already %s' % device.version)
+                return
+        report.update(device, 'flashing', 0)
+        if device.kind == 'serial':
+            flash_serial(device, report, mcu, args, firmware)
+        else:
+            flash_wifi(device, report, mcu, args, firmware)
+        report.update(device, 'done')
+    except Exception as e:
+        report.update(device, 'failed', error=str(e))
+
+def flash_fleet(devicetype, mcu, args, firmware):
+    """
+    Discover and flash every reachable backpack of devicetype with firmware
+    :returns: True if none of them failed
+    """
+    target = firmware_target(firmware)
+    devices = []
+    if not args.no_serial:
+        print('  ** Asking serial ports for a backpack version **')
+        devices += discover_serial()
+    if not args.no_wifi:
+        print('  ** Looking for backpacks on the network for %ds **' % args.mdns_wait)
+        devices += discover_mdns(args.mdns_wait)
+
+    # Anything that is not known to be the kind and target being flashed is
+    # left alone, a serial port may as well be a flight controller or a receiver
+    wanted = []
+    for d in devices:
+        if args.force:
+            wanted.append(d)
+        elif d.state == 'silent':
+            print('  %-28s no backpack answered, use --force to flash anyway' % d)
+        elif d.devtype not in (None, str(devicetype)):
+            print('  %-28s is a %s backpack' % (d, d.devtype))
+        elif not target_matches(d, target):
+            print('  %-28s target %s, image is for %s, use --force to flash anyway' % (d, d.target or 'unknown', target or 'unknown'))
+        else:
+            wanted.append(d)
+    devices = wanted
+
+    if not devices:
+        print('No devices found')
+        return False
+
+    # Compressed once up front, the workers would race each other writing it
+    if str(mcu) == 'esp8266' and any(d.kind == 'wifi' for d in devices):
+        with open(firmware, 'rb') as f_in, gzip.open(firmware + '.gz', 'wb') as f_out:
+            shutil.copyfileobj(f_in, f_out)
+
+    print()
+    print('Flashing %d device(s), %d at a time:' % (len(devices), args.jobs))
+    report = Report(devices)
+    with ThreadPoolExecutor(max_workers=args.jobs) as pool:
+        for device in devices:
+            pool.submit(flash_one, device, report, mcu, args, firmware)
+    return report.summary()
@@ -0,0 +1,449 @@
+import sys
+import json
+import time
+import argparse
+import threading
+
+# Hardware-in-the-loop latency and throughput benchmark.
+#
+# Drives a TX backpack's UART with scripted mixes of MSP traffic while
+# capturing the UART of the VRX or Timer backpack it is bound to, both from
+# this host. Every frame carries a sequence number in a field the receiving
+# backpack passes on to its module, so arrivals are matched to sends and the
+# one-way latency is the difference of two readings of the same clock (the
+# USB serial adapters' own buffering included).
+#
+# What comes out of the receiving UART depends on the module it talks to:
+#   vtx, osd   MSP modules (Skyzone, HDZero)    SET_CHANNEL_INDEX, OSD writes and draws
+#   crsf       Fusion                           CRSF battery frames, at most one per 500ms
+#   ptr        MSP modules, the other way       written to the VRX UART, read on the TX UART
+#   recording  Timer                            SET_RECORDING_STATE
+#
+# vtx, ptr and crsf only keep the newest value on their way through, so frames
+# sent faster than they are handled are superseded rather than lost, and are
+# reported as such.
+
+MSP_SET_VTX_CONFIG = 0x0059
+MSP_ELRS_SET_OSD = 0x00B6
+MSP_ELRS_BACKPACK_CRSF_TLM = 0x0011
+MSP_ELRS_BACKPACK_SET_CHANNEL_INDEX = 0x0301
+MSP_ELRS_BACKPACK_SET_RECORDING_STATE = 0x0305
+MSP_ELRS_BACKPACK_SET_HEAD_TRACKING = 0x030D
+MSP_ELRS_BACKPACK_SET_PTR = 0x0383
+
+OSD_CMD_CLEAR = 2
+OSD_CMD_WRITE_STRING = 3
+OSD_CMD_DRAW = 4
+OSD_ROWS = 18
+OSD_COLS = 50
+
+CRSF_SYNC_BYTE = 0xC8
+CRSF_FRAMETYPE_BATTERY_SENSOR = 0x08
+CRSF_FRAMETYPE_EXTENDED = 0x40
+
+def crc8(crc, a):
+  crc = crc ^ a
+  for ii in range(8):
+    if crc & 0x80:
+      crc = (crc << 1) ^ 0xD5
+    else:
+      crc = crc << 1
+  return crc & 0xFF
+
+CRC_TABLE = [crc8(0, i) for i in range(256)]
+
+def calc_crc(data):
+  crc = 0
+  for x in data:
+    crc = CRC_TABLE[crc ^ x]
+  return crc
+
+def msp_frame(function, payload):
+  body = bytes([0, function & 0xFF, function >> 8, len(payload) & 0xFF, len(payload) >> 8]) + bytes(payload)
+  return b'$X<' + body + bytes([calc_crc(body)])
+
+def crsf_frame(type, payload):
+  body = bytes([type]) + bytes(payload)
+  return bytes([CRSF_SYNC_BYTE, len(body) + 1]) + body + bytes([calc_crc(body)])
+
+# Streams: how a sequence number goes into a frame on the way in, and comes
+# back out of what the receiving backpack writes. modulus is the range of the
+# field it travels in.
+
+class Stream:
+  name = None
+  direction = 'tx'      # written to the TX backpack, 'rx' for the other way
+  modulus = 1 << 16
+  coalesces = False
+
+  def frames(self, seq):
+    raise NotImplementedError
+
+  # seq carried by a frame read back, or None if it is not one of ours
+  def match_msp(self, function, payload):
+    return None
+
+  def match_crsf(self, frame):
+    return None
+
+class VtxStream(Stream):
+  name = 'vtx'
+  modulus = 48
+  coalesces = True
+
+  def frames(self, seq):
+    return [msp_frame(MSP_SET_VTX_CONFIG, [seq % 48, 0, 0, 0])]
+
+  def match_msp(self, function, payload):
+    if function == MSP_ELRS_BACKPACK_SET_CHANNEL_INDEX and len(payload) >= 1:
+      return payload[0]
+
+class OsdStream(Stream):
+  """ A clear, a screen of writes and a draw. Only changes reach the goggles, so the screen is rebuilt here to read the number back """
+  name = 'osd'
+  modulus = 1 << 32
+
+  def __init__(self, rows):
+    self.rows = rows
+    self.screen = [[' '] * OSD_COLS for _ in range(OSD_ROWS)]
+
+  def frames(self, seq):
+    out = [msp_frame(MSP_ELRS_SET_OSD, [OSD_CMD_CLEAR])]
+    out.append(msp_frame(MSP_ELRS_SET_OSD, [OSD_CMD_WRITE_STRING, 0, 0, 0] + list(b'%08X' % seq)))
+    for row in range(1, self.rows):
+      text = ('%02d BENCH %08X' % (row, seq + row)).encode()
+      out.append(msp_frame(MSP_ELRS_SET_OSD, [OSD_CMD_WRITE_STRING, row, 2, 0] + list(text)))
+    out.append(msp_frame(MSP_ELRS_SET_OSD, [OSD_CMD_DRAW]))
+    return out
+
+  def match_msp(self, function, payload):
+    if function != MSP_ELRS_SET_OSD or len(payload) < 1:
+      return None
+    if payload[0] == OSD_CMD_CLEAR:
+      self.screen = [[' '] * OSD_COLS for _ in range(OSD_ROWS)]
+    elif payload[0] == OSD_CMD_WRITE_STRING and len(payload) >= 4:
+      row, col = payload[1], payload[2]
+      for i, c in enumerate(payload[4:]):
+        if row < OSD_ROWS and col + i < OSD_COLS:
+          self.screen[row][col + i] = chr(c)
+    elif payload[0] == OSD_CMD_DRAW:
+      try:
+        return int(''.join(self.screen[0][:8]), 16)
+      except ValueError:
+        pass
+    return None
+
+class CrsfStream(Stream):
+  """ Battery telemetry as an ELRS TX module hands it over, the number in the capacity field """
+  name = 'crsf'
+  modulus = 1 << 24
+  coalesces = True
+
+  def frames(self, seq):
+    battery = crsf_frame(CRSF_FRAMETYPE_BATTERY_SENSOR, [0x00, 0xA8, 0x00, 0x10, (seq >> 16) & 0xFF, (seq >> 8) & 0xFF, seq & 0xFF, 50])
+    return [msp_frame(MSP_ELRS_BACKPACK_CRSF_TLM, battery)]
+
+  def match_crsf(self, frame):
+    # Plain, or wrapped in the extended header the Fusion module uses
+    if frame[2] == CRSF_FRAMETYPE_BATTERY_SENSOR and len(frame) >= 11:
+      return frame[7] << 16 | frame[8] << 8 | frame[9]
+    if frame[2] == CRSF_FRAMETYPE_EXTENDED and len(frame) >= 14 and frame[5] == CRSF_FRAMETYPE_BATTERY_SENSOR:
+      return frame[10] << 16 | frame[11] << 8 | frame[12]
+
+class PtrStream(Stream):
+  """ Head tracking from the goggles, the number in place of roll """
+  name = 'ptr'
+  direction = 'rx'
+  coalesces = True
+
+  def frames(self, seq):
+    return [msp_frame(MSP_ELRS_BACKPACK_SET_PTR, [0x00, 0x08, 0x00, 0x08, seq & 0xFF, (seq >> 8) & 0xFF])]
+
+  def match_msp(self, function, payload):
+    if function == MSP_ELRS_BACKPACK_SET_PTR and len(payload) >= 6:
+      return payload[4] | payload[5] << 8
+
+class RecordingStream(Stream):
+  """ Recording state changes for a Timer backpack, the number in the delay """
+  name = 'recording'
+
+  def frames(self, seq):
+    return [msp_frame(MSP_ELRS_BACKPACK_SET_RECORDING_STATE, [seq & 1, seq & 0xFF, (seq >> 8) & 0xFF])]
+
+  def match_msp(self, function, payload):
+    if function == MSP_ELRS_BACKPACK_SET_RECORDING_STATE and len(payload) >= 3:
+      return payload[1] | payload[2] << 8
+
+def make_stream(name, osd_rows):
+  return {
+    'vtx': VtxStream,
+    'osd': lambda: OsdStream(osd_rows),
+    'crsf': CrsfStream,
+    'ptr': PtrStream,
+    'recording': RecordingStream,
+  }[name]()
+
+# Mixes: streams and the rate each is sent at, in Hz
+MIXES = {
+  'vtx':       {'vtx': 5},
+  'ptr50':     {'ptr': 50},
+  'ptr100':    {'ptr': 100},
+  'osd':       {'osd': 10},
+  'crsf':      {'crsf': 10},
+  'recording': {'recording': 10},
+  'flight':    {'vtx': 1, 'ptr': 50, 'osd': 10, 'crsf': 10},
+}
+
+class Tracker:
+  """ Send times of the frames in flight, matched up with what comes back """
+  def __init__(self, stream):
+    self.stream = stream
+    self.lock = threading.Lock()
+    self.inflight = {}
+    self.sent = 0
+    self.bytes = 0
+    self.received = 0
+    self.latencies = []
+
+  def sent_at(self, seq, t, size):
+    with self.lock:
+      self.inflight.setdefault(seq % self.stream.modulus, []).append(t)
+      self.sent += 1
+      self.bytes += size
+
+  def arrived(self, key, t):
+    with self.lock:
+      pending = self.inflight.get(key)
+      if not pending:
+        # A repeat, or from before the run started
+        return
+      # Anything older that came through the same slot was superseded
+      self.latencies.append(t - pending[-1])
+      del self.inflight[key]
+      self.received += 1
+
+class Capture(threading.Thread):
+  """ Reads a UART, handing each MSP v2 and CRSF frame found to the streams """
+  def __init__(self, port, trackers):
+    threading.Thread.__init__(self, daemon=True)
+    self.port = port
+    self.trackers = trackers
+    self.running = True
+    self.buf = bytearray()
+
+  def run(self):
+    while self.running:
+      data = self.port.read(self.port.in_waiting or 1)
+      t = time.perf_counter()
+      if data:
+        self.buf += data
+        self.parse(t)
+
+  def parse(self, t):
+    buf = self.buf
+    i = 0
+    while i < len(buf):
+      if buf[i] == ord('$'):
+        if len(buf) - i < 9:
+          break
+        if buf[i + 1] == ord('X') and buf[i + 2] in b'<>!':
+          size = buf[i + 6] | buf[i + 7] << 8
+          if size <= 512:
+            if len(buf) - i < 9 + size:
+              break
+            body = bytes(buf[i + 3:i + 8 + size])
+            if calc_crc(body) == buf[i + 8 + size]:
+              self.msp(body[1] | body[2] << 8, body[5:], t)
+              i += 9 + size
+              continue
+      elif buf[i] == CRSF_SYNC_BYTE:
+        if len(buf) - i < 2:
+          break
+        size = buf[i + 1]
+        if 2 <= size <= 62:
+          if len(buf) - i < 2 + size:
+            break
+          frame = bytes(buf[i:i + 2 + size])
+          if calc_crc(frame[2:-1]) == frame[-1]:
+            self.crsf(frame, t)
+            i += 2 + size
+            continue
+      i += 1
+    del buf[:i]
+
+  def msp(self, function, payload, t):
+    for tracker in self.trackers:
+      key = tracker.stream.match_msp(function, payload)
+      if key is not None:
+        tracker.arrived(key, t)
+
+  def crsf(self, frame, t):
+    for tracker in self.trackers:
+      key = tracker.stream.match_crsf(frame)
+      if key is not None:
+        tracker.arrived(key, t)
+
+def percentile(values, p):
+  if not values:
+    return None
+  values = sorted(values)
+  return values[min(len(values) - 1, int(p / 100.0 * len(values)))]
+
+def run_mix(ports, mix, args, scale=1.0):
+  trackers = [Tracker(make_stream(name, args.osd_rows)) for name in mix]
+  rates = [mix[name] * scale for name in mix]
+  captures = [Capture(ports['rx'], [t for t in trackers if t.stream.direction == 'tx']),
+              Capture(ports['tx'], [t for t in trackers if t.stream.direction == 'rx'])]
+  for c in captures:
+    c.start()
+
+  start = time.perf_counter()
+  next_send = [start] * len(trackers)
+  seqs = [0] * len(trackers)
+  while True:
+    now = time.perf_counter()
+    if now - start >= args.duration:
+      break
+    i = min(range(len(trackers)), key=lambda n: next_send[n])
+    if next_send[i] > now:
+      time.sleep(next_send[i] - now)
+    tracker = trackers[i]
+    data = b''.join(tracker.stream.frames(seqs[i]))
+    ports[tracker.stream.direction].write(data)
+    tracker.sent_at(seqs[i], time.perf_counter(), len(data))
+    seqs[i] += 1
+    next_send[i] += 1.0 / rates[i]
+
+  # Give the stragglers time to arrive
+  time.sleep(args.settle)
+  for c in captures:
+    c.running = False
+  for c in captures:
+    c.join()
+
+  elapsed = time.perf_counter() - start - args.settle
+  results = {}
+  for tracker in trackers:
+    lat = [x * 1000.0 for x in tracker.latencies]
+    results[tracker.stream.name] = {
+      'sent': tracker.sent,
+      'received': tracker.received,
+      'loss': 1.0 - tracker.received / tracker.sent if tracker.sent else 0.0,
+      'coalesces': tracker.stream.coalesces,
+      'rate': tracker.received / elapsed,
+      'bytes_per_s': tracker.bytes / elapsed,
+      'p50_ms': percentile(lat, 50),
+      'p90_ms': percentile(lat, 90),
+      'p99_ms': percentile(lat, 99),
+      'max_ms': max(lat) if lat else None,
+    }
+  return results
+
+def over_budget(results, args):
+  """ Streams of a run that break the latency budget, or lose frames they should not """
+  bad = []
+  for name, r in results.items():
+    if args.budget_ms is not None and (r['p99_ms'] is None or r['p99_ms'] > args.budget_ms):
+      bad.append(name)
+    elif not r['coalesces'] and r['loss'] > args.max_loss:
+      bad.append(name)
+  return bad
+
+def sustained(ports, mix, args):
+  """ Double the rates of a mix until it no longer keeps within budget, the last that did is the sustained throughput """
+  best = None
+  scale = 1.0
+  while scale <= args.max_scale:
+    results = run_mix(ports, mix, args, scale)
+    if over_budget(results, args):
+      break
+    best = (scale, results)
+    scale *= 2
+  return best
+
+def ms(value):
+  return '%7.1f' % value if value is not None else '      -'
+
+def report(name, results):
+  print("%s:" % name)
+  print("  %-10s %6s %6s %8s %9s %s %s %s %s" % ('stream', 'sent', 'recv', 'loss', 'frames/s', '    p50', '    p90', '    p99', '    max'))
+  for stream, r in results.items():
+    loss = '%7.2f%%' % (r['loss'] * 100)
+    if r['coalesces']:
+      # Superseded by a newer value, not lost
+      loss = '%7.2f%%*' % (r['loss'] * 100)
+    print("  %-10s %6d %6d %8s %9.1f %s %s %s %s" % (stream, r['sent'], r['received'], loss, r['rate'],
+      ms(r['p50_ms']), ms(r['p90_ms']), ms(r['p99_ms']), ms(r['max_ms'])))
+
+if __name__ == '__main__':
+  parser = argparse.ArgumentParser(
+    description="Measure latency, loss and throughput from a TX backpack to a VRX or Timer backpack")
+  parser.add_argument("-t", "--tx", type=str, required=True,
+    help="Serial port of the TX backpack")
+  parser.add_argument("-r", "--rx", type=str, required=True,
+    help="Serial port of the VRX or Timer backpack (its module's side)")
+  parser.add_argument("-b", "--baud", type=int, default=460800,
+    help="Baud rate of the TX backpack UART")
+  parser.add_argument("--rx-baud", type=int, default=None,
+    help="Baud rate of the receiving backpack UART, if it differs")
+  parser.add_argument("-m", "--mix", type=str, default='flight',
+    help="Comma separated mixes to run: %s" % ', '.join(MIXES))
+  parser.add_argument("-d", "--duration", type=float, default=10.0,
+    help="Seconds each mix runs for")
+  parser.add_argument("--settle", type=float, default=1.0,
+    help="Seconds to wait for late frames after a run")
+  parser.add_argument("--osd-rows", type=int, default=10,
+    help="Rows written in each OSD burst")
+  parser.add_argument("--budget-ms", type=float, default=None,
+    help="Fail if the p99 latency of any stream is above this")
+  parser.add_argument("--max-loss", type=float, default=0.01,
+    help="Fail if a stream that does not coalesce loses more than this fraction")
+  parser.add_argument("--ramp", action='store_true',
+    help="Also find the highest multiple of each mix's rates that stays within budget")
+  parser.add_argument("--max-scale", type=float, default=64,
+    help="Highest rate multiple --ramp tries")
+  parser.add_argument("--json", type=str,
+    help="Write the results to a file as JSON")
+  args = parser.parse_args()
+
+  import serial
+  ports = {
+    'tx': serial.Serial(port=args.tx, baudrate=args.baud, timeout=0.01),
+    'rx': serial.Serial(port=args.rx, baudrate=args.rx_baud or args.baud, timeout=0.01),
+  }
+  for p in ports.values():
+    p.reset_input_buffer()
+  # Head tracking has to be on before the VRX forwards PTR
+  ports['tx'].write(msp_frame(MSP_ELRS_BACKPACK_SET_HEAD_TRACKING, [1]))
+  time.sleep(0.5)
+
+  failed = []
+  output = {}
+  for name in args.mix.split(','):
+    results = run_mix(ports, MIXES[name], args)
+    report(name, results)
+    output[name] = {'results': results}
+    if over_budget(results, args):
+      failed.append(name)
+    if args.ramp:
+      best = sustained(ports, MIXES[name], args)
+      if best is None:
+        print("  sustained: not even at x1")
+      else:
+        scale, ramp = best
+        frames = sum(r['rate'] for r in ramp.values())
+        bytes_per_s = sum(r['bytes_per_s'] for r in ramp.values())
+        print("  sustained: x%g, %.0f frames/s, %.0f bytes/s" % (scale, frames, bytes_per_s))
+        output[name]['sustained'] = {'scale': scale, 'frames_per_s': frames, 'bytes_per_s': bytes_per_s, 'results': ramp}
+    print()
+
+  ports['tx'].write(msp_frame(MSP_ELRS_BACKPACK_SET_HEAD_TRACKING, [0]))
+  print("* frames superseded by a newer value on the way, by design")
+
+  if args.json:
+    with open(args.json, 'w') as f:
+      json.dump(output, f, indent=2)
+
+  if failed:
+    print("Over budget: %s" % ', '.join(failed))
+    sys.exit(1)
@@ -0,0 +1,4 @@
+Import("env")
+
+# build_flags only reach the compiler, the sanitizer runtimes have to be linked in too
+env.Append(LINKFLAGS=[f for f in env.get('BUILD_FLAGS', []) if f.startswith('-fsanitize')])
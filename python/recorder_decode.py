@@ -0,0 +1,69 @@
+import struct
+import argparse
+
+# Decodes the flight recorder download from a backpack, either a file saved
+# from http://<backpack>/recorder.bin or fetched directly from the backpack,
+# into one line per event with the time relative to the download.
+
+HEADER = struct.Struct('<IBBHI')
+RECORD = struct.Struct('<IBBHI')
+MAGIC = 0x54524C45
+
+PORTS = ['uart', 'espnow']
+STATES = ['starting', 'binding', 'running', 'wifiUpdate', 'FAILURE']
+
+def port(arg):
+  return PORTS[arg] if arg < len(PORTS) else str(arg)
+
+def state(arg):
+  return STATES[arg] if arg < len(STATES) else str(arg)
+
+EVENTS = {
+  0: ('MSP_IN', lambda arg, a, b: '%s function=0x%04X size=%u' % (port(arg), a, b)),
+  1: ('MSP_OUT', lambda arg, a, b: '%s function=0x%04X size=%u' % (port(arg), a, b)),
+  2: ('ESPNOW_STATUS', lambda arg, a, b: 'ok' if arg == 0 else 'fail(%u)' % arg),
+  3: ('CONNECTION_STATE', lambda arg, a, b: '%s -> %s' % (state(a), state(arg))),
+  4: ('GPS_FIX', lambda arg, a, b: 'sats=%u azimuth=%u distance=%um' % (arg, a, b)),
+  5: ('SERVO_TARGET', lambda arg, a, b: 'azim=%uus elev=%uus' % (a, b)),
+}
+
+def decode(data):
+  magic, version, record_size, count, now = HEADER.unpack_from(data, 0)
+  if magic != MAGIC:
+    raise ValueError('not a recorder download')
+  if record_size != RECORD.size:
+    raise ValueError('unsupported record size %u (version %u)' % (record_size, version))
+  events = []
+  for i in range(count):
+    t, type, arg, a, b = RECORD.unpack_from(data, HEADER.size + i * record_size)
+    # micros() wraps every 71 minutes, age is taken modulo 2^32
+    age = (now - t) & 0xFFFFFFFF
+    events.append((age, type, arg, a, b))
+  return events
+
+def fetch(url):
+  import urllib.request
+  with urllib.request.urlopen(url) as response:
+    return response.read()
+
+if __name__ == '__main__':
+  parser = argparse.ArgumentParser(
+    description="Decode a backpack flight recorder download")
+  parser.add_argument("source", type=str,
+    help="recorder.bin file, or the backpack address to download it from")
+  args = parser.parse_args()
+
+  if args.source.endswith('.bin'):
+    with open(args.source, 'rb') as f:
+      data = f.read()
+  else:
+    url = args.source if args.source.startswith('http') else 'http://%s/recorder.bin' % args.source
+    data = fetch(url)
+
+  events = decode(data)
+  last = None
+  for age, type, arg, a, b in events:
+    name, describe = EVENTS.get(type, ('UNKNOWN(%u)' % type, lambda arg, a, b: 'arg=%u a=%u b=%u' % (arg, a, b)))
+    delta = '' if last is None else '+%uus' % (last - age)
+    print('%12.6fs %10s %-16s %s' % (-age / 1e6, delta, name, describe(arg, a, b)))
+    last = age
@@ -0,0 +1,134 @@
+import time
+import random
+import argparse
+
+# Generates MSPv2 and CRSF streams with random framing errors, corrupted bytes
+# and line noise, and either writes them to a file or pushes them at a backpack
+# UART as fast as the port allows. Used to soak the MSP and CRSF parsers on
+# hardware and measure how many frames per second they keep up with. The same
+# streams are fuzzed on the host by the native_parser_fuzz env, see src/bench.
+
+MSP_MAX_PAYLOAD = 64
+CRSF_SYNC_BYTE = 0xC8
+CRSF_MAX_PAYLOAD = 60
+CRSF_FRAMETYPE_GPS = 0x02
+
+def crc8(crc, a, poly):
+  crc = crc ^ a
+  for ii in range(8):
+    if crc & 0x80:
+      crc = (crc << 1) ^ poly
+    else:
+      crc = crc << 1
+  return crc & 0xFF
+
+def crc8_table(poly):
+  return [crc8(0, i, poly) for i in range(256)]
+
+MSP_CRC = crc8_table(0xD5)
+CRSF_CRC = crc8_table(0xD5)
+
+def calc_crc(table, data):
+  crc = 0
+  for x in data:
+    crc = table[crc ^ x]
+  return crc
+
+def msp_frame(rnd, function=None, payload=None):
+  if function is None:
+    function = rnd.choice([0x0301, 0x0305, 0x00B6, 0x0383, 0x0011, rnd.randrange(0x10000)])
+  if payload is None:
+    payload = bytes(rnd.randrange(256) for _ in range(rnd.randrange(MSP_MAX_PAYLOAD + 1)))
+  body = bytes([0, function & 0xFF, function >> 8, len(payload) & 0xFF, len(payload) >> 8]) + payload
+  return b'$X<' + body + bytes([calc_crc(MSP_CRC, body)])
+
+def crsf_frame(rnd, type=None, payload=None):
+  if type is None:
+    type = rnd.choice([CRSF_FRAMETYPE_GPS, 0x08, 0x14, rnd.randrange(256)])
+  if payload is None:
+    payload = bytes(rnd.randrange(256) for _ in range(rnd.randrange(1, CRSF_MAX_PAYLOAD + 1)))
+  body = bytes([type]) + payload
+  return bytes([CRSF_SYNC_BYTE, len(body) + 1]) + body + bytes([calc_crc(CRSF_CRC, body)])
+
+def corrupt(rnd, frame):
+  frame = bytearray(frame)
+  kind = rnd.randrange(4)
+  if kind == 0:
+    # flip a bit anywhere, usually caught by the crc
+    i = rnd.randrange(len(frame))
+    frame[i] ^= 1 << rnd.randrange(8)
+  elif kind == 1:
+    # truncate, the next frame starts mid-packet
+    frame = frame[:rnd.randrange(1, len(frame))]
+  elif kind == 2:
+    # oversized length field
+    if len(frame) > 6:
+      frame[6 if frame[0] == ord('$') else 1] = 0xFF
+  else:
+    # duplicated framing chars
+    frame = frame[:1] + frame
+  return bytes(frame)
+
+def generate(rnd, protocol, count, corrupt_rate, noise_rate):
+  make = msp_frame if protocol == 'msp' else crsf_frame
+  stream = bytearray()
+  valid = 0
+  for _ in range(count):
+    if rnd.random() < noise_rate:
+      stream += bytes(rnd.randrange(256) for _ in range(rnd.randrange(1, 32)))
+    frame = make(rnd)
+    if rnd.random() < corrupt_rate:
+      frame = corrupt(rnd, frame)
+    else:
+      valid += 1
+    stream += frame
+  return bytes(stream), valid
+
+def send_stream(port, baud, stream, chunk):
+  import serial
+  s = serial.Serial(port=port, baudrate=baud,
+      bytesize=8, parity='N', stopbits=1,
+      timeout=1, xonxoff=0, rtscts=0)
+  start = time.monotonic()
+  for i in range(0, len(stream), chunk):
+    s.write(stream[i:i + chunk])
+  s.flush()
+  return time.monotonic() - start
+
+if __name__ == '__main__':
+  parser = argparse.ArgumentParser(
+    description="Generate corrupted MSP/CRSF streams to soak the backpack parsers")
+  parser.add_argument("protocol", choices=['msp', 'crsf'],
+    help="Protocol to generate")
+  parser.add_argument("-n", "--count", type=int, default=10000,
+    help="Number of frames to generate")
+  parser.add_argument("-c", "--corrupt", type=float, default=0.1,
+    help="Fraction of frames to corrupt")
+  parser.add_argument("-g", "--noise", type=float, default=0.05,
+    help="Fraction of frames preceded by random line noise")
+  parser.add_argument("-s", "--seed", type=int, default=None,
+    help="Random seed, to make a failing stream reproducible")
+  parser.add_argument("-o", "--out", type=str,
+    help="Write the stream to a file instead of a serial port")
+  parser.add_argument("-b", "--baud", type=int, default=460800,
+    help="Baud rate of the backpack UART")
+  parser.add_argument("-p", "--port", type=str,
+    help="Override serial port autodetection and use PORT")
+  parser.add_argument("--chunk", type=int, default=256,
+    help="Bytes per serial write")
+  args = parser.parse_args()
+
+  seed = args.seed if args.seed is not None else random.randrange(1 << 32)
+  rnd = random.Random(seed)
+  stream, valid = generate(rnd, args.protocol, args.count, args.corrupt, args.noise)
+  print("seed %d: %d frames (%d valid), %d bytes" % (seed, args.count, valid, len(stream)))
+
+  if args.out:
+    with open(args.out, 'wb') as f:
+      f.write(stream)
+  else:
+    if (args.port == None):
+      import serials_find
+      args.port = serials_find.get_serial_port()
+    elapsed = send_stream(args.port, args.baud, stream, args.chunk)
+    print("sent in %.2fs, %.0f bytes/s, %.0f frames/s" % (elapsed, len(stream) / elapsed, args.count / elapsed))
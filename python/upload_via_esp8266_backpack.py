@@ -1,12 +1,19 @@
 import subprocess, os
 
+def upload_command(elrs_bin_target):
+    """ The curl command line posting a firmware file, the URL still has to be appended """
+    return ["curl", "--max-time", "60",
+            "--retry", "2", "--retry-delay", "1",
+            "-F", "data=@%s" % (elrs_bin_target,)]
+
+def upload_url(addr, isstm):
+    return "http://%s/%s" % (addr, ['update', 'upload'][isstm])
+
 def do_upload(elrs_bin_target, pio_target, upload_addr, isstm, env):
     bootloader_target = None
     app_start = 0 # eka bootloader offset
 
-    cmd = ["curl", "--max-time", "60",
-           "--retry", "2", "--retry-delay", "1",
-           "-F", "data=@%s" % (elrs_bin_target,)]
+    cmd = upload_command(elrs_bin_target)
 
     if  bootloader_target is not None and isstm:
         cmd_bootloader = ["curl", "--max-time", "60",
@@ -21,7 +28,7 @@ def do_upload(elrs_bin_target, pio_target, upload_addr, isstm, env):
         upload_addr = [upload_port]
 
     for addr in upload_addr:
-        addr = "http://%s/%s" % (addr, ['update', 'upload'][isstm])
+        addr = upload_url(addr, isstm)
         print(" ** UPLOADING TO: %s" % addr)
         try:
             if  bootloader_target is not None:
@@ -0,0 +1,157 @@
+import os
+import sys
+import csv
+import time
+import random
+import argparse
+import subprocess
+
+# Replays an iNav GPS CSV (the same logs gpscsv_to_crsf.py plays over serial)
+# through a host build of AatModule, and reports how far the servos point from
+# the aircraft for each servo mode and projection setting. Use it to compare
+# predictor and smoothing changes before taking them to the field.
+
+SCRIPT_DIR = os.path.dirname(os.path.abspath(__file__))
+REPO_DIR = os.path.normpath(os.path.join(SCRIPT_DIR, '..', '..'))
+SIM_DIR = os.path.join(SCRIPT_DIR, 'aat_sim')
+
+SOURCES = [
+    os.path.join(SIM_DIR, 'sim_main.cpp'),
+    os.path.join(REPO_DIR, 'src', 'module_aat.cpp'),
+    os.path.join(REPO_DIR, 'src', 'module_crsf.cpp'),
+    os.path.join(REPO_DIR, 'lib', 'config', 'config.cpp'),
+    os.path.join(REPO_DIR, 'lib', 'CRC', 'crc.cpp'),
+]
+
+SERVO_MODES = ['2:1', 'Clip180', 'Flip180']
+PROJECTIONS = ['none', 'azim', 'elev', 'both']
+
+def build(cxx, build_dir):
+    os.makedirs(build_dir, exist_ok=True)
+    exe = os.path.join(build_dir, 'aat_sim')
+
+    # Rebuild whenever anything the simulator is made from changed
+    deps = SOURCES[:]
+    for d in [os.path.join(SIM_DIR, 'shim'), os.path.join(REPO_DIR, 'src'), os.path.join(REPO_DIR, 'lib')]:
+        for root, _, files in os.walk(d):
+            deps += [os.path.join(root, f) for f in files if f.endswith('.h')]
+    if os.path.exists(exe) and os.path.getmtime(exe) > max(os.path.getmtime(f) for f in deps):
+        return exe
+
+    includes = [os.path.join(SIM_DIR, 'shim'), os.path.join(REPO_DIR, 'include'), os.path.join(REPO_DIR, 'src')]
+    includes += [os.path.join(REPO_DIR, 'lib', d) for d in sorted(os.listdir(os.path.join(REPO_DIR, 'lib')))]
+    cmd = [cxx, '-std=gnu++17', '-O2', '-o', exe,
+        '-DTARGET_VRX_BACKPACK', '-DAAT_BACKPACK', '-DPIN_SERVO_AZIM=9', '-DPIN_SERVO_ELEV=10']
+    cmd += ['-I' + i for i in includes] + SOURCES
+    print('Building', exe)
+    subprocess.check_call(cmd)
+    return exe
+
+def load_log(fname, interval, latency, jitter, rnd):
+    # Returns the replay input: every row as the true position, and the rows
+    # that would have been sent as fixes, delayed by the telemetry link
+    lines = []
+    with open(fname, 'r') as csv_file:
+        reader = csv.reader(csv_file)
+        # ['time (us)', 'GPS_fixType', ' GPS_numSat', ' GPS_coord[0]', ' GPS_coord[1]', ' GPS_altitude', ' GPS_speed (m/s)', ' GPS_ground_course', ...]
+        next(reader)
+
+        startTime = None
+        lastFix = None
+        for row in reader:
+            timeS = float(row[0]) / 1e6
+            if startTime is None:
+                startTime = timeS
+            ms = int((timeS - startTime) * 1000)
+            lines.append('T %d %s %s %s' % (ms, row[3].strip(), row[4].strip(), row[5].strip()))
+
+            if lastFix is not None and timeS - lastFix < interval:
+                continue
+            lastFix = timeS
+            sats = int(row[2])
+            lat = int(float(row[3]) * 1e7)
+            lon = int(float(row[4]) * 1e7)
+            alt = int(row[5])
+            spd = int(float(row[6]) * 36) # m/s to km/h*10
+            hdg = int(float(row[7]) * 100) # deg to centideg
+            delay = latency + (rnd.random() * jitter if jitter > 0 else 0)
+            lines.append('F %d %d %d %d %d %d %d' % (ms + int(delay * 1000), lat, lon, alt, spd, hdg, sats))
+
+    # The simulator wants fixes in arrival order, jitter can reorder them
+    truth = [l for l in lines if l[0] == 'T']
+    fixes = sorted((l for l in lines if l[0] == 'F'), key=lambda l: int(l.split()[1]))
+    return '\n'.join(truth + fixes) + '\n'
+
+def percentile(values, pct):
+    if not values:
+        return float('nan')
+    return values[min(len(values) - 1, int(len(values) * pct / 100))]
+
+def run(exe, replay, mode, project, smooth, center):
+    start = time.monotonic()
+    out = subprocess.run([exe, '--mode', str(mode), '--project', str(project),
+        '--smooth', str(smooth), '--center', str(center)],
+        input=replay, capture_output=True, text=True, check=True).stdout
+    elapsed = time.monotonic() - start
+
+    errors = []
+    loopNs = []
+    frameNs = []
+    for line in out.splitlines():
+        f = line.split()
+        if f[0] == 'E':
+            errors.append(float(f[2]))
+        elif f[0] == 'L':
+            loopNs.append(int(f[1]))
+        elif f[0] == 'S':
+            frameNs.append(int(f[1]))
+    errors.sort()
+    return errors, loopNs, frameNs, elapsed
+
+if __name__ == '__main__':
+    parser = argparse.ArgumentParser(
+        prog='aat_replay',
+        description='Replay an iNav GPS CSV through a host build of the AAT module and report the tracking error')
+    parser.add_argument('filename')
+    parser.add_argument('-I', '--interval', default=1.0, type=float,
+        help='Skip GPS frames so that GPS updates are limited to this interval (s)')
+    parser.add_argument('-L', '--latency', default=0.0, type=float,
+        help='Fixed telemetry delay between a fix and it reaching the tracker (s)')
+    parser.add_argument('-J', '--jitter', default=0.0, type=float,
+        help='Random extra telemetry delay, up to this much (s)')
+    parser.add_argument('-m', '--modes', default='0,1,2',
+        help='Servo modes to run, 0=2:1 1=Clip180 2=Flip180')
+    parser.add_argument('-p', '--projections', default='0,1,2,3',
+        help='Projection settings to run, bit 0 azimuth, bit 1 elevation')
+    parser.add_argument('-s', '--smooth', default=5, type=int,
+        help='Servo smoothness, 0-9')
+    parser.add_argument('-c', '--center', default=0, type=int,
+        help='Center direction, in 45 degree steps from north')
+    parser.add_argument('--seed', default=None, type=int,
+        help='Random seed for the jitter, to make a run reproducible')
+    parser.add_argument('--cxx', default=os.environ.get('CXX', 'c++'),
+        help='Host C++ compiler')
+    parser.add_argument('--build-dir', default=os.path.join(REPO_DIR, '.pio', 'aat_sim'),
+        help='Where to build the simulator')
+    args = parser.parse_args()
+
+    exe = build(args.cxx, args.build_dir)
+    seed = args.seed if args.seed is not None else random.randrange(1 << 32)
+    replay = load_log(args.filename, args.interval, args.latency, args.jitter, random.Random(seed))
+    print('seed %d, interval %.2fs, latency %.2fs, jitter %.2fs, smooth %d' %
+        (seed, args.interval, args.latency, args.jitter, args.smooth))
+
+    duration = int(replay.splitlines()[-1].split()[1]) / 1000.0
+    print('%-8s %-5s %8s %8s %8s %8s %8s %10s %10s %8s' %
+        ('mode', 'proj', 'samples', 'p50', 'p90', 'p99', 'max', 'loop ns', 'frame ns', 'speed'))
+    for mode in [int(m) for m in args.modes.split(',')]:
+        for project in [int(p) for p in args.projections.split(',')]:
+            errors, loopNs, frameNs, elapsed = run(exe, replay, mode, project, args.smooth, args.center)
+            # Loop() time is the host's, only useful for comparing changes against each other
+            print('%-8s %-5s %8d %7.2f° %7.2f° %7.2f° %7.2f° %10.0f %10.0f %7.0fx' % (
+                SERVO_MODES[mode], PROJECTIONS[project], len(errors),
+                percentile(errors, 50), percentile(errors, 90), percentile(errors, 99),
+                errors[-1] if errors else float('nan'),
+                sum(loopNs) / max(len(loopNs), 1), sum(frameNs) / max(len(frameNs), 1),
+                duration / elapsed))
+            sys.stdout.flush()
@@ -0,0 +1,67 @@
+#pragma once
+
+// Just enough of the Arduino API to build the AAT module on the host, time
+// comes from the simulation clock rather than the real one
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <endian.h>
+#include <algorithm>
+
+using std::min;
+using std::max;
+
+#define PROGMEM
+#define PSTR(x) (x)
+#define IRAM_ATTR
+#define ICACHE_RAM_ATTR
+#define A0 0
+#define constrain(amt, low, high) ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+
+extern uint64_t simMicros; // advanced by the simulation
+
+inline uint32_t millis() { return simMicros / 1000; }
+inline uint32_t micros() { return simMicros; }
+inline void delay(uint32_t) {}
+inline void noInterrupts() {}
+inline void interrupts() {}
+inline int analogRead(uint8_t) { return 0; }
+
+inline long map(long x, long in_min, long in_max, long out_min, long out_max)
+{
+    return (x - in_min) * (out_max - out_min) / (in_max - in_min) + out_min;
+}
+
+class Print
+{
+public:
+    virtual ~Print() {}
+    virtual size_t write(uint8_t) = 0;
+    size_t write(const uint8_t *buf, size_t len) { size_t n = 0; while (len--) n += write(*buf++); return n; }
+    size_t printf(const char *, ...) { return 0; }
+    size_t print(const char *) { return 0; }
+    size_t println(const char * = "") { return 0; }
+    void flush() {}
+};
+
+class Stream : public Print
+{
+public:
+    virtual int available() = 0;
+    virtual int read() = 0;
+    size_t readBytes(uint8_t *buf, size_t len) { size_t n = 0; int c; while (n < len && (c = read()) >= 0) buf[n++] = c; return n; }
+};
+
+class HardwareSerial : public Stream
+{
+public:
+    void end() {}
+    int available() override { return 0; }
+    int read() override { return -1; }
+    size_t write(uint8_t) override { return 1; }
+};
+
+extern HardwareSerial Serial;
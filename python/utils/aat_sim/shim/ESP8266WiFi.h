@@ -0,0 +1,3 @@
+#pragma once
+
+// The AAT module only uses WiFi for the OLED status screen, which is not built here
@@ -0,0 +1,14 @@
+#pragma once
+
+#include <Arduino.h>
+
+// Records the pulse width instead of driving a pin
+class Servo
+{
+public:
+    void attach(int pin, int min, int max, int value) { _us = value; }
+    void writeMicroseconds(int value) { _us = value; }
+    int readMicroseconds() const { return _us; }
+private:
+    int _us = 0;
+};
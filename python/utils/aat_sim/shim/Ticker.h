@@ -0,0 +1,45 @@
+#pragma once
+
+#include <Arduino.h>
+#include <functional>
+#include <vector>
+
+// Callbacks are not run by a timer, the simulation calls Ticker::runDue() as its clock advances
+class Ticker
+{
+public:
+    Ticker() { all().push_back(this); }
+    ~Ticker() { detach(); all().erase(std::find(all().begin(), all().end(), this)); }
+
+    void attach_ms(uint32_t ms, std::function<void()> callback)
+    {
+        _periodUs = ms * 1000U;
+        _nextUs = simMicros + _periodUs;
+        _callback = callback;
+    }
+
+    void detach() { _callback = nullptr; }
+
+    static void runDue()
+    {
+        for (Ticker *t : all())
+        {
+            while (t->_callback && t->_nextUs <= simMicros)
+            {
+                t->_nextUs += t->_periodUs;
+                t->_callback();
+            }
+        }
+    }
+
+private:
+    static std::vector<Ticker *> &all()
+    {
+        static std::vector<Ticker *> tickers;
+        return tickers;
+    }
+
+    uint64_t _periodUs = 0;
+    uint64_t _nextUs = 0;
+    std::function<void()> _callback;
+};
@@ -0,0 +1,239 @@
+// Host build of AatModule that replays a GPS log and measures how closely the
+// servos point at the aircraft. Driven by python/utils/aat_replay.py, which converts
+// the log and summarises the output.
+//
+// stdin, one record per line:
+//   F <arrival ms> <lat> <lon> <alt m> <speed km/h*10> <heading deg*100> <sats>   fix delivered to the module
+//   T <time ms> <lat> <lon> <alt m>                                               true position
+// stdout:
+//   E <time ms> <error> <azim error> <elev error>   angles in degrees, once per servo frame
+//   L <ns>                                          host time of each Loop()
+//   S <ns>                                          host time of each servo frame
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include "common.h"
+#include "config.h"
+#include "module_aat.h"
+#include "recorder.h"
+
+uint64_t simMicros;
+HardwareSerial Serial;
+
+connectionState_e connectionState = running;
+unsigned long bindingStart = 0;
+const char *VERSION = "sim";
+
+VrxBackpackConfig config;
+AatModule vrxModule(Serial);
+
+// The bits of the firmware AatModule does not need for tracking
+void ModuleBase::Init() {}
+void ModuleBase::Loop(uint32_t now) {}
+void traceEvent(traceEvent_e type, uint8_t arg, uint16_t a, uint32_t b) {}
+
+static uint8_t eepromImage[RESERVED_EEPROM_SIZE];
+void ELRS_EEPROM::Begin() {}
+uint8_t ELRS_EEPROM::ReadByte(const uint32_t address) { return eepromImage[address]; }
+void ELRS_EEPROM::WriteByte(const uint32_t address, const uint8_t value) { eepromImage[address] = value; }
+bool ELRS_EEPROM::ReadBlock(const uint32_t address, uint8_t *data, const size_t len)
+{
+    if (address + len > RESERVED_EEPROM_SIZE)
+        return false;
+    memcpy(data, &eepromImage[address], len);
+    return true;
+}
+bool ELRS_EEPROM::WriteBlock(const uint32_t address, const uint8_t *data, const size_t len)
+{
+    if (address + len > RESERVED_EEPROM_SIZE)
+        return false;
+    memcpy(&eepromImage[address], data, len);
+    return true;
+}
+void ELRS_EEPROM::Commit() {}
+
+struct Fix
+{
+    uint32_t ms;
+    int32_t lat, lon, alt;
+    uint32_t speed, heading, sats;
+};
+
+struct Truth
+{
+    uint32_t ms;
+    double lat, lon, alt;
+};
+
+static double deg2rad(double deg) { return deg * M_PI / 180.0; }
+static double rad2deg(double rad) { return rad * 180.0 / M_PI; }
+
+static double wrap180(double deg)
+{
+    deg = fmod(deg + 540.0, 360.0);
+    return deg - 180.0;
+}
+
+static double servoFraction(uint8_t idx, int32_t us)
+{
+    return (double)(us - config.GetAatServoLow(idx)) / (config.GetAatServoHigh(idx) - config.GetAatServoLow(idx));
+}
+
+// Undo servoApplyMode(), giving where the tracker is actually pointing
+static void servoPointing(const uint16_t servoPos[2], double *azim, double *elev)
+{
+    double bearing;
+    switch (config.GetAatServoMode())
+    {
+    case 0: // TwoToOne
+        bearing = -180.0 + servoFraction(0, servoPos[0]) * 359.0;
+        *elev = servoFraction(1, servoPos[1]) * 90.0;
+        break;
+    case 1: // Clip180
+        bearing = -90.0 + servoFraction(0, servoPos[0]) * 180.0;
+        *elev = servoFraction(1, servoPos[1]) * 90.0;
+        break;
+    default: // Flip180, past vertical the tracker faces the other way
+        bearing = -90.0 + servoFraction(0, servoPos[0]) * 180.0;
+        *elev = servoFraction(1, servoPos[1]) * 180.0;
+        if (*elev > 90.0)
+        {
+            *elev = 180.0 - *elev;
+            bearing = (bearing < 0.0) ? -180.0 - bearing : 180.0 - bearing;
+        }
+        break;
+    }
+    *azim = wrap180(bearing + 45.0 * config.GetAatCenterDir());
+}
+
+// Azimuth, elevation and ground distance of the true position at time ms
+static bool truthAt(const std::vector<Truth> &truth, uint32_t ms, const aatTelemetry_t &telem,
+    double *azim, double *elev, double *dist)
+{
+    static size_t idx;
+    while (idx + 1 < truth.size() && truth[idx + 1].ms <= ms)
+        ++idx;
+    if (idx + 1 >= truth.size() || truth[idx].ms > ms)
+        return false;
+
+    const Truth &a = truth[idx];
+    const Truth &b = truth[idx + 1];
+    double f = (b.ms == a.ms) ? 0.0 : (double)(ms - a.ms) / (b.ms - a.ms);
+    double lat = a.lat + (b.lat - a.lat) * f;
+    double lon = a.lon + (b.lon - a.lon) * f;
+    double alt = a.alt + (b.alt - a.alt) * f;
+
+    const double R = 6371000.0;
+    double homeLat = telem.homeLat / 1e7;
+    double north = deg2rad(lat - homeLat) * R;
+    double east = deg2rad(lon - telem.homeLon / 1e7) * R * cos(deg2rad((lat + homeLat) / 2.0));
+    *dist = hypot(east, north);
+    *azim = rad2deg(atan2(east, north));
+    *elev = rad2deg(atan2(alt - telem.homeAlt, *dist));
+    return true;
+}
+
+static uint64_t nsSince(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char **argv)
+{
+    int mode = 0, project = 0xff, smooth = 5, center = 0;
+    for (int i = 1; i + 1 < argc; i += 2)
+    {
+        if (!strcmp(argv[i], "--mode"))
+            mode = atoi(argv[i + 1]);
+        else if (!strcmp(argv[i], "--project"))
+            project = atoi(argv[i + 1]);
+        else if (!strcmp(argv[i], "--smooth"))
+            smooth = atoi(argv[i + 1]);
+        else if (!strcmp(argv[i], "--center"))
+            center = atoi(argv[i + 1]);
+    }
+
+    std::vector<Fix> fixes;
+    std::vector<Truth> truth;
+    char line[256];
+    while (fgets(line, sizeof(line), stdin))
+    {
+        if (line[0] == 'F')
+        {
+            Fix f;
+            if (sscanf(line + 1, "%u %d %d %d %u %u %u", &f.ms, &f.lat, &f.lon, &f.alt, &f.speed, &f.heading, &f.sats) == 7)
+                fixes.push_back(f);
+        }
+        else if (line[0] == 'T')
+        {
+            Truth t;
+            if (sscanf(line + 1, "%u %lf %lf %lf", &t.ms, &t.lat, &t.lon, &t.alt) == 4)
+                truth.push_back(t);
+        }
+    }
+    if (fixes.empty() || truth.empty())
+    {
+        fprintf(stderr, "no fixes to replay\n");
+        return 1;
+    }
+
+    static ELRS_EEPROM eeprom;
+    config.SetStorageProvider(&eeprom);
+    config.Load();
+    config.SetAatServoMode(mode);
+    config.SetAatProject(project);
+    config.SetAatServoSmooth(smooth);
+    config.SetAatCenterDir(center);
+    vrxModule.Init();
+
+    const uint32_t FRAME_MS = 1000U / AAT_SERVO_FRAME_HZ;
+    const double MIN_DISTANCE_M = 20.0; // azimuth is meaningless right overhead
+    uint32_t endMs = max(fixes.back().ms, truth.back().ms);
+    size_t nextFix = 0;
+    for (uint32_t ms = 0; ms <= endMs; ++ms)
+    {
+        simMicros = (uint64_t)ms * 1000U;
+        for (; nextFix < fixes.size() && fixes[nextFix].ms <= ms; ++nextFix)
+        {
+            const Fix &f = fixes[nextFix];
+            crsf_packet_gps_t packet;
+            packet.p.lat = htobe32(f.lat);
+            packet.p.lon = htobe32(f.lon);
+            packet.p.speed = htobe16(f.speed);
+            packet.p.heading = htobe16(f.heading);
+            packet.p.altitude = htobe16(f.alt + 1000);
+            packet.p.satcnt = f.sats;
+            vrxModule.SendGpsTelemetry(&packet, GPS_SOURCE_UART);
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        vrxModule.Loop(ms);
+        printf("L %llu\n", (unsigned long long)nsSince(start));
+
+        if (ms % FRAME_MS != 0)
+            continue;
+        start = std::chrono::steady_clock::now();
+        Ticker::runDue();
+        printf("S %llu\n", (unsigned long long)nsSince(start));
+
+        aatTelemetry_t telem;
+        vrxModule.getTelemetry(&telem, ms);
+        // Servos only start following once home is set and the start up delay has passed
+        if (!(telem.flags & AAT_TELEMETRY_FLAG_HOME) || ms <= 5000U)
+            continue;
+        double azim, elev, dist, pointAzim, pointElev;
+        if (!truthAt(truth, ms, telem, &azim, &elev, &dist) || dist < MIN_DISTANCE_M)
+            continue;
+        uint16_t servoPos[2] = { telem.servoPos[0], telem.servoPos[1] };
+        servoPointing(servoPos, &pointAzim, &pointElev);
+
+        double cosErr = sin(deg2rad(elev)) * sin(deg2rad(pointElev))
+            + cos(deg2rad(elev)) * cos(deg2rad(pointElev)) * cos(deg2rad(azim - pointAzim));
+        double err = rad2deg(acos(constrain(cosErr, -1.0, 1.0)));
+        printf("E %u %.3f %.3f %.3f\n", ms, err, wrap180(pointAzim - azim), pointElev - elev);
+    }
+    return 0;
+}
@@ -87,7 +87,7 @@ def processFile(fname, interval, port, baud, jitter, output):
             lat = int(float(row[3]) * 1e7)
             lon = int(float(row[4]) * 1e7)
             alt = int(row[5]) + 1000
-            spd = int(float(row[6]) * 360) # m/s to km/h*10
+            spd = int(float(row[6]) * 36) # m/s to km/h*10
             hdg = int(float(row[7]) * 100) # deg to centideg
             print(f'{timeS:0.6f} GPS: ({lat},{lon}) {alt-1000}m {sats}sats')
 
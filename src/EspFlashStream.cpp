@@ -1,55 +1,148 @@
 #include "EspFlashStream.h"
 
+static_assert(FLASH_STREAM_BLOCK_SIZE % 4 == 0, "ESP.flashRead() needs whole words");
+
 EspFlashStream::EspFlashStream()
 {
+#if defined(PLATFORM_ESP32)
+    _mapped = nullptr;
+    _mappedSize = 0;
+#endif
     setBaseAddress(0);
 }
 
-void EspFlashStream::fillBuffer()
+EspFlashStream::~EspFlashStream()
 {
-    // Could also use spi_flash_read() here, but the return values differ between ESP (SPI_FLASH_RESULT_OK) and ESP32 (ESP_OK)
-    if (ESP.flashRead(_flashBase + _flashOffset, (uint32_t *)_buffer, sizeof(_buffer)))
+#if defined(PLATFORM_ESP32)
+    unmapFlash();
+#endif
+}
+
+#if defined(PLATFORM_ESP32)
+// Map the start of the stream into the data cache, so reads are plain memory accesses.
+// Done on first use rather than in setBaseAddress() so an unused stream costs no MMU pages.
+void EspFlashStream::mapFlash()
+{
+    _mapTried = true;
+    if (FLASH_STREAM_MMAP_SIZE == 0)
+    {
+        return;
+    }
+    // The mapping has to start on an MMU page boundary
+    size_t pageStart = _flashBase & ~(SPI_FLASH_MMU_PAGE_SIZE - 1);
+    size_t lead = _flashBase - pageStart;
+    size_t size = min((size_t)FLASH_STREAM_MMAP_SIZE, spi_flash_get_chip_size() - _flashBase);
+    const void *ptr;
+    if (spi_flash_mmap(pageStart, lead + size, SPI_FLASH_MMAP_DATA, &ptr, &_mapHandle) == ESP_OK)
     {
-        _bufferPos = 0;
+        _mapped = (const uint8_t *)ptr + lead;
+        _mappedSize = size;
     }
-    else
+}
+
+void EspFlashStream::unmapFlash()
+{
+    if (_mapped)
+    {
+        spi_flash_munmap(_mapHandle);
+        _mapped = nullptr;
+        _mappedSize = 0;
+    }
+}
+#endif
+
+bool EspFlashStream::fillBuffer()
+{
+    // Could also use spi_flash_read() here, but the return values differ between ESP (SPI_FLASH_RESULT_OK) and ESP32 (ESP_OK)
+    size_t offset = (_position >> 2) << 2;
+    if (ESP.flashRead(_flashBase + offset, (uint32_t *)_buffer, sizeof(_buffer)))
     {
-        // _bufferPos > sizeof() indicates error
-        _bufferPos = sizeof(_buffer) + 1;
+        _bufferOffset = offset;
+        _bufferValid = true;
+        return true;
     }
+    _bufferValid = false;
+    _error = true;
+    return false;
 }
 
 void EspFlashStream::setBaseAddress(size_t base)
 {
+#if defined(PLATFORM_ESP32)
+    unmapFlash();
+    _mapTried = false;
+#endif
     _flashBase = base;
-    _flashOffset = 0 - sizeof(_buffer); // underflow intentionally so offset+pos = 0
-    _bufferPos = sizeof(_buffer);
+    _position = 0;
+    _bufferValid = false;
+    _error = false;
 }
 
 void EspFlashStream::setPosition(size_t offset)
 {
-    // align(4), rounding down
-    _flashOffset = (offset >> 2) << 2;
-    // capture the new bufferPos before fill advances it
-    uint8_t newBufferPos = offset - _flashOffset;
-
-    fillBuffer();
-    _bufferPos = newBufferPos;
+    _position = offset;
 }
 
 int EspFlashStream::read()
 {
     int retVal = peek();
-    ++_bufferPos;
+    if (retVal >= 0)
+    {
+        ++_position;
+    }
     return retVal;
 }
 
 int EspFlashStream::peek()
 {
-    if (_bufferPos == sizeof(_buffer))
+#if defined(PLATFORM_ESP32)
+    if (!_mapTried)
+    {
+        mapFlash();
+    }
+    if (_position < _mappedSize)
+    {
+        return _mapped[_position];
+    }
+#endif
+    if (!_bufferValid || _position < _bufferOffset || _position >= _bufferOffset + sizeof(_buffer))
+    {
+        if (!fillBuffer())
+        {
+            return -1;
+        }
+    }
+    return _buffer[_position - _bufferOffset];
+}
+
+size_t EspFlashStream::readBytes(char *buffer, size_t length)
+{
+    size_t copied = 0;
+    while (copied < length)
     {
-        _flashOffset += sizeof(_buffer);
-        fillBuffer();
+#if defined(PLATFORM_ESP32)
+        if (!_mapTried)
+        {
+            mapFlash();
+        }
+        if (_position < _mappedSize)
+        {
+            size_t n = min(length - copied, _mappedSize - _position);
+            memcpy(&buffer[copied], &_mapped[_position], n);
+            copied += n;
+            _position += n;
+            continue;
+        }
+#endif
+        if (peek() < 0)
+        {
+            break;
+        }
+        // peek() left the block holding _position in the buffer
+        size_t n = min(length - copied, _bufferOffset + sizeof(_buffer) - _position);
+        memcpy(&buffer[copied], &_buffer[_position - _bufferOffset], n);
+        copied += n;
+        _position += n;
     }
-    return _buffer[_bufferPos];
+    return copied;
 }
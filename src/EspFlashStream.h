@@ -1,27 +1,53 @@
 #pragma once
 
 #include <Arduino.h>
+#if defined(PLATFORM_ESP32)
+#include <esp_spi_flash.h>
+#endif
+
+// Bytes fetched per ESP.flashRead(), must be a multiple of 4
+#if !defined(FLASH_STREAM_BLOCK_SIZE)
+#define FLASH_STREAM_BLOCK_SIZE 64
+#endif
+// Bytes from the base address mapped into the data cache on ESP32, 0 to always use block reads
+#if !defined(FLASH_STREAM_MMAP_SIZE)
+#define FLASH_STREAM_MMAP_SIZE 8192
+#endif
 
 class EspFlashStream : public Stream
 {
 public:
     EspFlashStream();
+    ~EspFlashStream();
     // Set the starting address to use with seek()s
     void setBaseAddress(size_t base);
-    size_t getPosition() const { return _flashOffset + _bufferPos; }
+    size_t getPosition() const { return _position; }
     void setPosition(size_t offset);
 
     // Stream class overrides
     virtual size_t write(uint8_t) { return 0; }
-    virtual int available() { return (_bufferPos <= sizeof(_buffer)) ? 1 : 0; }
+    virtual int available() { return _error ? 0 : 1; }
     virtual int read();
     virtual int peek();
+    using Stream::readBytes;
+    virtual size_t readBytes(char *buffer, size_t length);
 
 private:
     size_t _flashBase;
-    size_t _flashOffset;
-    uint8_t _buffer[4];
-    uint8_t _bufferPos;
+    size_t _position;
+    size_t _bufferOffset;
+    uint8_t _buffer[FLASH_STREAM_BLOCK_SIZE] __attribute__((aligned(4)));
+    bool _bufferValid;
+    bool _error;
+#if defined(PLATFORM_ESP32)
+    const uint8_t *_mapped;
+    size_t _mappedSize;
+    spi_flash_mmap_handle_t _mapHandle;
+    bool _mapTried;
+
+    void mapFlash();
+    void unmapFlash();
+#endif
 
-    void fillBuffer();
-};
\ No newline at end of file
+    bool fillBuffer();
+};
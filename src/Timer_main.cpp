@@ -11,11 +11,24 @@
 
 #include "msp.h"
 #include "msptypes.h"
+#if defined(PLATFORM_ESP32)
+#include "mspqueue.h"
+#endif
 #include "logging.h"
 #include "config.h"
 #include "common.h"
 #include "options.h"
 #include "helpers.h"
+#include "espnow_phy.h"
+#include "espnow_rssi.h"
+#include "backpack_link.h"
+#include "stats.h"
+#include "recorder.h"
+#include "profiler.h"
+#include "espnow_peers.h"
+#include "msplink.h"
+#include "SPSCRing.h"
+#include "uart_tx_ring.h"
 
 #include "device.h"
 #include "devWIFI.h"
@@ -28,9 +41,36 @@
 #define NO_BINDING_TIMEOUT  120000
 #define BINDING_LED_PAUSE   1000
 
+// Queue sizes in bytes, packets are stored at their real size
+#ifndef TIMER_RX_QUEUE_SIZE
+#define TIMER_RX_QUEUE_SIZE 1024
+#endif
+#ifndef TIMER_TX_QUEUE_SIZE
+#define TIMER_TX_QUEUE_SIZE 8192
+#endif
+// Bytes waiting to go out of the UART to the timer
+#ifndef TIMER_UART_TX_RING_SIZE
+#define TIMER_UART_TX_RING_SIZE 2048
+#endif
+#ifndef ESPNOW_TX_RING_SIZE
+#define ESPNOW_TX_RING_SIZE 2048
+#endif
+
+// ESP-NOW send retries, the backoff doubles after every failed attempt
+#define SEND_MAX_ATTEMPTS   5
+#define SEND_BACKOFF_US     1000
+#define SEND_TIMEOUT_US     100000
+
 /////////// GLOBALS ///////////
 
 uint8_t sendAddress[6];
+// Send to every registered peer rather than sendAddress
+bool sendToAllPeers = false;
+// What the station MAC is currently set to
+uint8_t stationAddress[6];
+// A frame has been handed to ESP-NOW and its send callback has not run yet
+volatile bool espnowSendPending = false;
+uint32_t espnowSendTime = 0;
 
 const uint8_t version[] = {LATEST_VERSION};
 
@@ -42,8 +82,8 @@ bool cacheFull = false;
 bool sendCached = false;
 bool tempUID = false;
 bool isBinding = false;
-bool espnowCTS = true;
-bool sendSuccess = false;
+// ESP-NOW settings taken from a bind, saved from loop()
+volatile bool phyOptionsChanged = false;
 
 device_t *ui_devices[] = {
 #ifdef PIN_LED
@@ -56,16 +96,56 @@ device_t *ui_devices[] = {
 };
 
 #if defined(PLATFORM_ESP32)
-  int maxAttempt = 5;
-  int sendAttempt = 0;
-  QueueHandle_t rxqueue = xQueueCreate(10, sizeof(mspPacket_t));
-  QueueHandle_t txqueue = xQueueCreate(500, sizeof(mspPacket_t));
-  SemaphoreHandle_t semaphore = xSemaphoreCreateBinary();
+  MSPQueue<TIMER_RX_QUEUE_SIZE> rxqueue;
+  MSPQueue<TIMER_TX_QUEUE_SIZE> txqueue;
+
+  typedef enum {
+    SEND_IDLE,
+    SEND_IN_FLIGHT,
+    SEND_BACKOFF
+  } sendState_e;
+
+  typedef enum {
+    SEND_RESULT_NONE,
+    SEND_RESULT_ACK,
+    SEND_RESULT_NAK
+  } sendResult_e;
+
+  typedef struct {
+    uint32_t sent;
+    uint32_t acked;
+    uint32_t retried;
+    uint32_t dropped;
+  } sendStats_t;
+
+  // Only one packet, the head of txqueue, is on the air at a time
+  sendState_e sendState = SEND_IDLE;
+  volatile sendResult_e sendResult = SEND_RESULT_NONE;
+  mspPacket_t inFlightPacket;
+  uint8_t sendAttempt = 0;
+  // In flight to peer sendTarget of sendTargets, counting from sendFirstTarget
+  uint8_t sendTarget = 0;
+  uint8_t sendFirstTarget = 0;
+  uint8_t sendTargets = 0;
+  uint32_t sendTime = 0;
+  sendStats_t sendStats;
 #endif
 
 /////////// CLASS OBJECTS ///////////
 
 MSP msp;
+// ESP-NOW frames get a parser of their own, so they can not break into a frame from the UART
+MSP espnowMsp;
+// The receive callback only copies frames in here, behind a byte saying if they are accepted
+SPSCRing<ESPNOW_RX_RING_SIZE> espnowRxRing;
+#if defined(PLATFORM_ESP8266)
+// Frames to send, each behind the address it goes to. One is on the air at a
+// time, the send callback starts the next so the station MAC can follow.
+SPSCRing<ESPNOW_TX_RING_SIZE> espnowTxRing;
+#endif
+MSPLinkSender espnowLink;
+EspnowPeers peers;
+UartTxRing<TIMER_UART_TX_RING_SIZE> uartTx(&Serial);
 ELRS_EEPROM eeprom;
 TimerBackpackConfig config;
 mspPacket_t cachedVTXPacket;
@@ -74,19 +154,15 @@ mspPacket_t cachedHTPacket;
 /////////// FUNCTION DEFS ///////////
 
 void ProcessMSPPacketFromTimer(mspPacket_t *packet, uint32_t now);
-int sendMSPViaEspnow(mspPacket_t *packet);
+int sendMSPViaEspnow(mspPacket_t *packet, const uint8_t *address, bool resend = false);
+int sendEspnowFrame(const uint8_t *address, uint8_t *data, uint8_t len);
 void resetBootCounter();
-void registerPeer(uint8_t* address);
+#if defined(PLATFORM_ESP8266)
+void SendNextEspnowFrame();
+#endif
 
 /////////////////////////////////////
 
-#if defined(PLATFORM_ESP32)
-// This seems to need to be global, as per this page,
-// otherwise we get errors about invalid peer:
-// https://rntlab.com/question/espnow-peer-interface-is-invalid/
-esp_now_peer_info_t peerInfo;
-#endif
-
 void RebootIntoWifi()
 {
   DBGLN("Rebooting into wifi update mode...");
@@ -95,8 +171,23 @@ void RebootIntoWifi()
   rebootTime = millis();
 }
 
+// Everything for the timer goes through uartTx so frames are never interleaved
+void sendMSPViaUart(mspPacket_t *packet)
+{
+  uint8_t data[MSP_FRAME_MAX_SIZE];
+  uint8_t size = msp.convertToByteArray(packet, data);
+  if (size && !uartTx.write(data, size))
+  {
+    DBGLN("uartTx full, dropping packet");
+    occupancyOverflow(OCCUPANCY_UART_TX);
+  }
+  occupancyRecord(OCCUPANCY_UART_TX, uartTx.size(), TIMER_UART_TX_RING_SIZE);
+  uartTx.drain();
+}
+
 void ProcessMSPPacketFromPeer(mspPacket_t *packet)
 {
+  PROFILE_SCOPE_ARG("msp_from_peer", packet->function);
   if (connectionState == binding)
   {
     DBGLN("Processing Binding Packet...");
@@ -111,6 +202,7 @@ void ProcessMSPPacketFromPeer(mspPacket_t *packet)
       }
       DBG(""); // Extra line for serial output readability
       resetBootCounter();
+      phyOptionsChanged = espnowPhyFromBind(packet->payload, packet->payloadSize);
       connectionState = running;
     }
     return;
@@ -122,21 +214,29 @@ void ProcessMSPPacketFromPeer(mspPacket_t *packet)
         out.reset();
         out.makeResponse();
         out.function = MSP_ELRS_BACKPACK_SET_RECORDING_STATE;
-        msp.sendPacket(packet, &Serial);
+        sendMSPViaUart(packet);
     }
   }
 }
 
-#if defined(PLATFORM_ESP32)
+#if defined(PLATFORM_ESP8266)
+  void OnDataSent(uint8_t *mac_addr, uint8_t status)
+  {
+    traceEvent(TRACE_ESPNOW_STATUS, status);
+    linkStatsSent(mac_addr, status == 0);
+    espnowSendPending = false;
+    // On the ESP8266 callbacks run from the SDK task, they never preempt loop()
+    SendNextEspnowFrame();
+  }
+#elif defined(PLATFORM_ESP32)
   void OnDataSent(const uint8_t *mac_addr, esp_now_send_status_t status)
   {
-    xSemaphoreTake(semaphore, (TickType_t)512);
-    espnowCTS = true;
-    if (status == ESP_NOW_SEND_SUCCESS)
-      sendSuccess = true;
-    else
-      sendSuccess = false;
-    xSemaphoreGive(semaphore);
+    traceEvent(TRACE_ESPNOW_STATUS, status);
+    linkStatsSent(mac_addr, status == ESP_NOW_SEND_SUCCESS);
+    espnowSendPending = false;
+    // Just record the result, loop() moves the send state on
+    sendResult = status == ESP_NOW_SEND_SUCCESS ? SEND_RESULT_ACK : SEND_RESULT_NAK;
+    devicesWakeup();
   }
 #endif
 
@@ -147,34 +247,56 @@ void OnDataRecv(uint8_t * mac_addr, uint8_t *data, uint8_t data_len)
 void OnDataRecv(const uint8_t * mac_addr, const uint8_t *data, int data_len)
 #endif
 {
-  DBGLN("ESP NOW DATA:");
-  for(int i = 0; i < data_len; i++)
+  linkStatsReceived(mac_addr);
+  // Only process packets from a bound MAC address
+  uint8_t accept = connectionState == binding || memcmp(firmwareOptions.uid, mac_addr, 6) == 0;
+  if (!espnowRxRing.push(&accept, 1, data, data_len))
   {
-    if (msp.processReceivedByte(data[i]))
+    DBGLN("ESP-NOW rx ring full, dropping frame");
+    occupancyOverflow(OCCUPANCY_ESPNOW_RX);
+  }
+  occupancyRecord(OCCUPANCY_ESPNOW_RX, espnowRxRing.used(), ESPNOW_RX_RING_SIZE);
+  devicesWakeup();
+}
+
+void ProcessEspnow(uint32_t now)
+{
+  uint8_t record[1 + ESPNOW_MAX_FRAME_SIZE];
+  uint16_t recordLen;
+  while ((recordLen = espnowRxRing.pop(record, sizeof(record))) != 0)
+  {
+    DBGLN("ESP NOW DATA:");
+    bool accept = record[0];
+    const uint8_t *frame = &record[1];
+    uint8_t frameLen = recordLen - 1;
+    if (MSPLinkReceiver::isLinkFrame(frame, frameLen))
     {
-      // Finished processing a complete packet
-      // Only process packets from a bound MAC address
-      if (connectionState == binding ||
-            (
-            firmwareOptions.uid[0] == mac_addr[0] &&
-            firmwareOptions.uid[1] == mac_addr[1] &&
-            firmwareOptions.uid[2] == mac_addr[2] &&
-            firmwareOptions.uid[3] == mac_addr[3] &&
-            firmwareOptions.uid[4] == mac_addr[4] &&
-            firmwareOptions.uid[5] == mac_addr[5]
-            )
-          )
+      // Nothing is sent reliably from here, so there are no ACKs to take
+      if (MSPLinkReceiver::isAck(frame, frameLen))
       {
+        continue;
+      }
+      frame += MSP_LINK_HEADER_SIZE;
+      frameLen -= MSP_LINK_HEADER_SIZE;
+    }
+    espnowMsp.processReceivedBytes(frame, frameLen, [accept, now](mspPacket_t *packet) {
+      if (accept)
+      {
+        traceEvent(TRACE_MSP_IN, TRACE_PORT_ESPNOW, packet->function, packet->payloadSize);
+        bootMark(BOOT_FIRST_PACKET);
         #if defined(PLATFORM_ESP8266)
-          ProcessMSPPacketFromTimer(msp.getReceivedPacket(), millis());
+          ProcessMSPPacketFromTimer(packet, now);
         #elif defined(PLATFORM_ESP32)
-          xQueueSend(rxqueue, msp.getReceivedPacket(), (TickType_t)1024);
+          if (!rxqueue.push(packet))
+          {
+            DBGLN("rxqueue full, dropping packet");
+          }
+          occupancyRecord(OCCUPANCY_TIMER_RX, rxqueue.bytes(), TIMER_RX_QUEUE_SIZE);
         #endif
       }
-      msp.markPacketReceived();
-    }
+    });
+    blinkLED();
   }
-  blinkLED();
 }
 
 void SendVersionResponse()
@@ -187,7 +309,34 @@ void SendVersionResponse()
   {
     out.addByte(version[i]);
   }
-  msp.sendPacket(&out, &Serial);
+  // The target after the version string, so flashing tools can tell what they
+  // found. Readers of the version stop at the NUL, a long name is cut short
+  out.addByte(0);
+  for (size_t i = 4 ; target_name[i] != 0 && out.payloadSize < MSP_PORT_INBUF_SIZE ; i++)
+  {
+    out.addByte(target_name[i]);
+  }
+  sendMSPViaUart(&out);
+}
+
+void SendLinkStatsResponse(uint8_t index)
+{
+  mspPacket_t out;
+  out.reset();
+  out.makeResponse();
+  out.function = MSP_ELRS_BACKPACK_GET_LINK_STATS;
+  out.payloadSize = linkStatsSerialize(index, out.payload);
+  sendMSPViaUart(&out);
+}
+
+void SendMemoryResponse(uint8_t report)
+{
+  mspPacket_t out;
+  out.reset();
+  out.makeResponse();
+  out.function = MSP_ELRS_BACKPACK_GET_MEMORY;
+  out.payloadSize = memorySerialize(report, out.payload);
+  sendMSPViaUart(&out);
 }
 
 void SendInProgressResponse()
@@ -201,11 +350,12 @@ void SendInProgressResponse()
     {
         out.addByte(response[i]);
     }
-    msp.sendPacket(&out, &Serial);
+    sendMSPViaUart(&out);
 }
 
 void ProcessMSPPacketFromTimer(mspPacket_t *packet, uint32_t now)
 {
+  PROFILE_SCOPE_ARG("msp_from_timer", packet->function);
   if (connectionState == binding)
   {
     DBGLN("Processing Binding Packet...");
@@ -220,6 +370,7 @@ void ProcessMSPPacketFromTimer(mspPacket_t *packet, uint32_t now)
       }
       DBG(""); // Extra line for serial output readability
       resetBootCounter();
+      phyOptionsChanged = espnowPhyFromBind(packet->payload, packet->payloadSize);
       connectionState = running;
     }
     return;
@@ -237,12 +388,14 @@ void ProcessMSPPacketFromTimer(mspPacket_t *packet, uint32_t now)
             bindingStart =  now;
             connectionState = binding;
             isBinding = true;
+            // Whatever this backpack runs, binding is done with the defaults
+            espnowPhyApplyDefault();
         }
         else if (packet->payload[0] == 'W')
         {
             DBGLN("Enter WIFI mode...");
             connectionState = wifiUpdate;
-            devicesTriggerEvent();
+            devicesTriggerEvent(EVENT_WIFI_REQUEST);
         }
         SendInProgressResponse();
       }
@@ -251,15 +404,21 @@ void ProcessMSPPacketFromTimer(mspPacket_t *packet, uint32_t now)
     DBGLN("Processing MSP_ELRS_GET_BACKPACK_VERSION...");
     SendVersionResponse();
     break;
+  case MSP_ELRS_BACKPACK_GET_LINK_STATS:
+    DBGLN("Processing MSP_ELRS_BACKPACK_GET_LINK_STATS...");
+    SendLinkStatsResponse(packet->readByte());
+    break;
+  case MSP_ELRS_BACKPACK_GET_MEMORY:
+    DBGLN("Processing MSP_ELRS_BACKPACK_GET_MEMORY...");
+    SendMemoryResponse(packet->readByte());
+    break;
   case MSP_ELRS_SET_SEND_UID:
   DBGLN("Processing MSP_ELRS_SET_SEND_UID...");
     {
       uint8_t function = packet->readByte();
+      sendToAllPeers = false;
 
-      // Unregister current peer
-      esp_now_del_peer(sendAddress);
-
-      // Set target send address
+      // Set target send address, peers stay registered from one target to the next
       if (function == 0x01)
       {
         uint8_t receivedAddress[6];
@@ -270,60 +429,245 @@ void ProcessMSPPacketFromTimer(mspPacket_t *packet, uint32_t now)
         receivedAddress[4] = packet->readByte();
         receivedAddress[5] = packet->readByte();
 
-        // Register new peer address
-        registerPeer(receivedAddress);
-
         // Set Send address for new target
-        memset(&sendAddress, 0, sizeof(sendAddress));
         memcpy(sendAddress, receivedAddress, 6);
       }
 
+      // Every address sent to so far, e.g. everyone in a race
+      else if (function == 0x02)
+      {
+        sendToAllPeers = true;
+      }
+
       // Return to bound send address
       else
       {
-        // Re-register stored address
-        registerPeer(firmwareOptions.uid);
-
         // Set Send address for normal target
-        memset(&sendAddress, 0, sizeof(sendAddress));
         memcpy(sendAddress, firmwareOptions.uid, 6);
       }
-
-      // Configure MAC address
-      #if defined(PLATFORM_ESP8266)
-        wifi_set_macaddr(STATION_IF, sendAddress);
-      #elif defined(PLATFORM_ESP32)
-        esp_wifi_set_mac(WIFI_IF_STA, sendAddress);
-      #endif
       break;
     }
   default:
     // transparently forward MSP packets via espnow to any subscribers
-    sendMSPViaEspnow(packet);
+    if (sendToAllPeers)
+    {
+      uint8_t count = peers.count();
+      uint8_t first = peers.indexOf(stationAddress);
+      for (uint8_t i = 0; i < count; i++)
+      {
+        sendMSPViaEspnow(packet, peers.address((first + i) % count));
+      }
+    }
+    else
+    {
+      sendMSPViaEspnow(packet, sendAddress);
+    }
     break;
   }
 }
 
-int sendMSPViaEspnow(mspPacket_t *packet)
+// Backpacks only take frames sent from their own group address, so the
+// station MAC follows the destination. It is only rewritten when that changes.
+// Sends are serialised, by espnowTxRing on the ESP8266 and the send queue on
+// the ESP32, so no frame is still going out from the old one.
+void SetStationAddress(const uint8_t *address)
+{
+  if (memcmp(stationAddress, address, 6) == 0)
+  {
+    return;
+  }
+  memcpy(stationAddress, address, 6);
+  #if defined(PLATFORM_ESP8266)
+    wifi_set_macaddr(STATION_IF, stationAddress);
+  #elif defined(PLATFORM_ESP32)
+    esp_wifi_set_mac(WIFI_IF_STA, stationAddress);
+  #endif
+}
+
+// A resend keeps the sequence number of the last attempt, so a receiver that
+// got the frame but whose MAC ACK was lost drops the copy
+int sendMSPViaEspnow(mspPacket_t *packet, const uint8_t *address, bool resend)
 {
+  static uint8_t lastLinkHeader[MSP_LINK_HEADER_SIZE];
   int esp_err = -1;
-  uint8_t packetSize = msp.getTotalPacketSize(packet);
-  uint8_t nowDataOutput[packetSize];
+  uint8_t nowDataOutput[MSP_LINK_HEADER_SIZE + MSP_FRAME_MAX_SIZE];
 
-  uint8_t result = msp.convertToByteArray(packet, nowDataOutput);
+  uint8_t packetSize = msp.convertToByteArray(packet, &nowDataOutput[MSP_LINK_HEADER_SIZE]);
 
-  if (!result)
+  if (!packetSize)
   {
     // packet could not be converted to array, bail out
     return esp_err;
   }
+  if (!peers.use(address))
+  {
+    return esp_err;
+  }
+  traceEvent(TRACE_MSP_OUT, TRACE_PORT_ESPNOW, packet->function, packet->payloadSize);
 
-  esp_err = esp_now_send(sendAddress, (uint8_t *) &nowDataOutput, packetSize);
+  packetSize += MSP_LINK_HEADER_SIZE;
+  if (resend)
+  {
+    memcpy(nowDataOutput, lastLinkHeader, MSP_LINK_HEADER_SIZE);
+  }
+  else
+  {
+    espnowLink.stamp(nowDataOutput, packetSize, MSP_LINK_BEST_EFFORT, millis());
+    memcpy(lastLinkHeader, nowDataOutput, MSP_LINK_HEADER_SIZE);
+  }
+
+  #if defined(PLATFORM_ESP8266)
+    if (!espnowTxRing.push(address, 6, nowDataOutput, packetSize))
+    {
+      DBGLN("espnowTxRing full, dropping packet");
+      return esp_err;
+    }
+    esp_err = 0;
+    SendNextEspnowFrame();
+  #elif defined(PLATFORM_ESP32)
+    esp_err = sendEspnowFrame(address, nowDataOutput, packetSize);
+  #endif
 
   blinkLED();
   return esp_err;
 }
 
+int sendEspnowFrame(const uint8_t *address, uint8_t *data, uint8_t len)
+{
+  SetStationAddress(address);
+  espnowSendPending = true;
+  espnowSendTime = micros();
+  int esp_err = esp_now_send((uint8_t *)address, data, len);
+  if (esp_err != 0)
+  {
+    espnowSendPending = false;
+  }
+  return esp_err;
+}
+
+#if defined(PLATFORM_ESP8266)
+// Start the oldest queued frame once nothing is on the air, a frame that
+// fails to start is dropped
+void SendNextEspnowFrame()
+{
+  uint8_t record[6 + MSP_LINK_HEADER_SIZE + MSP_FRAME_MAX_SIZE];
+  uint16_t len;
+  while (!espnowSendPending && (len = espnowTxRing.pop(record, sizeof(record))) > 6)
+  {
+    sendEspnowFrame(record, &record[6], len - 6);
+  }
+}
+#endif
+
+#if defined(PLATFORM_ESP32)
+void sendAttemptStart();
+
+// Done with the current target, move on to the next or to the next packet
+void sendTargetDone()
+{
+  if (++sendTarget < sendTargets)
+  {
+    sendAttempt = 0;
+    sendAttemptStart();
+    return;
+  }
+  txqueue.drop();
+  sendState = SEND_IDLE;
+}
+
+void sendAttemptFailed()
+{
+  if (sendAttempt >= SEND_MAX_ATTEMPTS)
+  {
+    DBGLN("ESP-NOW send failed, dropping packet");
+    sendStats.dropped++;
+    sendTargetDone();
+    return;
+  }
+  sendStats.retried++;
+  sendTime = micros();
+  sendState = SEND_BACKOFF;
+}
+
+void sendAttemptStart()
+{
+  sendAttempt++;
+  sendStats.sent++;
+  sendResult = SEND_RESULT_NONE;
+  sendTime = micros();
+  const uint8_t *address = sendToAllPeers ? peers.address((sendFirstTarget + sendTarget) % sendTargets) : sendAddress;
+  if (address != nullptr && sendMSPViaEspnow(&inFlightPacket, address, sendAttempt > 1) == ESP_OK)
+  {
+    sendState = SEND_IN_FLIGHT;
+  }
+  else
+  {
+    sendAttemptFailed();
+  }
+}
+
+void ProcessSendQueue(uint32_t now)
+{
+  switch (sendState)
+  {
+  case SEND_IDLE:
+    if (txqueue.peek(&inFlightPacket))
+    {
+      uint16_t function = inFlightPacket.function;
+      if (connectionState == binding ||
+        function == MSP_ELRS_GET_BACKPACK_VERSION ||
+        function == MSP_ELRS_BACKPACK_GET_LINK_STATS ||
+        function == MSP_ELRS_BACKPACK_GET_MEMORY ||
+        function == MSP_ELRS_BACKPACK_SET_MODE ||
+        function == MSP_ELRS_SET_SEND_UID)
+      {
+        // Handled locally, nothing goes on the air
+        ProcessMSPPacketFromTimer(&inFlightPacket, now);
+        txqueue.drop();
+      }
+      else
+      {
+        // The peer list is fixed for the whole fan-out, sending only touches existing peers
+        sendTarget = 0;
+        sendTargets = sendToAllPeers ? peers.count() : 1;
+        // Start with the peer the station MAC is already set for
+        sendFirstTarget = sendToAllPeers ? peers.indexOf(stationAddress) : 0;
+        sendAttempt = 0;
+        if (sendTargets == 0)
+        {
+          txqueue.drop();
+        }
+        else
+        {
+          sendAttemptStart();
+        }
+      }
+    }
+    break;
+
+  case SEND_IN_FLIGHT:
+    if (sendResult == SEND_RESULT_ACK)
+    {
+      latencyRecord(LATENCY_ESPNOW_SEND, micros() - sendTime);
+      sendStats.acked++;
+      sendTargetDone();
+    }
+    else if (sendResult == SEND_RESULT_NAK || micros() - sendTime >= SEND_TIMEOUT_US)
+    {
+      sendAttemptFailed();
+    }
+    break;
+
+  case SEND_BACKOFF:
+    if (micros() - sendTime >= ((uint32_t)SEND_BACKOFF_US << (sendAttempt - 1)))
+    {
+      sendAttemptStart();
+    }
+    break;
+  }
+}
+#endif
+
 void SetSoftMACAddress()
 {
   if (!firmwareOptions.hasUID)
@@ -341,16 +685,15 @@ void SetSoftMACAddress()
   // MAC address can only be set with unicast, so first byte must be even, not odd
   firmwareOptions.uid[0] = firmwareOptions.uid[0] & ~0x01;
 
+  // Bring the STA interface up on channel 1 directly, rather than through a dummy
+  // association attempt, and keep the SDK from writing the WiFi config to flash
+  WiFi.persistent(false);
   WiFi.mode(WIFI_STA);
-  WiFi.begin("network-name", "pass-to-network", 1);
   WiFi.disconnect();
+  espnowPhyApplyOptions();
 
   // Soft-set the MAC address to the passphrase UID for binding
-  #if defined(PLATFORM_ESP8266)
-    wifi_set_macaddr(STATION_IF, firmwareOptions.uid);
-  #elif defined(PLATFORM_ESP32)
-    esp_wifi_set_mac(WIFI_IF_STA, firmwareOptions.uid);
-  #endif
+  SetStationAddress(firmwareOptions.uid);
 }
 
 void resetBootCounter()
@@ -359,23 +702,6 @@ void resetBootCounter()
   config.Commit();
 }
 
-void registerPeer(uint8_t* address){
-  #if defined(PLATFORM_ESP8266)
-    esp_now_set_self_role(ESP_NOW_ROLE_COMBO);
-    esp_now_add_peer(address, ESP_NOW_ROLE_COMBO, 1, NULL, 0);
-  #elif defined(PLATFORM_ESP32)
-    memset(&peerInfo, 0, sizeof(peerInfo));
-    memcpy(peerInfo.peer_addr, address, 6);
-    peerInfo.channel = 0;
-    peerInfo.encrypt = false;
-    if (esp_now_add_peer(&peerInfo) != ESP_OK)
-    {
-      DBGLN("ESP-NOW failed to add peer");
-      return;
-    }
-  #endif
-}
-
 bool BindingExpired(uint32_t now)
 {
   return (connectionState == binding) && ((now - bindingStart) > NO_BINDING_TIMEOUT);
@@ -400,15 +726,18 @@ RF_PRE_INIT()
 
 void setup()
 {
+  bootMark(BOOT_SETUP);
   #ifdef DEBUG_LOG
     Serial1.begin(115200);
     Serial1.setDebugOutput(true);
   #endif
   Serial.begin(460800);
 
-  options_init();
-
   eeprom.Begin();
+  bootMark(BOOT_EEPROM);
+  options_init(&eeprom);
+  bootMark(BOOT_OPTIONS);
+
   config.SetStorageProvider(&eeprom);
   config.Load();
 
@@ -423,11 +752,12 @@ void setup()
     config.SetStartWiFiOnBoot(false);
     config.Commit();
     connectionState = wifiUpdate;
-    devicesTriggerEvent();
+    devicesTriggerEvent(EVENT_WIFI_REQUEST);
   }
   else
   {
     SetSoftMACAddress();
+    bootMark(BOOT_WIFI);
 
     if (esp_now_init() != 0)
     {
@@ -436,15 +766,18 @@ void setup()
     }
 
     esp_now_register_recv_cb(OnDataRecv);
+    esp_now_register_send_cb(OnDataSent);
+    espnowRssiBegin();
     
-    #if defined(PLATFORM_ESP32)
-      esp_now_register_send_cb(OnDataSent);
-      xSemaphoreGive(semaphore);
+    #if defined(PLATFORM_ESP8266)
+      esp_now_set_self_role(ESP_NOW_ROLE_COMBO);
     #endif
-    
-    registerPeer(firmwareOptions.uid);
+    espnowLink.begin(MSP_LINK_SOURCE_TIMER, random(256));
+    // The bound address is always kept registered
+    peers.use(firmwareOptions.uid, true);
 
     memcpy(sendAddress, firmwareOptions.uid, 6);
+    bootMark(BOOT_ESPNOW);
   }
 
   devicesStart();
@@ -459,18 +792,32 @@ void loop()
 {
   uint32_t now = millis();
 
+  // Print anything queued by deferred logging outside of the callbacks
+  DBGFLUSH();
+
   devicesUpdate(now);
+  eeprom.Update(now);
+  memoryUpdate(now);
+  linkStatsUpdate();
+  profilerUpdate(now);
 
   if (BindingExpired(now))
   {
       connectionState = running;
       isBinding = false;
       DBGLN("Bind timeout");
+      espnowPhyApplyOptions();
   }
   if (isBinding && connectionState == running)
   {
       DBGLN("Bind completed");
       isBinding = false;
+      if (phyOptionsChanged)
+      {
+        phyOptionsChanged = false;
+        saveOptions();
+      }
+      espnowPhyApplyOptions();
   }
 
   if (connectionState == wifiUpdate)
@@ -483,15 +830,22 @@ void loop()
     connectionState = running;
   }
 
+  ProcessEspnow(now);
+
   while (Serial.available())
   {
     uint8_t c = Serial.read();
     if (msp.processReceivedByte(c))
     {
+      traceEvent(TRACE_MSP_IN, TRACE_PORT_UART, msp.getReceivedPacket()->function, msp.getReceivedPacket()->payloadSize);
       #if defined(PLATFORM_ESP8266)
         ProcessMSPPacketFromTimer(msp.getReceivedPacket(), now);
       #elif defined(PLATFORM_ESP32)
-        xQueueSend(txqueue, msp.getReceivedPacket(), (TickType_t)1024);
+        if (!txqueue.push(msp.getReceivedPacket()))
+        {
+          DBGLN("txqueue full, dropping packet");
+        }
+        occupancyRecord(OCCUPANCY_TIMER_TX, txqueue.bytes(), TIMER_TX_QUEUE_SIZE);
       #endif
       msp.markPacketReceived();
     }
@@ -499,59 +853,50 @@ void loop()
 
   // If the reboot time is set and the current time is past the reboot time then reboot.
   #if defined(PLATFORM_ESP8266)
-    if (rebootTime != 0 && now > rebootTime)
+    if (rebootTime != 0 && now > rebootTime && espnowTxRing.empty())
+    {
+      eeprom.Flush();
       ESP.restart();
+    }
   #elif defined(PLATFORM_ESP32)
-    if (rebootTime != 0 && now > rebootTime && uxQueueMessagesWaiting(txqueue) == 0 && uxQueueMessagesWaiting(rxqueue) == 0)
+    if (rebootTime != 0 && now > rebootTime && txqueue.size() == 0 && rxqueue.size() == 0 && uartTx.size() == 0)
+    {
+      eeprom.Flush();
       ESP.restart();
+    }
   #endif
 
-  #if defined(PLATFORM_ESP32)
-    // Process packets in sendQueue
-    xSemaphoreTake(semaphore, (TickType_t)512);
-    if (uxQueueMessagesWaiting(txqueue) > 0 && espnowCTS)
+  #if defined(PLATFORM_ESP8266)
+    // A send callback that never came must not stall espnowTxRing
+    if (espnowSendPending && micros() - espnowSendTime >= SEND_TIMEOUT_US)
     {
-      mspPacket_t packet;
-      xQueuePeek(txqueue, &packet, (TickType_t)512);
-      uint16_t function = packet.function;
-
-      if (function == MSP_ELRS_GET_BACKPACK_VERSION ||
-        function == MSP_ELRS_BACKPACK_SET_MODE ||
-        function == MSP_ELRS_SET_SEND_UID)
-      {
-        xSemaphoreGive(semaphore);
-        ProcessMSPPacketFromTimer(&packet, now);
-        xQueueReceive(txqueue, &packet, (TickType_t)512);
-      }
-      else
-      {
-        if (++sendAttempt >= maxAttempt || sendSuccess)
-        {
-          espnowCTS = false;
-          xSemaphoreGive(semaphore);
-          sendAttempt = 0;
-          ProcessMSPPacketFromTimer(&packet, now);
-          xQueueReceive(txqueue, &packet, (TickType_t)512);
-        }
-        else
-        {
-          espnowCTS = false;
-          xSemaphoreGive(semaphore);
-          ProcessMSPPacketFromTimer(&packet, now);
-        }
-      }
+      espnowSendPending = false;
     }
-    else
+    SendNextEspnowFrame();
+  #elif defined(PLATFORM_ESP32)
+    // Process packets in sendQueue
+    ProcessSendQueue(now);
+
+    // Move everything received into the UART ring while it has room for a whole frame
+    mspPacket_t rxPacket;
+    while (uartTx.free() >= MSP_FRAME_MAX_SIZE && rxqueue.pop(&rxPacket))
     {
-      xSemaphoreGive(semaphore);
+      ProcessMSPPacketFromPeer(&rxPacket);
     }
+  #endif
+
+  uartTx.drain();
 
-    if (uxQueueMessagesWaiting(rxqueue) > 0 && Serial.availableForWrite() == 128)
+  #if defined(PLATFORM_ESP32)
+    // Keep going while there is queued work, the send callback wakes us otherwise
+    if (uartTx.size() == 0 && espnowRxRing.empty() && (sendState == SEND_IN_FLIGHT || (txqueue.size() == 0 && rxqueue.size() == 0)))
     {
-      mspPacket_t rxPacket;
-      if (xQueueReceive(rxqueue, &rxPacket, (TickType_t)512) == pdTRUE)
-        ProcessMSPPacketFromPeer(&rxPacket);
+      devicesIdle(millis(), LOOP_IDLE_MAX_MS);
+    }
+  #else
+    if (uartTx.size() == 0 && espnowRxRing.empty())
+    {
+      devicesIdle(millis(), LOOP_IDLE_MAX_MS);
     }
-
   #endif
 }
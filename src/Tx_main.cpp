@@ -11,17 +11,49 @@
 
 #include "msp.h"
 #include "msptypes.h"
+#include "mspmailbox.h"
+#include "mspcache.h"
+#include "mspfragment.h"
+#include "msplink.h"
+#include "mspcoalesce.h"
+#include "SPSCRing.h"
+#include "stats.h"
+#include "recorder.h"
+#include "profiler.h"
+#if defined(PTR_PREDICTION)
+#include "ptr_predictor.h"
+#endif
+#if defined(PLATFORM_ESP32) && defined(UART_EVENT_INGEST)
+#include "mspqueue.h"
+#endif
 #include "logging.h"
 #include "config.h"
 #include "common.h"
 #include "options.h"
 #include "helpers.h"
+#include "espnow_phy.h"
+#include "espnow_rssi.h"
+#include "backpack_link.h"
 
 #include "device.h"
 #include "devWIFI.h"
 #include "devButton.h"
 #include "devLED.h"
 
+/////////// DEFINES ///////////
+
+// Small MSP frames sent back to back are gathered into a single ESP-NOW frame,
+// which is sent when full or once it has waited this long. 0 sends every frame immediately
+#ifndef ESPNOW_COALESCE_TIMEOUT_US
+#define ESPNOW_COALESCE_TIMEOUT_US  2000
+#endif
+
+// Bytes pulled from the UART per readBytes() call
+#define UART_INGEST_CHUNK           64
+#if defined(UART_EVENT_INGEST) && !defined(UART_INGEST_QUEUE_SIZE)
+#define UART_INGEST_QUEUE_SIZE      2048
+#endif
+
 /////////// GLOBALS ///////////
 
 uint8_t bindingAddress[6] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
@@ -31,8 +63,17 @@ const uint8_t version[] = {LATEST_VERSION};
 connectionState_e connectionState = starting;
 unsigned long rebootTime = 0;
 
-bool cacheFull = false;
+static const uint16_t cacheFunctions[] = { MSP_CACHE_FUNCTIONS };
+static const uint16_t reliableFunctions[] = { MSP_LINK_RELIABLE_FUNCTIONS };
+
 bool sendCached = false;
+// (function, digest) pairs the VRX reported with its request, only entries that differ are resent
+uint8_t requestedDigests[MSP_PORT_INBUF_SIZE];
+uint8_t requestedDigestsSize = 0;
+
+MSPCoalescer coalescer;
+uint32_t espnowSendTime = 0;
+volatile bool espnowSendPending = false;
 
 device_t *ui_devices[] = {
 #ifdef PIN_LED
@@ -47,10 +88,25 @@ device_t *ui_devices[] = {
 /////////// CLASS OBJECTS ///////////
 
 MSP msp;
+// Every input has a parser of its own, ESP-NOW frames are parsed in loop()
+MSP espnowMsp;
+// The receive callback only copies frames in here, behind a byte saying if they came from the bound MAC
+SPSCRing<ESPNOW_RX_RING_SIZE> espnowRxRing;
+MSPFragmenter fragmenter;
+MSPLinkSender espnowLink;
+MSPLinkReceiver linkReceiver;
 ELRS_EEPROM eeprom;
 TxBackpackConfig config;
-mspPacket_t cachedVTXPacket;
-mspPacket_t cachedHTPacket;
+MSPCache<MSP_CACHE_MAX_ENTRIES, MSP_CACHE_POOL_SIZE> mspCache(cacheFunctions, ARRAY_SIZE(cacheFunctions));
+MSPMailbox ptrMailbox;
+#if defined(PTR_PREDICTION)
+PtrPredictor ptrPredictor;
+#endif
+#if defined(PLATFORM_ESP32) && defined(UART_EVENT_INGEST)
+// Decoded in the UART event task, handled in loop()
+MSP uartMsp;
+MSPQueue<UART_INGEST_QUEUE_SIZE> uartQueue;
+#endif
 
 /////////// FUNCTION DEFS ///////////
 
@@ -75,19 +131,22 @@ void RebootIntoWifi()
 
 void ProcessMSPPacketFromPeer(mspPacket_t *packet)
 {
+  PROFILE_SCOPE_ARG("msp_from_peer", packet->function);
+  traceEvent(TRACE_MSP_IN, TRACE_PORT_ESPNOW, packet->function, packet->payloadSize);
   switch (packet->function) {
     case MSP_ELRS_REQU_VTX_PKT: {
       DBGLN("MSP_ELRS_REQU_VTX_PKT...");
       // request from the vrx-backpack to send cached VTX packet
-      if (cacheFull)
-      {
-        sendCached = true;
-      }
+      // Older VRX backpacks send a single byte and get everything
+      requestedDigestsSize = packet->payloadSize > 1 ? packet->payloadSize - 1 : 0;
+      memcpy(requestedDigests, &packet->payload[1], requestedDigestsSize);
+      sendCached = true;
       break;
     }
     case MSP_ELRS_BACKPACK_SET_PTR: {
       DBGLN("MSP_ELRS_BACKPACK_SET_PTR...");
-      msp.sendPacket(packet, &Serial);
+      // Sent from loop(), a newer sample replaces one that has not gone out yet
+      ptrMailbox.post(packet, micros());
       break;
     }
     case MSP_SET_VTX_CONFIG: {
@@ -95,6 +154,34 @@ void ProcessMSPPacketFromPeer(mspPacket_t *packet)
       msp.sendPacket(packet, &Serial);
       break;
     }
+    case MSP_ELRS_BACKPACK_GET_CHANNEL_INDEX:
+    case MSP_ELRS_BACKPACK_GET_FREQUENCY:
+    case MSP_ELRS_BACKPACK_GET_RSSI: {
+      // channel change completed, or the result of a channel sweep
+      msp.sendPacket(packet, &Serial);
+      break;
+    }
+  }
+}
+
+// espnow on-send callback
+#if defined(PLATFORM_ESP8266)
+void OnDataSent(uint8_t *mac_addr, uint8_t status)
+#elif defined(PLATFORM_ESP32)
+void OnDataSent(const uint8_t *mac_addr, esp_now_send_status_t status)
+#endif
+{
+  traceEvent(TRACE_ESPNOW_STATUS, status);
+#if defined(PLATFORM_ESP8266)
+  linkStatsSent(mac_addr, status == 0);
+#elif defined(PLATFORM_ESP32)
+  linkStatsSent(mac_addr, status == ESP_NOW_SEND_SUCCESS);
+#endif
+  // Only the first of back to back sends is timed
+  if (espnowSendPending)
+  {
+    latencyRecord(LATENCY_ESPNOW_SEND, micros() - espnowSendTime);
+    espnowSendPending = false;
   }
 }
 
@@ -105,26 +192,67 @@ void OnDataRecv(uint8_t * mac_addr, uint8_t *data, uint8_t data_len)
 void OnDataRecv(const uint8_t * mac_addr, const uint8_t *data, int data_len)
 #endif
 {
-  DBGLN("ESP NOW DATA:");
-  for(int i = 0; i < data_len; i++)
+  linkStatsReceived(mac_addr);
+  // Only process packets from a bound MAC address
+  uint8_t bound = memcmp(firmwareOptions.uid, mac_addr, 6) == 0;
+  if (MSPLinkReceiver::isLinkFrame(data, data_len) && MSPLinkReceiver::isAck(data, data_len))
   {
-    if (msp.processReceivedByte(data[i]))
+    // Retransmits are timed from loop(), an ACK is only noted here
+    if (bound)
     {
-      // Finished processing a complete packet
-      // Only process packets from a bound MAC address
-      if (firmwareOptions.uid[0] == mac_addr[0] &&
-          firmwareOptions.uid[1] == mac_addr[1] &&
-          firmwareOptions.uid[2] == mac_addr[2] &&
-          firmwareOptions.uid[3] == mac_addr[3] &&
-          firmwareOptions.uid[4] == mac_addr[4] &&
-          firmwareOptions.uid[5] == mac_addr[5])
+      espnowLink.postAck(data, data_len);
+    }
+    return;
+  }
+  // Nothing is parsed or sent from the WiFi task, loop() owns the parser and the UART
+  if (!espnowRxRing.push(&bound, 1, data, data_len))
+  {
+    DBGLN("ESP-NOW rx ring full, dropping frame");
+    occupancyOverflow(OCCUPANCY_ESPNOW_RX);
+  }
+  occupancyRecord(OCCUPANCY_ESPNOW_RX, espnowRxRing.used(), ESPNOW_RX_RING_SIZE);
+  devicesWakeup();
+}
+
+void ProcessEspnow()
+{
+  uint8_t record[1 + ESPNOW_MAX_FRAME_SIZE];
+  uint16_t recordLen;
+  while ((recordLen = espnowRxRing.pop(record, sizeof(record))) != 0)
+  {
+    DBGLN("ESP NOW DATA:");
+    bool bound = record[0];
+    const uint8_t *frame = &record[1];
+    uint8_t frameLen = recordLen - 1;
+    if (MSPLinkReceiver::isLinkFrame(frame, frameLen))
+    {
+      if (!bound)
       {
-        ProcessMSPPacketFromPeer(msp.getReceivedPacket());
+        continue;
       }
-      msp.markPacketReceived();
+      // Frames from the timer, duplicates of ones already handled are dropped
+      uint8_t ack[MSP_LINK_ACK_SIZE];
+      uint8_t ackLen;
+      bool fresh = linkReceiver.accept(frame, frameLen, ack, &ackLen);
+      if (ackLen)
+      {
+        esp_now_send(firmwareOptions.uid, ack, ackLen);
+      }
+      if (!fresh)
+      {
+        continue;
+      }
+      frame += MSP_LINK_HEADER_SIZE;
+      frameLen -= MSP_LINK_HEADER_SIZE;
     }
+    espnowMsp.processReceivedBytes(frame, frameLen, [bound](mspPacket_t *packet) {
+      if (bound)
+      {
+        ProcessMSPPacketFromPeer(packet);
+      }
+    });
+    blinkLED();
   }
-  blinkLED();
 }
 
 void SendVersionResponse()
@@ -137,11 +265,65 @@ void SendVersionResponse()
   {
     out.addByte(version[i]);
   }
+  // The target after the version string, so flashing tools can tell what they
+  // found. Readers of the version stop at the NUL, a long name is cut short
+  out.addByte(0);
+  for (size_t i = 4 ; target_name[i] != 0 && out.payloadSize < MSP_PORT_INBUF_SIZE ; i++)
+  {
+    out.addByte(target_name[i]);
+  }
+  msp.sendPacket(&out, &Serial);
+}
+
+void SendLatencyResponse(uint8_t probe)
+{
+  if (probe >= LATENCY_PROBE_COUNT)
+  {
+    return;
+  }
+  mspPacket_t out;
+  out.reset();
+  out.makeResponse();
+  out.function = MSP_ELRS_BACKPACK_GET_LATENCY;
+  out.payloadSize = latencySerialize((latencyProbe_e)probe, out.payload);
+  msp.sendPacket(&out, &Serial);
+}
+
+void SendBootTimingResponse()
+{
+  mspPacket_t out;
+  out.reset();
+  out.makeResponse();
+  out.function = MSP_ELRS_BACKPACK_GET_BOOT_TIMING;
+  out.payloadSize = bootSerialize(out.payload);
+  msp.sendPacket(&out, &Serial);
+}
+
+void SendLinkStatsResponse(uint8_t index)
+{
+  mspPacket_t out;
+  out.reset();
+  out.makeResponse();
+  out.function = MSP_ELRS_BACKPACK_GET_LINK_STATS;
+  out.payloadSize = linkStatsSerialize(index, out.payload);
+  msp.sendPacket(&out, &Serial);
+}
+
+void SendMemoryResponse(uint8_t report)
+{
+  mspPacket_t out;
+  out.reset();
+  out.makeResponse();
+  out.function = MSP_ELRS_BACKPACK_GET_MEMORY;
+  out.payloadSize = memorySerialize(report, out.payload);
   msp.sendPacket(&out, &Serial);
 }
 
 void ProcessMSPPacketFromTX(mspPacket_t *packet)
 {
+  PROFILE_SCOPE_ARG("msp_from_tx", packet->function);
+  bootMark(BOOT_FIRST_PACKET);
+  traceEvent(TRACE_MSP_IN, TRACE_PORT_UART, packet->function, packet->payloadSize);
   if (packet->function == MSP_ELRS_BIND)
   {
     config.SetGroupAddress(packet->payload);
@@ -153,6 +335,16 @@ void ProcessMSPPacketFromTX(mspPacket_t *packet)
     }
     DBG(""); // Extra line for serial output readability
     config.Commit();
+    // Tell the other end what this one runs, handsets only send the address
+    if (packet->payloadSize == ESPNOW_BIND_PHY_OFFSET)
+    {
+      uint8_t phy[ESPNOW_BIND_PHY_SIZE];
+      espnowPhyToBind(phy);
+      for (uint8_t i = 0; i < ESPNOW_BIND_PHY_SIZE; i++)
+      {
+        packet->addByte(phy[i]);
+      }
+    }
     // delay(500); // delay may not be required
     sendMSPViaEspnow(packet);
     // delay(500); // delay may not be required
@@ -163,8 +355,7 @@ void ProcessMSPPacketFromTX(mspPacket_t *packet)
   {
   case MSP_SET_VTX_CONFIG:
     DBGLN("Processing MSP_SET_VTX_CONFIG...");
-    cachedVTXPacket = *packet;
-    cacheFull = true;
+    mspCache.update(packet);
     // transparently forward MSP packets via espnow to any subscribers
     sendMSPViaEspnow(packet);
     break;
@@ -180,60 +371,183 @@ void ProcessMSPPacketFromTX(mspPacket_t *packet)
     DBGLN("Processing MSP_ELRS_GET_BACKPACK_VERSION...");
     SendVersionResponse();
     break;
+  case MSP_ELRS_BACKPACK_GET_LATENCY:
+    DBGLN("Processing MSP_ELRS_BACKPACK_GET_LATENCY...");
+    SendLatencyResponse(packet->readByte());
+    break;
+  case MSP_ELRS_BACKPACK_GET_BOOT_TIMING:
+    DBGLN("Processing MSP_ELRS_BACKPACK_GET_BOOT_TIMING...");
+    SendBootTimingResponse();
+    break;
+  case MSP_ELRS_BACKPACK_GET_LINK_STATS:
+    DBGLN("Processing MSP_ELRS_BACKPACK_GET_LINK_STATS...");
+    SendLinkStatsResponse(packet->readByte());
+    break;
+  case MSP_ELRS_BACKPACK_GET_MEMORY:
+    DBGLN("Processing MSP_ELRS_BACKPACK_GET_MEMORY...");
+    SendMemoryResponse(packet->readByte());
+    break;
   case MSP_ELRS_BACKPACK_SET_HEAD_TRACKING:
     DBGLN("Processing MSP_ELRS_BACKPACK_SET_HEAD_TRACKING...");
-    cachedHTPacket = *packet;
-    cacheFull = true;
+    mspCache.update(packet);
     sendMSPViaEspnow(packet);
     break;
   default:
+    mspCache.update(packet);
     // transparently forward MSP packets via espnow to any subscribers
     sendMSPViaEspnow(packet);
     break;
   }
 }
 
+static void SendLinkFrame(const uint8_t *data, uint8_t len)
+{
+  esp_now_send(firmwareOptions.uid, (uint8_t *)data, len);
+  blinkLED();
+}
+
+static mspLinkClass_e LinkClass(uint16_t function)
+{
+  if (function == MSP_ELRS_BACKPACK_SET_PTR)
+  {
+    return MSP_LINK_LATEST;
+  }
+  for (uint8_t i = 0 ; i < ARRAY_SIZE(reliableFunctions) ; i++)
+  {
+    if (reliableFunctions[i] == function)
+    {
+      return MSP_LINK_RELIABLE;
+    }
+  }
+  return MSP_LINK_BEST_EFFORT;
+}
+
+static void SendCoalesced(uint8_t *frame, uint8_t len, mspLinkClass_e linkClass, uint32_t startUs)
+{
+  uint32_t now = micros();
+  // The oldest frame in the buffer was queued as soon as it was decoded
+  latencyRecord(LATENCY_MSP_TO_ESPNOW, now - startUs);
+  if (!espnowSendPending)
+  {
+    espnowSendTime = now;
+    espnowSendPending = true;
+  }
+  espnowLink.stamp(frame, len, linkClass, millis());
+  SendLinkFrame(frame, len);
+}
+
+void flushMSPViaEspnow()
+{
+  coalescer.flush(SendCoalesced);
+}
+
 void sendMSPViaEspnow(mspPacket_t *packet)
 {
-  uint8_t packetSize = msp.getTotalPacketSize(packet);
-  uint8_t nowDataOutput[packetSize];
+  uint8_t nowDataOutput[MSP_FRAME_MAX_SIZE];
 
-  uint8_t result = msp.convertToByteArray(packet, nowDataOutput);
+  uint8_t packetSize = msp.convertToByteArray(packet, nowDataOutput);
 
-  if (!result)
+  if (!packetSize)
   {
     // packet could not be converted to array, bail out
     return;
   }
+  traceEvent(TRACE_MSP_OUT, TRACE_PORT_ESPNOW, packet->function, packet->payloadSize);
 
   if (packet->function == MSP_ELRS_BIND)
   {
-    esp_now_send(bindingAddress, (uint8_t *) &nowDataOutput, packetSize); // Send Bind packet with the broadcast address
+    // Keep the ordering with anything already waiting
+    flushMSPViaEspnow();
+    // Backpacks in binding mode listen with the default settings, this one reboots after binding
+    espnowPhyApplyDefault();
+    esp_now_send(bindingAddress, nowDataOutput, packetSize); // Send Bind packet with the broadcast address
+    blinkLED();
+    return;
   }
-  else
+
+  coalescer.add(nowDataOutput, packetSize, LinkClass(packet->function), micros(), SendCoalesced);
+
+  // Latency sensitive frames go straight out, taking anything pending with them
+  if (ESPNOW_COALESCE_TIMEOUT_US == 0 ||
+      packet->function == MSP_ELRS_BACKPACK_SET_HEAD_TRACKING ||
+      packet->function == MSP_ELRS_BACKPACK_SET_PTR)
   {
-    esp_now_send(firmwareOptions.uid, (uint8_t *) &nowDataOutput, packetSize);
+    flushMSPViaEspnow();
   }
+}
 
+static void SendFragment(const uint8_t *data, uint8_t len)
+{
+  esp_now_send(firmwareOptions.uid, (uint8_t *)data, len);
   blinkLED();
 }
 
-void SendCachedMSP()
+// Payloads too big for an mspPacket_t arrive from the TX in chunks, and are
+// passed on as they come, as fragments of one MSP frame
+void ForwardMSPChunk(mspChunkEvent_e event, const mspPacket_t *packet, uint16_t offset, const uint8_t *data, uint16_t len)
 {
-  if (!cacheFull)
+  static uint8_t crc;
+
+  switch (event)
   {
-    // nothing to send
-    return;
+  case MSP_CHUNK_DATA:
+    if (offset == 0)
+    {
+      uint8_t header[MSP_FRAME_PREAMBLE_SIZE + sizeof(mspHeaderV2_t)];
+      uint8_t headerSize = msp.convertHeaderToByteArray(packet, header);
+      traceEvent(TRACE_MSP_OUT, TRACE_PORT_ESPNOW, packet->function, packet->payloadSize);
+
+      // Keep the ordering with anything already waiting
+      flushMSPViaEspnow();
+      fragmenter.begin(headerSize + packet->payloadSize + 1);
+      fragmenter.write(header, headerSize, SendFragment);
+      crc = MSP::crc(0, &header[MSP_FRAME_PREAMBLE_SIZE], sizeof(mspHeaderV2_t));
+    }
+    crc = MSP::crc(crc, data, len);
+    fragmenter.write(data, len, SendFragment);
+    break;
+  case MSP_CHUNK_END:
+    fragmenter.write(&crc, 1, SendFragment);
+    break;
+  case MSP_CHUNK_ABORT:
+    DBGLN("Dropped streamed MSP function %x", packet->function);
+    fragmenter.abort();
+    break;
   }
+}
 
-  if (cachedVTXPacket.type != MSP_PACKET_UNKNOWN)
+// Digest the VRX reported for a function, 0 if it holds none
+static uint16_t RequestedDigest(uint16_t function)
+{
+  for (uint8_t i = 0 ; i + 4 <= requestedDigestsSize ; i += 4)
   {
-    sendMSPViaEspnow(&cachedVTXPacket);
+    if ((requestedDigests[i] | requestedDigests[i + 1] << 8) == function)
+    {
+      return requestedDigests[i + 2] | requestedDigests[i + 3] << 8;
+    }
   }
-  if (cachedHTPacket.type != MSP_PACKET_UNKNOWN)
+  return 0;
+}
+
+void SendCachedMSP()
+{
+  mspCache.replay(
+    [](uint16_t function, uint16_t digest) { return RequestedDigest(function) != digest; },
+    [](mspPacket_t *packet) { sendMSPViaEspnow(packet); });
+
+  // Always answer, even with nothing cached, so the VRX stops asking
+  mspPacket_t out;
+  out.reset();
+  out.makeResponse();
+  out.function = MSP_ELRS_REQU_VTX_PKT;
+  for (uint8_t i = 0 ; i < mspCache.size() && out.payloadSize + 4 <= MSP_PORT_INBUF_SIZE ; i++)
   {
-    sendMSPViaEspnow(&cachedHTPacket);
+    out.addByte(mspCache.function(i) & 0xFF);
+    out.addByte(mspCache.function(i) >> 8);
+    out.addByte(mspCache.digest(i) & 0xFF);
+    out.addByte(mspCache.digest(i) >> 8);
   }
+  sendMSPViaEspnow(&out);
 }
 
 void SetSoftMACAddress()
@@ -252,9 +566,12 @@ void SetSoftMACAddress()
   // MAC address can only be set with unicast, so first byte must be even, not odd
   firmwareOptions.uid[0] = firmwareOptions.uid[0] & ~0x01;
 
+  // Bring the STA interface up on channel 1 directly, rather than through a dummy
+  // association attempt, and keep the SDK from writing the WiFi config to flash
+  WiFi.persistent(false);
   WiFi.mode(WIFI_STA);
-  WiFi.begin("network-name", "pass-to-network", 1);
   WiFi.disconnect();
+  espnowPhyApplyOptions();
 
   // Soft-set the MAC address to the passphrase UID for binding
   #if defined(PLATFORM_ESP8266)
@@ -264,6 +581,48 @@ void SetSoftMACAddress()
   #endif
 }
 
+#if defined(PLATFORM_ESP32) && defined(UART_EVENT_INGEST)
+void OnSerialReceive()
+{
+  uint8_t buf[UART_INGEST_CHUNK];
+  int avail;
+  while ((avail = Serial.available()) > 0)
+  {
+    size_t len = Serial.readBytes(buf, min(avail, (int)sizeof(buf)));
+    uartMsp.processReceivedBytes(buf, len, [](mspPacket_t *packet) {
+      if (!uartQueue.push(packet))
+      {
+        DBGLN("uartQueue full, dropping packet");
+      }
+      occupancyRecord(OCCUPANCY_UART_INGEST, uartQueue.bytes(), UART_INGEST_QUEUE_SIZE);
+    });
+  }
+  devicesWakeup();
+}
+#endif
+
+void ProcessSerial()
+{
+#if defined(PLATFORM_ESP32) && defined(UART_EVENT_INGEST)
+  mspPacket_t packet;
+  while (uartQueue.pop(&packet))
+  {
+    ProcessMSPPacketFromTX(&packet);
+  }
+#else
+  // Drain everything the UART has buffered in as few calls as possible
+  uint8_t buf[UART_INGEST_CHUNK];
+  int avail;
+  while ((avail = Serial.available()) > 0)
+  {
+    size_t len = Serial.readBytes(buf, min(avail, (int)sizeof(buf)));
+    msp.processReceivedBytes(buf, len, [](mspPacket_t *packet) {
+      ProcessMSPPacketFromTX(packet);
+    });
+  }
+#endif
+}
+
 #if defined(PLATFORM_ESP8266)
 // Called from core's user_rf_pre_init() function (which is called by SDK) before setup()
 RF_PRE_INIT()
@@ -283,15 +642,21 @@ RF_PRE_INIT()
 
 void setup()
 {
+  bootMark(BOOT_SETUP);
   #ifdef DEBUG_LOG
     Serial1.begin(115200);
     Serial1.setDebugOutput(true);
   #endif
   Serial.begin(460800);
-
-  options_init();
+  #if defined(PLATFORM_ESP32) && defined(UART_EVENT_INGEST)
+    Serial.onReceive(OnSerialReceive);
+  #endif
 
   eeprom.Begin();
+  bootMark(BOOT_EEPROM);
+  options_init(&eeprom);
+  bootMark(BOOT_OPTIONS);
+
   config.SetStorageProvider(&eeprom);
   config.Load();
 
@@ -306,11 +671,12 @@ void setup()
     config.SetStartWiFiOnBoot(false);
     config.Commit();
     connectionState = wifiUpdate;
-    devicesTriggerEvent();
+    devicesTriggerEvent(EVENT_WIFI_REQUEST);
   }
   else
   {
     SetSoftMACAddress();
+    bootMark(BOOT_WIFI);
 
     if (esp_now_init() != 0)
     {
@@ -333,6 +699,15 @@ void setup()
     #endif
 
     esp_now_register_recv_cb(OnDataRecv);
+    esp_now_register_send_cb(OnDataSent);
+    espnowRssiBegin();
+    // A new session each boot, so the VRX does not take the restarted sequence for duplicates
+    espnowLink.begin(MSP_LINK_SOURCE_TX, random(256));
+    #if !defined(UART_EVENT_INGEST)
+      // Chunks are sent from loop(), the UART event task would race the coalesce buffer
+      msp.setChunkHandler(ForwardMSPChunk);
+    #endif
+    bootMark(BOOT_ESPNOW);
   }
 
   devicesStart();
@@ -347,11 +722,19 @@ void loop()
 {
   uint32_t now = millis();
 
+  // Print anything queued by deferred logging outside of the callbacks
+  DBGFLUSH();
+
   devicesUpdate(now);
+  eeprom.Update(now);
+  memoryUpdate(now);
+  linkStatsUpdate();
+  profilerUpdate(now);
 
   #if defined(PLATFORM_ESP8266) || defined(PLATFORM_ESP32)
     // If the reboot time is set and the current time is past the reboot time then reboot.
     if (rebootTime != 0 && now > rebootTime) {
+      eeprom.Flush();
       ESP.restart();
     }
   #endif
@@ -361,21 +744,49 @@ void loop()
     return;
   }
 
-  if (Serial.available())
+  // Head-tracking goes out ahead of other traffic
+  mspPacket_t ptrPacket;
+  if (ptrMailbox.take(&ptrPacket, micros()))
   {
-    uint8_t c = Serial.read();
-
-    if (msp.processReceivedByte(c))
-    {
-      // Finished processing a complete packet
-      ProcessMSPPacketFromTX(msp.getReceivedPacket());
-      msp.markPacketReceived();
-    }
+#if defined(PTR_PREDICTION)
+    ptrPredictor.sample(&ptrPacket, micros() - ptrMailbox.latency());
+#else
+    msp.sendPacket(&ptrPacket, &Serial);
+#endif
+    latencyRecord(LATENCY_PTR, ptrMailbox.latency());
+  }
+#if defined(PTR_PREDICTION)
+  // Sent on a steady clock of its own, predicted to the moment it goes out
+  if (ptrPredictor.output(&ptrPacket, micros()))
+  {
+    msp.sendPacket(&ptrPacket, &Serial);
   }
+#endif
+
+  ProcessSerial();
+  ProcessEspnow();
 
-  if (cacheFull && sendCached)
+  // Nothing else can go out between the fragments of a streamed frame
+  if (sendCached && !fragmenter.active())
   {
     SendCachedMSP();
     sendCached = false;
   }
+
+  if (coalescer.due(micros(), ESPNOW_COALESCE_TIMEOUT_US))
+  {
+    flushMSPViaEspnow();
+  }
+  espnowLink.update(millis(), SendLinkFrame);
+  if (espnowLink.gaveUp())
+  {
+    // A VRX missed a reliable frame, send it all the latest state
+    requestedDigestsSize = 0;
+    sendCached = true;
+  }
+
+  if (!ptrMailbox.pending() && !Serial.available() && espnowRxRing.empty())
+  {
+    devicesIdle(millis(), LOOP_IDLE_MAX_MS);
+  }
 }
@@ -12,12 +12,23 @@
 
 #include "msp.h"
 #include "msptypes.h"
+#include "mspfragment.h"
+#include "msplink.h"
+#include "SPSCRing.h"
+#include "vrx_power.h"
+#include "osd_framebuffer.h"
 #include "logging.h"
 #include "helpers.h"
+#include "espnow_phy.h"
+#include "espnow_rssi.h"
+#include "backpack_link.h"
 #include "common.h"
 #include "options.h"
 #include "config.h"
 #include "crsf_protocol.h"
+#include "stats.h"
+#include "recorder.h"
+#include "profiler.h"
 
 #include "device.h"
 #include "devWIFI.h"
@@ -50,6 +61,14 @@
   #define VRX_BOOT_DELAY  0
 #endif
 
+// Longest loop() sleeps while saving power, the frame callback wakes it early.
+// Modules reading a UART from loop() have to keep polling it
+#if defined(FUSION_BACKPACK) || defined(HDZERO_BACKPACK) || defined(SKYZONE_MSP_BACKPACK) || defined(ORQA_BACKPACK)
+  #define VRX_POWER_SAVE_IDLE_MS    LOOP_IDLE_MAX_MS
+#else
+  #define VRX_POWER_SAVE_IDLE_MS    20
+#endif
+
 #if !defined(VRX_UART_BAUD)
   #define VRX_UART_BAUD  460800
 #endif
@@ -62,13 +81,45 @@ connectionState_e connectionState = starting;
 unsigned long bindingStart = 0;
 unsigned long rebootTime = 0;
 
+// Channel changes are coalesced, only the latest one received is sent to the
+// receiver, and the TX backpack is told once the receiver has it
+typedef enum {
+  CHANNEL_IDLE,
+  CHANNEL_PENDING,  // received, not yet handed to the module
+  CHANNEL_SENDING   // handed to the module, still going out
+} channelState_e;
+
 uint8_t cachedIndex = 0;
-bool sendChannelChangesToVrx = false;
+uint16_t cachedFrequency = 0;  // MHz, tuned to instead of cachedIndex when set
+channelState_e channelState = CHANNEL_IDLE;
+bool channelApplied = false;  // the module took the last channel handed to it
 bool sendHeadTrackingChangesToVrx = false;
 bool sendRTCChangesToVrx = false;
 bool gotInitialPacket = false;
 bool headTrackingEnabled = false;
-uint32_t lastSentRequest = 0;
+// ESP-NOW settings taken from a bind, saved before the reboot
+volatile bool phyOptionsChanged = false;
+// Digests of the VTX and head-tracking packets last applied, sent with the sync request.
+// Kept in the config, so after a reboot the TX only resends what changed meanwhile
+uint16_t appliedVTXDigest = 0;
+uint16_t appliedHTDigest = 0;
+// The state saved with them still has to be put back on the receiver
+bool restoreAppliedState = false;
+
+typedef enum {
+  SYNC_IDLE,
+  SYNC_SENT,
+  SYNC_DELIVERED,
+  SYNC_FAILED
+} syncState_e;
+
+volatile syncState_e syncState = SYNC_IDLE;
+uint32_t syncSentAt = 0;
+uint32_t syncNextRequest = 0;
+uint32_t syncRetryInterval = VRX_SYNC_RETRY_MIN_MS;
+// Of the frame loop() is working on
+uint32_t espnowRecvTime = 0;
+uint32_t cachedIndexRecvTime = 0;
 
 device_t *ui_devices[] = {
 #ifdef PIN_LED
@@ -87,9 +138,19 @@ device_t *ui_devices[] = {
 esp_now_peer_info_t peerInfo;
 #endif
 
+typedef struct {
+  uint32_t recvTime;
+  bool bound;
+} espnowRxMeta_t;
+
 /////////// CLASS OBJECTS ///////////
 
 MSP msp;
+MSPDefragmenter defrag;
+// The receive callback only copies frames in here, loop() parses them and drives the module
+SPSCRing<ESPNOW_RX_RING_SIZE> espnowRxRing;
+VrxPower power;
+MSPLinkReceiver linkReceiver;
 
 ELRS_EEPROM eeprom;
 VrxBackpackConfig config;
@@ -114,6 +175,7 @@ VrxBackpackConfig config;
 
 void ProcessMSPPacket(mspPacket_t *packet);
 void sendMSPViaEspnow(mspPacket_t *packet);
+void RequestVTXPacket();
 void resetBootCounter();
 void SetupEspNow();
 
@@ -134,44 +196,162 @@ void OnDataRecv(uint8_t * mac_addr, uint8_t *data, uint8_t data_len)
 #elif defined(PLATFORM_ESP32)
 void OnDataRecv(const uint8_t * mac_addr, const uint8_t *data, int data_len)
 #endif
+{
+  linkStatsReceived(mac_addr);
+  // Each frame is kept with when it arrived and whether it came from the bound MAC
+  espnowRxMeta_t meta;
+  meta.recvTime = micros();
+  meta.bound = memcmp(firmwareOptions.uid, mac_addr, 6) == 0;
+  if (!espnowRxRing.push((const uint8_t *)&meta, sizeof(meta), data, data_len))
+  {
+    DBGLN("ESP-NOW rx ring full, dropping frame");
+    occupancyOverflow(OCCUPANCY_ESPNOW_RX);
+  }
+  occupancyRecord(OCCUPANCY_ESPNOW_RX, espnowRxRing.used(), ESPNOW_RX_RING_SIZE);
+  devicesWakeup();
+}
+
+void ProcessEspnowFrame(const uint8_t *data, uint8_t data_len, bool bound)
 {
   DBGLN("ESP NOW DATA:");
   for(int i = 0; i < data_len; i++)
   {
     DBG("%x", data[i]); // Debug prints
     DBG(",");
+  }
+  DBGLN(""); // Extra line for serial output readability
+
+  // Only process packets from a bound MAC address
+  bool accept = connectionState == binding || bound;
 
-    if (msp.processReceivedByte(data[i]))
+  const uint8_t *frame = data;
+  uint8_t frameLen = data_len;
+  if (MSPLinkReceiver::isLinkFrame(data, data_len))
+  {
+    // Numbered frames, duplicates are dropped and reliable ones acknowledged
+    uint8_t ack[MSP_LINK_ACK_SIZE];
+    uint8_t ackLen;
+    bool fresh = linkReceiver.accept(data, data_len, ack, &ackLen);
+    if (ackLen && bound)
+    {
+      esp_now_send(firmwareOptions.uid, ack, ackLen);
+    }
+    if (!fresh)
+    {
+      return;
+    }
+    frame += MSP_LINK_HEADER_SIZE;
+    frameLen -= MSP_LINK_HEADER_SIZE;
+  }
+
+  // Long frames come as fragments, their bodies go to the parser in order
+  if (MSPDefragmenter::isFragment(data, data_len))
+  {
+    bool restart;
+    bool parse = bound && defrag.accept(data, data_len, &frame, &frameLen, &restart);
+    if (bound && restart)
     {
-      DBGLN(""); // Extra line for serial output readability
-      // Finished processing a complete packet
-      // Only process packets from a bound MAC address
-      if (connectionState == binding ||
-            (
-            firmwareOptions.uid[0] == mac_addr[0] &&
-            firmwareOptions.uid[1] == mac_addr[1] &&
-            firmwareOptions.uid[2] == mac_addr[2] &&
-            firmwareOptions.uid[3] == mac_addr[3] &&
-            firmwareOptions.uid[4] == mac_addr[4] &&
-            firmwareOptions.uid[5] == mac_addr[5]
-            )
-          )
-      {
-        gotInitialPacket = true;
-        ProcessMSPPacket(msp.getReceivedPacket());
-      }
-      else
-      {
-        DBGLN("Failed MAC add check and not in bindingMode.");
-      }
       msp.markPacketReceived();
     }
+    if (!parse)
+    {
+      return;
+    }
+  }
+  else if (defrag.interrupt())
+  {
+    msp.markPacketReceived();
   }
+
+  msp.processReceivedBytes(frame, frameLen, [accept](mspPacket_t *packet) {
+    if (accept)
+    {
+      gotInitialPacket = true;
+      ProcessMSPPacket(packet);
+    }
+    else
+    {
+      DBGLN("Failed MAC add check and not in bindingMode.");
+    }
+  });
   blinkLED();
 }
 
+// Everything that arrived since the last loop(), in order
+void ProcessEspnow()
+{
+  uint8_t record[sizeof(espnowRxMeta_t) + ESPNOW_MAX_FRAME_SIZE];
+  uint16_t recordLen;
+  while ((recordLen = espnowRxRing.pop(record, sizeof(record))) != 0)
+  {
+    espnowRxMeta_t meta;
+    memcpy(&meta, record, sizeof(meta));
+    espnowRecvTime = meta.recvTime;
+    power.traffic(millis());
+    ProcessEspnowFrame(&record[sizeof(meta)], recordLen - sizeof(meta), meta.bound);
+  }
+}
+
+// Pieces of a payload too big for an mspPacket_t, as the parser gets them.
+// A long OSD string is cut into write-strings the module can take.
+void ProcessMSPChunk(mspChunkEvent_e event, const mspPacket_t *packet, uint16_t offset, const uint8_t *data, uint16_t len)
+{
+  static uint8_t row, col, attr;
+
+  if (packet->function != MSP_ELRS_SET_OSD)
+  {
+    if (event == MSP_CHUNK_DATA && offset == 0)
+    {
+      DBGLN("Dropped MSP function %x, payload %u too long", packet->function, packet->payloadSize);
+    }
+    return;
+  }
+  if (event != MSP_CHUNK_DATA)
+  {
+    // Anything already drawn from an aborted string is put right by the next redraw
+    return;
+  }
+
+  if (offset == 0)
+  {
+    if (len < 4 || data[0] != OSD_CMD_WRITE_STRING)
+    {
+      return;
+    }
+    row = data[1];
+    col = data[2];
+    attr = data[3];
+    data += 4;
+    len -= 4;
+  }
+
+  while (len > 0)
+  {
+    mspPacket_t out;
+    out.reset();
+    out.makeCommand();
+    out.function = MSP_ELRS_SET_OSD;
+    out.addByte(OSD_CMD_WRITE_STRING);
+    out.addByte(row);
+    out.addByte(col);
+    out.addByte(attr);
+    uint8_t count = min(len, (uint16_t)(MSP_PORT_INBUF_SIZE - 4));
+    for (uint8_t i = 0; i < count; i++)
+    {
+      out.addByte(data[i]);
+    }
+    PROFILE_CALL("module_SetOSD", vrxModule.SetOSD(&out));
+    col += count;
+    data += count;
+    len -= count;
+  }
+}
+
 void ProcessMSPPacket(mspPacket_t *packet)
 {
+  PROFILE_SCOPE_ARG("msp_from_espnow", packet->function);
+  bootMark(BOOT_FIRST_PACKET);
+  traceEvent(TRACE_MSP_IN, TRACE_PORT_ESPNOW, packet->function, packet->payloadSize);
   if (connectionState == binding)
   {
     DBGLN("Processing Binding Packet...");
@@ -186,8 +366,10 @@ void ProcessMSPPacket(mspPacket_t *packet)
       }
       DBG(""); // Extra line for serial output readability
       resetBootCounter();
+      // Saved from loop(), writing SPIFFS does not belong in the radio callback
+      phyOptionsChanged = espnowPhyFromBind(packet->payload, packet->payloadSize);
       connectionState = running;
-      rebootTime = millis() + 200; // Add 200ms to allow for any response message(s) to be sent back to device
+      rebootTime = millis() + VRX_BIND_REBOOT_MS;
     }
     return;
   }
@@ -196,17 +378,50 @@ void ProcessMSPPacket(mspPacket_t *packet)
   {
   case MSP_SET_VTX_CONFIG:
     DBGLN("Processing MSP_SET_VTX_CONFIG...");
-    if (packet->payload[0] < 48) // Standard 48 channel VTx table size e.g. A, B, E, F, R, L
     {
-      // cache changes here, to be handled outside this callback, in the main loop
-      cachedIndex = packet->payload[0];;
-      sendChannelChangesToVrx = true;
+      // The first field is a band/channel index below 64, or a frequency in MHz
+      uint16_t value = packet->payload[0];
+      if (packet->payloadSize > 1)
+      {
+        value |= packet->payload[1] << 8;
+      }
+      if (value < 48) // Standard 48 channel VTx table size e.g. A, B, E, F, R, L
+      {
+        // cache changes here, to be handled outside this callback, in the main loop
+        cachedIndex = value;
+        cachedFrequency = 0;
+      }
+      else if (value >= 64)
+      {
+        cachedFrequency = value;
+      }
+      else
+      {
+        return;
+      }
+      cachedIndexRecvTime = espnowRecvTime;
+      channelState = CHANNEL_PENDING;
+      appliedVTXDigest = packet->digest();
     }
-    else
+    break;
+  case MSP_ELRS_BACKPACK_SET_FREQUENCY:
+    DBGLN("Processing MSP_ELRS_BACKPACK_SET_FREQUENCY...");
     {
-      return; // Packets containing frequency in MHz are not yet supported.
+      uint8_t lowByte = packet->readByte();
+      uint8_t highByte = packet->readByte();
+      if (!packet->readError)
+      {
+        cachedFrequency = lowByte | highByte << 8;
+        cachedIndexRecvTime = espnowRecvTime;
+        channelState = CHANNEL_PENDING;
+      }
     }
     break;
+  case MSP_ELRS_BACKPACK_GET_RSSI:
+    DBGLN("Processing MSP_ELRS_BACKPACK_GET_RSSI...");
+    // Optional payload is the time to settle on each channel, in ms
+    vrxModule.StartChannelSweep(packet->payloadSize > 0 ? packet->readByte() : 0);
+    break;
   case MSP_ELRS_SET_VRX_BACKPACK_WIFI_MODE:
     DBGLN("Processing MSP_ELRS_SET_VRX_BACKPACK_WIFI_MODE...");
     RebootIntoWifi();
@@ -218,16 +433,22 @@ void ProcessMSPPacket(mspPacket_t *packet)
       uint8_t lowByte = packet->readByte();
       uint8_t highByte = packet->readByte();
       uint16_t delay = lowByte | highByte << 8;
-      vrxModule.SetRecordingState(state, delay);
+      PROFILE_CALL("module_SetRecordingState", vrxModule.SetRecordingState(state, delay));
     }
     break;
   case MSP_ELRS_SET_OSD:
-    vrxModule.SetOSD(packet);
+    PROFILE_CALL("module_SetOSD", vrxModule.SetOSD(packet));
+    latencyRecord(LATENCY_ESPNOW_TO_VRX, micros() - espnowRecvTime);
     break;
   case MSP_ELRS_BACKPACK_SET_HEAD_TRACKING:
     DBGLN("Processing MSP_ELRS_BACKPACK_SET_HEAD_TRACKING...");
     headTrackingEnabled = packet->readByte();
     sendHeadTrackingChangesToVrx = true;
+    appliedHTDigest = packet->digest();
+    break;
+  case MSP_ELRS_REQU_VTX_PKT:
+    // The TX backpack has sent everything that differed, nothing more to ask for
+    DBGLN("Processing MSP_ELRS_REQU_VTX_PKT reply...");
     break;
   case MSP_ELRS_BACKPACK_CRSF_TLM:
     DBGV("Processing MSP_ELRS_BACKPACK_CRSF_TLM type %x\n", packet->payload[1]);
@@ -237,10 +458,14 @@ void ProcessMSPPacket(mspPacket_t *packet)
     }
     switch (packet->payload[2]) {
     case CRSF_FRAMETYPE_BATTERY_SENSOR:
-      vrxModule.SendBatteryTelemetry(packet->payload);
+      PROFILE_CALL("module_SendBatteryTelemetry", vrxModule.SendBatteryTelemetry(packet->payload));
       break;
     case CRSF_FRAMETYPE_LINK_STATISTICS:
-      vrxModule.SendLinkTelemetry(packet->payload);
+      PROFILE_CALL("module_SendLinkTelemetry", vrxModule.SendLinkTelemetry(packet->payload));
+      break;
+    case CRSF_FRAMETYPE_GPS:
+      if (packet->payloadSize >= sizeof(crsf_packet_gps_t))
+        PROFILE_CALL("module_SendGpsTelemetry", vrxModule.SendGpsTelemetry((crsf_packet_gps_t *)packet->payload, GPS_SOURCE_ESPNOW));
       break;
     }
     break;
@@ -250,12 +475,68 @@ void ProcessMSPPacket(mspPacket_t *packet)
   }
 }
 
+// espnow on-send callback, only the outcome of a sync request matters here
+#if defined(PLATFORM_ESP8266)
+void OnDataSent(uint8_t *mac_addr, uint8_t status)
+{
+  bool delivered = status == 0;
+#elif defined(PLATFORM_ESP32)
+void OnDataSent(const uint8_t *mac_addr, esp_now_send_status_t status)
+{
+  bool delivered = status == ESP_NOW_SEND_SUCCESS;
+#endif
+  linkStatsSent(mac_addr, delivered);
+  if (syncState == SYNC_SENT)
+  {
+    syncState = delivered ? SYNC_DELIVERED : SYNC_FAILED;
+  }
+}
+
+/**
+ * @brief: Ask the TX backpack for any state that differs from what was last applied.
+ *         A failed send is retried with exponential backoff, a delivered one waits
+ *         for the reply before asking again.
+ */
+void ServiceStateSync(uint32_t now)
+{
+  switch (syncState)
+  {
+  case SYNC_FAILED:
+    syncNextRequest = now + syncRetryInterval;
+    syncRetryInterval = min(syncRetryInterval * 2, (uint32_t)VRX_SYNC_RETRY_MAX_MS);
+    syncState = SYNC_IDLE;
+    break;
+  case SYNC_DELIVERED:
+    syncNextRequest = now + VRX_SYNC_REPLY_TIMEOUT_MS;
+    syncRetryInterval = VRX_SYNC_RETRY_MIN_MS;
+    syncState = SYNC_IDLE;
+    break;
+  case SYNC_SENT:
+    // The send callback should always fire, but do not wait on it forever
+    if (now - syncSentAt > VRX_SYNC_RETRY_MAX_MS)
+    {
+      syncState = SYNC_FAILED;
+    }
+    break;
+  case SYNC_IDLE:
+    if ((int32_t)(now - syncNextRequest) >= 0)
+    {
+      DBGLN("RequestVTXPacket...");
+      syncSentAt = now;
+      syncState = SYNC_SENT;
+      RequestVTXPacket();
+    }
+    break;
+  }
+}
+
 void SetupEspNow()
 {
   if (esp_now_init() != 0)
     {
       DBGLN("Error initializing ESP-NOW");
       turnOffLED();
+      eeprom.Flush();
       ESP.restart();
     }
 
@@ -274,6 +555,16 @@ void SetupEspNow()
     #endif
 
     esp_now_register_recv_cb(OnDataRecv);
+    esp_now_register_send_cb(OnDataSent);
+    espnowRssiBegin();
+
+    // Every VRX of the group ACKs from the group MAC, the chip id tells them apart
+    #if defined(PLATFORM_ESP8266)
+      uint32_t chipId = ESP.getChipId();
+    #elif defined(PLATFORM_ESP32)
+      uint32_t chipId = (uint32_t)ESP.getEfuseMac();
+    #endif
+    linkReceiver.begin(chipId ^ (chipId >> 8) ^ (chipId >> 16) ^ (chipId >> 24));
 }
 
 void SetSoftMACAddress()
@@ -292,9 +583,20 @@ void SetSoftMACAddress()
   // MAC address can only be set with unicast, so first byte must be even, not odd
   firmwareOptions.uid[0] = firmwareOptions.uid[0] & ~0x01;
 
+  // Bring the STA interface up on channel 1 directly, rather than through a dummy
+  // association attempt, and keep the SDK from writing the WiFi config to flash
+  WiFi.persistent(false);
   WiFi.mode(WIFI_STA);
-  WiFi.begin("network-name", "pass-to-network", 1);
   WiFi.disconnect();
+  // Binding is always done with the defaults, whatever the last bind set
+  if (connectionState == binding)
+  {
+    espnowPhyApplyDefault();
+  }
+  else
+  {
+    espnowPhyApplyOptions();
+  }
 
   // Soft-set the MAC address to the passphrase UID for binding
   #if defined(PLATFORM_ESP8266)
@@ -310,30 +612,60 @@ void RequestVTXPacket()
   packet.reset();
   packet.makeCommand();
   packet.function = MSP_ELRS_REQU_VTX_PKT;
-  packet.addByte(0);  // empty byte
+  packet.addByte(0);  // empty byte, all an older TX backpack expects
+  packet.addByte(MSP_SET_VTX_CONFIG & 0xFF);
+  packet.addByte(MSP_SET_VTX_CONFIG >> 8);
+  packet.addByte(appliedVTXDigest & 0xFF);
+  packet.addByte(appliedVTXDigest >> 8);
+  packet.addByte(MSP_ELRS_BACKPACK_SET_HEAD_TRACKING & 0xFF);
+  packet.addByte(MSP_ELRS_BACKPACK_SET_HEAD_TRACKING >> 8);
+  packet.addByte(appliedHTDigest & 0xFF);
+  packet.addByte(appliedHTDigest >> 8);
 
   blinkLED();
   sendMSPViaEspnow(&packet);
 }
 
+// Tell the TX backpack which channel or frequency was asked for, followed by
+// 1 if the receiver is now on it or 0 if the module could not tune to it
+void SendChannelReport(bool applied)
+{
+  mspPacket_t packet;
+  packet.reset();
+  packet.makeResponse();
+  if (cachedFrequency)
+  {
+    packet.function = MSP_ELRS_BACKPACK_GET_FREQUENCY;
+    packet.addByte(cachedFrequency & 0xFF);
+    packet.addByte(cachedFrequency >> 8);
+  }
+  else
+  {
+    packet.function = MSP_ELRS_BACKPACK_GET_CHANNEL_INDEX;
+    packet.addByte(cachedIndex);
+  }
+  packet.addByte(applied);
+  sendMSPViaEspnow(&packet);
+}
+
 void sendMSPViaEspnow(mspPacket_t *packet)
 {
   // Do not send while in binding mode.  The currently used firmwareOptions.uid may be garbage.
   if (connectionState == binding)
     return;
 
-  uint8_t packetSize = msp.getTotalPacketSize(packet);
-  uint8_t nowDataOutput[packetSize];
+  uint8_t nowDataOutput[MSP_FRAME_MAX_SIZE];
 
-  uint8_t result = msp.convertToByteArray(packet, nowDataOutput);
+  uint8_t packetSize = msp.convertToByteArray(packet, nowDataOutput);
 
-  if (!result)
+  if (!packetSize)
   {
     // packet could not be converted to array, bail out
     return;
   }
+  traceEvent(TRACE_MSP_OUT, TRACE_PORT_ESPNOW, packet->function, packet->payloadSize);
 
-  esp_now_send(firmwareOptions.uid, (uint8_t *) &nowDataOutput, packetSize);
+  esp_now_send(firmwareOptions.uid, nowDataOutput, packetSize);
 }
 
 void resetBootCounter()
@@ -395,6 +727,7 @@ RF_PRE_INIT()
 
 void setup()
 {
+  bootMark(BOOT_SETUP);
   #if !defined(HDZERO_BACKPACK)
     // Serial.begin() seems to prevent the HDZ VRX from booting
     // If we're not on HDZ, init serial early for debug msgs
@@ -402,11 +735,16 @@ void setup()
     Serial.begin(VRX_UART_BAUD);
   #endif
 
-  options_init();
-
   eeprom.Begin();
+  bootMark(BOOT_EEPROM);
+  options_init(&eeprom);
+  bootMark(BOOT_OPTIONS);
+
   config.SetStorageProvider(&eeprom);
   config.Load();
+  appliedVTXDigest = config.GetSyncVTXDigest();
+  appliedHTDigest = config.GetSyncHTDigest();
+  restoreAppliedState = appliedVTXDigest || config.GetSyncFrequency() || appliedHTDigest;
 
   devicesInit(ui_devices, ARRAY_SIZE(ui_devices));
 
@@ -419,7 +757,7 @@ void setup()
     config.SetStartWiFiOnBoot(false);
     config.Commit();
     connectionState = wifiUpdate;
-    devicesTriggerEvent();
+    devicesTriggerEvent(EVENT_WIFI_REQUEST);
   }
   else
   {
@@ -427,7 +765,10 @@ void setup()
     checkIfInBindingMode();
 #endif
     SetSoftMACAddress();
+    bootMark(BOOT_WIFI);
     SetupEspNow();
+    msp.setChunkHandler(ProcessMSPChunk);
+    bootMark(BOOT_ESPNOW);
   }
 
   devicesStart();
@@ -440,6 +781,7 @@ void setup()
   #if defined(HDZERO_BACKPACK)
     Serial.begin(VRX_UART_BAUD);
   #endif
+  power.begin(millis());
   DBGLN("Setup completed");
 }
 
@@ -447,13 +789,31 @@ void loop()
 {
   uint32_t now = millis();
 
+  // Print anything queued by deferred logging outside of the callbacks
+  DBGFLUSH();
+
   devicesUpdate(now);
-  vrxModule.Loop(now);
+  eeprom.Update(now);
+  memoryUpdate(now);
+  linkStatsUpdate();
+  profilerUpdate(now);
+  PROFILE_CALL("module_Loop", vrxModule.Loop(now));
+
+#if !defined(NO_POWER_SAVE)
+  // Only once the initial sync is over, nothing is being sent to the module and head tracking is off
+  bool synced = gotInitialPacket || (now >= VRX_BOOT_DELAY && now - VRX_BOOT_DELAY >= VRX_SYNC_WINDOW_MS);
+  power.update(now, connectionState == running && synced && channelState == CHANNEL_IDLE && !headTrackingEnabled);
+#endif
 
   #if defined(PLATFORM_ESP8266) || defined(PLATFORM_ESP32)
     // If the reboot time is set and the current time is past the reboot time then reboot.
     if (rebootTime != 0 && now > rebootTime) {
       turnOffLED();
+      if (phyOptionsChanged)
+      {
+        saveOptions();
+      }
+      eeprom.Flush();
       ESP.restart();
     }
   #endif
@@ -468,6 +828,8 @@ void loop()
     return;
   }
 
+  ProcessEspnow();
+
   if (BindingExpired(now))
   {
     DBGLN("Binding expired");
@@ -478,23 +840,67 @@ void loop()
 #endif
   }
 
-  if (sendChannelChangesToVrx)
+  // A change received while the last is going out supersedes it, the module
+  // drops whatever of the old one it has not sent yet
+  if (channelState == CHANNEL_PENDING)
+  {
+    channelState = CHANNEL_SENDING;
+    if (cachedFrequency)
+    {
+      PROFILE_CALL("module_SendFrequencyCmd", channelApplied = vrxModule.SendFrequencyCmd(cachedFrequency));
+    }
+    else
+    {
+      PROFILE_CALL("module_SendIndexCmd", channelApplied = vrxModule.SendIndexCmd(cachedIndex));
+    }
+  }
+  if (channelState == CHANNEL_SENDING && !vrxModule.IndexCmdPending())
   {
-    sendChannelChangesToVrx = false;
-    vrxModule.SendIndexCmd(cachedIndex);
+    channelState = CHANNEL_IDLE;
+    channelApplied &= !vrxModule.IndexCmdFailed();
+    latencyRecord(LATENCY_ESPNOW_TO_VRX, micros() - cachedIndexRecvTime);
+    SendChannelReport(channelApplied);
+    if (channelApplied)
+    {
+      config.SetSyncChannel(cachedIndex, cachedFrequency, appliedVTXDigest);
+      config.Commit();
+    }
+    else
+    {
+      DBGLN("Module did not take the channel");
+    }
   }
   if (sendHeadTrackingChangesToVrx)
   {
     sendHeadTrackingChangesToVrx = false;
-    vrxModule.SendHeadTrackingEnableCmd(headTrackingEnabled);
+    PROFILE_CALL("module_SendHeadTrackingEnableCmd", vrxModule.SendHeadTrackingEnableCmd(headTrackingEnabled));
+    config.SetSyncHeadTracking(headTrackingEnabled, appliedHTDigest);
+    config.Commit();
   }
 
-  // spam out a bunch of requests for the desired band/channel for the first 5s
-  if (!gotInitialPacket && now - VRX_BOOT_DELAY < 5000 && now - lastSentRequest > 1000 && connectionState != binding)
+  // Once the receiver is up, put back what was applied before the reboot. The digests
+  // say it is applied, so the TX will not send it again
+  if (restoreAppliedState && now >= VRX_BOOT_DELAY && connectionState == running)
   {
-    DBGLN("RequestVTXPacket...");
-    RequestVTXPacket();
-    lastSentRequest = now;
+    restoreAppliedState = false;
+    if (channelState == CHANNEL_IDLE && (appliedVTXDigest || config.GetSyncFrequency()))
+    {
+      cachedIndex = config.GetSyncChannelIndex();
+      cachedFrequency = config.GetSyncFrequency();
+      cachedIndexRecvTime = micros();
+      channelState = CHANNEL_PENDING;
+    }
+    if (appliedHTDigest && config.GetSyncHeadTracking())
+    {
+      headTrackingEnabled = true;
+      sendHeadTrackingChangesToVrx = true;
+    }
+  }
+
+  // Any packet from the TX backpack, including the reply to a sync request, ends the sync
+  if (!gotInitialPacket && now >= VRX_BOOT_DELAY && now - VRX_BOOT_DELAY < VRX_SYNC_WINDOW_MS && connectionState != binding)
+  {
+    ServiceStateSync(now);
   }
 
 #if !defined(NO_AUTOBIND)
@@ -505,4 +911,6 @@ void loop()
     resetBootCounter();
   }
 #endif
+
+  devicesIdle(millis(), power.saving() ? VRX_POWER_SAVE_IDLE_MS : LOOP_IDLE_MAX_MS);
 }
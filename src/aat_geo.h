@@ -0,0 +1,143 @@
+#pragma once
+
+// Distance, bearing and elevation math for the AAT, kept apart from AatModule
+// so the host benchmarks can build it without the rest of the module
+
+#include <Arduino.h>
+#include <math.h>
+
+#if !defined(AAT_FLAT_EARTH_MAX_M)
+#define AAT_FLAT_EARTH_MAX_M (50000)    // meters, beyond this use the spherical formulas
+#endif
+
+#define DEG2RAD(deg) ((deg) * M_PI / 180.0)
+#define RAD2DEG(rad) ((rad) * 180.0 / M_PI)
+
+static inline void calcDistAndAzimuth(int32_t srcLat, int32_t srcLon, int32_t dstLat, int32_t dstLon,
+    uint32_t *out_dist, uint32_t *out_azimuth)
+{
+    // https://www.movable-type.co.uk/scripts/latlong.html
+    // https://www.igismap.com/formula-to-find-bearing-or-heading-angle-between-two-points-latitude-longitude/
+
+    // Have to use doubles for at least some of these, due to short distances getting rounded
+    // particularly cos(deltaLon) for <2000 m rounds to 1.0000000000
+    double deltaLon = DEG2RAD((float)(dstLon - srcLon) / 1e7);
+    double thetaA = DEG2RAD((float)srcLat / 1e7);
+    double thetaB = DEG2RAD((float)dstLat / 1e7);
+    double cosThetaA = cos(thetaA);
+    double cosThetaB = cos(thetaB);
+    double sinThetaA = sin(thetaA);
+    double sinThetaB = sin(thetaB);
+    double cosDeltaLon = cos(deltaLon);
+    double sinDeltaLon = sin(deltaLon);
+
+    if (out_dist)
+    {
+        const double R = 6371e3;
+        double dist = acos(sinThetaA * sinThetaB + cosThetaA * cosThetaB * cosDeltaLon) * R;
+        *out_dist = (uint32_t)dist;
+    }
+
+    if (out_azimuth)
+    {
+        double X = cosThetaB * sinDeltaLon;
+        double Y = cosThetaA * sinThetaB - sinThetaA * cosThetaB * cosDeltaLon;
+
+        // Convert to degrees, normalized to 0-360
+        uint32_t hdg = RAD2DEG(atan2(X, Y));
+        *out_azimuth = (hdg + 360) % 360;
+    }
+}
+
+/**
+ * @brief: Integer atan2, accurate to about 0.1 degree
+ * @return: -18000 to +18000, in centidegrees
+ */
+static inline int32_t atan2Centideg(int64_t y, int64_t x)
+{
+    if (x == 0 && y == 0)
+        return 0;
+    uint64_t ax = (x < 0) ? -x : x;
+    uint64_t ay = (y < 0) ? -y : y;
+    bool steep = ay > ax;
+    // z = min/max in Q15, then atan(z) ~= 45z - z(z-1)(14.02 + 3.80z) degrees
+    int64_t z = steep ? (ax << 15) / ay : (ay << 15) / ax;
+    int64_t t = 1402 + ((380 * z) >> 15);
+    int32_t angle = ((4500 * z) >> 15) - ((z * (z - 32768) >> 15) * t >> 15);
+    if (steep)
+        angle = 9000 - angle;
+    if (x < 0)
+        angle = 18000 - angle;
+    return (y < 0) ? -angle : angle;
+}
+
+static inline uint64_t isqrt64(uint64_t v)
+{
+    uint64_t res = 0;
+    uint64_t bit = 1ULL << 62;
+    while (bit > v)
+        bit >>= 2;
+    while (bit)
+    {
+        if (v >= res + bit)
+        {
+            v -= res + bit;
+            res = (res >> 1) + bit;
+        }
+        else
+            res >>= 1;
+        bit >>= 2;
+    }
+    return res;
+}
+
+/**
+ * @brief: Local tangent plane (equirectangular) offset of dst from src
+ * All integer math, cosLat and sinLat are cos(srcLat) and sin(srcLat) in Q16,
+ * so the trig is only done when home is set. Against a haversine the offset is
+ * within about 1m out to 1km and a few meters out to AAT_FLAT_EARTH_MAX_M,
+ * further than that this gives up.
+ * @return: false if the target is out of range for the flat approximation
+ */
+static inline bool calcEnuFlat(int32_t srcLat, int32_t srcLon, int32_t dstLat, int32_t dstLon,
+    int32_t cosLat, int32_t sinLat, int32_t *out_east, int32_t *out_north)
+{
+    // Scale longitude by the cosine of the mid latitude, cos(a + d) ~= cos(a) - sin(a) * d
+    // with d half the latitude difference in radians (one radian is 572957795 units)
+    int64_t dLat = (int64_t)dstLat - srcLat;
+    int64_t cosMid = cosLat - (sinLat * dLat) / (2 * 572957795LL);
+    int64_t dLon = (int64_t)dstLon - srcLon;
+    if (dLon > 1800000000LL)
+        dLon -= 3600000000LL;
+    else if (dLon < -1800000000LL)
+        dLon += 3600000000LL;
+    // One 1e-7 degree step of latitude is 11.1194926mm on a 6371km sphere
+    int64_t north = dLat * 111195 / 10000;
+    int64_t east = ((dLon * cosMid) >> 16) * 111195 / 10000;
+    if (north > AAT_FLAT_EARTH_MAX_M * 1000LL || north < -AAT_FLAT_EARTH_MAX_M * 1000LL ||
+        east > AAT_FLAT_EARTH_MAX_M * 1000LL || east < -AAT_FLAT_EARTH_MAX_M * 1000LL)
+        return false;
+    *out_east = east;
+    *out_north = north;
+    return true;
+}
+
+// Horizontal distance in mm of an east/north offset in mm
+static inline uint32_t calcEnuDist(int32_t east, int32_t north)
+{
+    return isqrt64((int64_t)north * north + (int64_t)east * east);
+}
+
+// Bearing clockwise from north of an east/north offset, 0-359 degrees. Always
+// rounded down, with the atan2 error this is up to 1.1 degrees below the true bearing
+static inline uint32_t calcEnuAzimuth(int32_t east, int32_t north)
+{
+    // Wrap in centidegrees before dropping to whole degrees, truncating
+    // a negative angle first would round western bearings the wrong way
+    return ((atan2Centideg(east, north) + 36000) / 100) % 360;
+}
+
+static inline int32_t calcElevation(uint32_t distance, int32_t altitude)
+{
+    return atan2Centideg(altitude, distance) / 100;
+}
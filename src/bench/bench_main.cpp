@@ -0,0 +1,544 @@
+// Host benchmarks and fuzzers for the MSP and CRSF parsers, the CRCs and the AAT math
+//   pio run -e native_parser_bench -t exec   throughput and cost per frame / byte / fix
+//   pio run -e native_parser_fuzz -t exec    random and damaged streams under ASan and UBSan
+// Arguments are --name value, see usage() for the list. A fuzz failure prints
+// the seed and round, rerun with --seed and --rounds 1 to reproduce it.
+
+#include <Arduino.h>
+#include <chrono>
+#include <vector>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "streams.h"
+#include "module_crsf.h"
+#include "aat_geo.h"
+
+namespace sim
+{
+    uint64_t nowUs = 0;
+}
+
+HostSerial Serial;
+
+// CrsfModuleBase only needs the base Loop()
+void ModuleBase::Loop(uint32_t now) {}
+
+using namespace bench;
+
+typedef struct {
+    const char *name;
+    float value;
+    const char *help;
+} option_t;
+
+static option_t options[] = {
+#if defined(PARSER_FUZZ)
+    {"fuzz", 1, "1: run the fuzzers, 0: run the benchmarks"},
+#else
+    {"fuzz", 0, "1: run the fuzzers, 0: run the benchmarks"},
+#endif
+    {"seed", 1, "random seed"},
+    {"frames", 20000, "frames in each generated stream"},
+    {"rounds", 200, "fuzz rounds, each with its own stream"},
+    {"repeat", 20, "times each benchmark goes through its stream"},
+    {"corrupt", 0.1f, "chance a frame is damaged"},
+    {"noise", 0.05f, "chance a frame is preceded by line noise"},
+};
+
+static float option(const char *name)
+{
+    for (const option_t &o : options)
+    {
+        if (strcmp(o.name, name) == 0)
+        {
+            return o.value;
+        }
+    }
+    return 0;
+}
+
+static void usage()
+{
+    printf("Usage: parser_bench [--name value]...\n");
+    for (const option_t &o : options)
+    {
+        printf("  --%-10s %-8g %s\n", o.name, o.value, o.help);
+    }
+}
+
+static bool parseArgs(int argc, char **argv)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        if (strncmp(argv[i], "--", 2) != 0 || i + 1 == argc)
+        {
+            return false;
+        }
+        option_t *found = nullptr;
+        for (option_t &o : options)
+        {
+            if (strcmp(o.name, argv[i] + 2) == 0)
+            {
+                found = &o;
+            }
+        }
+        if (found == nullptr)
+        {
+            return false;
+        }
+        found->value = atof(argv[++i]);
+    }
+    return true;
+}
+
+static uint64_t nowNs()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Time stamp counter ticks, which track core cycles on any recent x86. 0 elsewhere
+static uint64_t cycles()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+// Everything a parser handed over, in order, so two runs can be compared
+struct Capture
+{
+    uint32_t frames = 0;
+    bytes_t data;
+
+    void add(uint8_t tag, uint16_t id, const uint8_t *payload, uint16_t len)
+    {
+        frames++;
+        data.push_back(tag);
+        data.push_back(id & 0xFF);
+        data.push_back(id >> 8);
+        data.push_back(len & 0xFF);
+        data.push_back(len >> 8);
+        data.insert(data.end(), payload, payload + len);
+    }
+    bool operator==(const Capture &other) const { return frames == other.frames && data == other.data; }
+};
+
+class BenchCrsf : public CrsfModuleBase
+{
+public:
+    BenchCrsf(Stream &port, bool capture = true) : CrsfModuleBase(port), frames(0), bad(0), capture(capture), crc(CRSF_CRC_POLY) {}
+
+    void onCrsfPacketIn(const crsf_header_t *pkt) override
+    {
+        frames++;
+        if (!capture)
+            return;
+        const uint8_t *frame = (const uint8_t *)pkt;
+        uint8_t len = pkt->frame_size;
+        if (pkt->sync_byte != CRSF_SYNC_BYTE || len < 3 || len > CRSF_MAX_PAYLOAD_LEN + 2 ||
+            crc.calc(&frame[2], len - 1) != frame[len + 1])
+        {
+            bad++;
+        }
+        captured.add(pkt->type, 0, &frame[3], len - 2);
+    }
+
+    Capture captured;
+    uint32_t frames;
+    uint32_t bad;
+
+private:
+    bool capture;
+    GENERIC_CRC8 crc;
+};
+
+static Capture mspBulk(const bytes_t &stream, size_t chunk)
+{
+    MSP msp;
+    Capture out;
+    for (size_t pos = 0; pos < stream.size(); pos += chunk)
+    {
+        msp.processReceivedBytes(&stream[pos], min(chunk, stream.size() - pos), [&](mspPacket_t *packet) {
+            out.add(packet->type, packet->function, packet->payload, packet->payloadSize);
+        });
+    }
+    return out;
+}
+
+static Capture mspBytewise(const bytes_t &stream)
+{
+    MSP msp;
+    Capture out;
+    for (uint8_t c : stream)
+    {
+        if (msp.processReceivedByte(c))
+        {
+            mspPacket_t *packet = msp.getReceivedPacket();
+            out.add(packet->type, packet->function, packet->payload, packet->payloadSize);
+            msp.markPacketReceived();
+        }
+    }
+    return out;
+}
+
+static Capture crsfParse(const bytes_t &stream, size_t fifo, uint32_t *bad)
+{
+    MemoryStream port(stream, fifo);
+    BenchCrsf crsf(port);
+    while (!port.done())
+    {
+        crsf.Loop(0);
+    }
+    *bad = crsf.bad;
+    return crsf.captured;
+}
+
+/***
+ * Benchmarks
+ ***/
+
+static void reportRate(const char *name, uint64_t ns, uint64_t bytes, uint64_t frames)
+{
+    printf("%-28s %10.1f MB/s %10.1f ns/frame %12llu frames\n", name,
+        bytes * 1000.0 / ns, frames ? (double)ns / frames : 0.0, (unsigned long long)frames);
+}
+
+static void benchMsp(const bytes_t &stream, uint32_t repeat, const char *label)
+{
+    char name[40];
+    uint64_t frames = 0;
+    uint64_t start = nowNs();
+    for (uint32_t r = 0; r < repeat; r++)
+    {
+        MSP msp;
+        // Counted here, the return value is only a uint8_t
+        msp.processReceivedBytes(stream.data(), stream.size(), [&](mspPacket_t *packet) { frames++; });
+    }
+    snprintf(name, sizeof(name), "msp bulk %s", label);
+    reportRate(name, nowNs() - start, (uint64_t)stream.size() * repeat, frames);
+
+    frames = 0;
+    start = nowNs();
+    for (uint32_t r = 0; r < repeat; r++)
+    {
+        MSP msp;
+        for (uint8_t c : stream)
+        {
+            if (msp.processReceivedByte(c))
+            {
+                frames++;
+                msp.markPacketReceived();
+            }
+        }
+    }
+    snprintf(name, sizeof(name), "msp bytewise %s", label);
+    reportRate(name, nowNs() - start, (uint64_t)stream.size() * repeat, frames);
+}
+
+static void benchCrsf(const bytes_t &stream, uint32_t repeat, const char *label)
+{
+    char name[40];
+    uint64_t frames = 0;
+    uint64_t start = nowNs();
+    for (uint32_t r = 0; r < repeat; r++)
+    {
+        // 128 bytes is the ESP32 and ESP8266 UART RX FIFO
+        MemoryStream port(stream, 128);
+        BenchCrsf crsf(port, false);
+        while (!port.done())
+        {
+            crsf.Loop(0);
+        }
+        frames += crsf.frames;
+    }
+    snprintf(name, sizeof(name), "crsf %s", label);
+    reportRate(name, nowNs() - start, (uint64_t)stream.size() * repeat, frames);
+}
+
+static void benchCrc(uint32_t repeat)
+{
+    static const uint32_t BLOCKS = 100000;
+    uint8_t block[64];
+    for (uint8_t i = 0; i < sizeof(block); i++)
+    {
+        block[i] = i * 37;
+    }
+    uint64_t bytes = (uint64_t)BLOCKS * repeat * sizeof(block);
+
+    GENERIC_CRC8 crc8(CRSF_CRC_POLY);
+    volatile uint8_t sink8 = 0;
+    uint64_t start = nowNs();
+    uint64_t startCycles = cycles();
+    for (uint64_t n = 0; n < (uint64_t)BLOCKS * repeat; n++)
+    {
+        sink8 = crc8.calc(block, sizeof(block), sink8);
+    }
+    uint64_t ns = nowNs() - start;
+    printf("%-28s %10.2f ns/byte %10.2f cycles/byte\n", "crc8", (double)ns / bytes, (double)(cycles() - startCycles) / bytes);
+
+    // The polynomial ELRS uses for its OTA packets
+    GENERIC_CRC14 crc14(0x2E57);
+    volatile uint16_t sink14 = 0;
+    start = nowNs();
+    startCycles = cycles();
+    for (uint64_t n = 0; n < (uint64_t)BLOCKS * repeat; n++)
+    {
+        sink14 = crc14.calc(block, sizeof(block), sink14);
+    }
+    ns = nowNs() - start;
+    printf("%-28s %10.2f ns/byte %10.2f cycles/byte\n", "crc14", (double)ns / bytes, (double)(cycles() - startCycles) / bytes);
+}
+
+struct GeoFix
+{
+    int32_t homeLat, homeLon, lat, lon, cosLat, sinLat;
+    double dist, azim;
+};
+
+static void benchAat(StreamGenerator &gen, uint32_t repeat)
+{
+    // Fixes within 5km of homes between +-70 degrees latitude, with the exact answer
+    const double R = 6371000.0;
+    std::vector<GeoFix> fixes(10000);
+    for (GeoFix &f : fixes)
+    {
+        double lat = (int32_t)gen.below(1400000000) - 700000000;
+        double lon = (int32_t)gen.below(3600000000U) - 1800000000;
+        f.homeLat = lat;
+        f.homeLon = lon;
+        f.lat = lat + (int32_t)gen.below(9000000) - 4500000;
+        f.lon = lon + (int32_t)gen.below(9000000) - 4500000;
+        f.cosLat = cos(DEG2RAD(f.homeLat / 1e7)) * 65536;
+        f.sinLat = sin(DEG2RAD(f.homeLat / 1e7)) * 65536;
+
+        double t1 = DEG2RAD(f.homeLat / 1e7), t2 = DEG2RAD(f.lat / 1e7), dl = DEG2RAD((f.lon - f.homeLon) / 1e7);
+        double h = sin((t2 - t1) / 2) * sin((t2 - t1) / 2) + cos(t1) * cos(t2) * sin(dl / 2) * sin(dl / 2);
+        f.dist = 2 * R * asin(sqrt(h));
+        f.azim = RAD2DEG(atan2(sin(dl) * cos(t2), cos(t1) * sin(t2) - sin(t1) * cos(t2) * cos(dl)));
+        if (f.azim < 0)
+            f.azim += 360;
+    }
+
+    double maxDist = 0, maxAzim = 0;
+    volatile uint32_t sink = 0;
+    uint64_t start = nowNs();
+    for (uint32_t r = 0; r < repeat; r++)
+    {
+        for (const GeoFix &f : fixes)
+        {
+            int32_t east, north;
+            if (!calcEnuFlat(f.homeLat, f.homeLon, f.lat, f.lon, f.cosLat, f.sinLat, &east, &north))
+                continue;
+            uint32_t dist = calcEnuDist(east, north);
+            uint32_t azim = calcEnuAzimuth(east, north);
+            sink = dist + azim + calcElevation(dist / 1000, 100);
+            if (r == 0 && f.dist > 20.0)
+            {
+                double azimErr = fabs(azim - f.azim);
+                maxDist = max(maxDist, fabs(dist / 1000.0 - f.dist));
+                maxAzim = max(maxAzim, min(azimErr, 360 - azimErr));
+            }
+        }
+    }
+    uint64_t ns = nowNs() - start;
+    printf("%-28s %10.1f ns/fix %8.2f m %6.2f deg max error\n", "aat flat", (double)ns / fixes.size() / repeat, maxDist, maxAzim);
+
+    maxDist = maxAzim = 0;
+    start = nowNs();
+    for (uint32_t r = 0; r < repeat; r++)
+    {
+        for (const GeoFix &f : fixes)
+        {
+            uint32_t dist, azim;
+            calcDistAndAzimuth(f.homeLat, f.homeLon, f.lat, f.lon, &dist, &azim);
+            sink = dist + azim;
+            if (r == 0 && f.dist > 20.0)
+            {
+                double azimErr = fabs(azim - f.azim);
+                maxDist = max(maxDist, fabs(dist - f.dist));
+                maxAzim = max(maxAzim, min(azimErr, 360 - azimErr));
+            }
+        }
+    }
+    ns = nowNs() - start;
+    (void)sink;
+    printf("%-28s %10.1f ns/fix %8.2f m %6.2f deg max error\n", "aat spherical", (double)ns / fixes.size() / repeat, maxDist, maxAzim);
+}
+
+static int runBenchmarks()
+{
+    uint32_t frames = option("frames");
+    uint32_t repeat = max(1, (int)option("repeat"));
+    StreamGenerator gen(option("seed"));
+
+    bytes_t clean, damaged;
+    gen.generate(true, frames, 0, 0, clean);
+    gen.generate(true, frames, option("corrupt"), option("noise"), damaged);
+    benchMsp(clean, repeat, "clean");
+    benchMsp(damaged, repeat, "damaged");
+
+    clean.clear();
+    damaged.clear();
+    gen.generate(false, frames, 0, 0, clean);
+    gen.generate(false, frames, option("corrupt"), option("noise"), damaged);
+    benchCrsf(clean, repeat, "clean");
+    benchCrsf(damaged, repeat, "damaged");
+
+    benchCrc(repeat);
+    benchAat(gen, repeat);
+    return 0;
+}
+
+/***
+ * Fuzzers, any out of bounds access is left to the sanitizers to catch
+ ***/
+
+static bool fuzzFailed(uint32_t seed, const char *what)
+{
+    printf("FAIL seed %u: %s\n", seed, what);
+    return false;
+}
+
+static bool fuzzMsp(uint32_t seed, uint32_t frames, float corruptRate, float noiseRate)
+{
+    StreamGenerator gen(seed);
+    bytes_t stream;
+    gen.generate(true, frames, corruptRate, noiseRate, stream);
+
+    // Whole buffer, byte by byte and random splits all have to find the same packets
+    Capture whole = mspBulk(stream, stream.size());
+    if (!(mspBytewise(stream) == whole))
+        return fuzzFailed(seed, "msp bytewise differs from bulk");
+    if (!(mspBulk(stream, 1 + gen.below(300)) == whole))
+        return fuzzFailed(seed, "msp split buffer differs from whole");
+
+    // Streamed payloads have to arrive in order and within the declared size
+    MSP msp;
+    uint16_t expected = 0;
+    bool inOrder = true;
+    msp.setChunkHandler([&](mspChunkEvent_e event, const mspPacket_t *packet, uint16_t offset, const uint8_t *data, uint16_t len) {
+        if (event == MSP_CHUNK_DATA)
+        {
+            inOrder &= offset == expected && len <= MSP_PORT_INBUF_SIZE && offset + len <= packet->payloadSize;
+            expected = offset + len;
+            return;
+        }
+        inOrder &= event == MSP_CHUNK_ABORT || expected == packet->payloadSize;
+        expected = 0;
+    });
+    msp.processReceivedBytes(stream.data(), stream.size(), [](mspPacket_t *packet) {});
+    if (!inOrder)
+        return fuzzFailed(seed, "msp chunks out of order");
+    return true;
+}
+
+static bool fuzzMspClean(uint32_t seed, uint32_t frames)
+{
+    // Every frame has to come out exactly as it went in, the big ones through the chunk handler
+    StreamGenerator gen(seed);
+    bytes_t stream;
+    Capture sent;
+    for (uint32_t i = 0; i < frames; i++)
+    {
+        bytes_t frame = gen.mspFrame();
+        uint16_t size = frame[6] | (frame[7] << 8);
+        sent.add(frame[2] == '<' ? MSP_PACKET_COMMAND : MSP_PACKET_RESPONSE, frame[4] | (frame[5] << 8), &frame[8], size);
+        stream.insert(stream.end(), frame.begin(), frame.end());
+    }
+
+    MSP msp;
+    Capture received;
+    bytes_t payload;
+    msp.setChunkHandler([&](mspChunkEvent_e event, const mspPacket_t *packet, uint16_t offset, const uint8_t *data, uint16_t len) {
+        if (event == MSP_CHUNK_DATA)
+        {
+            payload.insert(payload.end(), data, data + len);
+            return;
+        }
+        if (event == MSP_CHUNK_END)
+        {
+            received.add(packet->type, packet->function, payload.data(), payload.size());
+        }
+        payload.clear();
+    });
+    size_t chunk = 1 + gen.below(300);
+    for (size_t pos = 0; pos < stream.size(); pos += chunk)
+    {
+        msp.processReceivedBytes(&stream[pos], min(chunk, stream.size() - pos), [&](mspPacket_t *packet) {
+            received.add(packet->type, packet->function, packet->payload, packet->payloadSize);
+        });
+    }
+    if (!(received == sent))
+        return fuzzFailed(seed, "msp lost or changed a clean frame");
+    return true;
+}
+
+static bool fuzzCrsf(uint32_t seed, uint32_t frames, float corruptRate, float noiseRate)
+{
+    StreamGenerator gen(seed);
+    bytes_t stream;
+    gen.generate(false, frames, corruptRate, noiseRate, stream);
+
+    // How the bytes are split between polls must not change what is found
+    uint32_t bad;
+    Capture first = crsfParse(stream, 1 + gen.below(128), &bad);
+    if (bad)
+        return fuzzFailed(seed, "crsf handed over a malformed frame");
+    if (!(crsfParse(stream, 1 + gen.below(128), &bad) == first))
+        return fuzzFailed(seed, "crsf result depends on the read size");
+    return true;
+}
+
+static bool fuzzCrsfClean(uint32_t seed, uint32_t frames)
+{
+    StreamGenerator gen(seed);
+    bytes_t stream;
+    Capture sent;
+    for (uint32_t i = 0; i < frames; i++)
+    {
+        bytes_t frame = gen.crsfFrame();
+        sent.add(frame[2], 0, &frame[3], frame[1] - 2);
+        stream.insert(stream.end(), frame.begin(), frame.end());
+    }
+    uint32_t bad;
+    if (!(crsfParse(stream, 1 + gen.below(128), &bad) == sent))
+        return fuzzFailed(seed, "crsf lost or changed a clean frame");
+    return true;
+}
+
+static int runFuzzers()
+{
+    uint32_t seed = option("seed");
+    uint32_t rounds = option("rounds");
+    // Shorter streams, more of them, so a failure is quick to replay
+    uint32_t frames = max(1, (int)option("frames") / 100);
+    float corruptRate = option("corrupt");
+    float noiseRate = option("noise");
+
+    uint64_t start = nowNs();
+    for (uint32_t r = 0; r < rounds; r++)
+    {
+        uint32_t s = seed + r;
+        if (!fuzzMsp(s, frames, corruptRate, noiseRate) || !fuzzMspClean(s, frames) ||
+            !fuzzCrsf(s, frames, corruptRate, noiseRate) || !fuzzCrsfClean(s, frames))
+        {
+            return 1;
+        }
+    }
+    printf("%u rounds of %u frames passed in %.1fs\n", rounds, frames, (nowNs() - start) / 1e9);
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    if (!parseArgs(argc, argv))
+    {
+        usage();
+        return 1;
+    }
+    return option("fuzz") ? runFuzzers() : runBenchmarks();
+}
@@ -0,0 +1,136 @@
+#pragma once
+
+#include <Arduino.h>
+#include <random>
+#include <vector>
+
+#include "msp.h"
+#include "crsf_protocol.h"
+#include "crc.h"
+
+namespace bench
+{
+
+typedef std::vector<uint8_t> bytes_t;
+
+// The same mix of frames and damage as python/stream_fuzz.py
+class StreamGenerator
+{
+public:
+    StreamGenerator(uint32_t seed) : m_rnd(seed), m_crc(CRSF_CRC_POLY) {}
+
+    uint32_t below(uint32_t n) { return std::uniform_int_distribution<uint32_t>(0, n - 1)(m_rnd); }
+    bool chance(float p) { return std::uniform_real_distribution<float>(0, 1)(m_rnd) < p; }
+
+    // A valid MSPv2 frame, with a payload larger than an mspPacket_t now and then
+    bytes_t mspFrame()
+    {
+        static const uint16_t functions[] = { 0x0301, 0x0305, 0x00B6, 0x0383, 0x0011 };
+        uint16_t function = below(6) < 5 ? functions[below(5)] : below(0x10000);
+        uint16_t size = chance(0.02f) ? MSP_PORT_INBUF_SIZE + 1 + below(64) : below(MSP_PORT_INBUF_SIZE + 1);
+        bytes_t frame = { '$', 'X', (uint8_t)(chance(0.5f) ? '<' : '>'),
+            0, (uint8_t)(function & 0xFF), (uint8_t)(function >> 8), (uint8_t)(size & 0xFF), (uint8_t)(size >> 8) };
+        for (uint16_t i = 0; i < size; i++)
+        {
+            frame.push_back(below(256));
+        }
+        frame.push_back(MSP::crc(0, &frame[MSP_FRAME_PREAMBLE_SIZE], frame.size() - MSP_FRAME_PREAMBLE_SIZE));
+        return frame;
+    }
+
+    // A valid CRSF frame of a random type
+    bytes_t crsfFrame()
+    {
+        static const uint8_t types[] = { CRSF_FRAMETYPE_GPS, CRSF_FRAMETYPE_BATTERY_SENSOR, CRSF_FRAMETYPE_LINK_STATISTICS };
+        uint8_t type = below(4) < 3 ? types[below(3)] : below(256);
+        uint8_t size = 1 + below(CRSF_MAX_PAYLOAD);
+        bytes_t frame = { CRSF_SYNC_BYTE, (uint8_t)(size + 2), type };
+        for (uint8_t i = 0; i < size; i++)
+        {
+            frame.push_back(below(256));
+        }
+        frame.push_back(m_crc.calc(&frame[2], size + 1));
+        return frame;
+    }
+
+    // Bit flips, truncation, oversized length fields and duplicated framing bytes
+    void corrupt(bytes_t &frame)
+    {
+        bool msp = frame[0] == '$';
+        switch (below(4))
+        {
+        case 0:
+            frame[below(frame.size())] ^= 1 << below(8);
+            break;
+        case 1:
+            frame.resize(1 + below(frame.size() - 1));
+            break;
+        case 2:
+            frame[msp ? 7 : 1] = 0xFF;
+            break;
+        default:
+            frame.insert(frame.begin(), frame[0]);
+            break;
+        }
+    }
+
+    // count frames, some of them corrupted and some preceded by line noise.
+    // Returns the number of frames left intact
+    uint32_t generate(bool msp, uint32_t count, float corruptRate, float noiseRate, bytes_t &stream)
+    {
+        uint32_t intact = 0;
+        for (uint32_t i = 0; i < count; i++)
+        {
+            if (chance(noiseRate))
+            {
+                for (uint32_t n = 1 + below(31); n > 0; n--)
+                {
+                    stream.push_back(below(256));
+                }
+            }
+            bytes_t frame = msp ? mspFrame() : crsfFrame();
+            if (chance(corruptRate))
+            {
+                corrupt(frame);
+            }
+            else
+            {
+                intact++;
+            }
+            stream.insert(stream.end(), frame.begin(), frame.end());
+        }
+        return intact;
+    }
+
+    static constexpr uint8_t CRSF_MAX_PAYLOAD = 60;
+
+private:
+    std::mt19937 m_rnd;
+    GENERIC_CRC8 m_crc;
+};
+
+// A UART that has at most fifo bytes waiting each time it is polled
+class MemoryStream : public Stream
+{
+public:
+    MemoryStream(const bytes_t &data, size_t fifo) : m_data(data), m_pos(0), m_fifo(fifo) {}
+
+    int available() override { return min(m_data.size() - m_pos, m_fifo); }
+    int read() override { return m_pos < m_data.size() ? m_data[m_pos++] : -1; }
+    size_t readBytes(uint8_t *buffer, size_t length) override
+    {
+        length = min(length, m_data.size() - m_pos);
+        memcpy(buffer, &m_data[m_pos], length);
+        m_pos += length;
+        return length;
+    }
+    size_t write(uint8_t c) override { return 1; }
+    bool done() const { return m_pos == m_data.size(); }
+
+private:
+    const bytes_t &m_data;
+    size_t m_pos;
+    size_t m_fifo;
+};
+
+} // namespace bench
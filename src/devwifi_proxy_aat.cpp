@@ -3,6 +3,21 @@
 #include "devwifi_proxies.h"
 #include "module_aat.h"
 
+// Live tracker state for calibration, pushed as aatTelemetry_t frames
+#define AAT_TELEMETRY_HZ_DEFAULT 10
+#define AAT_TELEMETRY_HZ_MAX 20
+
+// Commands from the client, one byte of command then an int16 value
+enum aatWsCommand_e {
+    AAT_WS_CMD_BEARING = 1, // target bearing override, -180 to 180
+    AAT_WS_CMD_ELEV = 2,    // target elevation override, 0 to 90
+    AAT_WS_CMD_RATE = 3,    // telemetry rate in Hz, 0 stops it
+};
+
+static AsyncWebSocket aatWS("/aat.ws");
+static uint32_t telemetryIntervalMs = 1000 / AAT_TELEMETRY_HZ_DEFAULT;
+static uint32_t lastTelemetryMs;
+
 void WebAatAppendConfig(ArduinoJson::JsonDocument &json)
 {
     auto aat = json["config"].createNestedObject("aat");
@@ -21,6 +36,7 @@ void WebAatAppendConfig(ArduinoJson::JsonDocument &json)
     vbat["offset"] = config.GetVbatOffset();
     vbat["scale"] = config.GetVbatScale();
     vbat["vbat"] = vrxModule.getVbat();
+    vbat["low"] = vrxModule.isVbatLow();
 }
 
 void WebAatConfig(AsyncWebServerRequest *request)
@@ -63,9 +79,55 @@ void WebAatConfig(AsyncWebServerRequest *request)
     request->send(200, "text/plain", response);
 }
 
+static void WebAatSocketEvent(AsyncWebSocket *server, AsyncWebSocketClient *client, AwsEventType type, void *arg, uint8_t *data, size_t len)
+{
+    if (type != WS_EVT_DATA)
+        return;
+    AwsFrameInfo *info = (AwsFrameInfo *)arg;
+    // Commands are tiny, anything fragmented is not one of ours
+    if (!info->final || info->index != 0 || info->opcode != WS_BINARY)
+        return;
+
+    for (size_t pos = 0; pos + 3 <= len; pos += 3)
+    {
+        int16_t value = (int16_t)(data[pos + 1] | (data[pos + 2] << 8));
+        switch (data[pos])
+        {
+        case AAT_WS_CMD_BEARING:
+            vrxModule.overrideTargetBearing(constrain(value, -180, 180));
+            break;
+        case AAT_WS_CMD_ELEV:
+            vrxModule.overrideTargetElev(value);
+            break;
+        case AAT_WS_CMD_RATE:
+            telemetryIntervalMs = (value > 0) ? 1000 / min((int16_t)AAT_TELEMETRY_HZ_MAX, value) : 0;
+            break;
+        default:
+            break;
+        }
+    }
+}
+
 void WebAatInit(AsyncWebServer &server)
 {
     server.on("/aatconfig", WebAatConfig);
+    aatWS.onEvent(WebAatSocketEvent);
+    server.addHandler(&aatWS);
+}
+
+void WebAatLoop(uint32_t now)
+{
+    aatWS.cleanupClients();
+    if (telemetryIntervalMs == 0 || aatWS.count() == 0 || now - lastTelemetryMs < telemetryIntervalMs)
+        return;
+    lastTelemetryMs = now;
+
+    // A client that is not keeping up just misses frames, the next one supersedes it
+    if (!aatWS.availableForWriteAll())
+        return;
+    aatTelemetry_t telem;
+    vrxModule.getTelemetry(&telem, now);
+    aatWS.binaryAll((uint8_t *)&telem, sizeof(telem));
 }
 
 #endif /* defined(AAT_BACKPACK) */
@@ -0,0 +1,143 @@
+#pragma once
+
+#include <Arduino.h>
+#include "logging.h"
+
+#if defined(PLATFORM_ESP8266)
+  #include <espnow.h>
+#elif defined(PLATFORM_ESP32)
+  #include <esp_now.h>
+#endif
+
+// Peers kept registered with ESP-NOW, the SDK's limit for unencrypted peers
+#ifndef ESPNOW_PEER_SLOTS
+#define ESPNOW_PEER_SLOTS   20
+#endif
+
+/**
+ * @brief: ESP-NOW peers registered on first use and kept, least recently used evicted
+ *
+ * Registering a peer is only paid for the first time an address is sent to,
+ * or after it was evicted to make room, rather than on every change of target.
+ * Pinned peers (the bound address) are never evicted.
+ */
+class EspnowPeers
+{
+public:
+    /***
+     * @brief: Make sure address is registered with ESP-NOW and mark it used
+     * @return: false if it could not be registered
+     */
+    bool use(const uint8_t *address, bool pin = false)
+    {
+        int8_t slot = find(address);
+        if (slot < 0)
+        {
+            slot = victim();
+            if (slot < 0)
+                return false;
+            if (_peers[slot].used)
+                esp_now_del_peer(_peers[slot].mac);
+            _peers[slot].used = false;
+            if (!add(address))
+                return false;
+            memcpy(_peers[slot].mac, address, 6);
+            _peers[slot].used = true;
+            _peers[slot].pinned = false;
+        }
+        _peers[slot].pinned |= pin;
+        _peers[slot].lastUsed = ++_clock;
+        return true;
+    }
+
+    // Registered peers, for sending one packet to all of them
+    uint8_t count() const
+    {
+        uint8_t n = 0;
+        for (uint8_t i = 0; i < ESPNOW_PEER_SLOTS; i++)
+            n += _peers[i].used;
+        return n;
+    }
+
+    const uint8_t *address(uint8_t index) const
+    {
+        for (uint8_t i = 0; i < ESPNOW_PEER_SLOTS; i++)
+        {
+            if (_peers[i].used && index-- == 0)
+                return _peers[i].mac;
+        }
+        return nullptr;
+    }
+
+    // Position of address in the order address() walks, 0 if not registered
+    uint8_t indexOf(const uint8_t *address) const
+    {
+        uint8_t index = 0;
+        for (uint8_t i = 0; i < ESPNOW_PEER_SLOTS; i++)
+        {
+            if (!_peers[i].used)
+                continue;
+            if (memcmp(_peers[i].mac, address, 6) == 0)
+                return index;
+            index++;
+        }
+        return 0;
+    }
+
+private:
+    struct Peer
+    {
+        uint8_t mac[6];
+        uint32_t lastUsed;
+        bool used;
+        bool pinned;
+    };
+
+    Peer _peers[ESPNOW_PEER_SLOTS] = {};
+    uint32_t _clock = 0;
+
+    int8_t find(const uint8_t *address) const
+    {
+        for (uint8_t i = 0; i < ESPNOW_PEER_SLOTS; i++)
+        {
+            if (_peers[i].used && memcmp(_peers[i].mac, address, 6) == 0)
+                return i;
+        }
+        return -1;
+    }
+
+    // A free slot, else the least recently used peer that is not pinned
+    int8_t victim() const
+    {
+        int8_t slot = -1;
+        for (uint8_t i = 0; i < ESPNOW_PEER_SLOTS; i++)
+        {
+            if (!_peers[i].used)
+                return i;
+            if (!_peers[i].pinned && (slot < 0 || _peers[i].lastUsed < _peers[slot].lastUsed))
+                slot = i;
+        }
+        return slot;
+    }
+
+    static bool add(const uint8_t *address)
+    {
+    #if defined(PLATFORM_ESP8266)
+        return esp_now_add_peer((uint8_t *)address, ESP_NOW_ROLE_COMBO, 1, NULL, 0) == 0;
+    #elif defined(PLATFORM_ESP32)
+        esp_now_peer_info_t peerInfo;
+        memset(&peerInfo, 0, sizeof(peerInfo));
+        memcpy(peerInfo.peer_addr, address, 6);
+        peerInfo.channel = 0;
+        peerInfo.encrypt = false;
+        if (esp_now_add_peer(&peerInfo) != ESP_OK)
+        {
+            DBGLN("ESP-NOW failed to add peer");
+            return false;
+        }
+        return true;
+    #else
+        return true;
+    #endif
+    }
+};
@@ -10,12 +10,25 @@ void
 Fusion::Init()
 {
     ModuleBase::Init();
+    telemetry.setInterval(FUSION_TLM_LINK, FUSION_TLM_LINK_INTERVAL_MS);
+    telemetry.setInterval(FUSION_TLM_BATTERY, FUSION_TLM_BATTERY_INTERVAL_MS);
     DBGLN("Fusion backpack init complete");
 }
 
 void
+Fusion::Loop(uint32_t now)
+{
+    telemetry.update(now);
+    ModuleBase::Loop(now);
+}
+
+bool
 Fusion::SendIndexCmd(uint8_t index)
-{  
+{
+    if (index >= CHANNEL_COUNT)
+    {
+        return false;
+    }
     uint16_t f = frequencyTable[index];
     uint8_t buf[12];
     uint8_t pos = 0;
@@ -37,10 +50,7 @@ Fusion::SendIndexCmd(uint8_t index)
     uint8_t crc = crsf_crc.calc(&buf[2], pos - 2); // first 2 bytes not included in CRC
     buf[pos++] = crc;
 
-    for (uint8_t i = 0; i < pos; ++i)
-    {
-        Serial.write(buf[i]);
-    }
+    Serial.write(buf, pos);
 
     // Leaving this in as its useful to debug
     // for (uint8_t i = 0; i < pos; ++i)
@@ -48,6 +58,7 @@ Fusion::SendIndexCmd(uint8_t index)
     //     Serial.print("0x"); Serial.print(buf[i], HEX); Serial.print(", ");
     // }
     // Serial.println("");
+    return true;
 }
 
 void
@@ -81,10 +92,7 @@ Fusion::SendLinkTelemetry(uint8_t *rawCrsfPacket)
     };
     // Calculate & write CRC
     buf[sizeof(buf) - 1] = crsf_crc.calc(&buf[2], sizeof(buf) - 3);
-    for (uint8_t i = 0; i < sizeof(buf); i++)
-    {
-        Serial.write(buf[i]);
-    }
+    telemetry.post(FUSION_TLM_LINK, buf, sizeof(buf));
 }
 
 void
@@ -114,8 +122,5 @@ Fusion::SendBatteryTelemetry(uint8_t *rawCrsfPacket)
     };
     // Calculate & write CRC
     buf[sizeof(buf) - 1] = crsf_crc.calc(&buf[2], sizeof(buf) - 3);
-    for (uint8_t i = 0; i < sizeof(buf); i++)
-    {
-        Serial.write(buf[i]);
-    }
+    telemetry.post(FUSION_TLM_BATTERY, buf, sizeof(buf));
 }
\ No newline at end of file
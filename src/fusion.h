@@ -1,26 +1,37 @@
 #pragma once
 
 #include "module_base.h"
+#include <channels.h>
+#include "telemetry_forwarder.h"
 #include <Arduino.h>
 
 #define VRX_BOOT_DELAY  1000
 
 #define VRX_UART_BAUD   500000   // fusion uses 500k baud between the ESP8266 and the STM32
 
-const uint16_t frequencyTable[48] = {
-    5865, 5845, 5825, 5805, 5785, 5765, 5745, 5725, // A
-    5733, 5752, 5771, 5790, 5809, 5828, 5847, 5866, // B
-    5705, 5685, 5665, 5645, 5885, 5905, 5925, 5945, // E
-    5740, 5760, 5780, 5800, 5820, 5840, 5860, 5880, // F
-    5658, 5695, 5732, 5769, 5806, 5843, 5880, 5917, // R
-    5333, 5373, 5413, 5453, 5493, 5533, 5573, 5613  // L
-};
+// Fastest the goggles are sent each telemetry type, newer values replace older ones in between
+#if !defined(FUSION_TLM_LINK_INTERVAL_MS)
+#define FUSION_TLM_LINK_INTERVAL_MS     100
+#endif
+#if !defined(FUSION_TLM_BATTERY_INTERVAL_MS)
+#define FUSION_TLM_BATTERY_INTERVAL_MS  500
+#endif
+
+typedef enum {
+    FUSION_TLM_LINK,
+    FUSION_TLM_BATTERY
+} fusionTelemetrySlot_e;
 
 class Fusion : public ModuleBase
 {
 public:
+    Fusion() : telemetry(&Serial) {}
     void Init();
-    void SendIndexCmd(uint8_t index);
+    void Loop(uint32_t now);
+    bool SendIndexCmd(uint8_t index);
     void SendLinkTelemetry(uint8_t *rawCrsfPacket);
     void SendBatteryTelemetry(uint8_t *rawCrsfPacket);
+
+private:
+    TelemetryForwarder telemetry;
 };
@@ -1,6 +1,9 @@
 #include "rx5808.h"
 #include <SPI.h>
 #include "logging.h"
+#include "msptypes.h"
+
+void sendMSPViaEspnow(mspPacket_t *packet);
 
 void
 RX5808::Init()
@@ -15,6 +18,8 @@ RX5808::Init()
         pinMode(PIN_CS_2, INPUT);
     #endif
 
+    _shadow.invalidate();
+
     DBGLN("RX5808 init complete");
 }
 
@@ -39,62 +44,165 @@ RX5808::EnableSPIMode()
     DBGLN("SPI config complete");
 }
 
-void
+bool
 RX5808::SendIndexCmd(uint8_t index)
 {
     DBG("Setting index ");
     DBGLN("%x", index);
 
-    uint16_t f = frequencyTable[index];
-    
-    uint32_t data = ((((f - 479) / 2) / 32) << 7) | (((f - 479) / 2) % 32);
+    if (index >= CHANNEL_COUNT)
+    {
+        return false;
+    }
+    changeChannel(rtc6705ChannelData[index]);
+    return true;
+}
 
-    uint32_t newRegisterData = SYNTHESIZER_REG_B  | (RX5808_WRITE_CTRL_BIT << 4) | (data << 5);
+bool
+RX5808::SendFrequencyCmd(uint16_t mhz)
+{
+    DBGLN("Setting frequency %d", mhz);
 
-    uint32_t currentRegisterData = SYNTHESIZER_REG_B | (RX5808_WRITE_CTRL_BIT << 4) | rtc6705readRegister(SYNTHESIZER_REG_B);
+    if (mhz < RTC6705_MIN_MHZ || mhz > RTC6705_MAX_MHZ)
+    {
+        return false;
+    }
+    changeChannel(rtc6705FrequencyData(mhz));
+    return true;
+}
 
-    if (newRegisterData != currentRegisterData)
+void
+RX5808::changeChannel(uint32_t data)
+{
+#if defined(PIN_RSSI)
+    // The pilot has picked a channel, stay on it rather than going back
+    _sweepIndex = RX5808_SWEEP_IDLE;
+#endif
+
+    // Already written, or queued to be
+    if (_shadow.matches(SYNTHESIZER_REG_B, data))
     {
-        rtc6705WriteRegister(newRegisterData);
+        return;
     }
+
+    // A newer channel replaces any that has not gone out yet
+    _spi.cancelPending();
+    tune(data);
 }
 
 void
-RX5808::rtc6705WriteRegister(uint32_t buf)
+RX5808::tune(uint32_t data)
 {
-    if (!SPIModeEnabled) 
+    if (!_shadow.matches(SYNTHESIZER_REG_B, data))
     {
-        EnableSPIMode();
+        rtc6705WriteRegister(SYNTHESIZER_REG_B  | (RX5808_WRITE_CTRL_BIT << 4) | (data << 5));
     }
+}
 
-    uint32_t periodMicroSec = 1000000 / BIT_BANG_FREQ;
+#if defined(PIN_RSSI)
+void
+RX5808::StartChannelSweep(uint8_t dwellMs)
+{
+    if (_sweepIndex != RX5808_SWEEP_IDLE)
+    {
+        return;
+    }
+    DBGLN("Starting channel sweep");
 
-    digitalWrite(PIN_CS, LOW);
-    #if defined(PIN_CS_2)
-        digitalWrite(PIN_CS_2, LOW);
-    #endif
-    delayMicroseconds(periodMicroSec);
+    // Go back to the channel the receiver was on when done
+    _spi.flush();
+    _sweepRestore = rtc6705readRegister(SYNTHESIZER_REG_B) >> 5;
+    _shadow.set(SYNTHESIZER_REG_B, _sweepRestore);
 
-    for (uint8_t i = 0; i < RX5808_PACKET_LENGTH; ++i)
+    _sweepDwellMs = dwellMs ? dwellMs : RX5808_SWEEP_DWELL_MS;
+    _sweepIndex = 0;
+    _sweepStepMs = millis();
+    tune(rtc6705ChannelData[0]);
+}
+
+void
+RX5808::sweepStep(uint32_t now)
+{
+    // RSSI is sampled once the channel has gone out and the output has settled
+    if (_sweepIndex == RX5808_SWEEP_IDLE || _spi.busy() || now - _sweepStepMs < _sweepDwellMs)
     {
-        digitalWrite(PIN_CLK, LOW);
-        delayMicroseconds(periodMicroSec / 4);
-        digitalWrite(PIN_MOSI, buf & 0x01);
-        delayMicroseconds(periodMicroSec / 4);
-        digitalWrite(PIN_CLK, HIGH);
-        delayMicroseconds(periodMicroSec / 2);
+        return;
+    }
 
-        buf >>= 1; 
+#if defined(PLATFORM_ESP32)
+    _sweepRssi[_sweepIndex] = analogRead(PIN_RSSI) >> 4;
+#else
+    _sweepRssi[_sweepIndex] = analogRead(PIN_RSSI) >> 2;
+#endif
+
+    if (++_sweepIndex < CHANNEL_COUNT)
+    {
+        _sweepStepMs = now;
+        tune(rtc6705ChannelData[_sweepIndex]);
+        return;
     }
 
-    digitalWrite(PIN_CLK, LOW);
-    delayMicroseconds(periodMicroSec);
-    digitalWrite(PIN_MOSI, LOW);
-    digitalWrite(PIN_CLK, LOW);
-    digitalWrite(PIN_CS, HIGH);
-    #if defined(PIN_CS_2)
-        digitalWrite(PIN_CS_2, HIGH);
-    #endif
+    _sweepIndex = RX5808_SWEEP_IDLE;
+    tune(_sweepRestore);
+
+    mspPacket_t packet;
+    packet.reset();
+    packet.makeResponse();
+    packet.function = MSP_ELRS_BACKPACK_GET_RSSI;
+    for (uint8_t i = 0; i < CHANNEL_COUNT; ++i)
+    {
+        packet.addByte(_sweepRssi[i]);
+    }
+    sendMSPViaEspnow(&packet);
+    DBGLN("Channel sweep complete");
+}
+#endif
+
+void
+RX5808::Loop(uint32_t now)
+{
+    _spi.update();
+#if defined(PIN_RSSI)
+    sweepStep(now);
+#endif
+
+    // Pick up a channel changed on the receiver itself
+    if (!_spi.busy() && _shadow.verifyDue(SYNTHESIZER_REG_B, now))
+    {
+        uint32_t data = rtc6705readRegister(SYNTHESIZER_REG_B) >> 5;
+        if (!_shadow.matches(SYNTHESIZER_REG_B, data))
+        {
+            DBGLN("RTC6705 REG_B changed outside the backpack");
+            _shadow.set(SYNTHESIZER_REG_B, data);
+        }
+    }
+
+    ModuleBase::Loop(now);
+}
+
+void
+RX5808::rtc6705WriteRegister(uint32_t buf)
+{
+    if (!SPIModeEnabled) 
+    {
+        EnableSPIMode();
+    }
+
+    uint8_t reg = buf & 0x0F;
+    if (reg == POWER_DOWN_CONTROL_REGISTER)
+    {
+        _shadow.invalidate();
+    }
+
+    uint32_t periodMicroSec = 1000000 / BIT_BANG_FREQ;
+    if (_spi.queueWrite(buf, RX5808_PACKET_LENGTH, false, periodMicroSec, 0))
+    {
+        _shadow.set(reg, buf >> 5);
+    }
+    else
+    {
+        _shadow.invalidate();
+    }
 }
 
 uint32_t
@@ -0,0 +1,21 @@
+#pragma once
+
+// Collects what UpdateInflater writes, in place of the ESP32 Update class
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+class UpdateClass
+{
+public:
+    std::vector<uint8_t> image;
+
+    size_t write(uint8_t *data, size_t len)
+    {
+        image.insert(image.end(), data, data + len);
+        return len;
+    }
+};
+
+extern UpdateClass Update;
@@ -0,0 +1,215 @@
+// Host test for the ESP32 gzip OTA path, UpdateInflater over the ROM tinfl API
+//   pio run -e native_inflate_test -t exec
+// Inflates a firmware-like image compressed by gzip -9 (zlib level 9 when
+// gzip is not on the PATH) in several upload chunk sizes, and checks the
+// output and the trailer ISIZE. Any .gz files given on the command line, such
+// as a real .pio/build/<env>/firmware.bin.gz, are checked the same way.
+
+#include <Arduino.h>
+#include <string>
+#include <vector>
+
+#include <Update.h>
+#include "UpdateInflater.h"
+
+namespace sim
+{
+    uint64_t nowUs = 0;
+}
+
+HostSerial Serial;
+UpdateClass Update;
+uint32_t tinflOverread = 0;
+
+typedef std::vector<uint8_t> bytes_t;
+
+static unsigned failures = 0;
+
+#define CHECK(cond, ...)                  \
+    do                                    \
+    {                                     \
+        if (!(cond))                      \
+        {                                 \
+            printf("FAIL: " __VA_ARGS__); \
+            printf("\n");                 \
+            failures++;                   \
+        }                                 \
+    } while (0)
+
+// Mostly repeated 4 byte "instructions" and some strings, it compresses
+// about like a real image does
+static bytes_t firmwareImage(size_t len)
+{
+    static const char *strings[] = {"Inflate failed: %d", "/update", "backpack", "ESP-NOW", "channel", "TLM"};
+    bytes_t image;
+    uint32_t seed = 0x1F8B0808;
+    image.push_back(0xE9);
+    while (image.size() < len)
+    {
+        seed = seed * 1103515245 + 12345;
+        if ((seed >> 24) < 16)
+        {
+            const char *s = strings[(seed >> 8) % 6];
+            image.insert(image.end(), s, s + strlen(s) + 1);
+        }
+        else
+        {
+            uint32_t insn = ((seed >> 8) & 0x3F) * 0x01010101 ^ (seed >> 20);
+            image.insert(image.end(), (uint8_t *)&insn, (uint8_t *)&insn + 4);
+        }
+    }
+    image.resize(len);
+    return image;
+}
+
+static bool readFile(const char *path, bytes_t &out)
+{
+    FILE *f = fopen(path, "rb");
+    if (f == nullptr)
+        return false;
+    uint8_t buf[4096];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0)
+        out.insert(out.end(), buf, buf + n);
+    fclose(f);
+    return true;
+}
+
+static bool gzipTool(const bytes_t &image, bytes_t &gz)
+{
+    std::string path = "/tmp/inflate_test_firmware.bin";
+    FILE *f = fopen(path.c_str(), "wb");
+    if (f == nullptr)
+        return false;
+    fwrite(image.data(), 1, image.size(), f);
+    fclose(f);
+    bool ok = system(("gzip -9 -f " + path + " 2>/dev/null").c_str()) == 0 && readFile((path + ".gz").c_str(), gz);
+    remove(path.c_str());
+    remove((path + ".gz").c_str());
+    return ok;
+}
+
+static bool gzipZlib(const bytes_t &image, bytes_t &gz)
+{
+    z_stream z = {};
+    if (deflateInit2(&z, 9, Z_DEFLATED, 31, 9, Z_DEFAULT_STRATEGY) != Z_OK)
+        return false;
+    gz_header header = {};
+    header.name = (Bytef *)"firmware.bin";
+    deflateSetHeader(&z, &header);
+    gz.resize(deflateBound(&z, image.size()) + 64);
+    z.next_in = (Bytef *)image.data();
+    z.avail_in = image.size();
+    z.next_out = gz.data();
+    z.avail_out = gz.size();
+    int ret = deflate(&z, Z_FINISH);
+    gz.resize(z.total_out);
+    deflateEnd(&z);
+    return ret == Z_STREAM_END;
+}
+
+static bool gunzip(const bytes_t &gz, bytes_t &image)
+{
+    z_stream z = {};
+    if (inflateInit2(&z, 31) != Z_OK)
+        return false;
+    z.next_in = (Bytef *)gz.data();
+    z.avail_in = gz.size();
+    int ret;
+    do
+    {
+        uint8_t buf[4096];
+        z.next_out = buf;
+        z.avail_out = sizeof(buf);
+        ret = inflate(&z, Z_NO_FLUSH);
+        image.insert(image.end(), buf, buf + sizeof(buf) - z.avail_out);
+    } while (ret == Z_OK);
+    inflateEnd(&z);
+    return ret == Z_STREAM_END;
+}
+
+// Feed gz in chunks the way the upload handler does, chunk 0 is random sizes
+static bool upload(const bytes_t &gz, size_t chunk, bytes_t &image)
+{
+    UpdateInflater inflater;
+    Update.image.clear();
+    if (!inflater.begin())
+        return false;
+    size_t pos = 0;
+    while (pos < gz.size())
+    {
+        size_t len = chunk ? chunk : 1 + rand() % 1500;
+        len = min(len, gz.size() - pos);
+        if (inflater.write(gz.data() + pos, len) != len)
+            break;
+        pos += len;
+    }
+    bool ok = inflater.finished();
+    inflater.end();
+    image = Update.image;
+    return ok;
+}
+
+static void checkImage(const char *name, const bytes_t &gz, const bytes_t &expected)
+{
+    static const size_t chunks[] = {1, 3, 7, 8, 9, 512, 1436, 4096, 65536, 0, 0, 0};
+    uint32_t overread = tinflOverread;
+    for (size_t chunk : chunks)
+    {
+        bytes_t image;
+        CHECK(upload(gz, chunk, image), "%s in %zu byte chunks not finished", name, chunk);
+        CHECK(image == expected, "%s in %zu byte chunks inflated %zu of %zu bytes", name, chunk, image.size(), expected.size());
+    }
+
+    // A damaged ISIZE or a short upload must not pass
+    bytes_t image;
+    bytes_t bad = gz;
+    bad[bad.size() - 1] ^= 0x01;
+    CHECK(!upload(bad, 1436, image), "%s with a bad ISIZE finished", name);
+    bad = gz;
+    bad.pop_back();
+    CHECK(!upload(bad, 1436, image), "%s without its last byte finished", name);
+    bad.resize(gz.size() / 2);
+    CHECK(!upload(bad, 1436, image), "%s cut in half finished", name);
+
+    printf("%s: %zu -> %zu bytes, %u bytes read past the deflate stream\n", name, gz.size(), expected.size(), tinflOverread - overread);
+}
+
+int main(int argc, char **argv)
+{
+    srand(1);
+
+    // Sizes that leave the stream end at different points of the last chunk
+    for (size_t len : {1000000u, 1000001u, 1000003u, 65536u, 0u})
+    {
+        bytes_t image = firmwareImage(len);
+        bytes_t gz;
+        char name[48];
+        if (gzipTool(image, gz))
+        {
+            snprintf(name, sizeof(name), "gzip -9 %zu", len);
+            checkImage(name, gz, image);
+        }
+        gz.clear();
+        CHECK(gzipZlib(image, gz), "zlib failed on %zu bytes", len);
+        snprintf(name, sizeof(name), "zlib 9 %zu", len);
+        checkImage(name, gz, image);
+    }
+
+    for (int i = 1; i < argc; i++)
+    {
+        bytes_t gz, image;
+        CHECK(readFile(argv[i], gz), "%s not readable", argv[i]);
+        CHECK(gunzip(gz, image), "%s is not a gzip file", argv[i]);
+        if (!image.empty())
+            checkImage(argv[i], gz, image);
+    }
+
+    if (failures)
+    {
+        printf("%u checks failed\n", failures);
+        return 1;
+    }
+    printf("all passed\n");
+    return 0;
+}
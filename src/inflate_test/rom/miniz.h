@@ -0,0 +1,82 @@
+#pragma once
+
+// The ESP32 ROM tinfl API on top of zlib, for the host inflate test.
+// Like the miniz 1.x copy in ROM, the end of the deflate stream can report a
+// few bytes past it as consumed, they are counted in m_num_bits.
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <zlib.h>
+
+#define TINFL_LZ_DICT_SIZE 32768
+#define TINFL_FLAG_HAS_MORE_INPUT 2
+
+typedef enum
+{
+    TINFL_STATUS_BAD_PARAM = -3,
+    TINFL_STATUS_ADLER32_MISMATCH = -2,
+    TINFL_STATUS_FAILED = -1,
+    TINFL_STATUS_DONE = 0,
+    TINFL_STATUS_NEEDS_MORE_INPUT = 1,
+    TINFL_STATUS_HAS_MORE_OUTPUT = 2
+} tinfl_status;
+
+typedef struct
+{
+    uint32_t m_state;
+    uint32_t m_num_bits;
+    z_stream m_zstream;
+} tinfl_decompressor;
+
+// Bytes past the end of a deflate stream reported as consumed so far
+extern uint32_t tinflOverread;
+
+inline void tinfl_init(tinfl_decompressor *r)
+{
+    r->m_state = 0;
+    r->m_num_bits = 0;
+}
+
+inline tinfl_status tinfl_decompress(tinfl_decompressor *r, const uint8_t *pIn_buf_next, size_t *pIn_buf_size,
+                                     uint8_t *pOut_buf_start, uint8_t *pOut_buf_next, size_t *pOut_buf_size, const uint32_t decomp_flags)
+{
+    if (r->m_state == 0)
+    {
+        memset(&r->m_zstream, 0, sizeof(r->m_zstream));
+        if (inflateInit2(&r->m_zstream, -15) != Z_OK)
+            return TINFL_STATUS_BAD_PARAM;
+        r->m_state = 1;
+    }
+    z_stream &z = r->m_zstream;
+    z.next_in = (Bytef *)pIn_buf_next;
+    z.avail_in = *pIn_buf_size;
+    z.next_out = pOut_buf_next;
+    z.avail_out = *pOut_buf_size;
+    int ret = inflate(&z, Z_NO_FLUSH);
+    *pIn_buf_size -= z.avail_in;
+    *pOut_buf_size -= z.avail_out;
+
+    if (ret == Z_STREAM_END)
+    {
+        // 1.x reads ahead up to 4 bytes, how many depends on where the stream ends
+        size_t extra = z.total_out % 5;
+        if (extra > z.avail_in)
+            extra = z.avail_in;
+        *pIn_buf_size += extra;
+        r->m_num_bits = extra * 8 + z.data_type % 8;
+        tinflOverread += extra;
+        inflateEnd(&z);
+        r->m_state = 0;
+        return TINFL_STATUS_DONE;
+    }
+    if (ret != Z_OK && ret != Z_BUF_ERROR)
+    {
+        inflateEnd(&z);
+        r->m_state = 0;
+        return TINFL_STATUS_FAILED;
+    }
+    if (z.avail_out == 0)
+        return TINFL_STATUS_HAS_MORE_OUTPUT;
+    return (decomp_flags & TINFL_FLAG_HAS_MORE_INPUT) ? TINFL_STATUS_NEEDS_MORE_INPUT : TINFL_STATUS_FAILED;
+}
@@ -2,6 +2,9 @@
 #include "common.h"
 #include "module_aat.h"
 #include "logging.h"
+#include "recorder.h"
+#include "profiler.h"
+#include "aat_geo.h"
 
 #include <math.h>
 #include <Arduino.h>
@@ -11,89 +14,69 @@
 #include <ESP8266WiFi.h>
 #endif
 
-#define DEG2RAD(deg) ((deg) * M_PI / 180.0)
-#define RAD2DEG(rad) ((rad) * 180.0 / M_PI)
 #define DELAY_IDLE          (20U)   // sleep used when not tracking
 #define DELAY_FIRST_UPDATE  (5000U) // absolute delay before first servo update
 #define FONT_W              (6)     // Actually 5x7 + 1 pixel space
 #define FONT_H              (8)
+// Target predictor gains, out of 256
+#define AAT_TRACK_ALPHA     (192)   // position correction from the fix
+#define AAT_TRACK_BETA      (64)    // velocity correction from the fix
+#define AAT_TRACK_GPS_VEL   (128)   // pull towards the GPS ground velocity
+#define AAT_TRACK_MAX_PREDICT_MS (3000)
 
-static void calcDistAndAzimuth(int32_t srcLat, int32_t srcLon, int32_t dstLat, int32_t dstLon,
-    uint32_t *out_dist, uint32_t *out_azimuth)
-{
-    // https://www.movable-type.co.uk/scripts/latlong.html
-    // https://www.igismap.com/formula-to-find-bearing-or-heading-angle-between-two-points-latitude-longitude/
-
-    // Have to use doubles for at least some of these, due to short distances getting rounded
-    // particularly cos(deltaLon) for <2000 m rounds to 1.0000000000
-    double deltaLon = DEG2RAD((float)(dstLon - srcLon) / 1e7);
-    double thetaA = DEG2RAD((float)srcLat / 1e7);
-    double thetaB = DEG2RAD((float)dstLat / 1e7);
-    double cosThetaA = cos(thetaA);
-    double cosThetaB = cos(thetaB);
-    double sinThetaA = sin(thetaA);
-    double sinThetaB = sin(thetaB);
-    double cosDeltaLon = cos(deltaLon);
-    double sinDeltaLon = sin(deltaLon);
-
-    if (out_dist)
-    {
-        const double R = 6371e3;
-        double dist = acos(sinThetaA * sinThetaB + cosThetaA * cosThetaB * cosDeltaLon) * R;
-        *out_dist = (uint32_t)dist;
-    }
-
-    if (out_azimuth)
-    {
-        double X = cosThetaB * sinDeltaLon;
-        double Y = cosThetaA * sinThetaB - sinThetaA * cosThetaB * cosDeltaLon;
-
-        // Convert to degrees, normalized to 0-360
-        uint32_t hdg = RAD2DEG(atan2(X, Y));
-        *out_azimuth = (hdg + 360) % 360;
-    }
+VbatSampler::VbatSampler() :
+    _sum(0), _cnt(0), _adc(0), _ready(false), _value(0), _low(false)
+{
 }
 
-static int32_t calcElevation(uint32_t distance, int32_t altitude)
+void VbatSampler::begin()
 {
-    return RAD2DEG(atan2(altitude, distance));
+    // Sampled off a timer so readings cost the loop nothing, spaced out because
+    // back to back ADC reads on the ESP8266 upset the WiFi
+    _ticker.attach_ms(VBAT_SAMPLE_INTERVAL_MS, [this]() { sample(); });
 }
 
-VbatSampler::VbatSampler() :
-    _lastUpdate(0), _value(0), _sum(0), _cnt(0)
+void VbatSampler::sample()
 {
+    _sum += analogRead(A0);
+    if (++_cnt < VBAT_OVERSAMPLE)
+        return;
+
+    _adc = _sum;
+    _ready = true;
+    _sum = 0;
+    _cnt = 0;
 }
 
 void VbatSampler::update(uint32_t now)
 {
-    if (_lastUpdate != 0 && now - _lastUpdate < VBAT_UPDATE_INTERVAL)
+    if (!_ready)
         return;
-    _lastUpdate = now;
-
-    uint32_t adc = analogRead(A0);
-    _sum += adc;
-    ++_cnt;
-
-    if (_cnt >= VBAT_UPDATE_COUNT)
-    {
-        adc = _sum / _cnt;
-        // For negative offsets, anything between abs(OFFSET) and 0 is considered 0
-        if ((config.GetVbatOffset() < 0 && (int32_t)adc <= -config.GetVbatOffset())
-            || config.GetVbatScale() == 0)
-            _value = 0;
-        else
-            _value = ((int32_t)adc - config.GetVbatOffset()) * 100 / config.GetVbatScale();
-
-        _sum = 0;
-        _cnt = 0;
-    }
+    _ready = false;
+
+    // Keep the oversampled resolution through the scaling
+    int32_t adc = _adc;
+    int32_t offset = config.GetVbatOffset() * (int32_t)VBAT_OVERSAMPLE;
+    // For negative offsets, anything between abs(OFFSET) and 0 is considered 0
+    if ((offset < 0 && adc <= -offset) || config.GetVbatScale() == 0)
+        _value = 0;
+    else
+        _value = (adc - offset) * 100 / (config.GetVbatScale() * (int32_t)VBAT_OVERSAMPLE);
+
+    if (AAT_VBAT_LOW == 0 || _value == 0)
+        _low = false;
+    else if (_value < AAT_VBAT_LOW)
+        _low = true;
+    else if (_value >= AAT_VBAT_LOW + VBAT_LOW_HYSTERESIS)
+        _low = false;
 }
 
 AatModule::AatModule(Stream &port) :
-    CrsfModuleBase(port), _gpsLast{0}, _home{0},
+    CrsfModuleBase(port), _gpsLast{0}, _gpsSourceLatencyMs{0}, _home{0},
+    _homeCosLat(65536), _homeSinLat(0), _track{},
     _gpsAvgUpdateIntervalMs(0), _lastServoUpdateMs(0), _targetDistance(0),
     _targetAzim(0), _targetElev(0), _azimMsPerDegree(0),
-    _servoPos{0}, _lastAzimFlipMs(0)
+    _servoPos{0}, _servoTarget{0}, _lastServoFrameUs(0), _lastAzimFlipMs(0)
 #if defined(PIN_SERVO_AZIM)
     , _servo_Azim()
 #endif
@@ -101,7 +84,8 @@ AatModule::AatModule(Stream &port) :
     , _servo_Elev()
 #endif
 #if defined(PIN_OLED_SDA)
-    , _display(SCREEN_WIDTH, SCREEN_HEIGHT), _lastDisplayActiveMs(0)
+    , _display(SCREEN_WIDTH, SCREEN_HEIGHT, &Wire, -1, SCREEN_I2C_CLOCK, SCREEN_I2C_CLOCK), _lastDisplayActiveMs(0),
+    _displayNextPage(0), _displaySynced(false)
 #endif
 {
     // Init is called manually
@@ -120,21 +104,58 @@ void AatModule::Init()
     _servoPos[IDX_ELEV] = (config.GetAatServoLow(IDX_ELEV) + config.GetAatServoHigh(IDX_ELEV)) / 2;
 #if defined(PIN_SERVO_ELEV)
     _servo_Elev.attach(PIN_SERVO_ELEV, 500, 2500, _servoPos[IDX_ELEV]);
+#endif
+    for (uint32_t idx=IDX_AZIM; idx<IDX_COUNT; ++idx)
+        _trajectory[idx].reset(_servoPos[idx]);
+#if defined(PIN_SERVO_AZIM) || defined(PIN_SERVO_ELEV)
+    _lastServoFrameUs = micros();
+    _servoTicker.attach_ms(1000U / AAT_SERVO_FRAME_HZ, [this]() { servoFrame(); });
 #endif
 #if defined(PIN_OLED_SDA)
     displayInit();
 #endif
+    _vbat.begin();
     ModuleBase::Init();
 }
 
-void AatModule::SendGpsTelemetry(crsf_packet_gps_t *packet)
+void AatModule::SendGpsTelemetry(crsf_packet_gps_t *packet, GpsSource source)
 {
-    _gpsLast.lat = be32toh(packet->p.lat);
-    _gpsLast.lon = be32toh(packet->p.lon);
+    uint32_t now = millis();
+    int32_t lat = be32toh(packet->p.lat);
+    int32_t lon = be32toh(packet->p.lon);
+    int32_t altitude = (int32_t)be16toh(packet->p.altitude) - 1000;
+
+    // The same fix arriving again over another link tells how much slower that link is
+    const uint32_t GPS_DUPLICATE_WINDOW_MS = 1000U;
+    // A repeat over the same link is taken as a new fix, the position just did not change
+    if (source != _gpsLast.source && now - _gpsLast.arrivalMs < GPS_DUPLICATE_WINDOW_MS
+        && lat == _gpsLast.lat && lon == _gpsLast.lon && altitude == _gpsLast.altitude)
+    {
+        int32_t behind = _gpsSourceLatencyMs[_gpsLast.source] + (int32_t)(now - _gpsLast.arrivalMs);
+        _gpsSourceLatencyMs[source] += (behind - _gpsSourceLatencyMs[source]) / 4;
+        // Keep the quickest link at 0
+        int32_t quickest = _gpsSourceLatencyMs[0];
+        for (uint8_t i = 1; i < GPS_SOURCE_COUNT; ++i)
+            quickest = min(quickest, _gpsSourceLatencyMs[i]);
+        for (uint8_t i = 0; i < GPS_SOURCE_COUNT; ++i)
+            _gpsSourceLatencyMs[i] -= quickest;
+        return;
+    }
+
+    // A fix older than the last one used, delivered late by a slower link
+    uint32_t fixMs = now - AAT_GPS_LATENCY_MS - _gpsSourceLatencyMs[source];
+    if (_gpsLast.lastUpdateMs != 0 && (int32_t)(fixMs - _gpsLast.lastUpdateMs) <= 0)
+        return;
+
+    _gpsLast.lat = lat;
+    _gpsLast.lon = lon;
     _gpsLast.speed = be16toh(packet->p.speed);
     _gpsLast.heading = be16toh(packet->p.heading);
-    _gpsLast.altitude = (int32_t)be16toh(packet->p.altitude) - 1000;
+    _gpsLast.altitude = altitude;
     _gpsLast.satcnt = packet->p.satcnt;
+    _gpsLast.fixMs = fixMs;
+    _gpsLast.arrivalMs = now;
+    _gpsLast.source = source;
 
     //DBGLN("GPS: (%d,%d) %dm %usats", _gpsLast.lat, _gpsLast.lon,
     //    _gpsLast.altitude, _gpsLast.satcnt);
@@ -170,9 +191,9 @@ void AatModule::processGps(uint32_t now)
         return;
     _gpsLast.updated = false;
 
-    // Actually want to track time between _processing_ each GPS update
-    uint32_t interval = now - _gpsLast.lastUpdateMs;
-    _gpsLast.lastUpdateMs = now;
+    // Time between the fixes being taken, not between them arriving or being processed
+    uint32_t interval = _gpsLast.fixMs - _gpsLast.lastUpdateMs;
+    _gpsLast.lastUpdateMs = _gpsLast.fixMs;
 
     // Check if need to set home position
     bool didSetHome = false;
@@ -184,6 +205,8 @@ void AatModule::processGps(uint32_t now)
             _home.lat = _gpsLast.lat;
             _home.lon = _gpsLast.lon;
             _home.alt = _gpsLast.altitude;
+            _homeCosLat = cos(DEG2RAD(_home.lat / 1e7)) * 65536;
+            _homeSinLat = sin(DEG2RAD(_home.lat / 1e7)) * 65536;
             DBGLN("GPS Home set to (%d,%d)", _home.lat, _home.lon);
         }
         else
@@ -192,7 +215,19 @@ void AatModule::processGps(uint32_t now)
 
     uint32_t azimuth;
     uint32_t distance;
-    calcDistAndAzimuth(_home.lat, _home.lon, _gpsLast.lat, _gpsLast.lon, &distance, &azimuth);
+    int32_t east, north;
+    bool flat = calcEnuFlat(_home.lat, _home.lon, _gpsLast.lat, _gpsLast.lon, _homeCosLat, _homeSinLat, &east, &north);
+    if (flat && calcEnuDist(east, north) <= AAT_FLAT_EARTH_MAX_M * 1000U)
+    {
+        distance = calcEnuDist(east, north) / 1000;
+        azimuth = calcEnuAzimuth(east, north);
+        trackUpdate(_gpsLast.fixMs, east, north, (_gpsLast.altitude - _home.alt) * 1000, didSetHome);
+    }
+    else
+    {
+        calcDistAndAzimuth(_home.lat, _home.lon, _gpsLast.lat, _gpsLast.lon, &distance, &azimuth);
+        _track.valid = false;
+    }
     uint8_t elevation = constrain(calcElevation(distance, _gpsLast.altitude - _home.alt), 0, 90);
     DBGLN("Azimuth: %udeg Elevation: %udeg Distance: %um", azimuth, elevation, distance);
 
@@ -209,13 +244,94 @@ void AatModule::processGps(uint32_t now)
     _targetDistance = distance;
     _targetElev = elevation;
     _targetAzim = azimuth;
+    traceEvent(TRACE_GPS_FIX, _gpsLast.satcnt, azimuth, distance);
+}
+
+void AatModule::trackUpdate(uint32_t now, int32_t east, int32_t north, int32_t up, bool reset)
+{
+    // Ground velocity straight from the receiver, km/h * 10 to mm/s
+    float heading = DEG2RAD(_gpsLast.heading / 100.0f);
+    int32_t speed = _gpsLast.speed * 1000 / 36;
+    int32_t gpsVel[2] = { (int32_t)(speed * sinf(heading)), (int32_t)(speed * cosf(heading)) };
+    int32_t meas[3] = { east, north, up };
+
+    int32_t dt = now - _track.lastMs;
+    if (reset || !_track.valid || dt <= 0 || dt > AAT_TRACK_MAX_PREDICT_MS)
+    {
+        // Start over from the fix, nothing is known about vertical speed yet
+        for (uint8_t i = 0; i < 3; ++i)
+            _track.pos[i] = meas[i];
+        _track.vel[0] = gpsVel[0];
+        _track.vel[1] = gpsVel[1];
+        _track.vel[2] = 0;
+    }
+    else
+    {
+        // Alpha-beta filter, the residual from the prediction corrects position
+        // and velocity, horizontal velocity is also pulled towards the GPS value
+        for (uint8_t i = 0; i < 3; ++i)
+        {
+            int32_t predicted = _track.pos[i] + (int64_t)_track.vel[i] * dt / 1000;
+            int32_t residual = meas[i] - predicted;
+            _track.pos[i] = predicted + (int64_t)residual * AAT_TRACK_ALPHA / 256;
+            _track.vel[i] += (int64_t)residual * 1000 * AAT_TRACK_BETA / 256 / dt;
+            if (i < 2)
+                _track.vel[i] += ((int64_t)gpsVel[i] - _track.vel[i]) * AAT_TRACK_GPS_VEL / 256;
+        }
+    }
+    _track.lastMs = now;
+    _track.valid = true;
+}
+
+bool AatModule::trackPredict(uint32_t now, int32_t *azim, int32_t *elev)
+{
+    if (!_track.valid)
+        return false;
+
+    // Coast on the last estimate for at most two GPS intervals
+    uint32_t elapsed = now - _track.lastMs;
+    uint32_t limit = _gpsAvgUpdateIntervalMs ? min(2 * _gpsAvgUpdateIntervalMs, (uint32_t)AAT_TRACK_MAX_PREDICT_MS) : 0;
+    elapsed = min(elapsed, limit);
+
+    int32_t pos[3];
+    for (uint8_t i = 0; i < 3; ++i)
+        pos[i] = _track.pos[i] + (int64_t)_track.vel[i] * elapsed / 1000;
+    uint32_t dist = calcEnuDist(pos[0], pos[1]);
+    // Too close to home for the angles to mean much
+    if (dist < 3000)
+        return false;
+    *azim = calcEnuAzimuth(pos[0], pos[1]);
+    *elev = constrain(atan2Centideg(pos[2], dist) / 100, 0, 90);
+    return true;
+}
+
+void AatModule::calcProjected(uint32_t now, int32_t *azim, int32_t *elev)
+{
+    *azim = _targetAzim;
+    *elev = _targetElev;
+    if (_isOverrideMode)
+        return;
+
+    int32_t trackAzim, trackElev;
+    if (trackPredict(now, &trackAzim, &trackElev))
+    {
+        if (config.GetAatProject() & AAT_PROJECT_AZIM)
+            *azim = trackAzim;
+        if (config.GetAatProject() & AAT_PROJECT_ELEV)
+            *elev = trackElev;
+    }
+    else if (config.GetAatProject() & AAT_PROJECT_AZIM)
+    {
+        // Out of range of the local frame, fall back to azimuth dead reckoning
+        *azim = calcProjectedAzim(now);
+    }
 }
 
 int32_t AatModule::calcProjectedAzim(uint32_t now)
 {
     // Attempt to do a linear projection of the last
     // If enabled, we know the GPS update rate, the azimuth has changed, and more than a few meters away
-    if (config.GetAatProject() && _gpsAvgUpdateIntervalMs && _azimMsPerDegree && _targetDistance > 3)
+    if ((config.GetAatProject() & AAT_PROJECT_AZIM) && _gpsAvgUpdateIntervalMs && _azimMsPerDegree && _targetDistance > 3)
     {
         uint32_t elapsed = constrain(now - _gpsLast.lastUpdateMs, 0U, _gpsAvgUpdateIntervalMs);
 
@@ -286,7 +402,7 @@ void AatModule::displayState()
     _display.print(VERSION);
 
     displayVBat();
-    _display.display();
+    displayFlush();
 }
 
 void AatModule::displayGpsIdle(uint32_t now)
@@ -306,7 +422,7 @@ void AatModule::displayGpsIdle(uint32_t now)
 
     displayGpsIntervalBar(now);
     displayVBat();
-    _display.display();
+    displayFlush();
 }
 
 void AatModule::displayAzimuthExtent(int32_t y)
@@ -466,7 +582,11 @@ void AatModule::displayVBat()
     if (_vbat.value() == 0)
         return;
 
-    _display.setTextColor(SSD1306_WHITE);
+    // Inverted while low, flashing at 1Hz
+    bool alarm = _vbat.isLow() && (millis() % 1000U) < 500U;
+    if (alarm)
+        _display.fillRect(SCREEN_WIDTH - 5*FONT_W - 1, FONT_H - 1, 5*FONT_W + 1, FONT_H + 1, SSD1306_WHITE);
+    _display.setTextColor(alarm ? SSD1306_BLACK : SSD1306_WHITE);
     _display.setTextSize(1);
     _display.setCursor(SCREEN_WIDTH - 5*FONT_W, FONT_H);
     _display.printf("%2d.%1dV", _vbat.value() / 10, _vbat.value() % 10);
@@ -488,7 +608,7 @@ void AatModule::displayActive(uint32_t now, int32_t projectedAzim)
     displayTargetDistance();
     displayVBat();
 
-    _display.display();
+    displayFlush();
 }
 
 void AatModule::displayGpsIntervalBar(uint32_t now)
@@ -513,6 +633,78 @@ void AatModule::displayGpsIntervalBar(uint32_t now)
         _display.fillRect(SCREEN_WIDTH-pxWidth, 0, pxWidth, 2, SSD1306_WHITE);
     }
 }
+
+/***
+ * @brief: Send the parts of the framebuffer that differ from what is on the panel
+ *
+ * Each 8 pixel page is compared with a copy of what was last sent and only the
+ * changed column span goes out over I2C, at most DISPLAY_FLUSH_BYTES per call,
+ * so a full screen change is spread over a few updates instead of stalling the
+ * loop for the whole 1KB blit.
+ */
+void AatModule::displayFlush()
+{
+    uint8_t *buffer = _display.getBuffer();
+    if (!_displaySynced)
+    {
+        // Panel RAM is unknown after begin()
+        _display.display();
+        memcpy(_displaySent, buffer, sizeof(_displaySent));
+        _displaySynced = true;
+        return;
+    }
+
+    const uint32_t DISPLAY_PAGES = SCREEN_HEIGHT / 8;
+    const int32_t DISPLAY_FLUSH_BYTES = 384;
+    int32_t budget = DISPLAY_FLUSH_BYTES;
+    for (uint32_t n = 0; n < DISPLAY_PAGES && budget > 0; ++n)
+    {
+        uint32_t page = (_displayNextPage + n) % DISPLAY_PAGES;
+        const uint8_t *row = &buffer[page * SCREEN_WIDTH];
+        uint8_t *sent = &_displaySent[page * SCREEN_WIDTH];
+
+        int32_t first = 0;
+        int32_t last = SCREEN_WIDTH - 1;
+        while (first <= last && row[first] == sent[first])
+            ++first;
+        if (first > last)
+            continue;
+        while (row[last] == sent[last])
+            --last;
+        // Out of budget, the rest of this page goes first next time
+        last = min(last, first + budget - 1);
+
+        displaySendSpan(page, first, last, &row[first]);
+        memcpy(&sent[first], &row[first], last - first + 1);
+        budget -= last - first + 1;
+        _displayNextPage = (budget > 0) ? (page + 1) % DISPLAY_PAGES : page;
+    }
+}
+
+void AatModule::displaySendSpan(uint8_t page, uint8_t first, uint8_t last, const uint8_t *data)
+{
+    // The panel is in horizontal addressing mode, so the data fills the window column by column
+    Wire.beginTransmission(SCREEN_ADDRESS);
+    Wire.write((uint8_t)0x00); // Co = 0, D/C = 0: command stream
+    Wire.write(SSD1306_PAGEADDR);
+    Wire.write(page);
+    Wire.write(page);
+    Wire.write(SSD1306_COLUMNADDR);
+    Wire.write(first);
+    Wire.write(last);
+    Wire.endTransmission();
+
+    // Keep each transfer inside the Wire buffer, less one for the control byte
+    const uint32_t DISPLAY_I2C_CHUNK = 31;
+    uint32_t len = last - first + 1;
+    for (uint32_t pos = 0; pos < len; pos += DISPLAY_I2C_CHUNK)
+    {
+        Wire.beginTransmission(SCREEN_ADDRESS);
+        Wire.write((uint8_t)0x40); // Co = 0, D/C = 1: data stream
+        Wire.write(&data[pos], min(len - pos, DISPLAY_I2C_CHUNK));
+        Wire.endTransmission();
+    }
+}
 #endif /* defined(PIN_OLED_SDA) */
 
 void AatModule::servoApplyMode(int32_t azim, int32_t elev, int32_t newServoPos[])
@@ -565,17 +757,21 @@ void AatModule::servoUpdate(uint32_t now)
     if (!config.GetAatServoEndpointsValid())
         return;
 
-    int32_t projectedAzim = calcProjectedAzim(now);
+    int32_t projectedAzim, projectedElev;
+    calcProjected(now, &projectedAzim, &projectedElev);
     int32_t newServoPos[IDX_COUNT];
-    servoApplyMode(projectedAzim, _targetElev, newServoPos);
+    servoApplyMode(projectedAzim, projectedElev, newServoPos);
+
+    // Use smoothness to denote the maximum us per 10ms, the trajectory limits are per second
+    const int32_t SMOOTHNESS_US_PER_STEP = (config.GetAatServoSmooth() < 3) ? 6 : 4;
+    const int32_t maxVel = (10 - config.GetAatServoSmooth()) * SMOOTHNESS_US_PER_STEP * 100;
+    _trajectory[IDX_AZIM].setLimits(maxVel, AAT_SERVO_ACCEL_AZIM);
+    _trajectory[IDX_ELEV].setLimits(maxVel, AAT_SERVO_ACCEL_ELEV);
 
     for (uint32_t idx=IDX_AZIM; idx<IDX_COUNT; ++idx)
     {
-        // Use smoothness to denote the maximum us per 10ms update
-        const int32_t SMOOTHNESS_US_PER_STEP = (config.GetAatServoSmooth() < 3) ? 6 : 4;
         int32_t range = (config.GetAatServoHigh(idx) - config.GetAatServoLow(idx));
         int32_t diff = newServoPos[idx] - _servoPos[idx];
-        int32_t maxDiff = (10 - config.GetAatServoSmooth()) * SMOOTHNESS_US_PER_STEP;
         // If the distance the servo needs to go is more than 80% away
         // jump immediately. otherwise smooth it
         if (idx == IDX_AZIM && (abs(diff) * 100 / range) > 80)
@@ -585,29 +781,54 @@ void AatModule::servoUpdate(uint32_t now)
             const uint32_t AZIM_FLIP_MIN_DELAY = 2000U;
             if (now - _lastAzimFlipMs > AZIM_FLIP_MIN_DELAY)
             {
-                _servoPos[idx] = newServoPos[idx];
+                _trajectory[idx].reset(newServoPos[idx]);
                 _lastAzimFlipMs = now;
             }
-            else if (diff < 0)
-                _servoPos[idx] = constrain(_servoPos[idx] + maxDiff, _servoPos[idx], config.GetAatServoHigh(idx));
             else
-                _servoPos[idx] = constrain(_servoPos[idx] - maxDiff, config.GetAatServoLow(idx), _servoPos[idx]);
+                newServoPos[idx] = (diff < 0) ? config.GetAatServoHigh(idx) : config.GetAatServoLow(idx);
         }
-        else
-            _servoPos[idx] += constrain(diff, -maxDiff, maxDiff);
+        _trajectory[idx].setTarget(newServoPos[idx]);
     }
     //DBGLN("t=%u pro=%d us=%d smoo=%d", _targetAzim, projectedAzim, newServoPos[IDX_AZIM], _servoPos[IDX_AZIM]);
+    // Only target changes are recorded, a stationary tracker would flood the recorder at 100Hz
+    if (newServoPos[IDX_AZIM] != _servoTarget[IDX_AZIM] || newServoPos[IDX_ELEV] != _servoTarget[IDX_ELEV])
+    {
+        traceEvent(TRACE_SERVO_TARGET, 0, newServoPos[IDX_AZIM], newServoPos[IDX_ELEV]);
+        _servoTarget[IDX_AZIM] = newServoPos[IDX_AZIM];
+        _servoTarget[IDX_ELEV] = newServoPos[IDX_ELEV];
+    }
+
+#if defined(PIN_OLED_SDA)
+    displayActive(now, projectedAzim);
+#endif
+}
+
+/***
+ * @brief: Step the servo trajectories and output the new positions, called from
+ * _servoTicker every servo frame so the motion does not depend on when loop() runs
+ */
+void AatModule::servoFrame()
+{
+    uint32_t now = micros();
+    // A frame held off by something long running moves further, but never by more than a few frames
+    uint32_t dt = min(now - _lastServoFrameUs, 4000000U / AAT_SERVO_FRAME_HZ);
+    _lastServoFrameUs = now;
 
+    for (uint32_t idx=IDX_AZIM; idx<IDX_COUNT; ++idx)
+    {
+        int32_t pos = _trajectory[idx].step(dt);
+        if (pos == _servoPos[idx])
+            continue;
+        _servoPos[idx] = pos;
 #if defined(PIN_SERVO_AZIM)
-    _servo_Azim.writeMicroseconds(_servoPos[IDX_AZIM]);
+        if (idx == IDX_AZIM)
+            _servo_Azim.writeMicroseconds(pos);
 #endif
 #if defined(PIN_SERVO_ELEV)
-    _servo_Elev.writeMicroseconds(_servoPos[IDX_ELEV]);
-#endif
-
-#if defined(PIN_OLED_SDA)
-    displayActive(now, projectedAzim);
+        if (idx == IDX_ELEV)
+            _servo_Elev.writeMicroseconds(pos);
 #endif
+    }
 }
 
 uint32_t AatModule::getVbat()
@@ -615,6 +836,35 @@ uint32_t AatModule::getVbat()
     return _vbat.value();
 }
 
+void AatModule::getTelemetry(aatTelemetry_t *telem, uint32_t now)
+{
+    telem->version = AAT_TELEMETRY_VERSION;
+    telem->flags = (isHomeSet() ? AAT_TELEMETRY_FLAG_HOME : 0)
+        | (_isOverrideMode ? AAT_TELEMETRY_FLAG_OVERRIDE : 0)
+        | (isGpsActive() ? AAT_TELEMETRY_FLAG_GPS : 0)
+        | (_vbat.isLow() ? AAT_TELEMETRY_FLAG_VBAT_LOW : 0);
+    telem->lat = _gpsLast.lat;
+    telem->lon = _gpsLast.lon;
+    telem->altitude = _gpsLast.altitude;
+    telem->speed = _gpsLast.speed;
+    telem->heading = _gpsLast.heading;
+    telem->satcnt = _gpsLast.satcnt;
+    telem->homeLat = _home.lat;
+    telem->homeLon = _home.lon;
+    telem->homeAlt = _home.alt;
+    telem->targetDistance = _targetDistance;
+    telem->targetAzim = _targetAzim;
+    telem->targetElev = _targetElev;
+    int32_t projectedAzim, projectedElev;
+    calcProjected(now, &projectedAzim, &projectedElev);
+    telem->projectedAzim = projectedAzim;
+    telem->servoPos[IDX_AZIM] = _servoPos[IDX_AZIM];
+    telem->servoPos[IDX_ELEV] = _servoPos[IDX_ELEV];
+    telem->vbat = _vbat.value();
+    telem->gpsIntervalMs = _gpsAvgUpdateIntervalMs;
+    telem->gpsAgeMs = isGpsActive() ? min(now - _gpsLast.lastUpdateMs, (uint32_t)UINT16_MAX) : UINT16_MAX;
+}
+
 void AatModule::overrideTargetCommon(int32_t azimuth, int32_t elevation)
 {
     _targetAzim = azimuth;
@@ -622,6 +872,7 @@ void AatModule::overrideTargetCommon(int32_t azimuth, int32_t elevation)
 
     // Clear out other fields to not do projection or process any updates
     _isOverrideMode = true;
+    _track.valid = false;
     _gpsAvgUpdateIntervalMs = 0;
     _targetDistance = 0;
     _azimMsPerDegree = 0;
@@ -647,7 +898,7 @@ void AatModule::onCrsfPacketIn(const crsf_header_t *pkt)
     if (pkt->sync_byte == CRSF_SYNC_BYTE)
     {
         if (pkt->type == CRSF_FRAMETYPE_GPS)
-            SendGpsTelemetry((crsf_packet_gps_t *)pkt);
+            SendGpsTelemetry((crsf_packet_gps_t *)pkt, GPS_SOURCE_UART);
     }
 }
 
@@ -658,7 +909,7 @@ void AatModule::Loop(uint32_t now)
 
     if (isHomeSet() && now > DELAY_FIRST_UPDATE)
     {
-        servoUpdate(now);
+        PROFILE_CALL("aat_servoUpdate", servoUpdate(now));
     }
     else
     {
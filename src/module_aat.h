@@ -9,6 +9,8 @@
 #if defined(PIN_SERVO_AZIM) || defined(PIN_SERVO_ELEV)
 #include <Servo.h>
 #endif
+#include <Ticker.h>
+#include "servo_trajectory.h"
 
 #if defined(PIN_OLED_SDA)
 #include <Wire.h>
@@ -18,6 +20,18 @@
 #define SCREEN_WIDTH 128
 #define SCREEN_HEIGHT 64
 #define SCREEN_ADDRESS 0x3C
+#define SCREEN_I2C_CLOCK 400000UL
+#endif
+
+// Delay between a GPS fix and it arriving over the quickest link, the extra
+// delay of each slower link is measured from fixes that arrive over both
+#if !defined(AAT_GPS_LATENCY_MS)
+#define AAT_GPS_LATENCY_MS 0
+#endif
+
+// Battery voltage (V * 10) below which the low battery alarm shows, 0 disables it
+#if !defined(AAT_VBAT_LOW)
+#define AAT_VBAT_LOW 0
 #endif
 
 class VbatSampler
@@ -25,19 +39,73 @@ class VbatSampler
 public:
     VbatSampler();
 
+    void begin();
     void update(uint32_t now);
     // Reported in V * 10
     uint32_t value() const { return _value; }
+    // Below AAT_VBAT_LOW
+    bool isLow() const { return _low; }
 private:
-    const uint32_t VBAT_UPDATE_INTERVAL = 100U;
-    const uint32_t VBAT_UPDATE_COUNT = 5U;
+    static const uint32_t VBAT_SAMPLE_INTERVAL_MS = 20U;
+    static const uint32_t VBAT_OVERSAMPLE = 16U; // samples per reading
+    static const uint32_t VBAT_LOW_HYSTERESIS = 2U; // V * 10
 
-    uint32_t _lastUpdate;
-    uint32_t _value;
-    uint32_t _sum;  // in progress sum/count
+    void sample();
+
+    Ticker _ticker;
+    uint32_t _sum;  // in progress sum/count, only touched from sample()
     uint32_t _cnt;
+    volatile uint32_t _adc; // last completed sum of VBAT_OVERSAMPLE readings
+    volatile bool _ready;
+    uint32_t _value;
+    bool _low;
 };
 
+// Bits of the project config field
+#define AAT_PROJECT_AZIM (1 << 0)
+#define AAT_PROJECT_ELEV (1 << 1)
+
+// Rate the servo trajectory is stepped at, independent of loop()
+#if !defined(AAT_SERVO_FRAME_HZ)
+#define AAT_SERVO_FRAME_HZ 50
+#endif
+// Servo acceleration limits in us/s^2, the velocity limit comes from the smoothness setting
+#if !defined(AAT_SERVO_ACCEL_AZIM)
+#define AAT_SERVO_ACCEL_AZIM 8000
+#endif
+#if !defined(AAT_SERVO_ACCEL_ELEV)
+#define AAT_SERVO_ACCEL_ELEV 8000
+#endif
+
+#define AAT_TELEMETRY_VERSION 1
+#define AAT_TELEMETRY_FLAG_HOME     (1 << 0)
+#define AAT_TELEMETRY_FLAG_OVERRIDE (1 << 1)
+#define AAT_TELEMETRY_FLAG_GPS      (1 << 2)
+#define AAT_TELEMETRY_FLAG_VBAT_LOW (1 << 3)
+
+// Snapshot of the tracker state pushed to the web UI, little endian
+typedef struct __attribute__((packed)) {
+    uint8_t  version;
+    uint8_t  flags;          // AAT_TELEMETRY_FLAG_*
+    int32_t  lat;            // degrees * 1e7
+    int32_t  lon;            // degrees * 1e7
+    int32_t  altitude;       // meters
+    uint16_t speed;          // km/h * 10
+    uint16_t heading;        // degrees * 100
+    uint8_t  satcnt;
+    int32_t  homeLat;        // degrees * 1e7
+    int32_t  homeLon;        // degrees * 1e7
+    int32_t  homeAlt;        // meters
+    uint32_t targetDistance; // meters
+    uint16_t targetAzim;     // degrees
+    uint8_t  targetElev;     // degrees
+    uint16_t projectedAzim;  // degrees
+    uint16_t servoPos[2];    // us, azimuth then elevation
+    uint16_t vbat;           // V * 10
+    uint16_t gpsIntervalMs;  // average time between GPS updates
+    uint16_t gpsAgeMs;       // time since the last GPS update
+} aatTelemetry_t;
+
 class AatModule : public CrsfModuleBase
 {
 public:
@@ -47,13 +115,15 @@ public:
     void Init();
     void Loop(uint32_t now);
 
-    void SendGpsTelemetry(crsf_packet_gps_t *packet);
+    void SendGpsTelemetry(crsf_packet_gps_t *packet, GpsSource source);
     bool isHomeSet() const { return _home.lat != 0 || _home.lon != 0 || _isOverrideMode; }
     bool isGpsActive() const { return _gpsLast.lastUpdateMs != 0; };
 
     void overrideTargetBearing(int32_t bearing);
     void overrideTargetElev(int32_t elev);
     uint32_t getVbat();
+    bool isVbatLow() const { return _vbat.isLow(); }
+    void getTelemetry(aatTelemetry_t *telem, uint32_t now);
 protected:
     void overrideTargetCommon(int32_t azimuth, int32_t elevation);
     virtual void onCrsfPacketIn(const crsf_header_t *pkt);
@@ -65,9 +135,13 @@ private:
     void updateGpsInterval(uint32_t interval);
     uint8_t calcGpsIntervalPct(uint32_t now);
     int32_t calcProjectedAzim(uint32_t now);
+    void trackUpdate(uint32_t now, int32_t east, int32_t north, int32_t up, bool reset);
+    bool trackPredict(uint32_t now, int32_t *azim, int32_t *elev);
+    void calcProjected(uint32_t now, int32_t *azim, int32_t *elev);
     void servoApplyMode(int32_t azim, int32_t elev, int32_t newServoPos[]);
     void processGps(uint32_t now);
     void servoUpdate(uint32_t now);
+    void servoFrame();
     const int32_t azimToBearing(int32_t azim) const;
 
 #if defined(PIN_OLED_SDA)
@@ -81,23 +155,38 @@ private:
     void displayTargetCircle(int32_t projectedAzim);
     void displayTargetDistance();
     void displayVBat();
+    void displayFlush();
+    void displaySendSpan(uint8_t page, uint8_t first, uint8_t last, const uint8_t *data);
 #endif
 
     struct {
         int32_t lat;
         int32_t lon;
         uint32_t speed;   // km/h * 10
-        uint32_t heading; // degrees * 10
+        uint32_t heading; // degrees * 100
         int32_t altitude; // meters
         uint32_t lastUpdateMs; // timestamp of last update
+        uint32_t fixMs;   // when the pending fix was taken, arrival less the source latency
+        uint32_t arrivalMs; // when the pending fix arrived
+        GpsSource source; // link the pending fix arrived over
         uint8_t satcnt;   // number of satellites
         bool updated;
     } _gpsLast;
+    int32_t _gpsSourceLatencyMs[GPS_SOURCE_COUNT]; // how much later than the quickest link each delivers
     struct {
         int32_t lat;
         int32_t lon;
         int32_t alt;
     } _home;
+    int32_t _homeCosLat; // cos(_home.lat) Q16, for the flat earth distance
+    int32_t _homeSinLat; // sin(_home.lat) Q16
+    // Target estimate in the east/north/up frame around _home
+    struct {
+        int32_t pos[3];  // mm
+        int32_t vel[3];  // mm/s
+        uint32_t lastMs; // time of the last fix folded in
+        bool valid;
+    } _track;
     uint32_t _gpsAvgUpdateIntervalMs;
     // Servo Position
     uint32_t _lastServoUpdateMs;
@@ -107,6 +196,9 @@ private:
     bool    _isOverrideMode;
     int32_t _azimMsPerDegree; // milliseconds per degree
     int32_t _servoPos[IDX_COUNT]; // smoothed azim servo output us
+    int32_t _servoTarget[IDX_COUNT]; // us the trajectory is heading for
+    ServoTrajectory _trajectory[IDX_COUNT];
+    uint32_t _lastServoFrameUs;
     uint32_t _lastAzimFlipMs;
     VbatSampler _vbat;
 
@@ -116,9 +208,15 @@ private:
 #if defined(PIN_SERVO_ELEV)
     Servo _servo_Elev;
 #endif
+#if defined(PIN_SERVO_AZIM) || defined(PIN_SERVO_ELEV)
+    Ticker _servoTicker;
+#endif
 #if defined(PIN_OLED_SDA)
     Adafruit_SSD1306 _display;
     uint32_t _lastDisplayActiveMs;
+    uint8_t _displaySent[SCREEN_WIDTH * SCREEN_HEIGHT / 8]; // framebuffer as last sent to the panel
+    uint8_t _displayNextPage; // page the next flush starts comparing at
+    bool _displaySynced; // _displaySent matches the panel
 #endif
 };
 
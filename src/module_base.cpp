@@ -5,6 +5,7 @@
 #include "device.h"
 #include "msptypes.h"
 #include "logging.h"
+#include "stats.h"
 
 void RebootIntoWifi();
 bool BindingExpired(uint32_t now);
@@ -17,8 +18,20 @@ ModuleBase::Init()
 {
 }
 
-void
+bool
 ModuleBase::SendIndexCmd(uint8_t index)
+{
+    return false;
+}
+
+bool
+ModuleBase::SendFrequencyCmd(uint16_t mhz)
+{
+    return false;
+}
+
+void
+ModuleBase::StartChannelSweep(uint8_t dwellMs)
 {
 }
 
@@ -52,6 +65,11 @@ ModuleBase::SendBatteryTelemetry(uint8_t *rawCrsfPacket)
 {
 }
 
+void
+ModuleBase::SendGpsTelemetry(crsf_packet_gps_t *packet, GpsSource source)
+{
+}
+
 void
 ModuleBase::Loop(uint32_t now)
 {
@@ -83,7 +101,11 @@ MSPModuleBase::Loop(uint32_t now)
         {
             // process the packet
             mspPacket_t *packet = msp.getReceivedPacket();
-            if (packet->function == MSP_ELRS_BACKPACK_SET_MODE)
+            if (completeRequest(packet))
+            {
+                // a reply to something we asked for
+            }
+            else if (packet->function == MSP_ELRS_BACKPACK_SET_MODE)
             {
                 if (packet->payloadSize == 1)
                 {
@@ -98,7 +120,7 @@ MSPModuleBase::Loop(uint32_t now)
                     {
                         DBGLN("Enter WIFI mode...");
                         connectionState = wifiUpdate;
-                        devicesTriggerEvent();
+                        devicesTriggerEvent(EVENT_WIFI_REQUEST);
                     }
                     // send "in-progress" response
                     sendResponse(MSP_ELRS_BACKPACK_SET_MODE, (const uint8_t *)"P", 1);
@@ -118,26 +140,131 @@ MSPModuleBase::Loop(uint32_t now)
                 memcpy(&response[1], firmwareOptions.uid, 6);
                 sendResponse(MSP_ELRS_BACKPACK_GET_STATUS, response, sizeof(response));
             }
+            else if (packet->function == MSP_ELRS_BACKPACK_GET_LATENCY)
+            {
+                uint8_t probe = packet->readByte();
+                if (probe < LATENCY_PROBE_COUNT)
+                {
+                    uint8_t response[MSP_PORT_INBUF_SIZE];
+                    sendResponse(MSP_ELRS_BACKPACK_GET_LATENCY, response, latencySerialize((latencyProbe_e)probe, response));
+                }
+            }
+            else if (packet->function == MSP_ELRS_BACKPACK_GET_BOOT_TIMING)
+            {
+                uint8_t response[MSP_PORT_INBUF_SIZE];
+                sendResponse(MSP_ELRS_BACKPACK_GET_BOOT_TIMING, response, bootSerialize(response));
+            }
+            else if (packet->function == MSP_ELRS_BACKPACK_GET_LINK_STATS)
+            {
+                uint8_t response[MSP_PORT_INBUF_SIZE];
+                sendResponse(MSP_ELRS_BACKPACK_GET_LINK_STATS, response, linkStatsSerialize(packet->readByte(), response));
+            }
+            else if (packet->function == MSP_ELRS_BACKPACK_GET_MEMORY)
+            {
+                uint8_t response[MSP_PORT_INBUF_SIZE];
+                sendResponse(MSP_ELRS_BACKPACK_GET_MEMORY, response, memorySerialize(packet->readByte(), response));
+            }
             else if (packet->function == MSP_ELRS_BACKPACK_SET_PTR && headTrackingEnabled)
             {
-                  sendMSPViaEspnow(packet);
+                ptrMailbox.post(packet, msp.getReceivedTime());
             }
             msp.markPacketReceived();
         }
     }
+
+    expireRequests(now);
+
+    // Only the newest PTR sample read in this pass is worth sending
+    mspPacket_t ptrPacket;
+    if (ptrMailbox.take(&ptrPacket, micros()))
+    {
+        sendMSPViaEspnow(&ptrPacket);
+        latencyRecord(LATENCY_PTR, ptrMailbox.latency());
+    }
 }
 
 
 void
 MSPModuleBase::sendResponse(uint16_t function, const uint8_t *response, uint32_t responseSize)
 {
+    if (responseSize > MSP_PORT_INBUF_SIZE)
+    {
+        DBGLN("MSP response %x too large (%u bytes), not sent", function, responseSize);
+        return;
+    }
     mspPacket_t packet;
     packet.reset();
     packet.makeResponse();
     packet.function = function;
-    for (uint32_t i = 0 ; i < responseSize ; i++)
+    packet.payloadSize = responseSize;
+    memcpy(packet.payload, response, packet.payloadSize);
+    msp.sendPacket(&packet, m_port);
+}
+
+bool
+MSPModuleBase::sendRequest(mspPacket_t *packet, uint32_t timeoutMs, const mspPacketCallback_t &onReply)
+{
+    PendingRequest *request = nullptr;
+    for (uint8_t i = 0; i < m_pendingCount; i++)
+    {
+        if (m_pending[i].function == packet->function)
+        {
+            request = &m_pending[i];
+        }
+    }
+    if (request == nullptr)
     {
-        packet.addByte(response[i]);
+        if (m_pendingCount == MSP_MODULE_PENDING_REQUESTS)
+        {
+            DBGLN("MSP request table full, dropping request %x", packet->function);
+            return false;
+        }
+        request = &m_pending[m_pendingCount++];
+    }
+
+    request->function = packet->function;
+    request->sentAt = millis();
+    request->timeoutMs = timeoutMs;
+    request->onReply = onReply;
+    msp.sendPacket(packet, m_port);
+    return true;
+}
+
+/***
+ * @brief: Hand a received packet to the request waiting on it, if any
+ * @return: true if the packet was a reply
+ */
+bool
+MSPModuleBase::completeRequest(mspPacket_t *packet)
+{
+    for (uint8_t i = 0; i < m_pendingCount; i++)
+    {
+        if (m_pending[i].function == packet->function)
+        {
+            // Free the slot first, the callback may send the next request
+            mspPacketCallback_t onReply = m_pending[i].onReply;
+            m_pending[i] = m_pending[--m_pendingCount];
+            onReply(packet);
+            return true;
+        }
+    }
+    return false;
+}
+
+void
+MSPModuleBase::expireRequests(uint32_t now)
+{
+    uint8_t i = 0;
+    while (i < m_pendingCount)
+    {
+        if (now - m_pending[i].sentAt < m_pending[i].timeoutMs)
+        {
+            i++;
+            continue;
+        }
+        DBGLN("MSP request %x timed out", m_pending[i].function);
+        mspPacketCallback_t onReply = m_pending[i].onReply;
+        m_pending[i] = m_pending[--m_pendingCount];
+        onReply(nullptr);
     }
-    msp.sendPacket(&packet, m_port);
 }
@@ -2,18 +2,36 @@
 
 #include <Arduino.h>
 #include "msp.h"
+#include "mspmailbox.h"
+#include "crsf_protocol.h"
+
+// Requests to an MSP device that can be waiting on a reply at once
+#define MSP_MODULE_PENDING_REQUESTS 4
+
+// Links a CRSF GPS fix can arrive over
+enum GpsSource { GPS_SOURCE_UART, GPS_SOURCE_ESPNOW, GPS_SOURCE_COUNT };
 
 class ModuleBase
 {
 public:
     void Init();
-    void SendIndexCmd(uint8_t index);
+    // Both return false if the module can not tune to the channel, or has no receiver to tune
+    bool SendIndexCmd(uint8_t index);
+    // Tune to any frequency, for modules that are not limited to the 48 channel table
+    bool SendFrequencyCmd(uint16_t mhz);
+    // True while the last SendIndexCmd() is still going out to the receiver
+    bool IndexCmdPending() { return false; }
+    // True if the receiver did not take the last channel, once it is no longer pending
+    bool IndexCmdFailed() { return false; }
+    // Step through every channel measuring RSSI, see MSP_ELRS_BACKPACK_GET_RSSI
+    void StartChannelSweep(uint8_t dwellMs);
     void SetRecordingState(uint8_t recordingState, uint16_t delay);
     void SetOSD(mspPacket_t *packet);
     void SendHeadTrackingEnableCmd(bool enable);
     void SetRTC();
     void SendLinkTelemetry(uint8_t *rawCrsfPacket);
     void SendBatteryTelemetry(uint8_t *rawCrsfPacket);
+    void SendGpsTelemetry(crsf_packet_gps_t *packet, GpsSource source);
     void Loop(uint32_t now);
 };
 
@@ -24,7 +42,27 @@ public:
     void Loop(uint32_t);
 
     void sendResponse(uint16_t function, const uint8_t *response, uint32_t responseSize);
+    // Send a request and return straight away. onReply is called from Loop() with
+    // the reply, or with nullptr if none came within timeoutMs. A request for a
+    // function already waiting on a reply replaces it
+    bool sendRequest(mspPacket_t *packet, uint32_t timeoutMs, const mspPacketCallback_t &onReply);
 
     Stream *m_port;
     MSP msp;
+    // Latest head-tracking sample from the goggles, sent ahead of anything else
+    MSPMailbox ptrMailbox;
+
+private:
+    struct PendingRequest
+    {
+        uint16_t function;
+        uint32_t sentAt;
+        uint32_t timeoutMs;
+        mspPacketCallback_t onReply;
+    };
+    PendingRequest m_pending[MSP_MODULE_PENDING_REQUESTS];
+    uint8_t m_pendingCount = 0;
+
+    bool completeRequest(mspPacket_t *packet);
+    void expireRequests(uint32_t now);
 };
\ No newline at end of file
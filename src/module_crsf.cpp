@@ -2,75 +2,79 @@
 
 void CrsfModuleBase::Loop(uint32_t now)
 {
-    while (_port.available())
+    int avail;
+    while ((avail = _port.available()) > 0)
     {
-        uint8_t b = _port.read();
-        _rxBuf[_rxBufPos++] = b;
+        // Never read more than the ring can take, parsing always frees space
+        uint8_t chunk[CRSF_MAX_PACKET_SIZE];
+        uint8_t space = min((uint8_t)(CRSF_RX_RING_SIZE - _rxCount), (uint8_t)sizeof(chunk));
+        uint8_t len = _port.readBytes(chunk, min(avail, (int)space));
 
-        handleByteReceived();
-
-        if (_rxBufPos == (sizeof(_rxBuf)/sizeof(_rxBuf[0])))
-        {
-            // Packet buffer filled and no valid packet found, dump the whole thing
-            _rxBufPos = 0;
-        }
+        pushRxBytes(chunk, len);
+        parseRxBuffer();
     }
     ModuleBase::Loop(now);
 }
 
-void CrsfModuleBase::handleByteReceived()
+void CrsfModuleBase::pushRxBytes(const uint8_t *data, uint8_t len)
 {
-    bool reprocess;
-    do
+    uint8_t tail = (_rxHead + _rxCount) % CRSF_RX_RING_SIZE;
+    for (uint8_t i = 0; i < len; ++i)
     {
-        reprocess = false;
-        if (_rxBufPos > 1)
-        {
-            uint8_t len = _rxBuf[1];
-            // Sanity check the declared length isn't outside Type + X{1,CRSF_MAX_PAYLOAD_LEN} + CRC
-            // assumes there never will be a CRSF message that just has a type and no data (X)
-            if (len < 3 || len > (CRSF_MAX_PAYLOAD_LEN + 2))
-            {
-                shiftRxBuffer(1);
-                reprocess = true;
-            }
-
-            else if (_rxBufPos >= (len + 2))
-            {
-                uint8_t inCrc = _rxBuf[2 + len - 1];
-                uint8_t crc = _crc.calc(&_rxBuf[2], len - 1);
-                if (crc == inCrc)
-                {
-                    onCrsfPacketIn((const crsf_header_t *)_rxBuf);
+        _rxBuf[tail] = data[i];
+        _rxBuf[tail + CRSF_RX_RING_SIZE] = data[i];
+        tail = (tail + 1) % CRSF_RX_RING_SIZE;
+    }
+    _rxCount += len;
+}
 
-                    shiftRxBuffer(len + 2);
-                    reprocess = true;
-                }
-                else
-                {
-                    shiftRxBuffer(1);
-                    reprocess = true;
-                }
-            }  // if complete packet
-        } // if pos > 1
-    } while (reprocess);
+void CrsfModuleBase::consumeRxBytes(uint8_t cnt)
+{
+    _rxHead = (_rxHead + cnt) % CRSF_RX_RING_SIZE;
+    _rxCount -= cnt;
 }
 
-// Shift the bytes in the RxBuf down by cnt bytes
-void CrsfModuleBase::shiftRxBuffer(uint8_t cnt)
+void CrsfModuleBase::parseRxBuffer()
 {
-    // If removing the whole thing, just set pos to 0
-    if (cnt >= _rxBufPos)
+    while (_rxCount > 0)
     {
-        _rxBufPos = 0;
-        return;
-    }
+        // Skip straight to the next sync byte
+        const uint8_t *frame = &_rxBuf[_rxHead];
+        const uint8_t *sync = (const uint8_t *)memchr(frame, CRSF_SYNC_BYTE, _rxCount);
+        if (sync == nullptr)
+        {
+            consumeRxBytes(_rxCount);
+            return;
+        }
+        consumeRxBytes(sync - frame);
+        frame = sync;
 
-    // Otherwise do the slow shift down
-    uint8_t *src = &_rxBuf[cnt];
-    uint8_t *dst = &_rxBuf[0];
-    _rxBufPos -= cnt;
-    uint8_t left = _rxBufPos;
-    while (left--)
-        *dst++ = *src++;
+        if (_rxCount < 2)
+            return;
+
+        uint8_t len = frame[1];
+        // Sanity check the declared length isn't outside Type + X{1,CRSF_MAX_PAYLOAD_LEN} + CRC
+        // assumes there never will be a CRSF message that just has a type and no data (X)
+        if (len < 3 || len > (CRSF_MAX_PAYLOAD_LEN + 2))
+        {
+            consumeRxBytes(1);
+            continue;
+        }
+
+        if (_rxCount < len + 2)
+            return;
+
+        uint8_t inCrc = frame[2 + len - 1];
+        uint8_t crc = _crc.calc(&frame[2], len - 1);
+        if (crc == inCrc)
+        {
+            // The frame is contiguous in the mirrored ring, hand it over in place
+            onCrsfPacketIn((const crsf_header_t *)frame);
+            consumeRxBytes(len + 2);
+        }
+        else
+        {
+            consumeRxBytes(1);
+        }
+    }
 }
@@ -10,7 +10,7 @@ public:
     CrsfModuleBase() = delete;
     CrsfModuleBase(Stream &port) :
         _port(port), _crc(CRSF_CRC_POLY),
-        _rxBufPos(0)
+        _rxHead(0), _rxCount(0)
         {};
     void Loop(uint32_t now);
 
@@ -22,11 +22,16 @@ protected:
     static constexpr uint8_t CRSF_MAX_PACKET_SIZE = 64U;
     static constexpr uint8_t CRSF_MAX_PAYLOAD_LEN = (CRSF_MAX_PACKET_SIZE - 4U);
 
+    // Receive ring, every byte is stored twice (at i and i + CRSF_RX_RING_SIZE)
+    // so any window of up to CRSF_RX_RING_SIZE bytes is contiguous in _rxBuf
+    static constexpr uint8_t CRSF_RX_RING_SIZE = 2U * CRSF_MAX_PACKET_SIZE;
+
     GENERIC_CRC8 _crc;
-    uint8_t _rxBufPos;
-    uint8_t _rxBuf[CRSF_MAX_PACKET_SIZE];
+    uint8_t _rxHead;
+    uint8_t _rxCount;
+    uint8_t _rxBuf[2U * CRSF_RX_RING_SIZE];
 
-    void processPacketIn(uint8_t len);
-    void shiftRxBuffer(uint8_t cnt);
-    void handleByteReceived();
+    void pushRxBytes(const uint8_t *data, uint8_t len);
+    void consumeRxBytes(uint8_t cnt);
+    void parseRxBuffer();
 };
\ No newline at end of file
@@ -4,6 +4,9 @@
 #include <ArduinoJson.h>
 #include <StreamString.h>
 #include "EspFlashStream.h"
+#include "config.h"
+#include "espnow_phy.h"
+#include "stats.h"
 #if defined(PLATFORM_ESP8266)
 #include <FS.h>
 #else
@@ -14,10 +17,35 @@
 #include "esp_ota_ops.h"
 #endif
 
+// The resolved options are cached in the EEPROM, above the backpack config
+#define OPTIONS_CACHE_ADDR      768
+#define OPTIONS_CACHE_MAGIC     0x4F505432  // "OPT2", bump if firmware_options_t changes
+// Options JSON longer than this is not searched for the discriminator
+#define OPTIONS_FLASH_MAX       1024
+
+typedef struct {
+    uint32_t            magic;
+    uint32_t            discriminator;
+    firmware_options_t  options;
+} options_cache_t;
+
+static_assert(OPTIONS_CACHE_ADDR + sizeof(options_cache_t) <= RESERVED_EEPROM_SIZE, "Options cache does not fit the EEPROM");
+// The backpack config is stored from address 0
+#if defined(TARGET_TX_BACKPACK)
+static_assert(sizeof(tx_backpack_config_t) <= OPTIONS_CACHE_ADDR, "TX backpack config overlaps the options cache");
+#elif defined(TARGET_VRX_BACKPACK)
+static_assert(sizeof(vrx_backpack_config_t) <= OPTIONS_CACHE_ADDR, "VRX backpack config overlaps the options cache");
+#elif defined(TARGET_TIMER_BACKPACK)
+static_assert(sizeof(timer_backpack_config_t) <= OPTIONS_CACHE_ADDR, "Timer backpack config overlaps the options cache");
+#endif
+
+static ELRS_EEPROM *optionsEeprom;
+
 #define QUOTE(arg) #arg
 #define STR(macro) QUOTE(macro)
 const unsigned char target_name[] = "\xBE\xEF\xCA\xFE" STR(TARGET_NAME);
 const uint8_t target_name_size = sizeof(target_name);
+static_assert(sizeof(target_name) <= TARGET_NAME_MAX_SIZE, "TARGET_NAME is too long for the upload target matcher");
 
 const char PROGMEM compile_options[] = {
 #ifdef MY_BINDING_PHRASE
@@ -34,6 +62,11 @@ uint32_t flash_discriminator;
 static StreamString builtinOptions;
 String& getOptions()
 {
+    // Not built when the options came from the cache
+    if (builtinOptions.length() == 0)
+    {
+        saveOptions(builtinOptions, false);
+    }
     return builtinOptions;
 }
 
@@ -51,16 +84,47 @@ void saveOptions(Stream &stream, bool customised)
         doc["wifi-ssid"] = firmwareOptions.home_wifi_ssid;
         doc["wifi-password"] = firmwareOptions.home_wifi_password;
     }
+    if (firmwareOptions.espnow_channel != ESPNOW_DEFAULT_CHANNEL)
+    {
+        doc["espnow-channel"] = firmwareOptions.espnow_channel;
+    }
+    if (firmwareOptions.espnow_rate != ESPNOW_RATE_DEFAULT)
+    {
+        doc["espnow-rate"] = firmwareOptions.espnow_rate;
+    }
+    if (firmwareOptions.espnow_lr)
+    {
+        doc["espnow-lr"] = true;
+    }
     doc["flash-discriminator"] = flash_discriminator;
 
     serializeJson(doc, stream);
+    occupancyRecord(OCCUPANCY_OPTIONS_JSON, doc.memoryUsage(), doc.capacity());
+}
+
+static void options_SaveToCache()
+{
+    options_cache_t cache;
+    memset(&cache, 0, sizeof(cache));
+    cache.magic = OPTIONS_CACHE_MAGIC;
+    cache.discriminator = flash_discriminator;
+    cache.options = firmwareOptions;
+    optionsEeprom->Put(OPTIONS_CACHE_ADDR, cache);
+    optionsEeprom->Commit();
 }
 
 void saveOptions()
 {
+    // Not mounted if the options came from the cache
+#if defined(PLATFORM_ESP32)
+    SPIFFS.begin(true);
+#else
+    SPIFFS.begin();
+#endif
     File options = SPIFFS.open("/options.json", "w");
     saveOptions(options, true);
     options.close();
+    options_SaveToCache();
 }
 
 /**
@@ -78,6 +142,85 @@ bool options_HasStringInFlash(EspFlashStream &strmFlash)
     return firstBytes != 0xffffffff;
 }
 
+/**
+ * @brief:  Find the flash-discriminator in the options JSON at the end of the sketch
+ *          without parsing the document
+ * @return: true if the discriminator was found
+ */
+static bool options_FindDiscriminatorInFlash(EspFlashStream &strmFlash, uint32_t &discriminator)
+{
+    static const char key[] = "\"flash-discriminator\"";
+    size_t matched = 0;
+
+    strmFlash.setPosition(0);
+    for (size_t i = 0; i < OPTIONS_FLASH_MAX; i++)
+    {
+        int c = strmFlash.read();
+        if (c == 0 || c == 0xff)
+        {
+            // End of the options string
+            return false;
+        }
+        if (c == key[matched])
+        {
+            matched++;
+        }
+        else
+        {
+            matched = (c == key[0]) ? 1 : 0;
+        }
+        if (matched == sizeof(key) - 1)
+        {
+            break;
+        }
+    }
+    if (matched != sizeof(key) - 1)
+    {
+        return false;
+    }
+
+    // Skip the separator, then read the number
+    int c;
+    do {
+        c = strmFlash.read();
+    } while (c == ' ' || c == ':');
+    if (c < '0' || c > '9')
+    {
+        return false;
+    }
+    discriminator = 0;
+    while (c >= '0' && c <= '9')
+    {
+        discriminator = discriminator * 10 + (c - '0');
+        c = strmFlash.read();
+    }
+    return true;
+}
+
+/**
+ * @brief:  Fill firmwareOptions from the cache if it was made for this flash-discriminator
+ * @return: true if the cache was used
+ */
+static bool options_LoadFromCache(EspFlashStream &strmFlash)
+{
+    uint32_t discriminator;
+    if (!options_HasStringInFlash(strmFlash) || !options_FindDiscriminatorInFlash(strmFlash, discriminator))
+    {
+        return false;
+    }
+
+    // The EEPROM storage checks its own integrity, so a matching key is enough
+    options_cache_t cache;
+    optionsEeprom->Get(OPTIONS_CACHE_ADDR, cache);
+    if (cache.magic != OPTIONS_CACHE_MAGIC || cache.discriminator != discriminator)
+    {
+        return false;
+    }
+    firmwareOptions = cache.options;
+    flash_discriminator = discriminator;
+    return true;
+}
+
 /**
  * @brief:  Internal read options from either the flash stream at the end of the sketch or the options.json file
  *          Fills the firmwareOptions variable
@@ -94,6 +237,7 @@ static void options_LoadFromFlashOrFile(EspFlashStream &strmFlash)
     if (options_HasStringInFlash(strmFlash))
     {
         DeserializationError error = deserializeJson(flashDoc, strmFlash);
+        occupancyRecord(OCCUPANCY_OPTIONS_JSON, flashDoc.memoryUsage(), flashDoc.capacity());
         if (error)
         {
             return;
@@ -106,6 +250,7 @@ static void options_LoadFromFlashOrFile(EspFlashStream &strmFlash)
     if (file && !file.isDirectory())
     {
         DeserializationError error = deserializeJson(spiffsDoc, file);
+        occupancyRecord(OCCUPANCY_OPTIONS_JSON, spiffsDoc.memoryUsage(), spiffsDoc.capacity());
         if (!error)
         {
             hasSpiffs = true;
@@ -136,32 +281,59 @@ static void options_LoadFromFlashOrFile(EspFlashStream &strmFlash)
     }
     strlcpy(firmwareOptions.home_wifi_ssid, doc["wifi-ssid"] | "", sizeof(firmwareOptions.home_wifi_ssid));
     strlcpy(firmwareOptions.home_wifi_password, doc["wifi-password"] | "", sizeof(firmwareOptions.home_wifi_password));
+    firmwareOptions.espnow_channel = doc["espnow-channel"] | ESPNOW_DEFAULT_CHANNEL;
+    if (firmwareOptions.espnow_channel < 1 || firmwareOptions.espnow_channel > ESPNOW_MAX_CHANNEL)
+    {
+        firmwareOptions.espnow_channel = ESPNOW_DEFAULT_CHANNEL;
+    }
+    firmwareOptions.espnow_rate = doc["espnow-rate"] | (uint8_t)ESPNOW_RATE_DEFAULT;
+    if (firmwareOptions.espnow_rate >= ESPNOW_RATE_COUNT)
+    {
+        firmwareOptions.espnow_rate = ESPNOW_RATE_DEFAULT;
+    }
+    firmwareOptions.espnow_lr = doc["espnow-lr"] | false;
     flash_discriminator = doc["flash-discriminator"] | 0U;
 
     builtinOptions.clear();
     saveOptions(builtinOptions, doc["customised"] | false);
 }
 
-bool options_init()
+bool options_init(ELRS_EEPROM *eeprom)
 {
+    optionsEeprom = eeprom;
+
     uint32_t baseAddr = 0;
 #if defined(PLATFORM_ESP32)
-    SPIFFS.begin(true);
     const esp_partition_t *runningPart = esp_ota_get_running_partition();
     if (runningPart)
     {
         baseAddr = runningPart->address;
     }
 #else
-    SPIFFS.begin();
     // ESP8266 sketch baseAddr is always 0
 #endif
 
     EspFlashStream strmFlash;
     strmFlash.setBaseAddress(baseAddr + ESP.getSketchSize());
 
+    // Only a reflash changes the options, until then skip SPIFFS and the JSON parsing
+    if (options_LoadFromCache(strmFlash))
+    {
+        return true;
+    }
+
+#if defined(PLATFORM_ESP32)
+    SPIFFS.begin(true);
+#else
+    SPIFFS.begin();
+#endif
+
     // options.json
     options_LoadFromFlashOrFile(strmFlash);
+    if (flash_discriminator != 0)
+    {
+        options_SaveToCache();
+    }
 
     // hardware.json
     // bool hasHardware = hardware_init(strmFlash);
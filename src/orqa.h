@@ -11,8 +11,7 @@
 class Orqa : public ModuleBase
 {
 public:
-    void SendIndexCmd(uint8_t index);
+    bool SendIndexCmd(uint8_t index);
 private:
-    uint8_t GHSTChannel(uint8_t band, uint8_t channel);
     void SendGHSTUpdate(uint16_t freq, uint8_t ghstChannel);
 };
\ No newline at end of file
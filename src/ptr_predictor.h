@@ -0,0 +1,123 @@
+#pragma once
+
+#include <Arduino.h>
+#include "msp.h"
+#include "msptypes.h"
+
+// Pan/tilt/roll packets sent to the TX this often while samples arrive
+#ifndef PTR_OUTPUT_INTERVAL_US
+#define PTR_OUTPUT_INTERVAL_US  10000
+#endif
+// Time added to the sample's age, for the part of the link before it arrived
+#ifndef PTR_PREDICT_LEAD_US
+#define PTR_PREDICT_LEAD_US     5000
+#endif
+// Never extrapolate further than this past the last sample
+#ifndef PTR_PREDICT_MAX_US
+#define PTR_PREDICT_MAX_US      40000
+#endif
+// Largest distance a prediction may move an axis from its estimate
+#ifndef PTR_PREDICT_MAX_DELTA
+#define PTR_PREDICT_MAX_DELTA   64
+#endif
+// No sample for this long and the output stops, the aircraft holds the last one
+#define PTR_STALE_US            100000
+// Alpha-beta filter gains for position and velocity
+#define PTR_FILTER_ALPHA        0.5f
+#define PTR_FILTER_BETA         0.1f
+
+#define PTR_AXES                3
+
+/**
+ * @brief: Turns jittery PTR arrivals into a steady stream predicted to the present
+ *
+ * An alpha-beta filter per axis tracks position and angular velocity from the
+ * samples and the times they arrived, so a late or bunched sample is smoothed
+ * over rather than stepping the gimbal. Packets go out every
+ * PTR_OUTPUT_INTERVAL_US with each axis extrapolated by the time since the
+ * sample plus PTR_PREDICT_LEAD_US. The extrapolation is capped in time and in
+ * distance so a head that stops does not swing the camera past it, and it is
+ * clamped to the 16-bit range the axes are carried in.
+ */
+class PtrPredictor
+{
+public:
+    // A sample that arrived at sampleUs
+    void sample(const mspPacket_t *packet, uint32_t sampleUs)
+    {
+        if (packet->payloadSize < PTR_AXES * 2)
+        {
+            return;
+        }
+        bool fresh = !m_active || sampleUs - m_lastSampleUs >= PTR_STALE_US;
+        float dt = (sampleUs - m_lastSampleUs) / 1000000.0f;
+        for (uint8_t i = 0 ; i < PTR_AXES ; i++)
+        {
+            float measured = packet->payload[i * 2] | packet->payload[i * 2 + 1] << 8;
+            Axis &a = m_axes[i];
+            if (fresh || dt <= 0)
+            {
+                // Nothing to take a velocity from, start over at the sample
+                a.pos = measured;
+                a.vel = fresh ? 0 : a.vel;
+                continue;
+            }
+            float predicted = a.pos + a.vel * dt;
+            float residual = measured - predicted;
+            a.pos = predicted + PTR_FILTER_ALPHA * residual;
+            a.vel += PTR_FILTER_BETA * residual / dt;
+        }
+        m_packet = *packet;
+        m_lastSampleUs = sampleUs;
+        m_active = true;
+    }
+
+    // Fill out with the prediction for nowUs, false if one is not due
+    bool output(mspPacket_t *out, uint32_t nowUs)
+    {
+        if (!m_active)
+        {
+            return false;
+        }
+        uint32_t age = nowUs - m_lastSampleUs;
+        if (age >= PTR_STALE_US)
+        {
+            m_active = false;
+            return false;
+        }
+        if (m_sent && nowUs - m_lastOutputUs < PTR_OUTPUT_INTERVAL_US)
+        {
+            return false;
+        }
+        m_lastOutputUs = nowUs;
+        m_sent = true;
+
+        float horizon = min(age + PTR_PREDICT_LEAD_US, (uint32_t)PTR_PREDICT_MAX_US) / 1000000.0f;
+        *out = m_packet;
+        for (uint8_t i = 0 ; i < PTR_AXES ; i++)
+        {
+            const Axis &a = m_axes[i];
+            float delta = constrain(a.vel * horizon, (float)-PTR_PREDICT_MAX_DELTA, (float)PTR_PREDICT_MAX_DELTA);
+            uint16_t value = constrain(a.pos + delta, 0.0f, 65535.0f) + 0.5f;
+            out->payload[i * 2] = value & 0xFF;
+            out->payload[i * 2 + 1] = value >> 8;
+        }
+        return true;
+    }
+
+    bool active() const { return m_active; }
+
+private:
+    struct Axis
+    {
+        float pos = 0;
+        float vel = 0;   // units per second
+    };
+
+    Axis m_axes[PTR_AXES];
+    mspPacket_t m_packet;
+    uint32_t m_lastSampleUs = 0;
+    uint32_t m_lastOutputUs = 0;
+    bool m_active = false;
+    bool m_sent = false;
+};
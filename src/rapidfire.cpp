@@ -13,10 +13,18 @@ Rapidfire::Init()
     pinMode(PIN_MOSI, INPUT);
     pinMode(PIN_CLK, INPUT);
     pinMode(PIN_CS, INPUT);
+    _spi.setReleasePins(true);
 
     DBGLN("Rapid Fire init");
 }
 
+void
+Rapidfire::Loop(uint32_t now)
+{
+    _spi.update();
+    ModuleBase::Loop(now);
+}
+
 void
 Rapidfire::EnableSPIMode()
 {
@@ -58,23 +66,24 @@ Rapidfire::SendBuzzerCmd()
     SendSPI(cmd, 4);
 }
 
-void
+bool
 Rapidfire::SendIndexCmd(uint8_t index)
 {
-    uint8_t newBand = index / 8 + 1;
-    uint8_t newChannel = index % 8;
-
-    SendBandCmd(newBand);
-	delay(100);
-    SendChannelCmd(newChannel);
+    if (index >= CHANNEL_COUNT)
+    {
+        return false;
+    }
+    // Only the latest channel matters, drop one still waiting to go out
+    _spi.cancelPending();
+    SendBandCmd(GetImrcBand(index));
+    _spi.queueDelay(100000);
+    SendChannelCmd(GetChannel(index));
+    return true;
 }
 
 void
 Rapidfire::SendChannelCmd(uint8_t channel)
 {
-    // ELRS channel is zero based, need to add 1
-    channel++;
-
     DBG("Setting new channel ");
     DBGLN("%x", channel);
 
@@ -99,57 +108,13 @@ Rapidfire::SendBandCmd(uint8_t band)
     DBG("Setting new band ");
     DBGLN("%x", band);
 
-    // ELRS bands
-    // 0x01 - Boscam A
-    // 0x02 - Boscam B
-    // 0x03 - Boscam E
-    // 0x04 - ImmersionRC/FatShark
-    // 0x05 - RaceBand
-    // 0x06 - LowRace
-
-    // rapidfire bands
-    // 0x01 - ImmersionRC/FatShark
-    // 0x02 - RaceBand
-    // 0x03 - Boscam E
-    // 0x04 - Boscam B
-    // 0x05 - Boscam A
-    // 0x06 - LowRace
-    // 0x07 - Band X
-
-    // convert ELRS band index to IMRC band index:
-    uint8_t imrcBand;
-    switch (band)
-    {
-    case 0x01:
-        imrcBand = 0x05;
-        break;
-    case 0x02:
-        imrcBand = 0x04;
-        break;
-    case 0x03:
-        imrcBand = 0x03;
-        break;
-    case 0x04:
-        imrcBand = 0x01;
-        break;
-    case 0x05:
-        imrcBand = 0x02;
-        break;
-    case 0x06:
-        imrcBand = 0x06;
-        break;
-    default:
-        imrcBand = 0x01;
-        break;
-    }
-
     uint8_t cmd[5];
     cmd[0] = RF_API_BAND_CMD;       // 'C'
     cmd[1] = RF_API_DIR_EQUAL;      // '='
     cmd[2] = 0x01;                  // len
-    cmd[3] = imrcBand;              // temporarily set byte 4 to band for crc calc
+    cmd[3] = band;                  // temporarily set byte 4 to band for crc calc
     cmd[3] = crc8(cmd, 4);          // reset byte 4 to crc
-    cmd[4] = imrcBand;              // assign band to correct byte 5
+    cmd[4] = band;                  // assign band to correct byte 5
 
     // rapidfire sometimes misses pkts, so send each one 3x
     for (int i = 0; i < SPAM_COUNT; i++)
@@ -163,51 +128,21 @@ Rapidfire::SendSPI(uint8_t* buf, uint8_t bufLen)
 {
     if (!SPIModeEnabled) EnableSPIMode();
 
-    uint32_t periodMicroSec = 1000000 / BIT_BANG_FREQ;
-
-    pinMode(PIN_MOSI, OUTPUT);
-    pinMode(PIN_CLK, OUTPUT);
-    pinMode(PIN_CS, OUTPUT);
-    digitalWrite(PIN_MOSI, LOW);
-    digitalWrite(PIN_CLK, LOW);
-    digitalWrite(PIN_CS, HIGH);
-
-    delayMicroseconds(periodMicroSec);
-
-    digitalWrite(PIN_CS, LOW);
-    delay(100);
-
     // debug code for printing SPI pkt
+    uint64_t data = 0;
     for (int i = 0; i < bufLen; ++i)
     {
-        uint8_t bufByte = buf[i];
-
-        DBG("%x", bufByte);
+        DBG("%x", buf[i]);
         DBG(",");
-
-        for (uint8_t k = 0; k < 8; k++)
-        {
-            // digitalWrite takes about 0.5us, so it is not taken into account with delays.
-            digitalWrite(PIN_CLK, LOW);
-            delayMicroseconds(periodMicroSec / 4);
-            digitalWrite(PIN_MOSI, bufByte & 0x80);
-            delayMicroseconds(periodMicroSec / 4);
-            digitalWrite(PIN_CLK, HIGH);
-            delayMicroseconds(periodMicroSec / 2);
-
-            bufByte <<= 1;
-        }
+        data = (data << 8) | buf[i];
     }
     DBGLN("");
 
-    digitalWrite(PIN_MOSI, LOW);
-    digitalWrite(PIN_CLK, LOW);
-    digitalWrite(PIN_CS, HIGH);
-    delay(100);
-
-    pinMode(PIN_MOSI, INPUT);
-    pinMode(PIN_CLK, INPUT);
-    pinMode(PIN_CS, INPUT);
+    // CS is held low 100ms before the data and high 100ms after
+    if (!_spi.queueWrite(data, bufLen * 8, true, 100000, 100000))
+    {
+        DBGLN("SPI queue full");
+    }
 }
 
 // CRC function for IMRC rapidfire API
@@ -1,6 +1,8 @@
 #pragma once
 
 #include "module_base.h"
+#include "spi_engine.h"
+#include <channels.h>
 #include <Arduino.h>
 
 #define VRX_BOOT_DELAY  2000
@@ -17,9 +19,13 @@
 class Rapidfire : public ModuleBase
 {
 public:
+    Rapidfire() : _spi(PIN_MOSI, PIN_CLK, PIN_CS, -1, BIT_BANG_FREQ) {}
     void Init();
+    void Loop(uint32_t now);
+    bool IndexCmdPending() { return _spi.busy(); }
     void SendBuzzerCmd();
-    void SendIndexCmd(uint8_t index);
+    bool SendIndexCmd(uint8_t index);
+    // IMRC numbering, see GetImrcBand(), and a one based channel
     void SendChannelCmd(uint8_t channel);
     void SendBandCmd(uint8_t band);
 
@@ -28,4 +34,5 @@ private:
     void EnableSPIMode();
     uint8_t crc8(uint8_t* buf, uint8_t bufLen);
     bool SPIModeEnabled = false;
+    SpiEngine _spi;
 };
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <Arduino.h>
+#include <channels.h>
+
+#define SYNTHESIZER_REG_A                           0x00
+#define SYNTHESIZER_REG_B                           0x01
+#define SYNTHESIZER_REG_C                           0x02
+#define SYNTHESIZER_REG_D                           0x03
+#define VCO_SWITCH_CAP_CONTROL_REGISTER             0x04
+#define DFC_CONTROL_REGISTER                        0x05
+#define SIXM_AUDIO_DEMODULATOR_CONTROL_REGISTER     0x06
+#define SIXM5_AUDIO_DEMODULATOR_CONTROL_REGISTER    0x07
+#define RECEIVER_CONTROL_REGISTER_1                 0x08
+#define RECEIVER_CONTROL_REGISTER_2                 0x09
+#define POWER_DOWN_CONTROL_REGISTER                 0x0A
+#define STATE_REGISTER                              0x0F
+
+#define RX5808_READ_CTRL_BIT                        0x00
+#define RX5808_WRITE_CTRL_BIT                       0x01
+#define RX5808_ADDRESS_R_W_LENGTH                   5
+#define RX5808_DATA_LENGTH                          20
+#define RX5808_PACKET_LENGTH                        25
+
+// Frequencies the synthesizer is asked for outside these are ignored
+#define RTC6705_MIN_MHZ                             4900
+#define RTC6705_MAX_MHZ                             6000
+
+// SYNTHESIZER_REG_B data bits for mhz: the N and A counters of a synthesizer
+// stepping 2MHz from a 479MHz IF
+constexpr uint32_t rtc6705SynthData(uint16_t mhz)
+{
+    return ((((mhz - 479) / 2) / 32) << 7) | (((mhz - 479) / 2) % 32);
+}
+
+// SYNTHESIZER_REG_B data bits for each frequencyTable channel, built by the compiler
+#define RTC6705_BAND(b) \
+    rtc6705SynthData(frequencyTable[(b) * CHANNELS_PER_BAND + 0]), rtc6705SynthData(frequencyTable[(b) * CHANNELS_PER_BAND + 1]), \
+    rtc6705SynthData(frequencyTable[(b) * CHANNELS_PER_BAND + 2]), rtc6705SynthData(frequencyTable[(b) * CHANNELS_PER_BAND + 3]), \
+    rtc6705SynthData(frequencyTable[(b) * CHANNELS_PER_BAND + 4]), rtc6705SynthData(frequencyTable[(b) * CHANNELS_PER_BAND + 5]), \
+    rtc6705SynthData(frequencyTable[(b) * CHANNELS_PER_BAND + 6]), rtc6705SynthData(frequencyTable[(b) * CHANNELS_PER_BAND + 7])
+
+static_assert(CHANNEL_BAND_COUNT == 6, "RTC6705 table is built for 6 bands");
+
+constexpr uint32_t rtc6705ChannelData[CHANNEL_COUNT] = {
+    RTC6705_BAND(0), RTC6705_BAND(1), RTC6705_BAND(2), RTC6705_BAND(3), RTC6705_BAND(4), RTC6705_BAND(5)
+};
+
+#undef RTC6705_BAND
+
+static_assert(rtc6705ChannelData[0] == 0x2A05, "RTC6705 A1 register value");
+static_assert(rtc6705ChannelData[47] == 0x2807, "RTC6705 L8 register value");
+
+// Data bits for any frequency, straight from the table for a standard channel
+inline uint32_t rtc6705FrequencyData(uint16_t mhz)
+{
+    for (uint8_t i = 0; i < CHANNEL_COUNT; i++)
+    {
+        if (frequencyTable[i] == mhz)
+        {
+            return rtc6705ChannelData[i];
+        }
+    }
+    return rtc6705SynthData(mhz);
+}
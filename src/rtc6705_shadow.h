@@ -0,0 +1,57 @@
+#pragma once
+
+#include <Arduino.h>
+
+// How often the shadow is checked against the chip, 0 to never read back.
+// The receiver's own buttons can retune it behind the backpack's back.
+#ifndef RTC6705_VERIFY_INTERVAL_MS
+#define RTC6705_VERIFY_INTERVAL_MS  5000
+#endif
+
+#define RTC6705_REGISTER_COUNT      16
+
+/**
+ * @brief: Last value written to each RTC6705 register
+ *
+ * Lets a channel command skip the write when the register already holds the
+ * value, without a read back over SPI. Values are the 20 data bits. Anything
+ * not known to be in the chip (after init, power down, or a read back that
+ * disagreed) is invalid and always written.
+ */
+class Rtc6705Shadow
+{
+public:
+    void invalidate()
+    {
+        _valid = 0;
+        _lastVerifyMs = millis();
+    }
+
+    bool matches(uint8_t reg, uint32_t data) const
+    {
+        return (_valid & (1 << reg)) && _regs[reg] == data;
+    }
+
+    void set(uint8_t reg, uint32_t data)
+    {
+        _regs[reg] = data;
+        _valid |= 1 << reg;
+    }
+
+    // True once per RTC6705_VERIFY_INTERVAL_MS while reg is valid
+    bool verifyDue(uint8_t reg, uint32_t now)
+    {
+        if (RTC6705_VERIFY_INTERVAL_MS == 0 || !(_valid & (1 << reg)) ||
+            now - _lastVerifyMs < RTC6705_VERIFY_INTERVAL_MS)
+        {
+            return false;
+        }
+        _lastVerifyMs = now;
+        return true;
+    }
+
+private:
+    uint32_t _regs[RTC6705_REGISTER_COUNT];
+    uint16_t _valid = 0;
+    uint32_t _lastVerifyMs = 0;
+};
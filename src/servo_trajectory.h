@@ -0,0 +1,67 @@
+#pragma once
+
+#include <Arduino.h>
+
+/**
+ * @brief: Velocity and acceleration limited motion towards a servo target
+ *
+ * Advanced by the real time elapsed since the last step, so a late step moves
+ * further instead of the motion slowing down. Decelerates so it arrives at the
+ * target without overshooting (a trapezoidal profile).
+ */
+class ServoTrajectory
+{
+public:
+    // Jump straight to pos and stop there
+    void reset(int32_t pos)
+    {
+        _pos = pos * 1000;
+        _target = pos;
+        _vel = 0;
+    }
+
+    void setTarget(int32_t target) { _target = target; }
+
+    // maxVel in us/s, maxAccel in us/s^2
+    void setLimits(int32_t maxVel, int32_t maxAccel)
+    {
+        _maxVel = max(maxVel, (int32_t)1);
+        _maxAccel = max(maxAccel, (int32_t)1);
+    }
+
+    // Advance by dtUs microseconds and return the new position in us
+    int32_t step(uint32_t dtUs)
+    {
+        int32_t remaining = _target * 1000 - _pos; // thousandths of a us
+        if (remaining == 0 && _vel == 0)
+            return position();
+
+        // Fastest speed that can still stop in the remaining distance, v = sqrt(2ad)
+        uint32_t stopVel = sqrtf(2.0f * _maxAccel * (abs(remaining) / 1000.0f));
+        int32_t wanted = min((uint32_t)_maxVel, stopVel);
+        if (remaining < 0)
+            wanted = -wanted;
+        int32_t dv = (int64_t)_maxAccel * dtUs / 1000000;
+        _vel += constrain(wanted - _vel, -max(dv, (int32_t)1), max(dv, (int32_t)1));
+
+        int32_t move = (int64_t)_vel * dtUs / 1000;
+        // Arrive rather than overshoot
+        if ((remaining > 0 && move >= remaining) || (remaining < 0 && move <= remaining))
+        {
+            _pos = _target * 1000;
+            _vel = 0;
+        }
+        else
+            _pos += move;
+        return position();
+    }
+
+    int32_t position() const { return (_pos + 500) / 1000; }
+
+private:
+    int32_t _pos = 0;      // thousandths of a us
+    int32_t _target = 0;   // us
+    int32_t _vel = 0;      // us/s
+    int32_t _maxVel = 1;
+    int32_t _maxAccel = 1;
+};
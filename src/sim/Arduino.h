@@ -0,0 +1,94 @@
+#pragma once
+
+// Just enough of the Arduino core for the MSP, CRSF, link and FIFO libraries
+// to build on the host, for the network simulator and the parser benchmarks.
+// Time is the simulated clock, it only moves when the program advances it.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+
+using std::min;
+using std::max;
+
+#define ICACHE_RAM_ATTR
+#define DEC 10
+#define HEX 16
+
+#define constrain(amt, low, high) ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+
+namespace sim
+{
+    extern uint64_t nowUs;
+}
+
+inline uint32_t micros() { return (uint32_t)sim::nowUs; }
+inline uint32_t millis() { return (uint32_t)(sim::nowUs / 1000); }
+inline void delay(uint32_t ms) {}
+inline void yield() {}
+inline void noInterrupts() {}
+inline void interrupts() {}
+inline long random(long max) { return rand() % max; }
+
+class Print
+{
+public:
+    virtual ~Print() {}
+    virtual size_t write(uint8_t c) = 0;
+    virtual size_t write(const uint8_t *data, size_t len)
+    {
+        for (size_t i = 0; i < len; i++)
+        {
+            write(data[i]);
+        }
+        return len;
+    }
+    size_t print(const char *s) { return write((const uint8_t *)s, strlen(s)); }
+    size_t print(uint32_t v, int base = DEC) { return printNumber(v, base); }
+    size_t print(int32_t v, int base = DEC) { return printNumber(v, base); }
+    size_t println() { return write('\n'); }
+    size_t println(const char *s) { return print(s) + println(); }
+
+private:
+    size_t printNumber(long v, int base)
+    {
+        char buf[24];
+        snprintf(buf, sizeof(buf), base == HEX ? "%lx" : "%ld", v);
+        return print(buf);
+    }
+};
+
+class Stream : public Print
+{
+public:
+    virtual int available() { return 0; }
+    virtual int read() { return -1; }
+    virtual size_t readBytes(uint8_t *buffer, size_t length)
+    {
+        size_t count = 0;
+        int c;
+        while (count < length && (c = read()) >= 0)
+        {
+            buffer[count++] = c;
+        }
+        return count;
+    }
+};
+
+// Where every node's "UART" goes, the log output is dropped unless -DSIM_LOG
+class HostSerial : public Stream
+{
+public:
+    size_t write(uint8_t c) override
+    {
+#if defined(SIM_LOG)
+        fputc(c, stderr);
+#endif
+        return 1;
+    }
+    using Print::write;
+};
+
+extern HostSerial Serial;
@@ -0,0 +1,83 @@
+#include "espnow_bus.h"
+
+namespace sim
+{
+
+static const uint8_t broadcastAddress[6] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+
+bool EspnowBus::send(BusNode *from, const uint8_t *dst, const uint8_t *data, uint8_t len)
+{
+    if (from->queued >= m_config.txQueueSize)
+    {
+        from->queueFull++;
+        return false;
+    }
+    from->queued++;
+    from->maxQueued = max(from->maxQueued, from->queued);
+
+    uint32_t airtime = m_config.overheadUs + (len * 8 * 1000) / m_config.bitrateKbps;
+    uint64_t start = max(nowUs, m_channelFreeUs);
+    uint64_t end = start + airtime;
+    m_maxBacklogUs = max(m_maxBacklogUs, (uint32_t)(start - nowUs));
+    m_channelFreeUs = end;
+    m_frames++;
+    m_bytes += len;
+    m_airtimeUs += airtime;
+
+    auto frame = std::make_shared<frame_t>();
+    memcpy(frame->src, from->mac, 6);
+    frame->data.assign(data, data + len);
+
+    bool broadcast = memcmp(dst, broadcastAddress, 6) == 0;
+    bool delivered = broadcast;
+    std::uniform_real_distribution<float> lossDraw(0, 1);
+    std::uniform_int_distribution<uint32_t> jitterDraw(0, m_config.jitterUs);
+    for (BusNode *node : m_nodes)
+    {
+        if (node == from || !node->online || (!broadcast && memcmp(node->mac, dst, 6) != 0))
+        {
+            continue;
+        }
+        m_receptions++;
+        if (lossDraw(m_rng) < m_config.lossRate)
+        {
+            m_lost++;
+            continue;
+        }
+        delivered = true;
+        push(end + m_config.latencyUs + jitterDraw(m_rng), EVENT_DELIVER, node, true, frame);
+    }
+    push(end, EVENT_SENT, from, delivered, nullptr);
+    return true;
+}
+
+uint64_t EspnowBus::nextEvent() const
+{
+    return m_events.empty() ? UINT64_MAX : m_events.top().atUs;
+}
+
+void EspnowBus::run(uint64_t untilUs)
+{
+    while (!m_events.empty() && m_events.top().atUs <= untilUs)
+    {
+        event_t event = m_events.top();
+        m_events.pop();
+        nowUs = event.atUs;
+        if (event.type == EVENT_SENT)
+        {
+            event.node->queued--;
+            event.node->onSent(event.delivered);
+        }
+        else if (event.node->online)
+        {
+            event.node->onReceive(event.frame->src, event.frame->data.data(), event.frame->data.size());
+        }
+    }
+}
+
+void EspnowBus::push(uint64_t atUs, eventType_e type, BusNode *node, bool delivered, const std::shared_ptr<frame_t> &frame)
+{
+    m_events.push({atUs, m_order++, type, node, delivered, frame});
+}
+
+}
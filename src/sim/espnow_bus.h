@@ -0,0 +1,118 @@
+#pragma once
+
+#include <Arduino.h>
+#include <functional>
+#include <memory>
+#include <queue>
+#include <random>
+#include <vector>
+
+namespace sim
+{
+
+typedef struct {
+    float lossRate;         // chance each receiver misses a frame
+    uint32_t latencyUs;     // from the end of the airtime to the receive callback
+    uint32_t jitterUs;      // up to this much more, uniformly
+    uint32_t bitrateKbps;   // PHY rate the frame bytes go out at
+    uint32_t overheadUs;    // per frame: preamble, MAC header, ACK and backoff
+    uint8_t txQueueSize;    // frames a node can have waiting, esp_now_send() fails beyond it
+} busConfig_t;
+
+/**
+ * @brief: A backpack on the bus, the callbacks stand in for the ESP-NOW ones
+ */
+class BusNode
+{
+public:
+    virtual ~BusNode() {}
+    // The frame arrived from src
+    virtual void onReceive(const uint8_t *src, const uint8_t *data, uint8_t len) = 0;
+    // Unicast frames are delivered if any node with the address got them, broadcasts always are
+    virtual void onSent(bool delivered) {}
+    virtual void loop() = 0;
+
+    // Frames are sent from, and only received on, the station MAC
+    uint8_t mac[6] = {};
+    bool online = true;
+    uint8_t queued = 0;
+    uint8_t maxQueued = 0;
+    uint32_t queueFull = 0;
+};
+
+/**
+ * @brief: One shared ESP-NOW channel
+ *
+ * Frames take the channel one at a time for their airtime, in the order they
+ * were sent, so a busy channel shows up as queueing on every node. Each
+ * receiver with the destination MAC, or every node for a broadcast, then gets
+ * its own copy after the latency and jitter unless the loss draw drops it.
+ */
+class EspnowBus
+{
+public:
+    EspnowBus(const busConfig_t &config, uint32_t seed) : m_config(config), m_rng(seed) {}
+
+    void attach(BusNode *node) { m_nodes.push_back(node); }
+
+    // esp_now_send(), false if the node cannot queue any more frames
+    bool send(BusNode *from, const uint8_t *dst, const uint8_t *data, uint8_t len);
+
+    // Time of the next event, UINT64_MAX if there is none
+    uint64_t nextEvent() const;
+    // Run every event due at or before nowUs
+    void run(uint64_t nowUs);
+
+    uint32_t frames() const { return m_frames; }
+    uint64_t bytes() const { return m_bytes; }
+    uint64_t airtimeUs() const { return m_airtimeUs; }
+    uint32_t receptions() const { return m_receptions; }
+    uint32_t lost() const { return m_lost; }
+    uint32_t maxBacklogUs() const { return m_maxBacklogUs; }
+
+private:
+    typedef enum {
+        EVENT_SENT,
+        EVENT_DELIVER
+    } eventType_e;
+
+    typedef struct {
+        uint8_t src[6];
+        std::vector<uint8_t> data;
+    } frame_t;
+
+    typedef struct {
+        uint64_t atUs;
+        uint64_t order;
+        eventType_e type;
+        BusNode *node;
+        bool delivered;
+        std::shared_ptr<frame_t> frame;
+    } event_t;
+
+    struct Later
+    {
+        bool operator()(const event_t &a, const event_t &b) const
+        {
+            return a.atUs != b.atUs ? a.atUs > b.atUs : a.order > b.order;
+        }
+    };
+
+    busConfig_t m_config;
+    std::mt19937 m_rng;
+    std::vector<BusNode *> m_nodes;
+    std::priority_queue<event_t, std::vector<event_t>, Later> m_events;
+    uint64_t m_order = 0;
+    uint64_t m_channelFreeUs = 0;
+
+    uint32_t m_frames = 0;
+    uint64_t m_bytes = 0;
+    uint64_t m_airtimeUs = 0;
+    uint32_t m_receptions = 0;
+    uint32_t m_lost = 0;
+    uint32_t m_maxBacklogUs = 0;
+
+    void push(uint64_t atUs, eventType_e type, BusNode *node, bool delivered, const std::shared_ptr<frame_t> &frame);
+};
+
+}
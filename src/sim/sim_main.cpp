@@ -0,0 +1,300 @@
+// Host-side ESP-NOW network simulator, pio run -e native_espnow_sim -t exec
+//
+// Pilots each have a TX backpack and one or more VRX backpacks sharing one
+// group address, with optional timers sending OSD messages to every pilot.
+// Every node runs the firmware's MSP parser, cache, coalescing and link
+// classes over a simulated channel with loss, latency and airtime, and the
+// report gives delivery, duplicates, latency and queue depths per flow.
+// Arguments are --name value, see usage() for the list.
+
+#include <Arduino.h>
+#include <vector>
+
+#include "espnow_bus.h"
+#include "sim_nodes.h"
+
+namespace sim
+{
+    uint64_t nowUs = 0;
+}
+
+HostSerial Serial;
+
+using namespace sim;
+
+typedef struct {
+    const char *name;
+    float value;
+    const char *help;
+} option_t;
+
+static option_t options[] = {
+    {"pilots", 8, "TX backpacks, each with its own group address"},
+    {"vrx", 2, "VRX backpacks per pilot, the first is the head tracker"},
+    {"timers", 1, "timer backpacks sending OSD messages to every pilot"},
+    {"seconds", 30, "simulated time"},
+    {"seed", 1, "random seed"},
+    {"loss", 0.02f, "chance each receiver misses a frame"},
+    {"latency-us", 300, "from the end of a frame's airtime to the receive callback"},
+    {"jitter-us", 300, "up to this much more latency"},
+    {"bitrate-kbps", 1000, "PHY rate"},
+    {"overhead-us", 400, "airtime added to every frame: preamble, headers, ACK, backoff"},
+    {"tx-queue", 8, "frames a node can have waiting for the channel"},
+    {"loop-us", 1000, "time between loop() passes"},
+    {"coalesce-us", 2000, "ESPNOW_COALESCE_TIMEOUT_US, 0 sends every frame on its own"},
+    {"vtx-interval-ms", 2000, "VTX config changes from each handset, 0 for none"},
+    {"telemetry-hz", 10, "CRSF telemetry from each handset"},
+    {"ptr-hz", 50, "head tracker samples to each TX"},
+    {"osd-hz", 5, "timer messages to each pilot"},
+    {"join-spread-ms", 3000, "VRX backpacks power on at random times up to this, and sync from the TX cache"},
+    {"bind", 0, "1: every VRX starts in binding mode and the pilots bind one after another"},
+    {"bind-spacing-ms", 1000, "time between two pilots binding"},
+};
+
+static float option(const char *name)
+{
+    for (const option_t &o : options)
+    {
+        if (strcmp(o.name, name) == 0)
+        {
+            return o.value;
+        }
+    }
+    return 0;
+}
+
+static void usage()
+{
+    printf("Usage: sim [--name value]...\n");
+    for (const option_t &o : options)
+    {
+        printf("  --%-16s %-8g %s\n", o.name, o.value, o.help);
+    }
+}
+
+static bool parseArgs(int argc, char **argv)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        if (strncmp(argv[i], "--", 2) != 0 || i + 1 == argc)
+        {
+            return false;
+        }
+        option_t *found = nullptr;
+        for (option_t &o : options)
+        {
+            if (strcmp(o.name, argv[i] + 2) == 0)
+            {
+                found = &o;
+            }
+        }
+        if (found == nullptr)
+        {
+            return false;
+        }
+        found->value = atof(argv[++i]);
+    }
+    return true;
+}
+
+template <typename T, typename F>
+static uint32_t sum(const std::vector<T *> &nodes, F field)
+{
+    uint32_t total = 0;
+    for (const T *node : nodes)
+    {
+        total += field(node);
+    }
+    return total;
+}
+
+template <typename T, typename F>
+static uint32_t largest(const std::vector<T *> &nodes, F field)
+{
+    uint32_t most = 0;
+    for (const T *node : nodes)
+    {
+        most = max(most, (uint32_t)field(node));
+    }
+    return most;
+}
+
+int main(int argc, char **argv)
+{
+    if (!parseArgs(argc, argv))
+    {
+        usage();
+        return 1;
+    }
+    srand(option("seed"));
+
+    busConfig_t busConfig = {
+        option("loss"),
+        (uint32_t)option("latency-us"),
+        (uint32_t)option("jitter-us"),
+        (uint32_t)option("bitrate-kbps"),
+        (uint32_t)option("overhead-us"),
+        (uint8_t)option("tx-queue")
+    };
+    trafficConfig_t traffic = {
+        (uint32_t)option("coalesce-us"),
+        (uint32_t)option("vtx-interval-ms"),
+        (uint32_t)option("telemetry-hz"),
+        (uint32_t)option("ptr-hz"),
+        (uint32_t)option("osd-hz")
+    };
+    uint16_t pilots = option("pilots");
+    uint16_t vrxPerPilot = option("vrx");
+    uint16_t timerCount = option("timers");
+    bool bind = option("bind") != 0;
+    uint64_t endUs = option("seconds") * 1000000ULL;
+    uint64_t loopUs = max(1.0f, option("loop-us"));
+
+    EspnowBus bus(busConfig, option("seed"));
+    flows_t flows;
+    std::vector<BusNode *> nodes;
+    std::vector<TxNode *> txs;
+    std::vector<VrxNode *> vrxs;
+    std::vector<TimerNode *> timers;
+    std::vector<uint64_t> bindAtUs;
+
+    for (uint16_t p = 0; p < pilots; p++)
+    {
+        // Group addresses are unicast and locally administered
+        uint8_t uid[6] = {0x02, 0xE1, 0x25, 0x00, (uint8_t)(p >> 8), (uint8_t)p};
+        TxNode *tx = new TxNode(bus, flows, traffic, uid, nodes.size());
+        nodes.push_back(tx);
+        txs.push_back(tx);
+        uint64_t bindUs = (p + 1) * option("bind-spacing-ms") * 1000ULL;
+        bindAtUs.push_back(bindUs);
+
+        for (uint16_t v = 0; v < vrxPerPilot; v++)
+        {
+            VrxNode *vrx = new VrxNode(bus, flows, traffic, nodes.size(), v == 0);
+            vrx->ptrReceiver = tx->index;
+            vrx->intendedUid = tx->uid;
+            if (bind)
+            {
+                // Put in binding mode just before its pilot binds
+                vrx->boot(bindUs - 500000, tx->uid, true);
+            }
+            else
+            {
+                vrx->boot(random(max(1.0f, option("join-spread-ms"))) * 1000ULL, tx->uid, false);
+            }
+            nodes.push_back(vrx);
+            vrxs.push_back(vrx);
+            tx->addVrx(vrx);
+        }
+    }
+    for (uint16_t t = 0; t < timerCount; t++)
+    {
+        TimerNode *timer = new TimerNode(bus, flows, traffic, txs, vrxs, nodes.size());
+        nodes.push_back(timer);
+        timers.push_back(timer);
+    }
+    for (BusNode *node : nodes)
+    {
+        bus.attach(node);
+    }
+
+    for (uint64_t t = 0; t < endUs; t += loopUs)
+    {
+        bus.run(t);
+        nowUs = t;
+        for (uint16_t p = 0; bind && p < pilots; p++)
+        {
+            if (bindAtUs[p] != 0 && t >= bindAtUs[p])
+            {
+                bindAtUs[p] = 0;
+                txs[p]->bind();
+            }
+        }
+        for (BusNode *node : nodes)
+        {
+            node->loop();
+        }
+    }
+
+    printf("ESP-NOW simulation: %u pilots, %u VRX each, %u timers, %.0fs, seed %.0f\n",
+           pilots, vrxPerPilot, timerCount, option("seconds"), option("seed"));
+    printf("  loss %.1f%%, latency %u+%uus, %ukbps, %uus per frame, coalesce %uus\n\n",
+           busConfig.lossRate * 100, busConfig.latencyUs, busConfig.jitterUs,
+           busConfig.bitrateKbps, busConfig.overheadUs, traffic.coalesceUs);
+
+    printf("Bus\n");
+    printf("  frames %u, %.1fkB, airtime %.1f%% of the channel\n", bus.frames(), bus.bytes() / 1000.0f,
+           100.0f * bus.airtimeUs() / endUs);
+    printf("  receptions %u, lost %u (%.2f%%), longest wait for the channel %.2fms\n\n", bus.receptions(), bus.lost(),
+           bus.receptions() ? 100.0f * bus.lost() / bus.receptions() : 0.0f, bus.maxBacklogUs() / 1000.0f);
+
+    printf("Delivery (latency in ms)\n");
+    printf("  %-10s %7s %7s %9s %7s %7s %7s %7s %7s %7s\n", "flow", "sent", "expect", "delivered", "dup", "superse",
+           "avg", "p50", "p99", "max");
+    flows.vtx.report();
+    flows.telemetry.report();
+    flows.ptr.report();
+    flows.osd.report();
+    printf("\n");
+
+    printf("Link\n");
+    printf("  TX reliable frames resent %u, given up %u, window full %u\n",
+           sum(txs, [](const TxNode *n) { return n->link.resent(); }),
+           sum(txs, [](const TxNode *n) { return n->link.lost(); }),
+           sum(txs, [](const TxNode *n) { return n->link.windowFull(); }));
+    printf("  duplicate or stale frames dropped: TX %u, VRX %u\n\n",
+           sum(txs, [](const TxNode *n) { return n->linkReceiver.dropped(); }),
+           sum(vrxs, [](const VrxNode *n) { return n->linkReceiver.dropped(); }));
+
+    printf("Queues (largest seen)\n");
+    printf("  ESP-NOW send queue: TX %u, VRX %u, timer %u frames; sends refused %u\n",
+           largest(txs, [](const TxNode *n) { return n->maxQueued; }),
+           largest(vrxs, [](const VrxNode *n) { return n->maxQueued; }),
+           largest(timers, [](const TimerNode *n) { return n->maxQueued; }),
+           sum(nodes, [](const BusNode *n) { return n->queueFull; }));
+    printf("  rx ring: TX %u, VRX %u bytes\n\n",
+           largest(txs, [](const TxNode *n) { return n->maxRingUsed; }),
+           largest(vrxs, [](const VrxNode *n) { return n->maxRingUsed; }));
+
+    if (bind)
+    {
+        uint32_t bound = 0;
+        uint32_t wrong = 0;
+        for (const VrxNode *vrx : vrxs)
+        {
+            if (vrx->binding)
+            {
+                continue;
+            }
+            bound++;
+            wrong += memcmp(vrx->uid, vrx->intendedUid, 6) != 0;
+        }
+        printf("Bind\n");
+        printf("  VRX bound %u of %zu, to the wrong pilot %u\n\n", bound, vrxs.size(), wrong);
+    }
+
+    uint32_t synced = 0;
+    uint32_t onChannel = 0;
+    uint64_t syncTotal = 0;
+    uint64_t syncLongest = 0;
+    for (size_t i = 0; i < vrxs.size(); i++)
+    {
+        const VrxNode *vrx = vrxs[i];
+        const TxNode *tx = txs[i / max((uint16_t)1, vrxPerPilot)];
+        if (vrx->synced)
+        {
+            synced++;
+            syncTotal += vrx->syncedUs - vrx->bootUs;
+            syncLongest = max(syncLongest, vrx->syncedUs - vrx->bootUs);
+        }
+        onChannel += tx->lastChannel != 0xFF && vrx->appliedChannel == tx->lastChannel;
+    }
+    printf("Sync\n");
+    printf("  VRX synced %u of %zu, %.1fms average and %.1fms longest from power on\n", synced, vrxs.size(),
+           synced ? syncTotal / 1000.0f / synced : 0.0f, syncLongest / 1000.0f);
+    printf("  sync requests %u, cache replays %u, VRX on their pilot's last channel %u of %zu\n",
+           sum(vrxs, [](const VrxNode *n) { return n->syncRequests; }),
+           sum(txs, [](const TxNode *n) { return n->cacheReplays; }),
+           onChannel, vrxs.size());
+    return 0;
+}
@@ -0,0 +1,648 @@
+#include "sim_nodes.h"
+
+namespace sim
+{
+
+static const uint16_t cacheFunctions[] = { MSP_CACHE_FUNCTIONS };
+static const uint16_t reliableFunctions[] = { MSP_LINK_RELIABLE_FUNCTIONS };
+
+// Time from reset to ESP-NOW being up again
+#define BOOT_TIME_US                300000
+
+static const uint8_t broadcastAddress[6] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+
+static void putId(mspPacket_t *packet, uint32_t id)
+{
+    for (uint8_t i = 0; i < 4; i++)
+    {
+        packet->addByte(id >> (i * 8));
+    }
+}
+
+static uint32_t getId(const mspPacket_t *packet, uint8_t offset)
+{
+    if (packet->payloadSize < offset + 4)
+    {
+        return 0;
+    }
+    const uint8_t *p = &packet->payload[offset];
+    return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+/////////// Flow ///////////
+
+void Flow::sent(uint32_t id, const std::vector<uint16_t> &expected)
+{
+    m_sent++;
+    m_expected += expected.size();
+    m_records[id] = {nowUs, expected, {}};
+}
+
+void Flow::received(uint32_t id, uint16_t receiver)
+{
+    auto it = m_records.find(id);
+    if (it == m_records.end())
+    {
+        return;
+    }
+    record_t &r = it->second;
+    if (std::find(r.expected.begin(), r.expected.end(), receiver) == r.expected.end())
+    {
+        return;
+    }
+    if (std::find(r.seen.begin(), r.seen.end(), receiver) != r.seen.end())
+    {
+        m_duplicates++;
+        return;
+    }
+    r.seen.push_back(receiver);
+    m_delivered++;
+    m_latencies.push_back(nowUs - r.sentUs);
+}
+
+void Flow::report() const
+{
+    if (m_sent == 0)
+    {
+        return;
+    }
+    std::vector<uint32_t> sorted = m_latencies;
+    std::sort(sorted.begin(), sorted.end());
+    auto percentile = [&sorted](float p) {
+        return sorted.empty() ? 0.0f : sorted[std::min(sorted.size() - 1, (size_t)(p * sorted.size()))] / 1000.0f;
+    };
+    uint64_t total = 0;
+    for (uint32_t l : sorted)
+    {
+        total += l;
+    }
+
+    printf("  %-10s %7u %7u %8.2f%% %6.2f%% %7u %7.2f %7.2f %7.2f %7.2f\n", m_name,
+           m_sent, m_expected,
+           m_expected ? 100.0f * m_delivered / m_expected : 0.0f,
+           m_delivered ? 100.0f * m_duplicates / m_delivered : 0.0f,
+           m_superseded,
+           sorted.empty() ? 0.0f : total / 1000.0f / sorted.size(),
+           percentile(0.5f), percentile(0.99f), sorted.empty() ? 0.0f : sorted.back() / 1000.0f);
+}
+
+/////////// TxNode ///////////
+
+TxNode::TxNode(EspnowBus &bus, flows_t &flows, const trafficConfig_t &traffic, const uint8_t *address, uint16_t index)
+    : index(index), m_bus(bus), m_flows(flows), m_traffic(traffic),
+      m_cache(cacheFunctions, sizeof(cacheFunctions) / sizeof(cacheFunctions[0]))
+{
+    memcpy(uid, address, 6);
+    memcpy(mac, address, 6);
+    link.begin(MSP_LINK_SOURCE_TX, random(256));
+    // Pilots do not all change channel in step
+    m_nextVtxUs = nowUs + random(traffic.vtxIntervalMs ? traffic.vtxIntervalMs : 1) * 1000ULL;
+    m_nextTelemetryUs = nowUs + random(1000) * 1000ULL / (traffic.telemetryHz ? traffic.telemetryHz : 1);
+}
+
+void TxNode::bind()
+{
+    mspPacket_t packet;
+    packet.reset();
+    packet.makeCommand();
+    packet.function = MSP_ELRS_BIND;
+    for (uint8_t i = 0; i < 6; i++)
+    {
+        packet.addByte(uid[i]);
+    }
+    fromHandset(&packet);
+}
+
+void TxNode::fromHandset(mspPacket_t *packet)
+{
+    if (!online)
+    {
+        return;
+    }
+    if (packet->function == MSP_ELRS_BIND)
+    {
+        sendMSPViaEspnow(packet);
+        // The firmware reboots to take the address, losing the cache
+        online = false;
+        m_offlineUntilUs = nowUs + BOOT_TIME_US;
+        return;
+    }
+    m_cache.update(packet);
+    sendMSPViaEspnow(packet);
+}
+
+void TxNode::onReceive(const uint8_t *src, const uint8_t *data, uint8_t len)
+{
+    uint8_t bound = memcmp(uid, src, 6) == 0;
+    if (MSPLinkReceiver::isLinkFrame(data, len) && MSPLinkReceiver::isAck(data, len))
+    {
+        if (bound)
+        {
+            link.postAck(data, len);
+        }
+        return;
+    }
+    m_rxRing.push(&bound, 1, data, len);
+    maxRingUsed = max(maxRingUsed, m_rxRing.used());
+}
+
+void TxNode::loop()
+{
+    if (!online)
+    {
+        if (m_offlineUntilUs == 0 || nowUs < m_offlineUntilUs)
+        {
+            return;
+        }
+        online = true;
+        m_offlineUntilUs = 0;
+        m_cache.clear();
+        link.begin(MSP_LINK_SOURCE_TX, random(256));
+    }
+
+    if (m_traffic.vtxIntervalMs && nowUs >= m_nextVtxUs)
+    {
+        m_nextVtxUs += m_traffic.vtxIntervalMs * 1000ULL;
+        mspPacket_t packet;
+        packet.reset();
+        packet.makeCommand();
+        packet.function = MSP_SET_VTX_CONFIG;
+        lastChannel = random(VTX_CHANNELS);
+        packet.addByte(lastChannel);
+        packet.addByte(0);
+        uint32_t id = m_flows.nextId++;
+        putId(&packet, id);
+        m_flows.vtx.sent(id, boundVrxs());
+        fromHandset(&packet);
+    }
+    if (m_traffic.telemetryHz && nowUs >= m_nextTelemetryUs)
+    {
+        m_nextTelemetryUs += 1000000ULL / m_traffic.telemetryHz;
+        mspPacket_t packet;
+        packet.reset();
+        packet.makeCommand();
+        packet.function = MSP_ELRS_BACKPACK_CRSF_TLM;
+        uint32_t id = m_flows.nextId++;
+        putId(&packet, id);
+        // A battery frame's worth
+        for (uint8_t i = 0; i < 8; i++)
+        {
+            packet.addByte(i);
+        }
+        m_flows.telemetry.sent(id, boundVrxs());
+        fromHandset(&packet);
+    }
+
+    // Head-tracking goes out ahead of other traffic
+    mspPacket_t ptrPacket;
+    if (m_ptrMailbox.take(&ptrPacket, micros()))
+    {
+        m_flows.ptr.received(getId(&ptrPacket, 6), index);
+    }
+
+    // ProcessEspnow()
+    uint8_t record[1 + ESPNOW_MAX_FRAME_SIZE];
+    uint16_t recordLen;
+    while ((recordLen = m_rxRing.pop(record, sizeof(record))) != 0)
+    {
+        bool bound = record[0];
+        const uint8_t *frame = &record[1];
+        uint8_t frameLen = recordLen - 1;
+        if (MSPLinkReceiver::isLinkFrame(frame, frameLen))
+        {
+            if (!bound)
+            {
+                continue;
+            }
+            uint8_t ack[MSP_LINK_ACK_SIZE];
+            uint8_t ackLen;
+            bool fresh = linkReceiver.accept(frame, frameLen, ack, &ackLen);
+            if (ackLen)
+            {
+                m_bus.send(this, uid, ack, ackLen);
+            }
+            if (!fresh)
+            {
+                continue;
+            }
+            frame += MSP_LINK_HEADER_SIZE;
+            frameLen -= MSP_LINK_HEADER_SIZE;
+        }
+        m_espnowMsp.processReceivedBytes(frame, frameLen, [this, bound](mspPacket_t *packet) {
+            if (bound)
+            {
+                fromPeer(packet);
+            }
+        });
+    }
+
+    if (m_sendCached)
+    {
+        sendCachedMSP();
+        m_sendCached = false;
+    }
+    if (m_coalescer.due(micros(), m_traffic.coalesceUs))
+    {
+        m_coalescer.flush([this](uint8_t *f, uint8_t l, mspLinkClass_e c, uint32_t s) { sendCoalesced(f, l, c, s); });
+    }
+    link.update(millis(), [this](const uint8_t *data, uint8_t len) { m_bus.send(this, uid, data, len); });
+    if (link.gaveUp())
+    {
+        m_requestedDigestsSize = 0;
+        m_sendCached = true;
+    }
+}
+
+void TxNode::fromPeer(mspPacket_t *packet)
+{
+    switch (packet->function)
+    {
+    case MSP_ELRS_REQU_VTX_PKT:
+        m_requestedDigestsSize = packet->payloadSize > 1 ? packet->payloadSize - 1 : 0;
+        memcpy(m_requestedDigests, &packet->payload[1], m_requestedDigestsSize);
+        m_sendCached = true;
+        break;
+    case MSP_ELRS_BACKPACK_SET_PTR:
+        if (m_ptrMailbox.pending())
+        {
+            m_flows.ptr.superseded();
+        }
+        m_ptrMailbox.post(packet, micros());
+        break;
+    }
+}
+
+void TxNode::sendCoalesced(uint8_t *frame, uint8_t len, mspLinkClass_e linkClass, uint32_t startUs)
+{
+    link.stamp(frame, len, linkClass, millis());
+    m_bus.send(this, uid, frame, len);
+}
+
+void TxNode::sendMSPViaEspnow(mspPacket_t *packet)
+{
+    uint8_t nowDataOutput[MSP_FRAME_MAX_SIZE];
+    uint8_t packetSize = m_msp.convertToByteArray(packet, nowDataOutput);
+    if (!packetSize)
+    {
+        return;
+    }
+    auto send = [this](uint8_t *f, uint8_t l, mspLinkClass_e c, uint32_t s) { sendCoalesced(f, l, c, s); };
+
+    if (packet->function == MSP_ELRS_BIND)
+    {
+        m_coalescer.flush(send);
+        m_bus.send(this, broadcastAddress, nowDataOutput, packetSize);
+        return;
+    }
+
+    mspLinkClass_e linkClass = MSP_LINK_BEST_EFFORT;
+    if (packet->function == MSP_ELRS_BACKPACK_SET_PTR)
+    {
+        linkClass = MSP_LINK_LATEST;
+    }
+    for (uint16_t function : reliableFunctions)
+    {
+        if (function == packet->function)
+        {
+            linkClass = MSP_LINK_RELIABLE;
+        }
+    }
+    m_coalescer.add(nowDataOutput, packetSize, linkClass, micros(), send);
+
+    if (m_traffic.coalesceUs == 0 ||
+        packet->function == MSP_ELRS_BACKPACK_SET_HEAD_TRACKING ||
+        packet->function == MSP_ELRS_BACKPACK_SET_PTR)
+    {
+        m_coalescer.flush(send);
+    }
+}
+
+void TxNode::sendCachedMSP()
+{
+    cacheReplays++;
+    auto requested = [this](uint16_t function) -> uint16_t {
+        for (uint8_t i = 0; i + 4 <= m_requestedDigestsSize; i += 4)
+        {
+            if ((m_requestedDigests[i] | m_requestedDigests[i + 1] << 8) == function)
+            {
+                return m_requestedDigests[i + 2] | m_requestedDigests[i + 3] << 8;
+            }
+        }
+        return 0;
+    };
+    m_cache.replay(
+        [&requested](uint16_t function, uint16_t digest) { return requested(function) != digest; },
+        [this](mspPacket_t *packet) { sendMSPViaEspnow(packet); });
+
+    mspPacket_t out;
+    out.reset();
+    out.makeResponse();
+    out.function = MSP_ELRS_REQU_VTX_PKT;
+    for (uint8_t i = 0; i < m_cache.size() && out.payloadSize + 4 <= MSP_PORT_INBUF_SIZE; i++)
+    {
+        out.addByte(m_cache.function(i) & 0xFF);
+        out.addByte(m_cache.function(i) >> 8);
+        out.addByte(m_cache.digest(i) & 0xFF);
+        out.addByte(m_cache.digest(i) >> 8);
+    }
+    sendMSPViaEspnow(&out);
+}
+
+std::vector<uint16_t> TxNode::boundVrxs() const
+{
+    std::vector<uint16_t> bound;
+    for (const VrxNode *vrx : m_vrxs)
+    {
+        if (vrx->online && !vrx->binding && memcmp(vrx->uid, uid, 6) == 0)
+        {
+            bound.push_back(vrx->index);
+        }
+    }
+    return bound;
+}
+
+/////////// VrxNode ///////////
+
+VrxNode::VrxNode(EspnowBus &bus, flows_t &flows, const trafficConfig_t &traffic, uint16_t index, bool headTracker)
+    : index(index), m_bus(bus), m_flows(flows), m_traffic(traffic), m_headTracker(headTracker)
+{
+    online = false;
+    linkReceiver.begin(index);
+}
+
+void VrxNode::boot(uint64_t at, const uint8_t *address, bool bindingMode)
+{
+    bootUs = at;
+    binding = bindingMode;
+    if (binding)
+    {
+        // Whatever was left from before, unique to this one
+        uint8_t stale[6] = {0x02, 0x00, 0x00, 0x00, (uint8_t)(index >> 8), (uint8_t)index};
+        memcpy(uid, stale, 6);
+    }
+    else
+    {
+        memcpy(uid, address, 6);
+        boundUs = at;
+    }
+}
+
+void VrxNode::onReceive(const uint8_t *src, const uint8_t *data, uint8_t len)
+{
+    uint8_t bound = memcmp(uid, src, 6) == 0;
+    m_rxRing.push(&bound, 1, data, len);
+    maxRingUsed = max(maxRingUsed, m_rxRing.used());
+}
+
+void VrxNode::processEspnowFrame(const uint8_t *data, uint8_t len, bool bound)
+{
+    bool accept = binding || bound;
+    const uint8_t *frame = data;
+    uint8_t frameLen = len;
+    if (MSPLinkReceiver::isLinkFrame(data, len))
+    {
+        uint8_t ack[MSP_LINK_ACK_SIZE];
+        uint8_t ackLen;
+        bool fresh = linkReceiver.accept(data, len, ack, &ackLen);
+        if (ackLen && bound)
+        {
+            m_bus.send(this, uid, ack, ackLen);
+        }
+        if (!fresh)
+        {
+            return;
+        }
+        frame += MSP_LINK_HEADER_SIZE;
+        frameLen -= MSP_LINK_HEADER_SIZE;
+    }
+    m_msp.processReceivedBytes(frame, frameLen, [this, accept](mspPacket_t *packet) {
+        if (accept)
+        {
+            if (!synced && !binding)
+            {
+                synced = true;
+                syncedUs = nowUs;
+            }
+            processMSPPacket(packet);
+        }
+    });
+}
+
+void VrxNode::processMSPPacket(mspPacket_t *packet)
+{
+    if (binding)
+    {
+        if (packet->function == MSP_ELRS_BIND && packet->payloadSize >= 6)
+        {
+            memcpy(uid, packet->payload, 6);
+            boundUs = nowUs;
+            m_rebootAtUs = nowUs + VRX_BIND_REBOOT_MS * 1000ULL;
+        }
+        return;
+    }
+
+    switch (packet->function)
+    {
+    case MSP_SET_VTX_CONFIG:
+        if (packet->payload[0] < TxNode::VTX_CHANNELS)
+        {
+            appliedChannel = packet->payload[0];
+            appliedVTXDigest = packet->digest();
+        }
+        m_flows.vtx.received(getId(packet, 2), index);
+        break;
+    case MSP_ELRS_BACKPACK_CRSF_TLM:
+        m_flows.telemetry.received(getId(packet, 0), index);
+        break;
+    case MSP_ELRS_SET_OSD:
+        m_flows.osd.received(getId(packet, 3), index);
+        break;
+    }
+}
+
+void VrxNode::onSent(bool delivered)
+{
+    if (m_syncState == SYNC_SENT)
+    {
+        m_syncState = delivered ? SYNC_DELIVERED : SYNC_FAILED;
+    }
+}
+
+void VrxNode::serviceStateSync(uint32_t now)
+{
+    switch (m_syncState)
+    {
+    case SYNC_FAILED:
+        m_syncNextRequest = now + m_syncRetryInterval;
+        m_syncRetryInterval = min(m_syncRetryInterval * 2, (uint32_t)VRX_SYNC_RETRY_MAX_MS);
+        m_syncState = SYNC_IDLE;
+        break;
+    case SYNC_DELIVERED:
+        m_syncNextRequest = now + VRX_SYNC_REPLY_TIMEOUT_MS;
+        m_syncRetryInterval = VRX_SYNC_RETRY_MIN_MS;
+        m_syncState = SYNC_IDLE;
+        break;
+    case SYNC_SENT:
+        if (now - m_syncSentAt > VRX_SYNC_RETRY_MAX_MS)
+        {
+            m_syncState = SYNC_FAILED;
+        }
+        break;
+    case SYNC_IDLE:
+        if ((int32_t)(now - m_syncNextRequest) >= 0)
+        {
+            m_syncSentAt = now;
+            m_syncState = SYNC_SENT;
+            requestVTXPacket();
+        }
+        break;
+    }
+}
+
+void VrxNode::requestVTXPacket()
+{
+    syncRequests++;
+    mspPacket_t packet;
+    packet.reset();
+    packet.makeCommand();
+    packet.function = MSP_ELRS_REQU_VTX_PKT;
+    packet.addByte(0);
+    packet.addByte(MSP_SET_VTX_CONFIG & 0xFF);
+    packet.addByte(MSP_SET_VTX_CONFIG >> 8);
+    packet.addByte(appliedVTXDigest & 0xFF);
+    packet.addByte(appliedVTXDigest >> 8);
+    sendMSPViaEspnow(&packet);
+}
+
+void VrxNode::sendMSPViaEspnow(mspPacket_t *packet)
+{
+    if (binding)
+    {
+        return;
+    }
+    uint8_t nowDataOutput[MSP_FRAME_MAX_SIZE];
+    uint8_t packetSize = m_msp.convertToByteArray(packet, nowDataOutput);
+    if (!packetSize || !m_bus.send(this, uid, nowDataOutput, packetSize))
+    {
+        onSent(false);
+    }
+}
+
+void VrxNode::loop()
+{
+    if (m_rebootAtUs != 0 && nowUs >= m_rebootAtUs)
+    {
+        // Comes back up bound to the address it was given
+        m_rebootAtUs = 0;
+        online = false;
+        binding = false;
+        bootUs = nowUs + BOOT_TIME_US;
+    }
+    if (!online)
+    {
+        if (nowUs < bootUs || m_rebootAtUs != 0)
+        {
+            return;
+        }
+        online = true;
+        memcpy(mac, uid, 6);
+        synced = false;
+        m_syncState = SYNC_IDLE;
+        m_syncRetryInterval = VRX_SYNC_RETRY_MIN_MS;
+        m_syncNextRequest = millis();
+        m_nextPtrUs = nowUs;
+    }
+
+    uint8_t record[1 + ESPNOW_MAX_FRAME_SIZE];
+    uint16_t recordLen;
+    while ((recordLen = m_rxRing.pop(record, sizeof(record))) != 0)
+    {
+        processEspnowFrame(&record[1], recordLen - 1, record[0]);
+    }
+
+    uint32_t now = millis();
+    if (!binding && !synced && now - bootUs / 1000 < VRX_SYNC_WINDOW_MS)
+    {
+        serviceStateSync(now);
+    }
+
+    if (m_headTracker && !binding && m_traffic.ptrHz && nowUs >= m_nextPtrUs)
+    {
+        m_nextPtrUs += 1000000ULL / m_traffic.ptrHz;
+        mspPacket_t packet;
+        packet.reset();
+        packet.makeCommand();
+        packet.function = MSP_ELRS_BACKPACK_SET_PTR;
+        for (uint8_t i = 0; i < 6; i++)
+        {
+            packet.addByte(0x80);
+        }
+        uint32_t id = m_flows.nextId++;
+        putId(&packet, id);
+        m_flows.ptr.sent(id, {ptrReceiver});
+        sendMSPViaEspnow(&packet);
+    }
+}
+
+/////////// TimerNode ///////////
+
+TimerNode::TimerNode(EspnowBus &bus, flows_t &flows, const trafficConfig_t &traffic, const std::vector<TxNode *> &pilots,
+                     const std::vector<VrxNode *> &vrxs, uint16_t index)
+    : m_bus(bus), m_flows(flows), m_traffic(traffic), m_pilots(pilots), m_vrxs(vrxs)
+{
+    link.begin(MSP_LINK_SOURCE_TIMER, random(256));
+    m_nextUs = nowUs;
+    // Only what the timer sends is modelled, it takes the pilots' addresses in turn
+    online = false;
+}
+
+std::vector<uint16_t> TimerNode::vrxsOf(const uint8_t *uid) const
+{
+    std::vector<uint16_t> found;
+    for (const VrxNode *vrx : m_vrxs)
+    {
+        if (vrx->online && !vrx->binding && memcmp(vrx->uid, uid, 6) == 0)
+        {
+            found.push_back(vrx->index);
+        }
+    }
+    return found;
+}
+
+void TimerNode::loop()
+{
+    if (m_traffic.osdHz == 0 || m_pilots.empty() || nowUs < m_nextUs)
+    {
+        return;
+    }
+    // Every pilot gets osdHz messages a second, one send per step
+    m_nextUs += 1000000ULL / m_traffic.osdHz / m_pilots.size();
+    const uint8_t *address = m_pilots[m_nextPilot]->uid;
+    m_nextPilot = (m_nextPilot + 1) % m_pilots.size();
+
+    mspPacket_t packet;
+    packet.reset();
+    packet.makeCommand();
+    packet.function = MSP_ELRS_SET_OSD;
+    packet.addByte(0x03);   // write string
+    packet.addByte(0);
+    packet.addByte(0);
+    uint32_t id = m_flows.nextId++;
+    putId(&packet, id);
+    const char *text = "LAP 3 0:41.27";
+    for (const char *c = text; *c; c++)
+    {
+        packet.addByte(*c);
+    }
+    m_flows.osd.sent(id, vrxsOf(address));
+
+    uint8_t nowDataOutput[MSP_LINK_HEADER_SIZE + MSP_FRAME_MAX_SIZE];
+    uint8_t packetSize = m_msp.convertToByteArray(&packet, &nowDataOutput[MSP_LINK_HEADER_SIZE]);
+    packetSize += MSP_LINK_HEADER_SIZE;
+    link.stamp(nowDataOutput, packetSize, MSP_LINK_BEST_EFFORT, millis());
+    // The station MAC follows the destination, SetStationAddress()
+    memcpy(mac, address, 6);
+    m_bus.send(this, address, nowDataOutput, packetSize);
+}
+
+}
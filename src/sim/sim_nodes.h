@@ -0,0 +1,225 @@
+#pragma once
+
+#include <Arduino.h>
+#include <map>
+#include <vector>
+
+#include "msp.h"
+#include "msptypes.h"
+#include "mspcache.h"
+#include "mspcoalesce.h"
+#include "msplink.h"
+#include "mspmailbox.h"
+#include "SPSCRing.h"
+#include "backpack_link.h"
+
+#include "espnow_bus.h"
+
+namespace sim
+{
+
+/**
+ * @brief: Delivery of one kind of traffic, each message carries a 32 bit id
+ *
+ * A message is expected at the receivers listed when it is sent. Anything
+ * else that arrives with its id, e.g. a cache replay to a backpack that joined
+ * later, is not counted against it.
+ */
+class Flow
+{
+public:
+    explicit Flow(const char *name) : m_name(name) {}
+
+    void sent(uint32_t id, const std::vector<uint16_t> &expected);
+    void received(uint32_t id, uint16_t receiver);
+    // A newer message replaced this one before it was delivered
+    void superseded() { m_superseded++; }
+
+    void report() const;
+
+private:
+    typedef struct {
+        uint64_t sentUs;
+        std::vector<uint16_t> expected;
+        std::vector<uint16_t> seen;
+    } record_t;
+
+    const char *m_name;
+    std::map<uint32_t, record_t> m_records;
+    uint32_t m_sent = 0;
+    uint32_t m_expected = 0;
+    uint32_t m_delivered = 0;
+    uint32_t m_duplicates = 0;
+    uint32_t m_superseded = 0;
+    std::vector<uint32_t> m_latencies;
+};
+
+typedef struct {
+    Flow vtx {"vtx"};
+    Flow telemetry {"telemetry"};
+    Flow ptr {"ptr"};
+    Flow osd {"osd"};
+    uint32_t nextId = 1;
+} flows_t;
+
+typedef struct {
+    uint32_t coalesceUs;    // ESPNOW_COALESCE_TIMEOUT_US
+    uint32_t vtxIntervalMs; // handset VTX config changes
+    uint32_t telemetryHz;   // CRSF telemetry the handset passes on
+    uint32_t ptrHz;         // head tracker samples, from the first VRX of each pilot
+    uint32_t osdHz;         // messages from a timer to each pilot
+} trafficConfig_t;
+
+class VrxNode;
+
+/**
+ * @brief: The ESP-NOW side of Tx_main.cpp
+ *
+ * MSP from the handset is cached, coalesced and numbered exactly as the
+ * firmware does it, using the same classes. Frames received are copied into
+ * the ring in the callback and handled from loop().
+ */
+class TxNode : public BusNode
+{
+public:
+    TxNode(EspnowBus &bus, flows_t &flows, const trafficConfig_t &traffic, const uint8_t *uid, uint16_t index);
+
+    // ProcessMSPPacketFromTX()
+    void fromHandset(mspPacket_t *packet);
+    void onReceive(const uint8_t *src, const uint8_t *data, uint8_t len) override;
+    void loop() override;
+
+    // Send MSP_ELRS_BIND with this TX's address, from the handset
+    void bind();
+    void addVrx(VrxNode *vrx) { m_vrxs.push_back(vrx); }
+
+    uint8_t uid[6];
+    uint16_t index;
+    uint32_t maxRingUsed = 0;
+    MSPLinkSender link;
+    MSPLinkReceiver linkReceiver;
+    uint32_t cacheReplays = 0;
+    // The channel the handset last asked for
+    uint8_t lastChannel = 0xFF;
+
+    static const uint8_t VTX_CHANNELS = 48;
+
+private:
+    EspnowBus &m_bus;
+    flows_t &m_flows;
+    const trafficConfig_t &m_traffic;
+    std::vector<VrxNode *> m_vrxs;
+
+    MSP m_msp;
+    MSP m_espnowMsp;
+    MSPCache<MSP_CACHE_MAX_ENTRIES, MSP_CACHE_POOL_SIZE> m_cache;
+    MSPCoalescer m_coalescer;
+    MSPMailbox m_ptrMailbox;
+    SPSCRing<ESPNOW_RX_RING_SIZE> m_rxRing;
+    bool m_sendCached = false;
+    uint8_t m_requestedDigests[MSP_PORT_INBUF_SIZE];
+    uint8_t m_requestedDigestsSize = 0;
+
+    uint64_t m_nextVtxUs;
+    uint64_t m_nextTelemetryUs;
+    uint64_t m_offlineUntilUs = 0;
+
+    void sendMSPViaEspnow(mspPacket_t *packet);
+    void sendCoalesced(uint8_t *frame, uint8_t len, mspLinkClass_e linkClass, uint32_t startUs);
+    void sendCachedMSP();
+    void fromPeer(mspPacket_t *packet);
+    std::vector<uint16_t> boundVrxs() const;
+};
+
+/**
+ * @brief: The ESP-NOW side of Vrx_main.cpp
+ *
+ * Frames go through the ring to loop() like the firmware's, state sync with
+ * the TX backpack retries with the same backoff, and the head tracking VRX
+ * sends its PTR samples to the TX.
+ */
+class VrxNode : public BusNode
+{
+public:
+    VrxNode(EspnowBus &bus, flows_t &flows, const trafficConfig_t &traffic, uint16_t index, bool headTracker);
+
+    void onReceive(const uint8_t *src, const uint8_t *data, uint8_t len) override;
+    void onSent(bool delivered) override;
+    void loop() override;
+
+    // Power on at bootUs, already bound to uid or waiting in binding mode for the TX that owns it
+    void boot(uint64_t bootUs, const uint8_t *uid, bool binding);
+
+    uint8_t uid[6];
+    const uint8_t *intendedUid = nullptr;
+    uint16_t index;
+    bool binding = false;
+    bool synced = false;
+    uint64_t bootUs = 0;
+    uint64_t boundUs = 0;
+    uint64_t syncedUs = 0;
+    uint16_t appliedVTXDigest = 0;
+    uint8_t appliedChannel = 0xFF;
+    uint32_t syncRequests = 0;
+    // The TX expected to get this one's PTR samples
+    uint16_t ptrReceiver = 0;
+    uint32_t maxRingUsed = 0;
+    MSPLinkReceiver linkReceiver;
+
+private:
+    typedef enum {
+        SYNC_IDLE,
+        SYNC_SENT,
+        SYNC_DELIVERED,
+        SYNC_FAILED
+    } syncState_e;
+
+    EspnowBus &m_bus;
+    flows_t &m_flows;
+    const trafficConfig_t &m_traffic;
+    bool m_headTracker;
+    MSP m_msp;
+    SPSCRing<ESPNOW_RX_RING_SIZE> m_rxRing;
+
+    syncState_e m_syncState = SYNC_IDLE;
+    uint32_t m_syncNextRequest = 0;
+    uint32_t m_syncRetryInterval = 0;
+    uint32_t m_syncSentAt = 0;
+    uint64_t m_rebootAtUs = 0;
+    uint64_t m_nextPtrUs = 0;
+
+    void processEspnowFrame(const uint8_t *data, uint8_t len, bool bound);
+    void processMSPPacket(mspPacket_t *packet);
+    void sendMSPViaEspnow(mspPacket_t *packet);
+    void serviceStateSync(uint32_t now);
+    void requestVTXPacket();
+};
+
+/**
+ * @brief: The ESP-NOW side of Timer_main.cpp, sending OSD messages to each pilot in turn
+ */
+class TimerNode : public BusNode
+{
+public:
+    TimerNode(EspnowBus &bus, flows_t &flows, const trafficConfig_t &traffic, const std::vector<TxNode *> &pilots,
+              const std::vector<VrxNode *> &vrxs, uint16_t index);
+
+    void onReceive(const uint8_t *src, const uint8_t *data, uint8_t len) override {}
+    void loop() override;
+
+    MSPLinkSender link;
+
+private:
+    EspnowBus &m_bus;
+    flows_t &m_flows;
+    const trafficConfig_t &m_traffic;
+    const std::vector<TxNode *> &m_pilots;
+    const std::vector<VrxNode *> &m_vrxs;
+    MSP m_msp;
+    uint64_t m_nextUs;
+    size_t m_nextPilot = 0;
+
+    std::vector<uint16_t> vrxsOf(const uint8_t *uid) const;
+};
+
+}
@@ -9,38 +9,55 @@ SkyzoneMSP::Init()
     m_delay = 0;
 }
 
-void
+bool
 SkyzoneMSP::SendIndexCmd(uint8_t index)
 {
-    uint8_t retries = 3;
-    while (GetChannelIndex() != index && retries > 0)
+    // Set then verify, a newer index takes over the retries of one still going
+    m_targetIndex = index;
+    m_indexRetries = VRX_SET_INDEX_RETRIES;
+    m_indexFailed = false;
+    GetChannelIndex([this](uint8_t current) { VerifyChannelIndex(current); });
+    return true;
+}
+
+void
+SkyzoneMSP::VerifyChannelIndex(uint8_t current)
+{
+    if (current == m_targetIndex)
+    {
+        m_targetIndex = CHANNEL_INDEX_UNKNOWN;
+        return;
+    }
+    if (m_indexRetries == 0)
     {
-        SetChannelIndex(index);
-        retries--;
+        DBGLN("Skyzone module: Gave up setting channel index %d", m_targetIndex);
+        m_targetIndex = CHANNEL_INDEX_UNKNOWN;
+        m_indexFailed = true;
+        return;
     }
+    m_indexRetries--;
+    SetChannelIndex(m_targetIndex);
+    GetChannelIndex([this](uint8_t current) { VerifyChannelIndex(current); });
 }
 
-uint8_t
-SkyzoneMSP::GetChannelIndex()
+void
+SkyzoneMSP::GetChannelIndex(const std::function<void(uint8_t index)> &onIndex)
 {
-    MSP msp;
     mspPacket_t packet;
     packet.reset();
     packet.makeCommand();
     packet.function = MSP_ELRS_BACKPACK_GET_CHANNEL_INDEX;
 
-    // Send request, then wait for a response back from the VRX
-    bool receivedResponse = msp.awaitPacket(&packet, m_port, VRX_RESPONSE_TIMEOUT);
-
-    if (receivedResponse)
-    {
-        mspPacket_t* packetResponse = msp.getReceivedPacket();
-        msp.markPacketReceived();
-        return packetResponse->readByte();
-    }
-
-    DBGLN("Skyzone module: Exceeded timeout while waiting for channel index response");
-    return CHANNEL_INDEX_UNKNOWN;
+    // Send request, the response back from the VRX is picked up by Loop()
+    sendRequest(&packet, VRX_RESPONSE_TIMEOUT, [onIndex](mspPacket_t *response) {
+        if (response == nullptr)
+        {
+            DBGLN("Skyzone module: Exceeded timeout while waiting for channel index response");
+            onIndex(CHANNEL_INDEX_UNKNOWN);
+            return;
+        }
+        onIndex(response->readByte());
+    });
 }
 
 void
@@ -56,27 +73,24 @@ SkyzoneMSP::SetChannelIndex(uint8_t index)
     msp.sendPacket(&packet, m_port);
 }
 
-uint8_t
-SkyzoneMSP::GetRecordingState()
+void
+SkyzoneMSP::GetRecordingState(const std::function<void(uint8_t state)> &onState)
 {
-    MSP msp;
     mspPacket_t packet;
     packet.reset();
     packet.makeCommand();
     packet.function = MSP_ELRS_BACKPACK_GET_RECORDING_STATE;
 
-    // Send request, then wait for a response back from the VRX
-    bool receivedResponse = msp.awaitPacket(&packet, m_port, VRX_RESPONSE_TIMEOUT);
-
-    if (receivedResponse)
-    {
-        mspPacket_t *packetResponse = msp.getReceivedPacket();
-        msp.markPacketReceived();
-        return packetResponse->readByte() ? VRX_DVR_RECORDING_ACTIVE : VRX_DVR_RECORDING_INACTIVE;
-    }
-
-    DBGLN("Skyzone module: Exceeded timeout while waiting for recording state response");
-    return VRX_DVR_RECORDING_UNKNOWN;
+    // Send request, the response back from the VRX is picked up by Loop()
+    sendRequest(&packet, VRX_RESPONSE_TIMEOUT, [onState](mspPacket_t *response) {
+        if (response == nullptr)
+        {
+            DBGLN("Skyzone module: Exceeded timeout while waiting for recording state response");
+            onState(VRX_DVR_RECORDING_UNKNOWN);
+            return;
+        }
+        onState(response->readByte() ? VRX_DVR_RECORDING_ACTIVE : VRX_DVR_RECORDING_INACTIVE);
+    });
 }
 
 void
@@ -114,8 +128,8 @@ SkyzoneMSP::SendRecordingState()
 void
 SkyzoneMSP::SetOSD(mspPacket_t *packet)
 {
-    MSP msp;
-    msp.sendPacket(packet, m_port);
+    // Only what changed since the last draw goes on to the goggles
+    m_osd.apply(packet, [this](mspPacket_t *forward) { msp.sendPacket(forward, m_port); });
 }
 
 void
@@ -3,11 +3,13 @@
 #include "msp.h"
 #include "msptypes.h"
 #include "module_base.h"
+#include "osd_framebuffer.h"
 #include <Arduino.h>
 
 #define VRX_BOOT_DELAY              2000
 
 #define VRX_RESPONSE_TIMEOUT        500
+#define VRX_SET_INDEX_RETRIES       3
 #define VRX_UART_BAUD               115200  // skyzone uses 115k baud between the ESP32-PICO and their MCU
 
 #define CHANNEL_INDEX_UNKNOWN       255
@@ -20,10 +22,13 @@ class SkyzoneMSP : public MSPModuleBase
 public:
     SkyzoneMSP(Stream *port) : MSPModuleBase(port) {};
     void Init();
-    void SendIndexCmd(uint8_t index);
-    uint8_t GetChannelIndex();
+    bool SendIndexCmd(uint8_t index);
+    bool IndexCmdPending() { return m_targetIndex != CHANNEL_INDEX_UNKNOWN; }
+    bool IndexCmdFailed() { return m_indexFailed; }
+    // Replies arrive from Loop(), CHANNEL_INDEX_UNKNOWN or VRX_DVR_RECORDING_UNKNOWN on timeout
+    void GetChannelIndex(const std::function<void(uint8_t index)> &onIndex);
     void SetChannelIndex(uint8_t index);
-    uint8_t GetRecordingState();
+    void GetRecordingState(const std::function<void(uint8_t state)> &onState);
     void SetRecordingState(uint8_t recordingState, uint16_t delay);
     void SetOSD(mspPacket_t *packet);
     void SendHeadTrackingEnableCmd(bool enable);
@@ -31,8 +36,13 @@ public:
 
 private:
     void SendRecordingState();
+    void VerifyChannelIndex(uint8_t index);
 
     uint8_t     m_recordingState;
     uint16_t    m_delay;
     uint32_t    m_delayStartMillis;
+    uint8_t     m_targetIndex = CHANNEL_INDEX_UNKNOWN;
+    uint8_t     m_indexRetries;
+    bool        m_indexFailed = false;
+    OsdFramebuffer m_osd;
 };
@@ -6,6 +6,7 @@ void
 SteadyView::Init()
 {
     ModuleBase::Init();
+    _shadow.invalidate();
     
     pinMode(PIN_MOSI, OUTPUT);
     pinMode(PIN_CLK, OUTPUT);
@@ -17,27 +18,50 @@ SteadyView::Init()
 
     DBGLN("SPI config complete");
     delay(100);
+    _spi.setIdleMosi(HIGH);
     SetMode(ModeMix);
 }
 
-void
+bool
 SteadyView::SendIndexCmd(uint8_t index)
 {
     DBG("Setting index ");
     DBGLN("%x", index);
 
-    uint16_t f = frequencyTable[index];
-    uint32_t data = ((((f - 479) / 2) / 32) << 7) | (((f - 479) / 2) % 32);
-    uint32_t newRegisterData = SYNTHESIZER_REG_B  | (RX5808_WRITE_CTRL_BIT << 4) | (data << 5);
+    if (index >= CHANNEL_COUNT)
+    {
+        return false;
+    }
+    changeChannel(rtc6705ChannelData[index]);
+    return true;
+}
+
+bool
+SteadyView::SendFrequencyCmd(uint16_t mhz)
+{
+    DBGLN("Setting frequency %d", mhz);
 
-    uint32_t currentRegisterData = SYNTHESIZER_REG_B | (RX5808_WRITE_CTRL_BIT << 4) | rtc6705readRegister(SYNTHESIZER_REG_B);
+    if (mhz < RTC6705_MIN_MHZ || mhz > RTC6705_MAX_MHZ)
+    {
+        return false;
+    }
+    changeChannel(rtc6705FrequencyData(mhz));
+    return true;
+}
+
+void
+SteadyView::changeChannel(uint32_t data)
+{
+    currentData = data;
 
-    if (newRegisterData != currentRegisterData)
+    // Already written, or queued to be
+    if (_shadow.matches(SYNTHESIZER_REG_B, data))
     {
-        rtc6705WriteRegister(SYNTHESIZER_REG_A  | (RX5808_WRITE_CTRL_BIT << 4) | (0x8 << 5));
-        rtc6705WriteRegister(newRegisterData);
+        return;
     }
-    currentIndex = index;
+
+    rtc6705WriteRegister(SYNTHESIZER_REG_A  | (RX5808_WRITE_CTRL_BIT << 4) | (0x8 << 5));
+    rtc6705WriteRegister(SYNTHESIZER_REG_B  | (RX5808_WRITE_CTRL_BIT << 4) | (data << 5));
 }
 
 void
@@ -45,44 +69,54 @@ SteadyView::SetMode(videoMode_t mode)
 {
     if (mode == ModeMix)
     {
-        digitalWrite(PIN_CLK, HIGH);
-        delay(100);
-        digitalWrite(PIN_CLK, LOW);
-        delay(500);
+        // A clock strobe with CS high switches the receiver to mix mode
+        _spi.queueClockLevel(HIGH, 100000);
+        _spi.queueClockLevel(LOW, 500000);
     }
-    uint16_t f = frequencyTable[currentIndex];
-    uint32_t data = ((((f - 479) / 2) / 32) << 7) | (((f - 479) / 2) % 32);
-    uint32_t registerData = SYNTHESIZER_REG_B  | (RX5808_WRITE_CTRL_BIT << 4) | (data << 5);
+    uint32_t registerData = SYNTHESIZER_REG_B  | (RX5808_WRITE_CTRL_BIT << 4) | (currentData << 5);
 
-    rtc6705WriteRegister(SYNTHESIZER_REG_A  | (RX5808_WRITE_CTRL_BIT << 4) | (0x8 << 5));
-    delayMicroseconds(500);
+    rtc6705WriteRegister(SYNTHESIZER_REG_A  | (RX5808_WRITE_CTRL_BIT << 4) | (0x8 << 5), 500);
     rtc6705WriteRegister(SYNTHESIZER_REG_A  | (RX5808_WRITE_CTRL_BIT << 4) | (0x8 << 5));
     rtc6705WriteRegister(registerData);
 }
 
 void
-SteadyView::rtc6705WriteRegister(uint32_t buf)
+SteadyView::Loop(uint32_t now)
 {
-    uint32_t periodMicroSec = 1000000 / BIT_BANG_FREQ;
+    _spi.update();
 
-    digitalWrite(PIN_CS, LOW);
-    delayMicroseconds(periodMicroSec);
-
-    for (uint8_t i = 0; i < RX5808_PACKET_LENGTH; ++i)
+    // Pick up a channel changed on the receiver itself
+    if (!_spi.busy() && _shadow.verifyDue(SYNTHESIZER_REG_B, now))
     {
-        digitalWrite(PIN_MOSI, buf & 0x01);
-        delayMicroseconds(periodMicroSec / 4);
-        digitalWrite(PIN_CLK, HIGH);
-        delayMicroseconds(periodMicroSec / 4);
-        digitalWrite(PIN_CLK, LOW);
-        delayMicroseconds(periodMicroSec / 4);
+        uint32_t data = rtc6705readRegister(SYNTHESIZER_REG_B) >> 5;
+        if (!_shadow.matches(SYNTHESIZER_REG_B, data))
+        {
+            DBGLN("RTC6705 REG_B changed outside the backpack");
+            _shadow.set(SYNTHESIZER_REG_B, data);
+        }
+    }
 
-        buf >>= 1;
+    ModuleBase::Loop(now);
+}
+
+void
+SteadyView::rtc6705WriteRegister(uint32_t buf, uint32_t holdMicroSec)
+{
+    uint8_t reg = buf & 0x0F;
+    if (reg == POWER_DOWN_CONTROL_REGISTER)
+    {
+        _shadow.invalidate();
     }
 
-    delayMicroseconds(periodMicroSec);
-    digitalWrite(PIN_MOSI, HIGH);
-    digitalWrite(PIN_CS, HIGH);
+    uint32_t periodMicroSec = 1000000 / BIT_BANG_FREQ;
+    if (_spi.queueWrite(buf, RX5808_PACKET_LENGTH, false, periodMicroSec, holdMicroSec))
+    {
+        _shadow.set(reg, buf >> 5);
+    }
+    else
+    {
+        _shadow.invalidate();
+    }
 }
 
 uint32_t
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <Arduino.h>
+
+#define TELEMETRY_FORWARD_SLOTS     4
+#define TELEMETRY_FORWARD_FRAME_MAX 64
+
+/**
+ * @brief: Rate limited forwarding of telemetry frames to a UART
+ *
+ * Each slot holds the latest frame of one telemetry type. Posting replaces a
+ * frame that has not gone out yet, as only the newest value is worth showing,
+ * and update() sends each slot no more often than its interval, one write per
+ * frame. This keeps the UART load to the goggles fixed however fast telemetry
+ * arrives over ESP-NOW.
+ */
+class TelemetryForwarder
+{
+public:
+    TelemetryForwarder(Stream *port) : _port(port) {}
+
+    // Minimum time between frames of a slot, 0 sends each on the next update()
+    void setInterval(uint8_t slot, uint16_t intervalMs)
+    {
+        _slots[slot].intervalMs = intervalMs;
+    }
+
+    void post(uint8_t slot, const uint8_t *frame, uint8_t len)
+    {
+        Slot &s = _slots[slot];
+        if (s.pending)
+        {
+            _superseded++;
+        }
+        s.len = min(len, (uint8_t)TELEMETRY_FORWARD_FRAME_MAX);
+        memcpy(s.frame, frame, s.len);
+        s.pending = true;
+    }
+
+    void update(uint32_t now)
+    {
+        for (uint8_t i = 0; i < TELEMETRY_FORWARD_SLOTS; i++)
+        {
+            Slot &s = _slots[i];
+            if (s.pending && now - s.lastSentMs >= s.intervalMs)
+            {
+                _port->write(s.frame, s.len);
+                s.pending = false;
+                s.lastSentMs = now;
+            }
+        }
+    }
+
+    // Frames replaced by a newer one before they were sent
+    uint32_t superseded() const { return _superseded; }
+
+private:
+    struct Slot
+    {
+        uint8_t frame[TELEMETRY_FORWARD_FRAME_MAX];
+        uint8_t len = 0;
+        bool pending = false;
+        uint16_t intervalMs = 0;
+        uint32_t lastSentMs = 0;
+    };
+
+    Stream *_port;
+    Slot _slots[TELEMETRY_FORWARD_SLOTS];
+    uint32_t _superseded = 0;
+};
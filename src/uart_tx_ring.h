@@ -0,0 +1,59 @@
+#pragma once
+
+#include <Arduino.h>
+
+/**
+ * @brief: Byte ring between whole frames produced in loop() and a UART
+ *
+ * Frames are copied in whole or not at all, so the host never sees a partial
+ * frame, and drain() hands the UART as much as its TX FIFO has room for in one
+ * write. A burst of radio traffic then waits here rather than in a queue of
+ * packets processed one per loop(). Not safe to share with a callback.
+ */
+template <uint32_t RING_SIZE>
+class UartTxRing
+{
+public:
+    UartTxRing(Stream *port) : _port(port) {}
+
+    // Queue a frame, returns false if it does not fit
+    bool write(const uint8_t *data, uint32_t len)
+    {
+        if (len > RING_SIZE - _count)
+        {
+            return false;
+        }
+        uint32_t tail = (_head + _count) % RING_SIZE;
+        uint32_t first = min(len, RING_SIZE - tail);
+        memcpy(&_buffer[tail], data, first);
+        memcpy(&_buffer[0], data + first, len - first);
+        _count += len;
+        return true;
+    }
+
+    // Send what the UART can take without blocking
+    void drain()
+    {
+        while (_count > 0)
+        {
+            int room = _port->availableForWrite();
+            if (room <= 0)
+                return;
+            uint32_t n = min(min((uint32_t)room, _count), RING_SIZE - _head);
+            n = _port->write(&_buffer[_head], n);
+            if (n == 0)
+                return;
+            _head = (_head + n) % RING_SIZE;
+            _count -= n;
+        }
+    }
+
+    uint32_t free() const { return RING_SIZE - _count; }
+    uint32_t size() const { return _count; }
+
+private:
+    Stream *_port;
+    uint8_t _buffer[RING_SIZE];
+    uint32_t _head = 0;
+    uint32_t _count = 0;
+};
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <Arduino.h>
+#include "msplink.h"
+#include "stats.h"
+
+#if defined(PLATFORM_ESP32)
+  #include <esp_idf_version.h>
+  #include <esp_now.h>
+  #include <esp_wifi.h>
+#endif
+
+// No frames for this long, and the radio is let sleep
+#ifndef VRX_POWER_SAVE_AFTER_MS
+#define VRX_POWER_SAVE_AFTER_MS     3000
+#endif
+
+// While saving the radio listens VRX_POWER_WAKE_WINDOW_MS out of every
+// VRX_POWER_WAKE_INTERVAL_MS. The TX backpack resends a reliable frame every
+// MSP_LINK_RETRY_MS, so with a window at least that long and the attempts
+// spanning the rest of the interval one of them always lands in a window.
+#define VRX_POWER_WAKE_WINDOW_MS    40
+#define VRX_POWER_WAKE_INTERVAL_MS  120
+
+static_assert(VRX_POWER_WAKE_WINDOW_MS >= MSP_LINK_RETRY_MS, "a resend can fall between two wake windows");
+static_assert(VRX_POWER_WAKE_INTERVAL_MS <= MSP_LINK_RETRY_MS * MSP_LINK_MAX_RETRIES + VRX_POWER_WAKE_WINDOW_MS,
+    "resends do not span the time the radio sleeps");
+
+/**
+ * @brief: Lets the radio and CPU of a VRX backpack sleep while nothing is happening
+ *
+ * Full power is kept while frames arrive, and brought back by the first one
+ * after a quiet spell, so only that first best-effort frame can be missed.
+ * Reliable ones are resent until a wake window catches them. The caller decides
+ * when saving is allowed at all, e.g. not before the initial sync or while head
+ * tracking is on. Only ESP32 parts sleep the radio, connectionless modem sleep
+ * is not available on the ESP8266, where it is loop() alone that blocks longer.
+ * It also needs IDF 5, so on the IDF 4.4 Arduino core the unpinned espressif32
+ * platform currently resolves to, ESP32 parts only drop the CPU clock and
+ * promiscuous mode while the radio keeps listening.
+ */
+class VrxPower
+{
+public:
+    void begin(uint32_t now)
+    {
+    #if defined(PLATFORM_ESP32)
+        m_fullCpuMhz = getCpuFrequencyMhz();
+    #endif
+        m_lastTraffic = now;
+    }
+
+    // A frame arrived
+    void traffic(uint32_t now)
+    {
+        m_lastTraffic = now;
+        if (m_saving)
+        {
+            apply(false);
+        }
+    }
+
+    void update(uint32_t now, bool allowed)
+    {
+        bool save = allowed && now - m_lastTraffic >= VRX_POWER_SAVE_AFTER_MS;
+        if (save != m_saving)
+        {
+            apply(save);
+        }
+    }
+
+    bool saving() const { return m_saving; }
+
+private:
+    bool m_saving = false;
+    uint32_t m_lastTraffic = 0;
+#if defined(PLATFORM_ESP32)
+    uint32_t m_fullCpuMhz = 0;
+#endif
+
+    void apply(bool save)
+    {
+        m_saving = save;
+        powerModeEnter(save ? POWER_MODE_SAVE : POWER_MODE_FULL);
+    #if defined(PLATFORM_ESP32)
+        // Compiled out on IDF 4.4, which has no wake window for ESP-NOW
+        #if ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(5, 0, 0)
+        if (save)
+        {
+            esp_now_set_wake_window(VRX_POWER_WAKE_WINDOW_MS);
+            esp_wifi_connectionless_module_set_wake_interval(VRX_POWER_WAKE_INTERVAL_MS);
+        }
+        esp_wifi_set_ps(save ? WIFI_PS_MIN_MODEM : WIFI_PS_NONE);
+        #endif
+        // Promiscuous mode for the link RSSI keeps the radio from sleeping
+        esp_wifi_set_promiscuous(!save);
+        // 80MHz is the lowest WiFi keeps working at
+        setCpuFrequencyMhz(save ? 80 : m_fullCpuMhz);
+    #endif
+    }
+};